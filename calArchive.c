@@ -0,0 +1,1054 @@
+/**
+ * Contains functions for reading and writing compressed calendar archives
+ * (.calz files), meant for years of history that is rarely changed. Events
+ * are partitioned by the month they start in, with recurring events kept
+ * apart after every month, and stored in order of start time in blocks of
+ * up to ARCHIVE_BLOCK events, each holding events of one partition. Starts
+ * are on each event's own wall clock, whatever its time zone. Each
+ * block can be decoded on its own: start times are delta-encoded,
+ * numbers are written as varints, and activity and location text is kept
+ * once per block in a dictionary. A block index at the end of the file lets
+ * a reader skip blocks outside a date range without decoding them. None of
+ * these functions use the gui, so they can be called from a background
+ * thread.
+ *
+ * An archive is laid out as:
+ *   "CALZ", a version byte
+ *   the blocks, one after another
+ *   the block index: the number of blocks, then each block's length, event
+ *     count, first start (as a change from the last block's) and last end
+ *     (as a change from its first start, plus one, or 0 for no end), both
+ *     widened by ZONE_MARGIN for an event with a time zone, so they hold
+ *     whatever the display zone is
+ *   the offset of the block index as 8 bytes, least significant first, and
+ *     "CALZ" again
+ * A block is laid out as:
+ *   the number of strings, then the strings in strcmp order, each as the
+ *     number of characters it shares with the start of the one before, the
+ *     length of the rest of it, and the rest's bytes
+ *   the number of events, and the start of the first as a signed varint
+ *   for each event: its start as a change from the last event's, its
+ *     duration, its activity's string number, its location's string number
+ *     plus one (0 for no location) times four, plus two if it has a time
+ *     zone and plus one if it repeats, then for an event with a time zone
+ *     the string number of the zone's name, and then for a repeating
+ *     event, the frequency, interval, 1 if it has an
+ *     end date followed by the end date as a signed change from the event's
+ *     date (or 0 if it has none), and the number of exceptions, followed by
+ *     each exception as a signed change from the one before (the first from
+ *     the event's date)
+ * All numbers are varints unless said otherwise. Signed varints are zigzag
+ * encoded. Version 1 archives have no time zones, and their location's
+ * string number plus one is times two, plus one if the event repeats.
+ * Version 1 and 2 archives store each string whole, as its length and
+ * bytes, in the order the block's events first use them.
+ *
+ * Author: Alex Burress
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include "linkedList.h"
+#include "calFile.h"
+#include "calStats.h"
+#include "calDate.h"
+#include "calRecur.h"
+#include "calIntern.h"
+#include "calArchive.h"
+#include "calReport.h"
+#include "calSort.h"
+#include "calZone.h"
+#define FALSE 0
+#define TRUE !FALSE
+
+#define ARCHIVE_MAGIC "CALZ"
+#define ARCHIVE_VERSION 3
+
+/* the first version, which had no time zones, can still be read */
+#define ARCHIVE_NO_ZONES 1
+
+/* the last version to store each string of a block whole */
+#define ARCHIVE_WHOLE_STRINGS 2
+
+/* the most an event with a time zone can move against others when the
+ * display zone changes, in minutes */
+#define ZONE_MARGIN (2L * MAX_ZONE_OFFSET)
+
+/* the magic and version at the start, and the index offset and magic at the end */
+#define HEADER_SIZE 5
+#define TRAILER_SIZE 12
+
+/* recurring events are kept apart, after every month's events */
+#define RECURRING_PARTITION LONG_MAX
+
+/* the most bytes a varint of an unsigned long can take */
+#define MAX_VARINT 10
+
+/**
+ * An event waiting to be written, with its start in minutes on its own wall
+ * clock and the partition it is written to: the month it starts in (as
+ * year * 12 + month) for a one-off event, or RECURRING_PARTITION for a
+ * recurring one. zone is the interned name of its time zone, or NO_TEXT.
+ */
+typedef struct ArchiveItem {
+	long start;
+	long partition;
+	unsigned int zone;
+	Event* event;
+} ArchiveItem;
+
+/**
+ * A growable buffer that a block or the block index is encoded into before
+ * being written.
+ */
+typedef struct ByteBuffer {
+	unsigned char* bytes;
+	long length;
+	long capacity;
+} ByteBuffer;
+
+/**
+ * Bytes being decoded. failed is set, and zeroes are returned, once a read
+ * runs past the end.
+ */
+typedef struct ByteReader {
+	unsigned char* bytes;
+	long length;
+	long position;
+	int failed;
+} ByteReader;
+
+/**
+ * Makes sure a buffer has room for another numBytes bytes.
+ */
+static void reserveBytes(ByteBuffer* buffer, long numBytes)
+{
+	if (buffer->length + numBytes > buffer->capacity)
+	{
+		while (buffer->length + numBytes > buffer->capacity)
+		{
+			buffer->capacity *= 2;
+		}
+		buffer->bytes = (unsigned char*)realloc(buffer->bytes, buffer->capacity);
+	}
+}
+
+/**
+ * Appends an unsigned number to a buffer as a varint: seven bits per byte,
+ * least significant first, with the top bit set on every byte but the last.
+ */
+static void putVarint(ByteBuffer* buffer, unsigned long value)
+{
+	reserveBytes(buffer, MAX_VARINT);
+
+	while (value >= 0x80)
+	{
+		buffer->bytes[buffer->length] = (unsigned char)(value | 0x80);
+		buffer->length++;
+		value >>= 7;
+	}
+
+	buffer->bytes[buffer->length] = (unsigned char)value;
+	buffer->length++;
+}
+
+/**
+ * Appends a signed number to a buffer as a zigzag encoded varint, so numbers
+ * near zero take one byte whatever their sign.
+ */
+static void putSigned(ByteBuffer* buffer, long value)
+{
+	if (value < 0)
+	{
+		putVarint(buffer, ((unsigned long)(-(value + 1)) << 1) | 1);
+	}
+	else
+	{
+		putVarint(buffer, (unsigned long)value << 1);
+	}
+}
+
+/**
+ * Reads a varint written by putVarint.
+ */
+static unsigned long getVarint(ByteReader* reader)
+{
+	unsigned long value;
+	int shift;
+	int more;
+
+	value = 0;
+	shift = 0;
+	more = TRUE;
+
+	while (more == TRUE && reader->failed == FALSE)
+	{
+		if (reader->position >= reader->length || shift >= MAX_VARINT * 7)
+		{
+			reader->failed = TRUE;
+			value = 0;
+		}
+		else
+		{
+			value |= (unsigned long)(reader->bytes[reader->position] & 0x7f) << shift;
+			more = (reader->bytes[reader->position] & 0x80) != 0;
+			reader->position++;
+			shift += 7;
+		}
+	}
+
+	return value;
+}
+
+/**
+ * Reads a signed number written by putSigned.
+ */
+static long getSigned(ByteReader* reader)
+{
+	unsigned long value;
+	long result;
+
+	value = getVarint(reader);
+
+	if ((value & 1) != 0)
+	{
+		result = -(long)(value >> 1) - 1;
+	}
+	else
+	{
+		result = (long)(value >> 1);
+	}
+
+	return result;
+}
+
+/**
+ * Reads a varint that must be no more than max, failing the reader if it is
+ * larger.
+ */
+static unsigned long getBounded(ByteReader* reader, unsigned long max)
+{
+	unsigned long value;
+
+	value = getVarint(reader);
+
+	if (value > max)
+	{
+		reader->failed = TRUE;
+		value = 0;
+	}
+
+	return value;
+}
+
+/**
+ * Compares two ArchiveItems by partition, then start time, for qsort.
+ */
+static int compareItems(const void* a, const void* b)
+{
+	ArchiveItem* itemA;
+	ArchiveItem* itemB;
+	int result;
+
+	itemA = (ArchiveItem*)a;
+	itemB = (ArchiveItem*)b;
+	result = (itemA->partition > itemB->partition) - (itemA->partition < itemB->partition);
+
+	if (result == 0)
+	{
+		result = (itemA->start > itemB->start) - (itemA->start < itemB->start);
+	}
+
+	return result;
+}
+
+/**
+ * Returns the latest time, in minutes, that an event can end, or LONG_MAX
+ * for a recurring event with no end date. For a recurring event this is only
+ * a bound, as its last occurrence may fall before the end date.
+ */
+static long latestEnd(long start, Event* event)
+{
+	long end;
+
+	end = start + event->duration;
+
+	if (event->repeat != NULL)
+	{
+		if (event->repeat->hasUntil == FALSE)
+		{
+			end = LONG_MAX;
+		}
+		else if ((event->repeat->untilDay + 1) * MINS_PER_DAY + event->duration > end)
+		{
+			end = (event->repeat->untilDay + 1) * MINS_PER_DAY + event->duration;
+		}
+	}
+
+	return end;
+}
+
+/**
+ * Returns the string number of an interned id in the block being encoded,
+ * adding it to the block's dictionary if it isn't there yet. numberOf maps
+ * an id to its string number plus one, with 0 for strings not yet used in
+ * the block, and ids lists the block's strings in order.
+ */
+static unsigned long blockString(unsigned int id, unsigned int* numberOf, unsigned int* ids, int* numStrings)
+{
+	if (numberOf[id] == 0)
+	{
+		ids[*numStrings] = id;
+		(*numStrings)++;
+		numberOf[id] = *numStrings;
+	}
+
+	return numberOf[id] - 1;
+}
+
+/**
+ * Compares the text of two interned ids in strcmp order, for qsort.
+ */
+static int compareTexts(const void* a, const void* b)
+{
+	return strcmp(internedText(*(unsigned int*)a), internedText(*(unsigned int*)b));
+}
+
+/**
+ * Encodes count events, sorted by start time, as one block into buffer, and
+ * fills in the block's entry of the index, apart from its offset. The
+ * block's strings are sorted, so each is written as what it adds to the one
+ * before. numberOf must be all zeroes, and is left that way.
+ */
+static void encodeBlock(ByteBuffer* buffer, ArchiveItem* items, int count, unsigned int* numberOf, ArchiveBlock* outBlock)
+{
+	ByteBuffer events;
+	Event* event;
+	Recurrence* rule;
+	unsigned int ids[ARCHIVE_BLOCK * 3];
+	unsigned long location;
+	char* text;
+	char* last;
+	long shared;
+	long previous;
+	long day;
+	long end;
+	int numStrings;
+	int ii;
+	int jj;
+
+	events.capacity = 1024;
+	events.length = 0;
+	events.bytes = (unsigned char*)malloc(events.capacity);
+
+	numStrings = 0;
+	previous = items[0].start;
+	outBlock->count = count;
+	outBlock->firstStart = items[0].start;
+	outBlock->lastEnd = items[0].start;
+
+	/* the dictionary is gathered and sorted before the events are encoded */
+	for (ii = 0; ii < count; ii++)
+	{
+		blockString(items[ii].event->activity, numberOf, ids, &numStrings);
+		if (items[ii].event->location != NO_TEXT)
+		{
+			blockString(items[ii].event->location, numberOf, ids, &numStrings);
+		}
+		if (items[ii].zone != NO_TEXT)
+		{
+			blockString(items[ii].zone, numberOf, ids, &numStrings);
+		}
+	}
+
+	qsort(ids, numStrings, sizeof(unsigned int), &compareTexts);
+	for (ii = 0; ii < numStrings; ii++)
+	{
+		numberOf[ids[ii]] = ii + 1;
+	}
+
+	for (ii = 0; ii < count; ii++)
+	{
+		event = items[ii].event;
+
+		putVarint(&events, (unsigned long)(items[ii].start - previous));
+		putVarint(&events, (unsigned long)event->duration);
+		putVarint(&events, blockString(event->activity, numberOf, ids, &numStrings));
+
+		location = 0;
+		if (event->location != NO_TEXT)
+		{
+			location = blockString(event->location, numberOf, ids, &numStrings) + 1;
+		}
+		putVarint(&events, location * 4 + (items[ii].zone != NO_TEXT) * 2 + (event->repeat != NULL));
+
+		if (items[ii].zone != NO_TEXT)
+		{
+			putVarint(&events, blockString(items[ii].zone, numberOf, ids, &numStrings));
+		}
+
+		if (event->repeat != NULL)
+		{
+			rule = event->repeat;
+			day = minutesToDay(items[ii].start);
+
+			putVarint(&events, (unsigned long)rule->frequency);
+			putVarint(&events, (unsigned long)rule->interval);
+			putVarint(&events, rule->hasUntil == TRUE ? (unsigned long)1 : 0);
+			if (rule->hasUntil == TRUE)
+			{
+				putSigned(&events, rule->untilDay - day);
+			}
+
+			putVarint(&events, (unsigned long)rule->numExceptions);
+			for (jj = 0; jj < rule->numExceptions; jj++)
+			{
+				putSigned(&events, rule->exceptions[jj] - day);
+				day = rule->exceptions[jj];
+			}
+		}
+
+		end = latestEnd(items[ii].start, event);
+
+		/* an event in a zone may be shown up to a margin either way */
+		if (items[ii].zone != NO_TEXT)
+		{
+			if (items[ii].start - ZONE_MARGIN < outBlock->firstStart)
+			{
+				outBlock->firstStart = items[ii].start - ZONE_MARGIN;
+			}
+			end = (end == LONG_MAX) ? end : end + ZONE_MARGIN;
+		}
+
+		if (end > outBlock->lastEnd)
+		{
+			outBlock->lastEnd = end;
+		}
+
+		previous = items[ii].start;
+	}
+
+	/* the dictionary, then the events */
+	putVarint(buffer, (unsigned long)numStrings);
+	last = "";
+	for (ii = 0; ii < numStrings; ii++)
+	{
+		text = internedText(ids[ii]);
+		shared = 0;
+		while (text[shared] != '\0' && text[shared] == last[shared])
+		{
+			shared++;
+		}
+
+		location = strlen(text + shared);
+		putVarint(buffer, (unsigned long)shared);
+		putVarint(buffer, location);
+		reserveBytes(buffer, (long)location);
+		memcpy(buffer->bytes + buffer->length, text + shared, location);
+		buffer->length += (long)location;
+
+		numberOf[ids[ii]] = 0;
+		last = text;
+	}
+
+	putVarint(buffer, (unsigned long)count);
+	putSigned(buffer, items[0].start);
+	reserveBytes(buffer, events.length);
+	memcpy(buffer->bytes + buffer->length, events.bytes, events.length);
+	buffer->length += events.length;
+
+	free(events.bytes);
+}
+
+/**
+ * Returns TRUE if the passed-in filename ends in .calz (in any case), so
+ * should be read and written as a compressed archive.
+ */
+int isArchiveFile(char* filename)
+{
+	int length;
+	int archive;
+	int ii;
+
+	length = strlen(filename);
+	archive = (length >= 5);
+
+	for (ii = 0; ii < 5 && archive == TRUE; ii++)
+	{
+		archive = (tolower((unsigned char)filename[length - 5 + ii]) == ".calz"[ii]);
+	}
+
+	return archive;
+}
+
+/**
+ * Writes every event in the passed-in snapshot to a file as an archive, one
+ * block per month (or more for a month with over ARCHIVE_BLOCK events), then
+ * the recurring events. Returns the number of bytes written, or -1 if writing
+ * failed.
+ */
+long writeArchiveSnapshot(FILE* dest, ListSnapshot* snapshot)
+{
+	ArchiveItem* items;
+	ArchiveBlock* blocks;
+	ByteBuffer buffer;
+	Date date;
+	unsigned int* numberOf;
+	unsigned char trailer[TRAILER_SIZE];
+	long bytesWritten;
+	long previousStart;
+	long startTime;
+	int numBlocks;
+	int maxBlocks;
+	int first;
+	int count;
+	int ii;
+
+	startTime = STATS_BEGIN();
+
+	items = (ArchiveItem*)malloc((snapshot->count + 1) * sizeof(ArchiveItem));
+	for (ii = 0; ii < snapshot->count; ii++)
+	{
+		items[ii].start = civilToMinutes(&snapshot->events[ii]->eDate, &snapshot->events[ii]->eTime);
+		items[ii].event = snapshot->events[ii];
+		items[ii].partition = RECURRING_PARTITION;
+
+		/* zone names are interned before the table of ids is sized */
+		items[ii].zone = NO_TEXT;
+		if (snapshot->events[ii]->zone != NULL)
+		{
+			items[ii].zone = internText(snapshot->events[ii]->zone->name);
+		}
+
+		if (snapshot->events[ii]->repeat == NULL)
+		{
+			civilFromDays(minutesToDay(items[ii].start), &date);
+			items[ii].partition = date.year * 12L + date.month - 1;
+		}
+	}
+	qsort(items, snapshot->count, sizeof(ArchiveItem), &compareItems);
+
+	/* every id in the snapshot was interned before it was taken, and every
+	 * zone name above */
+	numberOf = (unsigned int*)calloc(internedCount(), sizeof(unsigned int));
+	numBlocks = 0;
+	maxBlocks = 64;
+	blocks = (ArchiveBlock*)malloc(maxBlocks * sizeof(ArchiveBlock));
+
+	buffer.capacity = 65536;
+	buffer.bytes = (unsigned char*)malloc(buffer.capacity);
+
+	fwrite(ARCHIVE_MAGIC, 1, 4, dest);
+	fputc(ARCHIVE_VERSION, dest);
+	bytesWritten = HEADER_SIZE;
+
+	/* each block holds one partition, or part of one that is too big */
+	for (first = 0; first < snapshot->count; first += count)
+	{
+		count = 1;
+		while (first + count < snapshot->count && count < ARCHIVE_BLOCK &&
+			items[first + count].partition == items[first].partition)
+		{
+			count++;
+		}
+
+		if (numBlocks == maxBlocks)
+		{
+			maxBlocks *= 2;
+			blocks = (ArchiveBlock*)realloc(blocks, maxBlocks * sizeof(ArchiveBlock));
+		}
+
+		buffer.length = 0;
+		encodeBlock(&buffer, items + first, count, numberOf, &blocks[numBlocks]);
+		fwrite(buffer.bytes, 1, buffer.length, dest);
+
+		blocks[numBlocks].offset = bytesWritten;
+		blocks[numBlocks].length = buffer.length;
+		bytesWritten += buffer.length;
+		numBlocks++;
+	}
+
+	/* the block index */
+	buffer.length = 0;
+	previousStart = 0;
+	putVarint(&buffer, (unsigned long)numBlocks);
+	for (ii = 0; ii < numBlocks; ii++)
+	{
+		putVarint(&buffer, (unsigned long)blocks[ii].length);
+		putVarint(&buffer, (unsigned long)blocks[ii].count);
+		putSigned(&buffer, blocks[ii].firstStart - previousStart);
+		putVarint(&buffer, blocks[ii].lastEnd == LONG_MAX ? 0 : (unsigned long)(blocks[ii].lastEnd - blocks[ii].firstStart) + 1);
+		previousStart = blocks[ii].firstStart;
+	}
+	fwrite(buffer.bytes, 1, buffer.length, dest);
+
+	for (ii = 0; ii < 8; ii++)
+	{
+		trailer[ii] = (unsigned char)((unsigned long)bytesWritten >> (ii * 8));
+	}
+	memcpy(trailer + 8, ARCHIVE_MAGIC, 4);
+	fwrite(trailer, 1, TRAILER_SIZE, dest);
+	bytesWritten += buffer.length + TRAILER_SIZE;
+
+	free(buffer.bytes);
+	free(blocks);
+	free(numberOf);
+	free(items);
+
+	STATS_END(STAT_SAVE, startTime, bytesWritten);
+
+	if (ferror(dest) != 0)
+	{
+		bytesWritten = -1;
+	}
+
+	return bytesWritten;
+}
+
+/**
+ * Reads the block index of an archive opened for reading, and returns a
+ * reader over all of its events. Returns NULL if the file isn't a valid
+ * archive. Must be freed with closeArchive, which doesn't close the file.
+ */
+ArchiveReader* openArchive(FILE* source)
+{
+	ArchiveReader* archive;
+	ByteReader index;
+	unsigned char header[TRAILER_SIZE];
+	long indexOffset;
+	long fileLength;
+	long offset;
+	long start;
+	unsigned long lastEnd;
+	int version;
+	int valid;
+	int ii;
+
+	archive = NULL;
+	indexOffset = 0;
+	fileLength = 0;
+
+	/* check the header, then find the index from the trailer */
+	valid = (fseek(source, 0, SEEK_SET) == 0 &&
+		fread(header, 1, HEADER_SIZE, source) == HEADER_SIZE &&
+		memcmp(header, ARCHIVE_MAGIC, 4) == 0 &&
+		(header[4] == ARCHIVE_VERSION || header[4] == ARCHIVE_WHOLE_STRINGS || header[4] == ARCHIVE_NO_ZONES));
+	version = header[4];
+
+	valid = (valid == TRUE && fseek(source, -TRAILER_SIZE, SEEK_END) == 0 &&
+		fread(header, 1, TRAILER_SIZE, source) == TRAILER_SIZE &&
+		memcmp(header + 8, ARCHIVE_MAGIC, 4) == 0);
+
+	if (valid == TRUE)
+	{
+		fileLength = ftell(source);
+		for (ii = 7; ii >= 0; ii--)
+		{
+			indexOffset = (indexOffset << 8) | header[ii];
+		}
+		valid = (indexOffset >= HEADER_SIZE && indexOffset <= fileLength - TRAILER_SIZE);
+	}
+
+	if (valid == TRUE)
+	{
+		index.length = fileLength - TRAILER_SIZE - indexOffset;
+		index.position = 0;
+		index.failed = FALSE;
+		index.bytes = (unsigned char*)malloc(index.length + 1);
+
+		valid = (fseek(source, indexOffset, SEEK_SET) == 0 &&
+			(long)fread(index.bytes, 1, index.length, source) == index.length);
+
+		archive = (ArchiveReader*)malloc(sizeof(ArchiveReader));
+		archive->source = source;
+		archive->version = version;
+		/* each block's entry takes at least four bytes */
+		archive->numBlocks = (int)getBounded(&index, (unsigned long)index.length / 4);
+		archive->blocks = (ArchiveBlock*)malloc((archive->numBlocks + 1) * sizeof(ArchiveBlock));
+		archive->nextBlock = 0;
+		archive->rangeStart = LONG_MIN;
+		archive->rangeEnd = LONG_MAX;
+		archive->events = (Event**)malloc(ARCHIVE_BLOCK * sizeof(Event*));
+		archive->count = 0;
+		archive->next = 0;
+		archive->damaged = 0;
+
+		offset = HEADER_SIZE;
+		start = 0;
+		for (ii = 0; ii < archive->numBlocks && index.failed == FALSE; ii++)
+		{
+			archive->blocks[ii].offset = offset;
+			archive->blocks[ii].length = (long)getBounded(&index, (unsigned long)(indexOffset - offset));
+			archive->blocks[ii].count = (int)getBounded(&index, ARCHIVE_BLOCK);
+			start += getSigned(&index);
+			archive->blocks[ii].firstStart = start;
+
+			lastEnd = getVarint(&index);
+			archive->blocks[ii].lastEnd = (lastEnd == 0) ? LONG_MAX : start + (long)(lastEnd - 1);
+
+			offset += archive->blocks[ii].length;
+		}
+
+		free(index.bytes);
+
+		if (valid == FALSE || index.failed == TRUE)
+		{
+			closeArchive(archive);
+			archive = NULL;
+		}
+	}
+
+	return archive;
+}
+
+/**
+ * Restricts a reader to the blocks holding events that overlap rangeStart
+ * up to rangeEnd (in minutes, as for eventStart). Blocks outside the range
+ * are skipped without being read, although events outside it may still be
+ * returned from blocks that overlap it. Must be called before the first
+ * readArchiveEntry.
+ */
+void setArchiveRange(ArchiveReader* reader, long rangeStart, long rangeEnd)
+{
+	reader->rangeStart = rangeStart;
+	reader->rangeEnd = rangeEnd;
+}
+
+/**
+ * Decodes one event of a block of an archive of the passed-in version into
+ * a new Event. strings holds the ids of the block's dictionary and lengths
+ * their lengths. Returns NULL, failing the reader, if the event can't be
+ * decoded or isn't valid.
+ */
+static Event* decodeEvent(ByteReader* block, int version, long start, unsigned int* strings, long* lengths, int numStrings)
+{
+	Event* event;
+	Recurrence rule;
+	unsigned long activity;
+	unsigned long location;
+	unsigned long zone;
+	int repeats;
+	long day;
+	int ii;
+
+	event = createEvent();
+	civilFromMinutes(start, &event->eDate, &event->eTime);
+	day = minutesToDay(start);
+	event->duration = (int)getBounded(block, INT_MAX);
+
+	activity = getVarint(block);
+	location = getVarint(block);
+	repeats = (int)(location & 1);
+
+	/* the flag for a time zone came in with version 2 */
+	zone = 0;
+	if (version == ARCHIVE_NO_ZONES)
+	{
+		location /= 2;
+	}
+	else
+	{
+		zone = (location & 2) ? getVarint(block) + 1 : 0;
+		location /= 4;
+	}
+
+	if (block->failed == FALSE && activity < (unsigned long)numStrings && lengths[activity] < MAX_ACTIVITY &&
+		location <= (unsigned long)numStrings && (location == 0 || lengths[location - 1] < MAX_LOCATION) &&
+		zone <= (unsigned long)numStrings)
+	{
+		event->activity = strings[activity];
+		if (location > 0)
+		{
+			event->location = strings[location - 1];
+		}
+
+		/* an unknown zone fails the block, as an invalid date does */
+		if (zone > 0)
+		{
+			event->zone = (strings[zone - 1] != NO_TEXT) ? findZone(internedText(strings[zone - 1])) : NULL;
+			block->failed = (event->zone == NULL);
+		}
+	}
+	else
+	{
+		block->failed = TRUE;
+	}
+
+	/* repeat rules are checked as if they had been typed in */
+	if (block->failed == FALSE && repeats != 0)
+	{
+		memset(&rule, 0, sizeof(Recurrence));
+		rule.frequency = (int)getBounded(block, REPEAT_MONTHLY);
+		rule.interval = (int)getBounded(block, MAX_INTERVAL);
+		rule.hasUntil = (int)getBounded(block, 1);
+		if (rule.hasUntil == TRUE)
+		{
+			rule.untilDay = day + getSigned(block);
+		}
+
+		rule.numExceptions = (int)getBounded(block, MAX_EXCEPTIONS);
+		for (ii = 0; ii < rule.numExceptions; ii++)
+		{
+			day += getSigned(block);
+			rule.exceptions[ii] = day;
+		}
+
+		if (rule.frequency < REPEAT_DAILY || rule.interval < 1)
+		{
+			block->failed = TRUE;
+		}
+
+		event->repeat = (Recurrence*)malloc(sizeof(Recurrence));
+		*(event->repeat) = rule;
+	}
+
+	if (block->failed == TRUE || eventValid(event->eDate.year, event->eDate.month, event->eDate.day,
+		event->eTime.hrs, event->eTime.mins, event->duration) == FALSE)
+	{
+		block->failed = TRUE;
+		releaseEvent(event);
+		event = NULL;
+	}
+
+	return event;
+}
+
+/**
+ * Reads and decodes one block of an archive, storing its events in
+ * outEvents, which must have room for the block's count of events. Returns the
+ * number of events, or -1 if the block is damaged, in which case none are
+ * kept.
+ */
+int readArchiveBlock(ArchiveReader* reader, int blockNo, Event** outEvents)
+{
+	ArchiveBlock* info;
+	ByteReader block;
+	unsigned int* strings;
+	long* lengths;
+	char text[MAX_ACTIVITY];
+	long startTime;
+	long start;
+	long shared;
+	long rest;
+	long kept;
+	int numStrings;
+	int count;
+	int decoded;
+	int ii;
+
+	startTime = STATS_BEGIN();
+	info = &reader->blocks[blockNo];
+	decoded = 0;
+
+	block.length = info->length;
+	block.position = 0;
+	block.bytes = (unsigned char*)malloc(block.length + 1);
+	block.failed = !(fseek(reader->source, info->offset, SEEK_SET) == 0 &&
+		(long)fread(block.bytes, 1, block.length, reader->source) == block.length);
+
+	/* each string takes at least one byte */
+	numStrings = (int)getBounded(&block, (unsigned long)block.length);
+	strings = (unsigned int*)malloc((numStrings + 1) * sizeof(unsigned int));
+	lengths = (long*)malloc((numStrings + 1) * sizeof(long));
+
+	for (ii = 0; ii < numStrings && block.failed == FALSE; ii++)
+	{
+		/* since version 3, each string starts with part of the one before */
+		shared = 0;
+		if (reader->version > ARCHIVE_WHOLE_STRINGS)
+		{
+			shared = (long)getBounded(&block, (unsigned long)((ii > 0) ? lengths[ii - 1] : 0));
+		}
+		rest = (long)getBounded(&block, (unsigned long)(block.length - block.position));
+		lengths[ii] = shared + rest;
+
+		/* as much as fits is kept in text, for the next string to share */
+		if (block.failed == FALSE && shared < MAX_ACTIVITY - 1)
+		{
+			kept = (rest < MAX_ACTIVITY - 1 - shared) ? rest : MAX_ACTIVITY - 1 - shared;
+			memcpy(text + shared, block.bytes + block.position, kept);
+		}
+
+		/* text too long for an event is kept out of the table */
+		if (block.failed == FALSE && lengths[ii] < MAX_ACTIVITY)
+		{
+			text[lengths[ii]] = '\0';
+			strings[ii] = internText(text);
+		}
+		else
+		{
+			strings[ii] = NO_TEXT;
+		}
+		block.position += rest;
+	}
+
+	count = (int)getBounded(&block, ARCHIVE_BLOCK);
+	start = getSigned(&block);
+
+	if (count != info->count)
+	{
+		block.failed = TRUE;
+	}
+
+	for (ii = 0; ii < count && block.failed == FALSE; ii++)
+	{
+		start += (long)getVarint(&block);
+		outEvents[decoded] = decodeEvent(&block, reader->version, start, strings, lengths, numStrings);
+
+		if (block.failed == FALSE)
+		{
+			decoded++;
+		}
+	}
+
+	if (block.failed == TRUE)
+	{
+		for (ii = 0; ii < decoded; ii++)
+		{
+			releaseEvent(outEvents[ii]);
+		}
+		decoded = -1;
+	}
+
+	free(lengths);
+	free(strings);
+	free(block.bytes);
+
+	STATS_END(STAT_PARSE, startTime, info->length);
+
+	return decoded;
+}
+
+/**
+ * Reads the next event from an archive. Works the same way as readEntry: a
+ * valid event is stored in outEvent and ENTRY_VALID is returned, ENTRY_NONE
+ * is returned once every block in range has been read, and ENTRY_INVALID is
+ * returned once for each event of a block that is damaged, each being added
+ * to report (which may be NULL).
+ */
+int readArchiveEntry(ArchiveReader* reader, Event** outEvent, ValidationReport* report)
+{
+	ArchiveBlock* info;
+	int result;
+
+	result = ENTRY_NONE;
+	*outEvent = NULL;
+
+	while (result == ENTRY_NONE && (reader->damaged > 0 || reader->next < reader->count || reader->nextBlock < reader->numBlocks))
+	{
+		if (reader->damaged > 0)
+		{
+			reader->damaged--;
+			reportInvalid(report, 0, "block", "damaged, its events were omitted");
+			result = ENTRY_INVALID;
+		}
+		else if (reader->next < reader->count)
+		{
+			*outEvent = reader->events[reader->next];
+			reader->next++;
+			result = ENTRY_VALID;
+		}
+		else
+		{
+			info = &reader->blocks[reader->nextBlock];
+
+			/* only blocks overlapping the range are decoded */
+			if (info->firstStart < reader->rangeEnd && info->lastEnd > reader->rangeStart)
+			{
+				reader->count = readArchiveBlock(reader, reader->nextBlock, reader->events);
+				reader->next = 0;
+
+				/* each event of a damaged block is reported as invalid */
+				if (reader->count < 0)
+				{
+					reader->count = 0;
+					reader->damaged = info->count;
+				}
+			}
+			reader->nextBlock++;
+		}
+	}
+
+	return result;
+}
+
+/**
+ * Reads the events of the named archive that overlap rangeStart up to
+ * rangeEnd onto the passed-in list, decoding only the blocks in range. The
+ * events are added in one batch with bulkInsert. Each invalid event skipped
+ * is added to report, which may be NULL.
+ * Returns the number of events added, or -1 if the file couldn't be opened
+ * or isn't an archive.
+ */
+long loadArchiveRange(LinkedList* list, char* filename, long rangeStart, long rangeEnd, ValidationReport* report)
+{
+	FILE* source;
+	ArchiveReader* archive;
+	Event* newEvent;
+	Event** batch;
+	long batchSize;
+	long loaded;
+	int result;
+
+	loaded = -1;
+	source = fopen(filename, "rb");
+
+	if (source != NULL)
+	{
+		archive = openArchive(source);
+
+		if (archive != NULL)
+		{
+			setArchiveRange(archive, rangeStart, rangeEnd);
+			loaded = 0;
+			batchSize = ARCHIVE_BLOCK;
+			batch = (Event**)malloc(batchSize * sizeof(Event*));
+
+			do
+			{
+				result = readArchiveEntry(archive, &newEvent, report);
+
+				if (result == ENTRY_VALID)
+				{
+					if (loaded == batchSize)
+					{
+						batchSize *= 2;
+						batch = (Event**)realloc(batch, batchSize * sizeof(Event*));
+					}
+					batch[loaded] = newEvent;
+					loaded++;
+				}
+			} while (result != ENTRY_NONE);
+
+			bulkInsert(list, batch, loaded);
+			free(batch);
+
+			closeArchive(archive);
+		}
+
+		fclose(source);
+	}
+
+	return loaded;
+}
+
+/**
+ * Frees a reader, releasing any events decoded but not yet read. The file
+ * is left open.
+ */
+void closeArchive(ArchiveReader* reader)
+{
+	int ii;
+
+	for (ii = reader->next; ii < reader->count; ii++)
+	{
+		releaseEvent(reader->events[ii]);
+	}
+
+	free(reader->events);
+	free(reader->blocks);
+	free(reader);
+}
@@ -0,0 +1,126 @@
+/**
+ * Contains functions for reading and writing compressed calendar archives
+ * (.calz files), meant for years of history that is rarely changed. Events
+ * are partitioned by the month they start in, with recurring events kept
+ * apart after every month, and stored in order of start time in blocks of
+ * up to ARCHIVE_BLOCK events, each holding events of one partition. Each
+ * block can be decoded on its own: start times are delta-encoded,
+ * numbers are written as varints, and activity and location text is kept
+ * once per block in a dictionary. A block index at the end of the file lets
+ * a reader skip blocks outside a date range without decoding them. None of
+ * these functions use the gui, so they can be called from a background
+ * thread.
+ *
+ * Author: Alex Burress
+ */
+
+#ifndef CALARCHIVE_H
+#define CALARCHIVE_H
+#include "linkedList.h"
+#include "calReport.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* the most events stored in one block */
+#define ARCHIVE_BLOCK 4096
+
+/**
+ * An entry of the block index: where a block starts in the file, how many
+ * events it holds, the earliest start of any of them and the latest end
+ * (in minutes, as for eventStart, with room either side for events in a
+ * time zone). A recurring event with no end date makes the block's lastEnd
+ * LONG_MAX.
+ */
+typedef struct ArchiveBlock {
+	long offset;
+	long length;
+	int count;
+	long firstStart;
+	long lastEnd;
+} ArchiveBlock;
+
+/**
+ * An archive open for reading. The block index is read when it is opened,
+ * then blocks overlapping rangeStart to rangeEnd are decoded one at a time
+ * into events, which readArchiveEntry hands out in order. damaged counts the
+ * events of a damaged block still to be reported as invalid, and version is
+ * the archive's format version.
+ */
+typedef struct ArchiveReader {
+	FILE* source;
+	int version;
+	ArchiveBlock* blocks;
+	int numBlocks;
+	int nextBlock;
+	long rangeStart;
+	long rangeEnd;
+	Event** events;
+	int count;
+	int next;
+	int damaged;
+} ArchiveReader;
+
+/**
+ * Returns TRUE if the passed-in filename ends in .calz (in any case), so
+ * should be read and written as a compressed archive.
+ */
+int isArchiveFile(char* filename);
+
+/**
+ * Writes every event in the passed-in snapshot to a file as an archive, one
+ * block per month (or more for a month with over ARCHIVE_BLOCK events), then
+ * the recurring events. Returns the number of bytes written, or -1 if writing
+ * failed.
+ */
+long writeArchiveSnapshot(FILE* dest, ListSnapshot* snapshot);
+
+/**
+ * Reads the block index of an archive opened for reading, and returns a
+ * reader over all of its events. Returns NULL if the file isn't a valid
+ * archive. Must be freed with closeArchive, which doesn't close the file.
+ */
+ArchiveReader* openArchive(FILE* source);
+
+/**
+ * Restricts a reader to the blocks holding events that overlap rangeStart
+ * up to rangeEnd (in minutes, as for eventStart). Blocks outside the range
+ * are skipped without being read, although events outside it may still be
+ * returned from blocks that overlap it. Must be called before the first
+ * readArchiveEntry.
+ */
+void setArchiveRange(ArchiveReader* reader, long rangeStart, long rangeEnd);
+
+/**
+ * Reads and decodes one block of an archive, storing its events in
+ * outEvents, which must have room for the block's count of events. Returns the
+ * number of events, or -1 if the block is damaged, in which case none are
+ * kept.
+ */
+int readArchiveBlock(ArchiveReader* reader, int blockNo, Event** outEvents);
+
+/**
+ * Reads the next event from an archive. Works the same way as readEntry: a
+ * valid event is stored in outEvent and ENTRY_VALID is returned, ENTRY_NONE
+ * is returned once every block in range has been read, and ENTRY_INVALID is
+ * returned once for each event of a block that is damaged, each being added
+ * to report (which may be NULL).
+ */
+int readArchiveEntry(ArchiveReader* reader, Event** outEvent, ValidationReport* report);
+
+/**
+ * Reads the events of the named archive that overlap rangeStart up to
+ * rangeEnd onto the passed-in list, decoding only the blocks in range. The
+ * events are added in one batch with bulkInsert. Each invalid event skipped
+ * is added to report, which may be NULL.
+ * Returns the number of events added, or -1 if the file couldn't be opened
+ * or isn't an archive.
+ */
+long loadArchiveRange(LinkedList* list, char* filename, long rangeStart, long rangeEnd, ValidationReport* report);
+
+/**
+ * Frees a reader, releasing any events decoded but not yet read. The file
+ * is left open.
+ */
+void closeArchive(ArchiveReader* reader);
+
+#endif
@@ -0,0 +1,487 @@
+/**
+ * A benchmark for the calendar's loading, rendering, searching, sorting,
+ * date arithmetic, editing and saving code, in text, iCalendar and archive
+ * formats, and its exporters. A synthetic diary is generated, then each
+ * operation is timed on it and reported in nanoseconds per operation and
+ * megabytes per second, so that changes in speed can be tracked from one
+ * version to the next.
+ *
+ * Usage: calBench [-n events] [-s seed] [-a meanActivityLen]
+ *                 [-l locationRatio] [-i invalidRatio] [-f diaryFile]
+ *                 [-t formatThreads]
+ *
+ * Author: Alex Burress
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "linkedList.h"
+#include "calText.h"
+#include "calFile.h"
+#include "calIcs.h"
+#include "calStats.h"
+#include "calDate.h"
+#include "calSort.h"
+#include "calIntern.h"
+#include "calArchive.h"
+#include "calExport.h"
+#include "calZone.h"
+#include "calHistory.h"
+#include "diaryGen.h"
+
+#define FALSE 0
+#define TRUE !FALSE
+#define NUM_SEARCHES 200
+#define NUM_DELETES 1000
+
+/**
+ * Prints one benchmark result. bytes may be 0 for operations where
+ * throughput in bytes doesn't mean anything.
+ */
+static void report(const char* name, long ops, long elapsedNs, long bytes)
+{
+	printf("%-16s %10ld ops %14.1f ns/op", name, ops, (ops > 0) ? (double)elapsedNs / ops : 0.0);
+
+	if (bytes > 0 && elapsedNs > 0)
+	{
+		printf(" %10.2f MB/s", ((double)bytes / (1024.0 * 1024.0)) / ((double)elapsedNs / 1.0e9));
+	}
+
+	printf("\n");
+}
+
+/**
+ * Parses the command line into settings and the diary filename, setting
+ * the threads events are formatted on if given. Returns FALSE if an option
+ * wasn't recognised.
+ */
+static int parseArgs(int argc, char** argv, DiarySettings* settings, char** filename)
+{
+	int ii;
+	int valid;
+
+	valid = TRUE;
+
+	for (ii = 1; ii + 1 < argc && valid == TRUE; ii += 2)
+	{
+		if (strcmp(argv[ii], "-n") == 0)
+		{
+			settings->numEvents = atol(argv[ii + 1]);
+		}
+		else if (strcmp(argv[ii], "-s") == 0)
+		{
+			settings->seed = strtoul(argv[ii + 1], NULL, 10);
+		}
+		else if (strcmp(argv[ii], "-a") == 0)
+		{
+			settings->meanActivityLen = atoi(argv[ii + 1]);
+		}
+		else if (strcmp(argv[ii], "-l") == 0)
+		{
+			settings->locationRatio = atof(argv[ii + 1]);
+		}
+		else if (strcmp(argv[ii], "-i") == 0)
+		{
+			settings->invalidRatio = atof(argv[ii + 1]);
+		}
+		else if (strcmp(argv[ii], "-f") == 0)
+		{
+			*filename = argv[ii + 1];
+		}
+		else if (strcmp(argv[ii], "-t") == 0)
+		{
+			setFormatThreads(atoi(argv[ii + 1]));
+		}
+		else
+		{
+			valid = FALSE;
+		}
+	}
+
+	/* an option missing its value */
+	if (ii < argc)
+	{
+		valid = FALSE;
+	}
+
+	return valid;
+}
+
+/**
+ * Generates a diary, then times each calendar operation on it.
+ */
+int main(int argc, char** argv)
+{
+	DiarySettings settings;
+	char* filename;
+	char* icsName;
+	char* archiveName;
+	char* exportName;
+	FILE* file;
+	LinkedList* list;
+	LinkedList* scratch;
+	LinkedList* sorted;
+	ListSnapshot* snapshot;
+	EventHandle* handles;
+	History* history;
+	Event* copy;
+	Event** batch;
+	SortKey* keys;
+	SortKey* sortScratch;
+	SortKey swapKey;
+	Event* zoned;
+	TimeZone* zones[4];
+	Date* dates;
+	long* ends;
+	long* days;
+	int* weekdays;
+	char* text;
+	char label[40];
+	unsigned long state;
+	long fileBytes;
+	long activityBytes;
+	long numEvents;
+	long startTime;
+	long shiftMinutes;
+	long bytes;
+	long ii;
+	int jj;
+	int found;
+
+	defaultDiarySettings(&settings);
+	filename = "bench_diary.txt";
+
+	if (parseArgs(argc, argv, &settings, &filename) == FALSE)
+	{
+		printf("Usage: calBench [-n events] [-s seed] [-a meanActivityLen] [-l locationRatio] [-i invalidRatio] [-f diaryFile] [-t formatThreads]\n");
+		return 1;
+	}
+
+	/* generate */
+	file = fopen(filename, "w");
+	if (file == NULL)
+	{
+		printf("Error: could not create %s\n", filename);
+		return 1;
+	}
+	startTime = statsNow();
+	fileBytes = generateDiary(file, &settings);
+	fclose(file);
+	report("generate", settings.numEvents, statsNow() - startTime, fileBytes);
+
+	/* load, as readFile does */
+	list = createList();
+	startTime = statsNow();
+	numEvents = loadFile(list, filename, NULL);
+	report("load", settings.numEvents, statsNow() - startTime, fileBytes);
+
+	if (numEvents <= 0)
+	{
+		printf("Error: no valid events were generated\n");
+		freeList(list);
+		return 1;
+	}
+
+	/* render for a text file */
+	startTime = statsNow();
+	text = listToText(list);
+	bytes = strlen(text);
+	report("listToText", numEvents, statsNow() - startTime, bytes);
+	free(text);
+
+	/* render for the gui, as a refresh of one calendar does */
+	startTime = statsNow();
+	text = sortedToWindow(&list, NULL, 1, SORT_START);
+	bytes = strlen(text);
+	report("sortedToWindow", numEvents, statsNow() - startTime, bytes);
+	free(text);
+
+	/* a second refresh finds the events already rendered */
+	startTime = statsNow();
+	text = sortedToWindow(&list, NULL, 1, SORT_START);
+	bytes = strlen(text);
+	report("second refresh", numEvents, statsNow() - startTime, bytes);
+	free(text);
+
+	/* searches that match nothing scan every activity */
+	snapshot = snapshotList(list);
+	activityBytes = 0;
+	for (ii = 0; ii < snapshot->count; ii++)
+	{
+		activityBytes += strlen(internedText(snapshot->events[ii]->activity));
+	}
+
+	startTime = statsNow();
+	found = 0;
+	for (ii = 0; ii < NUM_SEARCHES; ii++)
+	{
+		found += (findEvent(list, "no such activity").generation != NO_GENERATION);
+	}
+	report("findEvent miss", NUM_SEARCHES, statsNow() - startTime, activityBytes * NUM_SEARCHES);
+
+	/* searches for the activity of a random event */
+	state = settings.seed + 1;
+	startTime = statsNow();
+	for (ii = 0; ii < NUM_SEARCHES; ii++)
+	{
+		found += (findEvent(list, internedText(snapshot->events[nextRandom(&state) % snapshot->count]->activity)).generation != NO_GENERATION);
+	}
+	report("findEvent hit", NUM_SEARCHES, statsNow() - startTime, 0);
+
+	/* sort the events as listed by start, which takes no radix passes */
+	batch = (Event**)malloc((snapshot->count + 1) * sizeof(Event*));
+	memcpy(batch, snapshot->events, snapshot->count * sizeof(Event*));
+	startTime = statsNow();
+	sortEvents(batch, snapshot->count, SORT_START);
+	report("sort sorted", snapshot->count, statsNow() - startTime, 0);
+	free(batch);
+
+	/* shuffle the events, so no order is sorted already */
+	keys = (SortKey*)malloc((snapshot->count + 1) * sizeof(SortKey));
+	sortScratch = (SortKey*)malloc((snapshot->count + 1) * sizeof(SortKey));
+	state = settings.seed + 2;
+	for (ii = 0; ii < snapshot->count; ii++)
+	{
+		keys[ii].event = snapshot->events[ii];
+	}
+	for (ii = snapshot->count - 1; ii > 0; ii--)
+	{
+		swapKey = keys[ii];
+		jj = (int)(nextRandom(&state) % (ii + 1));
+		keys[ii] = keys[jj];
+		keys[jj] = swapKey;
+	}
+
+	/* the first sort by activity ranks every text interned */
+	for (ii = 0; ii < snapshot->count; ii++)
+	{
+		keys[ii].key = 0;
+	}
+	startTime = statsNow();
+	packSortKeys(keys, snapshot->count, SORT_ACTIVITY, 1);
+	report("rank activities", snapshot->count, statsNow() - startTime, 0);
+
+	/* sort into each display order, timing the keys apart from the sort */
+	for (jj = 0; jj < SORT_ORDERS; jj++)
+	{
+		for (ii = 0; ii < snapshot->count; ii++)
+		{
+			keys[ii].key = 0;
+		}
+
+		sprintf(label, "keys by %s", sortOrderName(jj));
+		startTime = statsNow();
+		packSortKeys(keys, snapshot->count, jj, 1);
+		report(label, snapshot->count, statsNow() - startTime, 0);
+
+		sprintf(label, "sort by %s", sortOrderName(jj));
+		startTime = statsNow();
+		radixSort(keys, sortScratch, snapshot->count);
+		report(label, snapshot->count, statsNow() - startTime, 0);
+	}
+	free(keys);
+	free(sortScratch);
+
+	/* the end of every event, then the date and weekday it ends on */
+	ends = (long*)malloc((snapshot->count + 1) * sizeof(long));
+	days = (long*)malloc((snapshot->count + 1) * sizeof(long));
+	dates = (Date*)malloc((snapshot->count + 1) * sizeof(Date));
+	weekdays = (int*)malloc((snapshot->count + 1) * sizeof(int));
+
+	startTime = statsNow();
+	eventEndBatch(snapshot->events, snapshot->count, ends);
+	report("event ends", snapshot->count, statsNow() - startTime, 0);
+
+	for (ii = 0; ii < snapshot->count; ii++)
+	{
+		days[ii] = minutesToDay(ends[ii]);
+	}
+
+	startTime = statsNow();
+	civilFromDaysBatch(days, snapshot->count, dates);
+	dayOfWeekBatch(days, snapshot->count, weekdays);
+	report("end dates", snapshot->count, statsNow() - startTime, 0);
+
+	/* the same ends with the events spread over several zones, each a
+	 * conversion through two transition tables */
+	zones[0] = NULL;
+	zones[1] = findZone("Europe/Paris");
+	zones[2] = findZone("America/New_York");
+	zones[3] = findZone("Asia/Tokyo");
+	zoned = (Event*)malloc((snapshot->count + 1) * sizeof(Event));
+	batch = (Event**)malloc((snapshot->count + 1) * sizeof(Event*));
+	for (ii = 0; ii < snapshot->count; ii++)
+	{
+		zoned[ii] = *(snapshot->events[ii]);
+		zoned[ii].zone = zones[ii % 4];
+		batch[ii] = &zoned[ii];
+	}
+
+	startTime = statsNow();
+	eventEndBatch(batch, snapshot->count, ends);
+	report("zoned event ends", snapshot->count, statsNow() - startTime, 0);
+	free(batch);
+	free(zoned);
+
+	found += weekdays[0] + dates[0].day + (int)(ends[0] & 1);
+	free(ends);
+	free(days);
+	free(dates);
+	free(weekdays);
+
+	/* insert copies of every event into a new list, keeping their handles,
+	 * last first so the list is in start order as a loaded one is */
+	scratch = createList();
+	handles = (EventHandle*)malloc(snapshot->count * sizeof(EventHandle));
+	startTime = statsNow();
+	for (ii = 0; ii < snapshot->count; ii++)
+	{
+		copy = copyEvent(snapshot->events[snapshot->count - 1 - ii]);
+		handles[ii] = insertFirst(scratch, copy);
+	}
+	report("insert", snapshot->count, statsNow() - startTime, 0);
+
+	/* the same copies added as one batch, then a second batch merged in */
+	sorted = createList();
+	batch = (Event**)malloc(snapshot->count * sizeof(Event*));
+	for (jj = 0; jj < 2; jj++)
+	{
+		for (ii = 0; ii < snapshot->count; ii++)
+		{
+			batch[ii] = copyEvent(snapshot->events[ii]);
+		}
+
+		startTime = statsNow();
+		bulkInsert(sorted, batch, snapshot->count);
+		report((jj == 0) ? "bulk insert" : "bulk merge", snapshot->count, statsNow() - startTime, 0);
+	}
+	free(batch);
+	freeList(sorted);
+
+	/* delete from random positions */
+	startTime = statsNow();
+	for (ii = 0; ii < NUM_DELETES && scratch->count > 0; ii++)
+	{
+		deleteNthElement(scratch, (int)(nextRandom(&state) % scratch->count));
+	}
+	report("delete", ii, statsNow() - startTime, 0);
+
+	/* delete by handle as the gui does, recording each delete (some were
+	 * already deleted above), then undo them all */
+	history = (History*)malloc(sizeof(History));
+	initHistory(history);
+	startTime = statsNow();
+	for (ii = 0; ii < NUM_DELETES; ii++)
+	{
+		recordDelete(history, scratch, handles[nextRandom(&state) % snapshot->count]);
+	}
+	report("delete by handle", ii, statsNow() - startTime, 0);
+
+	bytes = history->numUndo;
+	startTime = statsNow();
+	while (undoChange(history) == TRUE)
+	{
+	}
+	report("undo delete", bytes, statsNow() - startTime, 0);
+	clearHistory(history);
+	free(history);
+	free(handles);
+
+	/* move then delete every event sharing the first event's activity */
+	shiftMinutes = MINS_PER_DAY;
+	startTime = statsNow();
+	found += updateMatching(scratch, internedText(snapshot->events[0]->activity), &shiftEvent, (void*)&shiftMinutes, &startKey,
+		NULL, NULL);
+	report("shift matching", scratch->count, statsNow() - startTime, 0);
+
+	startTime = statsNow();
+	bytes = scratch->count;
+	found += deleteMatching(scratch, internedText(snapshot->events[0]->activity), NULL);
+	report("delete matching", bytes, statsNow() - startTime, 0);
+	freeList(scratch);
+
+	/* save */
+	file = fopen(filename, "w");
+	if (file != NULL)
+	{
+		startTime = statsNow();
+		bytes = writeSnapshot(file, snapshot);
+		fclose(file);
+		report("save", snapshot->count, statsNow() - startTime, bytes);
+	}
+
+	/* the same events as iCalendar, to compare with the text format */
+	icsName = (char*)malloc((strlen(filename) + 5) * sizeof(char));
+	sprintf(icsName, "%s.ics", filename);
+	file = fopen(icsName, "w");
+	if (file != NULL)
+	{
+		startTime = statsNow();
+		bytes = writeIcsSnapshot(file, snapshot);
+		fclose(file);
+		report("save ics", snapshot->count, statsNow() - startTime, bytes);
+
+		scratch = createList();
+		startTime = statsNow();
+		loadFile(scratch, icsName, NULL);
+		report("load ics", snapshot->count, statsNow() - startTime, bytes);
+		freeList(scratch);
+		remove(icsName);
+	}
+	free(icsName);
+
+	/* and as a compressed archive */
+	archiveName = (char*)malloc((strlen(filename) + 6) * sizeof(char));
+	sprintf(archiveName, "%s.calz", filename);
+	file = fopen(archiveName, "wb");
+	if (file != NULL)
+	{
+		startTime = statsNow();
+		bytes = writeArchiveSnapshot(file, snapshot);
+		fclose(file);
+		report("save archive", snapshot->count, statsNow() - startTime, bytes);
+
+		scratch = createList();
+		startTime = statsNow();
+		loadFile(scratch, archiveName, NULL);
+		report("load archive", snapshot->count, statsNow() - startTime, bytes);
+		freeList(scratch);
+		remove(archiveName);
+
+		if (bytes > 0)
+		{
+			printf("archive is %.1fx smaller than text\n", (double)fileBytes / bytes);
+		}
+	}
+	free(archiveName);
+
+	/* streamed out for other tools, as CSV and as JSON Lines */
+	exportName = (char*)malloc((strlen(filename) + 7) * sizeof(char));
+	for (jj = 0; jj < EXPORT_FORMATS; jj++)
+	{
+		sprintf(exportName, "%s.%s", filename, (jj == EXPORT_CSV) ? "csv" : "jsonl");
+		file = fopen(exportName, "w");
+		if (file != NULL)
+		{
+			startTime = statsNow();
+			bytes = exportSnapshot(file, snapshot, jj);
+			fclose(file);
+			report((jj == EXPORT_CSV) ? "export csv" : "export jsonl", snapshot->count, statsNow() - startTime, bytes);
+			remove(exportName);
+		}
+	}
+	free(exportName);
+
+	freeSnapshot(snapshot);
+	freeList(list);
+	remove(filename);
+
+	/* keeps the searches from being optimised away */
+	if (found < 0)
+	{
+		printf("%d\n", found);
+	}
+
+	return 0;
+}
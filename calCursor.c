@@ -0,0 +1,203 @@
+/**
+ * Contains a read-only cursor over the events of a list, for code that
+ * looks at every event in turn, such as renderers, savers and searches,
+ * without walking the list's nodes itself. A cursor moves forward or
+ * backward, can seek to a time, and can be limited to the events starting
+ * within a range. Events found through a cursor must not be modified; use
+ * retrieveElementForEdit or a handle for that.
+ *
+ * Author: Alex Burress
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <limits.h>
+#include "linkedList.h"
+#include "calDate.h"
+#include "calCursor.h"
+
+#define FALSE 0
+#define TRUE !FALSE
+
+/**
+ * Returns TRUE if the event at a node is within a cursor's range. An
+ * unlimited cursor doesn't work out the start at all.
+ */
+static int inRange(EventCursor* cursor, ListNode* node)
+{
+	long start;
+	int result;
+
+	result = TRUE;
+
+	if (cursor->rangeStart != LONG_MIN || cursor->rangeEnd != LONG_MAX)
+	{
+		start = eventStart(node->data);
+		result = (start >= cursor->rangeStart && start < cursor->rangeEnd);
+	}
+
+	return result;
+}
+
+/**
+ * Moves a cursor one node at a time from the passed-in node, forward or
+ * backward, until it reaches an event in range or falls off the list, and
+ * returns the event, or NULL. position is that of the passed-in node.
+ */
+static Event* moveFrom(EventCursor* cursor, ListNode* node, int position, int forward)
+{
+	assert(cursor->version == cursor->list->version);
+
+	while (node != NULL && inRange(cursor, node) == FALSE)
+	{
+		node = (forward == TRUE) ? node->next : node->prev;
+		position += (forward == TRUE) ? 1 : -1;
+	}
+
+	cursor->node = node;
+	if (node != NULL)
+	{
+		cursor->position = position;
+	}
+	else
+	{
+		cursor->position = (forward == TRUE) ? cursor->list->count : -1;
+	}
+
+	return cursorEvent(cursor);
+}
+
+/**
+ * Starts a cursor over every event on the passed-in list, positioned before
+ * the first, so the first call to cursorNext returns the first event.
+ */
+void openCursor(EventCursor* cursor, LinkedList* list)
+{
+	cursor->list = list;
+	cursor->node = NULL;
+	cursor->position = -1;
+	cursor->rangeStart = LONG_MIN;
+	cursor->rangeEnd = LONG_MAX;
+	cursor->version = list->version;
+}
+
+/**
+ * Limits a cursor to the events starting at or after rangeStart and before
+ * rangeEnd (in minutes, as for eventStart), as for a recurring event its
+ * first occurrence does. The cursor is moved back before the first event.
+ */
+void limitCursor(EventCursor* cursor, long rangeStart, long rangeEnd)
+{
+	cursor->rangeStart = rangeStart;
+	cursor->rangeEnd = rangeEnd;
+	cursor->node = NULL;
+	cursor->position = -1;
+}
+
+/**
+ * Moves a cursor to the first event in range and returns it, or returns NULL,
+ * leaving the cursor off the end, if there is none.
+ */
+Event* cursorFirst(EventCursor* cursor)
+{
+	return moveFrom(cursor, cursor->list->head, 0, TRUE);
+}
+
+/**
+ * Moves a cursor to the last event in range and returns it, or returns NULL,
+ * leaving the cursor off the start, if there is none.
+ */
+Event* cursorLast(EventCursor* cursor)
+{
+	return moveFrom(cursor, cursor->list->tail, cursor->list->count - 1, FALSE);
+}
+
+/**
+ * Moves a cursor to the next event in range and returns it, or returns NULL
+ * once it has moved off the end. A cursor off the start moves to the first
+ * event.
+ */
+Event* cursorNext(EventCursor* cursor)
+{
+	Event* event;
+
+	if (cursor->node != NULL)
+	{
+		event = moveFrom(cursor, cursor->node->next, cursor->position + 1, TRUE);
+	}
+	else if (cursor->position < 0)
+	{
+		event = cursorFirst(cursor);
+	}
+	else
+	{
+		event = NULL;
+	}
+
+	return event;
+}
+
+/**
+ * Moves a cursor to the previous event in range and returns it, or returns
+ * NULL once it has moved off the start. A cursor off the end moves to the
+ * last event.
+ */
+Event* cursorPrev(EventCursor* cursor)
+{
+	Event* event;
+
+	if (cursor->node != NULL)
+	{
+		event = moveFrom(cursor, cursor->node->prev, cursor->position - 1, FALSE);
+	}
+	else if (cursor->position >= 0)
+	{
+		event = cursorLast(cursor);
+	}
+	else
+	{
+		event = NULL;
+	}
+
+	return event;
+}
+
+/**
+ * Moves a cursor to the first event in range that starts at or after the
+ * passed-in time (in minutes, as for eventStart), and returns it, or returns
+ * NULL, leaving the cursor off the end, if there is none. The list must be in
+ * order of start time, as loading and editing keep it. The cursor walks from
+ * where it is, back then forward, so a seek costs the events it passes over:
+ * a seek to a nearby time is cheap, but one from a new cursor is linear in
+ * the events before the time. Use a Timeline to find a time in a large list
+ * by binary search.
+ */
+Event* cursorSeek(EventCursor* cursor, long when)
+{
+	Event* event;
+
+	/* back from where the cursor is, past every event from the time on */
+	event = (cursorEvent(cursor) != NULL) ? cursorEvent(cursor) : cursorPrev(cursor);
+	while (event != NULL && eventStart(event) >= when)
+	{
+		event = cursorPrev(cursor);
+	}
+
+	/* then on to the first of them */
+	event = cursorNext(cursor);
+	while (event != NULL && eventStart(event) < when)
+	{
+		event = cursorNext(cursor);
+	}
+
+	return event;
+}
+
+/**
+ * Returns the event a cursor is at, or NULL if it is off either end.
+ */
+Event* cursorEvent(EventCursor* cursor)
+{
+	return (cursor->node != NULL) ? cursor->node->data : NULL;
+}
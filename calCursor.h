@@ -0,0 +1,88 @@
+/**
+ * Contains a read-only cursor over the events of a list, for code that
+ * looks at every event in turn, such as renderers, savers and searches,
+ * without walking the list's nodes itself. A cursor moves forward or
+ * backward, can seek to a time, and can be limited to the events starting
+ * within a range. Events found through a cursor must not be modified; use
+ * retrieveElementForEdit or a handle for that.
+ *
+ * Author: Alex Burress
+ */
+
+#ifndef CALCURSOR_H
+#define CALCURSOR_H
+#include "linkedList.h"
+
+/**
+ * A position on a list, at one of its events or off either end. position
+ * is the element number of the event, or -1 or the list's count off the
+ * start or end. Only events starting at or after rangeStart and before
+ * rangeEnd (in minutes, as for eventStart) are stopped at. A cursor stays
+ * valid only while the list is unchanged (see list->version).
+ */
+typedef struct EventCursor {
+	LinkedList* list;
+	ListNode* node;
+	int position;
+	long rangeStart;
+	long rangeEnd;
+	unsigned long version;
+} EventCursor;
+
+/**
+ * Starts a cursor over every event on the passed-in list, positioned before
+ * the first, so the first call to cursorNext returns the first event.
+ */
+void openCursor(EventCursor* cursor, LinkedList* list);
+
+/**
+ * Limits a cursor to the events starting at or after rangeStart and before
+ * rangeEnd (in minutes, as for eventStart), as for a recurring event its
+ * first occurrence does. The cursor is moved back before the first event.
+ */
+void limitCursor(EventCursor* cursor, long rangeStart, long rangeEnd);
+
+/**
+ * Moves a cursor to the first event in range and returns it, or returns NULL,
+ * leaving the cursor off the end, if there is none.
+ */
+Event* cursorFirst(EventCursor* cursor);
+
+/**
+ * Moves a cursor to the last event in range and returns it, or returns NULL,
+ * leaving the cursor off the start, if there is none.
+ */
+Event* cursorLast(EventCursor* cursor);
+
+/**
+ * Moves a cursor to the next event in range and returns it, or returns NULL
+ * once it has moved off the end. A cursor off the start moves to the first
+ * event.
+ */
+Event* cursorNext(EventCursor* cursor);
+
+/**
+ * Moves a cursor to the previous event in range and returns it, or returns
+ * NULL once it has moved off the start. A cursor off the end moves to the
+ * last event.
+ */
+Event* cursorPrev(EventCursor* cursor);
+
+/**
+ * Moves a cursor to the first event in range that starts at or after the
+ * passed-in time (in minutes, as for eventStart), and returns it, or returns
+ * NULL, leaving the cursor off the end, if there is none. The list must be in
+ * order of start time, as loading and editing keep it. The cursor walks from
+ * where it is, back then forward, so a seek costs the events it passes over:
+ * a seek to a nearby time is cheap, but one from a new cursor is linear in
+ * the events before the time. Use a Timeline to find a time in a large list
+ * by binary search.
+ */
+Event* cursorSeek(EventCursor* cursor, long when);
+
+/**
+ * Returns the event a cursor is at, or NULL if it is off either end.
+ */
+Event* cursorEvent(EventCursor* cursor);
+
+#endif
@@ -0,0 +1,330 @@
+/**
+ * Contains functions for converting calendar dates and times to and from
+ * plain day and minute counts, so that date arithmetic is a few integer
+ * operations rather than a walk through months and years: weekdays, ends of
+ * events, moving by minutes and differences between dates, with batch
+ * versions for arrays of events and days.
+ *
+ * Author: Alex Burress
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "linkedList.h"
+#include "calDate.h"
+#include "calFile.h"
+#include "calZone.h"
+
+#define FALSE 0
+#define TRUE !FALSE
+
+/* further than any event can be moved and stay valid, so sums can't overflow */
+#define MAX_SHIFT (4000L * 366L * MINS_PER_DAY)
+
+/**
+ * Returns the number of days between 1 January 1970 and the passed-in date,
+ * negative for earlier dates. Works for any date in the proleptic
+ * Gregorian calendar.
+ *
+ * Years are counted from March so the leap day falls at the end of each
+ * year, then split into 400 year eras which all have the same length.
+ */
+long daysFromCivil(int year, int month, int day)
+{
+	long era;
+	long yearOfEra;
+	long dayOfYear;
+	long dayOfEra;
+
+	if (month <= 2)
+	{
+		year--;
+	}
+
+	era = (year >= 0 ? year : year - 399) / 400;
+	yearOfEra = year - era * 400;
+	dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+	dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+
+	return era * 146097 + dayOfEra - 719468;
+}
+
+/**
+ * Stores the date that is the passed-in number of days after 1 January 1970
+ * in outDate. The inverse of daysFromCivil.
+ */
+void civilFromDays(long days, Date* outDate)
+{
+	long era;
+	long dayOfEra;
+	long yearOfEra;
+	long dayOfYear;
+	long monthIndex;
+
+	days += 719468;
+	era = (days >= 0 ? days : days - 146096) / 146097;
+	dayOfEra = days - era * 146097;
+	yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+	dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+	monthIndex = (5 * dayOfYear + 2) / 153;
+
+	outDate->day = (int)(dayOfYear - (153 * monthIndex + 2) / 5 + 1);
+	outDate->month = (int)(monthIndex < 10 ? monthIndex + 3 : monthIndex - 9);
+	outDate->year = (int)(yearOfEra + era * 400 + (outDate->month <= 2));
+}
+
+/**
+ * Returns the day of the week of a day number, 0 for Sunday to 6 for
+ * Saturday.
+ */
+int dayOfWeek(long days)
+{
+	int weekday;
+
+	/* 1 January 1970 was a Thursday */
+	weekday = (int)((days + 4) % 7);
+	if (weekday < 0)
+	{
+		weekday += 7;
+	}
+
+	return weekday;
+}
+
+/**
+ * Returns the day number a time in minutes (as returned by eventStart) falls
+ * on, rounding down for times before 1970.
+ */
+long minutesToDay(long minutes)
+{
+	long day;
+
+	day = minutes / MINS_PER_DAY;
+	if (minutes % MINS_PER_DAY < 0)
+	{
+		day--;
+	}
+
+	return day;
+}
+
+/**
+ * Returns the number of days in the passed-in month.
+ */
+int daysInMonth(int year, int month)
+{
+	static const int lengths[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+	int days;
+
+	days = lengths[month - 1];
+
+	if (month == 2 && isLeapYear(year) == TRUE)
+	{
+		days = 29;
+	}
+
+	return days;
+}
+
+/**
+ * Returns a date and time as the number of minutes since midnight on
+ * 1 January 1970, negative for earlier times.
+ */
+long civilToMinutes(Date* date, Time* time)
+{
+	return daysFromCivil(date->year, date->month, date->day) * MINS_PER_DAY + time->hrs * 60 + time->mins;
+}
+
+/**
+ * Stores the date and time that is the passed-in number of minutes after
+ * midnight on 1 January 1970 in outDate and outTime. The inverse of
+ * civilToMinutes.
+ */
+void civilFromMinutes(long minutes, Date* outDate, Time* outTime)
+{
+	long day;
+	int minuteOfDay;
+
+	day = minutesToDay(minutes);
+	minuteOfDay = (int)(minutes - day * MINS_PER_DAY);
+
+	civilFromDays(day, outDate);
+	outTime->hrs = minuteOfDay / 60;
+	outTime->mins = minuteOfDay % 60;
+}
+
+/**
+ * Returns the day of the week of a date, 0 for Sunday to 6 for Saturday.
+ */
+int weekdayOf(Date* date)
+{
+	return dayOfWeek(daysFromCivil(date->year, date->month, date->day));
+}
+
+/**
+ * Moves a date and time the passed-in number of minutes later or, if
+ * negative, earlier, across days, months and years as needed.
+ */
+void addMinutes(Date* date, Time* time, long minutes)
+{
+	civilFromMinutes(civilToMinutes(date, time) + minutes, date, time);
+}
+
+/**
+ * Returns the number of days from one date to another, negative if to is
+ * earlier.
+ */
+long daysBetween(Date* from, Date* to)
+{
+	return daysFromCivil(to->year, to->month, to->day) - daysFromCivil(from->year, from->month, from->day);
+}
+
+/**
+ * Returns the number of minutes from one date and time to another, negative
+ * if the second is earlier.
+ */
+long minutesBetween(Date* fromDate, Time* fromTime, Date* toDate, Time* toTime)
+{
+	return civilToMinutes(toDate, toTime) - civilToMinutes(fromDate, fromTime);
+}
+
+/**
+ * Returns the start of an event as the number of minutes since midnight on
+ * 1 January 1970, so events can be ordered and compared with one subtraction.
+ * The start is the wall clock of the display zone (see displayZone), so
+ * events in different zones are ordered by when they really happen.
+ */
+long eventStart(Event* event)
+{
+	long start;
+
+	start = civilToMinutes(&event->eDate, &event->eTime);
+
+	/* events in no zone are in the display zone already */
+	if (event->zone != NULL)
+	{
+		start = convertZone(start, event->zone, NULL);
+	}
+
+	return start;
+}
+
+/**
+ * Returns the end of an event, its start (as for eventStart) plus its
+ * duration. For a recurring event this is the end of its first occurrence.
+ */
+long eventEnd(Event* event)
+{
+	return eventStart(event) + event->duration;
+}
+
+/**
+ * Stores the start (as for eventStart) of each of count events in
+ * outStarts.
+ */
+void eventStartBatch(Event** events, long count, long* outStarts)
+{
+	TimeZone* display;
+	TimeZone* zone;
+	long ii;
+
+	display = displayZone();
+
+	for (ii = 0; ii < count; ii++)
+	{
+		outStarts[ii] = civilToMinutes(&events[ii]->eDate, &events[ii]->eTime);
+
+		zone = events[ii]->zone;
+		if (zone != NULL && zone != display)
+		{
+			outStarts[ii] = utcToZone(display, zoneToUtc(zone, outStarts[ii]));
+		}
+	}
+}
+
+/**
+ * Stores the end (as for eventEnd) of each of count events in outEnds.
+ */
+void eventEndBatch(Event** events, long count, long* outEnds)
+{
+	long ii;
+
+	eventStartBatch(events, count, outEnds);
+
+	for (ii = 0; ii < count; ii++)
+	{
+		outEnds[ii] += events[ii]->duration;
+	}
+}
+
+/**
+ * Stores the date of each of count day numbers in outDates, as
+ * civilFromDays does.
+ */
+void civilFromDaysBatch(long* days, long count, Date* outDates)
+{
+	long ii;
+
+	for (ii = 0; ii < count; ii++)
+	{
+		civilFromDays(days[ii], &outDates[ii]);
+	}
+}
+
+/**
+ * Stores the day of the week of each of count day numbers in outWeekdays,
+ * as dayOfWeek does.
+ */
+void dayOfWeekBatch(long* days, long count, int* outWeekdays)
+{
+	long ii;
+
+	for (ii = 0; ii < count; ii++)
+	{
+		outWeekdays[ii] = dayOfWeek(days[ii]);
+	}
+}
+
+/**
+ * Moves an event the number of minutes (a long) that minutes points at,
+ * later or, if negative, earlier. The dates of a repeat rule move by as many
+ * days as the event's date does. Returns FALSE, leaving the event unchanged,
+ * if the event would no longer be valid. Can be passed to updateMatching.
+ */
+int shiftEvent(Event* event, void* minutes)
+{
+	Date newDate;
+	Time newTime;
+	long dayShift;
+	int shifted;
+	int ii;
+
+	shifted = FALSE;
+
+	if (*(long*)minutes > -MAX_SHIFT && *(long*)minutes < MAX_SHIFT)
+	{
+		/* an event moves on its own wall clock */
+		civilFromMinutes(civilToMinutes(&event->eDate, &event->eTime) + *(long*)minutes, &newDate, &newTime);
+
+		shifted = eventValid(newDate.year, newDate.month, newDate.day, newTime.hrs, newTime.mins, event->duration);
+	}
+
+	if (shifted == TRUE)
+	{
+		dayShift = daysBetween(&event->eDate, &newDate);
+
+		if (event->repeat != NULL)
+		{
+			event->repeat->untilDay += dayShift;
+			for (ii = 0; ii < event->repeat->numExceptions; ii++)
+			{
+				event->repeat->exceptions[ii] += dayShift;
+			}
+		}
+
+		event->eDate = newDate;
+		event->eTime = newTime;
+	}
+
+	return shifted;
+}
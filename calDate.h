@@ -0,0 +1,128 @@
+/**
+ * Contains functions for converting calendar dates and times to and from
+ * plain day and minute counts, so that date arithmetic is a few integer
+ * operations rather than a walk through months and years: weekdays, ends of
+ * events, moving by minutes and differences between dates, with batch
+ * versions for arrays of events and days.
+ *
+ * Author: Alex Burress
+ */
+
+#ifndef CALDATE_H
+#define CALDATE_H
+#include "linkedList.h"
+
+#define MINS_PER_DAY 1440
+
+/**
+ * Returns the number of days between 1 January 1970 and the passed-in date,
+ * negative for earlier dates. Works for any date in the proleptic
+ * Gregorian calendar.
+ */
+long daysFromCivil(int year, int month, int day);
+
+/**
+ * Stores the date that is the passed-in number of days after 1 January 1970
+ * in outDate. The inverse of daysFromCivil.
+ */
+void civilFromDays(long days, Date* outDate);
+
+/**
+ * Returns the day of the week of a day number, 0 for Sunday to 6 for
+ * Saturday.
+ */
+int dayOfWeek(long days);
+
+/**
+ * Returns the day number a time in minutes (as returned by eventStart) falls
+ * on, rounding down for times before 1970.
+ */
+long minutesToDay(long minutes);
+
+/**
+ * Returns the number of days in the passed-in month.
+ */
+int daysInMonth(int year, int month);
+
+/**
+ * Returns a date and time as the number of minutes since midnight on
+ * 1 January 1970, negative for earlier times.
+ */
+long civilToMinutes(Date* date, Time* time);
+
+/**
+ * Stores the date and time that is the passed-in number of minutes after
+ * midnight on 1 January 1970 in outDate and outTime. The inverse of
+ * civilToMinutes.
+ */
+void civilFromMinutes(long minutes, Date* outDate, Time* outTime);
+
+/**
+ * Returns the day of the week of a date, 0 for Sunday to 6 for Saturday.
+ */
+int weekdayOf(Date* date);
+
+/**
+ * Moves a date and time the passed-in number of minutes later or, if
+ * negative, earlier, across days, months and years as needed.
+ */
+void addMinutes(Date* date, Time* time, long minutes);
+
+/**
+ * Returns the number of days from one date to another, negative if to is
+ * earlier.
+ */
+long daysBetween(Date* from, Date* to);
+
+/**
+ * Returns the number of minutes from one date and time to another, negative
+ * if the second is earlier.
+ */
+long minutesBetween(Date* fromDate, Time* fromTime, Date* toDate, Time* toTime);
+
+/**
+ * Returns the start of an event as the number of minutes since midnight on
+ * 1 January 1970, so events can be ordered and compared with one subtraction.
+ * The start is the wall clock of the display zone (see displayZone), so
+ * events in different zones are ordered by when they really happen.
+ */
+long eventStart(Event* event);
+
+/**
+ * Returns the end of an event, its start (as for eventStart) plus its
+ * duration. For a recurring event this is the end of its first occurrence.
+ */
+long eventEnd(Event* event);
+
+/**
+ * Stores the start (as for eventStart) of each of count events in
+ * outStarts.
+ */
+void eventStartBatch(Event** events, long count, long* outStarts);
+
+/**
+ * Stores the end (as for eventEnd) of each of count events in outEnds.
+ */
+void eventEndBatch(Event** events, long count, long* outEnds);
+
+/**
+ * Stores the date of each of count day numbers in outDates, as
+ * civilFromDays does.
+ */
+void civilFromDaysBatch(long* days, long count, Date* outDates);
+
+/**
+ * Stores the day of the week of each of count day numbers in outWeekdays,
+ * as dayOfWeek does.
+ */
+void dayOfWeekBatch(long* days, long count, int* outWeekdays);
+
+/**
+ * Moves an event the number of minutes (a long) that minutes points at,
+ * later or, if negative, earlier. The dates of a repeat rule move by as many
+ * days as the event's date does. Returns FALSE, leaving the event unchanged,
+ * if the event would no longer be valid. Can be passed to updateMatching.
+ */
+int shiftEvent(Event* event, void* minutes);
+
+#endif
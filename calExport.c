@@ -0,0 +1,475 @@
+/**
+ * Contains streaming exporters that write events as CSV or as JSON Lines,
+ * for feeding calendars to other tools. Events are written one at a time
+ * through a fixed buffer, so a calendar of any size is exported in the
+ * same amount of memory. None of these functions use the gui, so they can
+ * be called from a background thread.
+ *
+ * Author: Alex Burress
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "linkedList.h"
+#include "calRecur.h"
+#include "calStats.h"
+#include "calIntern.h"
+#include "calZone.h"
+#include "calExport.h"
+
+#define FALSE 0
+#define TRUE !FALSE
+
+/* every byte of a word set to one, or to its top bit, for testing all of
+ * the bytes of a word at once; words are 64 bits, so unsigned long must be */
+#define BYTE_ONES 0x0101010101010101UL
+#define BYTE_HIGHS 0x8080808080808080UL
+#define WORD_BYTES 8
+
+/* the columns of a CSV export */
+#define CSV_HEADER "date,time,duration,activity,location,repeat,zone\n"
+
+/* the two digits of every number below 100, for writing numbers a pair of
+ * digits at a time */
+static const char digitPairs[] =
+	"0001020304050607080910111213141516171819"
+	"2021222324252627282930313233343536373839"
+	"4041424344454647484950515253545556575859"
+	"6061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+/**
+ * Writes a number in decimal to dest, padded with zeros to at least width
+ * digits, two digits at a time. Returns the number of characters written.
+ */
+static int putNumber(char* dest, unsigned long value, int width)
+{
+	char digits[24];
+	int first;
+	int length;
+
+	first = sizeof(digits);
+
+	while (value >= 100)
+	{
+		first -= 2;
+		memcpy(digits + first, digitPairs + (value % 100) * 2, 2);
+		value /= 100;
+	}
+
+	if (value >= 10)
+	{
+		first -= 2;
+		memcpy(digits + first, digitPairs + value * 2, 2);
+	}
+	else
+	{
+		first--;
+		digits[first] = (char)('0' + value);
+	}
+
+	while ((int)sizeof(digits) - first < width)
+	{
+		first--;
+		digits[first] = '0';
+	}
+
+	length = sizeof(digits) - first;
+	memcpy(dest, digits + first, length);
+
+	return length;
+}
+
+/**
+ * Writes an event's date as YYYY-MM-DD and, after separator, its time as
+ * HH:MM, to dest. Returns the number of characters written.
+ */
+static int putDateTime(char* dest, Event* event, char* separator)
+{
+	int length;
+
+	length = putNumber(dest, (unsigned long)event->eDate.year, 4);
+	dest[length] = '-';
+	length++;
+	length += putNumber(dest + length, (unsigned long)event->eDate.month, 2);
+	dest[length] = '-';
+	length++;
+	length += putNumber(dest + length, (unsigned long)event->eDate.day, 2);
+
+	strcpy(dest + length, separator);
+	length += strlen(separator);
+
+	length += putNumber(dest + length, (unsigned long)event->eTime.hrs, 2);
+	dest[length] = ':';
+	length++;
+	length += putNumber(dest + length, (unsigned long)event->eTime.mins, 2);
+
+	return length;
+}
+
+/**
+ * Returns TRUE if none of the WORD_BYTES bytes from text need escaping in a
+ * JSON string: none is a control character, a quote or a backslash. All of
+ * the bytes are tested at once, as one word.
+ */
+static int wordIsPlain(char* text)
+{
+	unsigned long word;
+	unsigned long quotes;
+	unsigned long slashes;
+	unsigned long special;
+
+	memcpy(&word, text, WORD_BYTES);
+
+	/* a byte is zero after the xor exactly where it matched */
+	quotes = word ^ (BYTE_ONES * '"');
+	slashes = word ^ (BYTE_ONES * '\\');
+
+	special = ((word - BYTE_ONES * 0x20) & ~word) |
+		((quotes - BYTE_ONES) & ~quotes) |
+		((slashes - BYTE_ONES) & ~slashes);
+
+	return (special & BYTE_HIGHS) == 0;
+}
+
+/**
+ * Writes text to dest as a quoted JSON string. Runs of bytes that need no
+ * escaping are found a word at a time and copied whole, so only the quotes,
+ * backslashes and control characters are looked at one by one. Text other
+ * than those, including UTF-8, is copied as it is. Returns the number of
+ * characters written.
+ */
+static int putJsonString(char* dest, char* text)
+{
+	long textLength;
+	long runStart;
+	long ii;
+	int length;
+	unsigned char here;
+
+	textLength = strlen(text);
+	dest[0] = '"';
+	length = 1;
+	runStart = 0;
+	ii = 0;
+
+	while (ii < textLength)
+	{
+		if (ii + WORD_BYTES <= textLength && wordIsPlain(text + ii) == TRUE)
+		{
+			ii += WORD_BYTES;
+		}
+		else
+		{
+			here = (unsigned char)text[ii];
+
+			if (here < 0x20 || here == '"' || here == '\\')
+			{
+				/* the run up to here goes out whole, then the escape */
+				memcpy(dest + length, text + runStart, ii - runStart);
+				length += ii - runStart;
+				runStart = ii + 1;
+
+				dest[length] = '\\';
+				length++;
+
+				if (here == '"' || here == '\\')
+				{
+					dest[length] = (char)here;
+					length++;
+				}
+				else if (here == '\n')
+				{
+					dest[length] = 'n';
+					length++;
+				}
+				else if (here == '\t')
+				{
+					dest[length] = 't';
+					length++;
+				}
+				else if (here == '\r')
+				{
+					dest[length] = 'r';
+					length++;
+				}
+				else
+				{
+					length += sprintf(dest + length, "u%04x", here);
+				}
+			}
+
+			ii++;
+		}
+	}
+
+	memcpy(dest + length, text + runStart, textLength - runStart);
+	length += textLength - runStart;
+	dest[length] = '"';
+	length++;
+
+	return length;
+}
+
+/**
+ * Writes text to dest as a CSV field. A field holding a comma, quote or line
+ * break is quoted, with its quotes doubled, any other is copied as it is.
+ * Returns the number of characters written.
+ */
+static int putCsvField(char* dest, char* text)
+{
+	char* quote;
+	int textLength;
+	int length;
+
+	textLength = strlen(text);
+
+	if ((int)strcspn(text, ",\"\r\n") == textLength)
+	{
+		memcpy(dest, text, textLength);
+		length = textLength;
+	}
+	else
+	{
+		dest[0] = '"';
+		length = 1;
+
+		/* copy up to and including each quote, then the quote again */
+		quote = strchr(text, '"');
+		while (quote != NULL)
+		{
+			memcpy(dest + length, text, quote - text + 1);
+			length += quote - text + 1;
+			dest[length] = '"';
+			length++;
+
+			text = quote + 1;
+			quote = strchr(text, '"');
+		}
+
+		strcpy(dest + length, text);
+		length += strlen(text);
+		dest[length] = '"';
+		length++;
+	}
+
+	return length;
+}
+
+/**
+ * Writes out the bytes gathered in an export's buffer, and empties it.
+ */
+static void flushExport(Exporter* exporter)
+{
+	if (exporter->used > 0 && exporter->failed == FALSE)
+	{
+		if (fwrite(exporter->buffer, 1, exporter->used, exporter->dest) != (size_t)exporter->used)
+		{
+			exporter->failed = TRUE;
+		}
+		exporter->written += exporter->used;
+	}
+
+	exporter->used = 0;
+}
+
+/**
+ * Finds the export format named by the passed-in text: csv or jsonl.
+ * Returns FALSE if there is no such format.
+ */
+int parseExportFormat(char* text, int* outFormat)
+{
+	int found;
+
+	found = TRUE;
+
+	if (strcmp(text, "csv") == 0)
+	{
+		*outFormat = EXPORT_CSV;
+	}
+	else if (strcmp(text, "jsonl") == 0)
+	{
+		*outFormat = EXPORT_JSON_LINES;
+	}
+	else
+	{
+		found = FALSE;
+	}
+
+	return found;
+}
+
+/**
+ * Starts an export to dest in the given format. A CSV export begins with a
+ * header row naming its columns: date, time, duration, activity, location
+ * and repeat.
+ */
+void startExport(Exporter* exporter, FILE* dest, int format)
+{
+	exporter->startTime = STATS_BEGIN();
+	exporter->dest = dest;
+	exporter->format = format;
+	exporter->used = 0;
+	exporter->written = 0;
+	exporter->failed = FALSE;
+
+	if (format == EXPORT_CSV)
+	{
+		strcpy(exporter->buffer, CSV_HEADER);
+		exporter->used = strlen(CSV_HEADER);
+	}
+}
+
+/**
+ * Adds one event to an export. In CSV it is a row, with fields quoted only
+ * if they need to be. In JSON Lines it is an object on a line of its own,
+ * with a missing location, repeat rule or zone given as null. Dates are
+ * written as YYYY-MM-DD, times as HH:MM (on the wall clock of the event's
+ * zone, if it has one), and a repeat rule as a calendar file's REPEAT line
+ * holds it.
+ */
+void exportEvent(Exporter* exporter, Event* event)
+{
+	char rule[MAX_RULE_TEXT];
+	char* dest;
+	int length;
+
+	if (EXPORT_BUFFER - exporter->used < MAX_EXPORT_EVENT)
+	{
+		flushExport(exporter);
+	}
+
+	dest = exporter->buffer + exporter->used;
+	rule[0] = '\0';
+	if (event->repeat != NULL)
+	{
+		recurrenceToText(rule, event->repeat);
+	}
+
+	if (exporter->format == EXPORT_CSV)
+	{
+		length = putDateTime(dest, event, ",");
+		dest[length] = ',';
+		length++;
+		length += putNumber(dest + length, (unsigned long)event->duration, 1);
+		dest[length] = ',';
+		length++;
+		length += putCsvField(dest + length, internedText(event->activity));
+		dest[length] = ',';
+		length++;
+		length += putCsvField(dest + length, internedText(event->location));
+		dest[length] = ',';
+		length++;
+		length += putCsvField(dest + length, rule);
+		dest[length] = ',';
+		length++;
+		if (event->zone != NULL)
+		{
+			length += putCsvField(dest + length, event->zone->name);
+		}
+	}
+	else
+	{
+		strcpy(dest, "{\"date\":\"");
+		length = strlen(dest);
+		length += putDateTime(dest + length, event, "\",\"time\":\"");
+
+		strcpy(dest + length, "\",\"duration\":");
+		length += strlen(dest + length);
+		length += putNumber(dest + length, (unsigned long)event->duration, 1);
+
+		strcpy(dest + length, ",\"activity\":");
+		length += strlen(dest + length);
+		length += putJsonString(dest + length, internedText(event->activity));
+
+		strcpy(dest + length, ",\"location\":");
+		length += strlen(dest + length);
+		if (event->location != NO_TEXT)
+		{
+			length += putJsonString(dest + length, internedText(event->location));
+		}
+		else
+		{
+			strcpy(dest + length, "null");
+			length += 4;
+		}
+
+		strcpy(dest + length, ",\"repeat\":");
+		length += strlen(dest + length);
+		if (event->repeat != NULL)
+		{
+			length += putJsonString(dest + length, rule);
+		}
+		else
+		{
+			strcpy(dest + length, "null");
+			length += 4;
+		}
+
+		strcpy(dest + length, ",\"zone\":");
+		length += strlen(dest + length);
+		if (event->zone != NULL)
+		{
+			length += putJsonString(dest + length, event->zone->name);
+		}
+		else
+		{
+			strcpy(dest + length, "null");
+			length += 4;
+		}
+
+		dest[length] = '}';
+		length++;
+	}
+
+	dest[length] = '\n';
+	exporter->used += length + 1;
+}
+
+/**
+ * Writes out what is left of an export. Returns the number of bytes
+ * written, or -1 if writing failed.
+ */
+long finishExport(Exporter* exporter)
+{
+	long bytesWritten;
+
+	flushExport(exporter);
+
+	STATS_END(STAT_SAVE, exporter->startTime, exporter->written);
+
+	bytesWritten = exporter->written;
+	if (exporter->failed == TRUE || ferror(exporter->dest) != 0)
+	{
+		bytesWritten = -1;
+	}
+
+	return bytesWritten;
+}
+
+/**
+ * Exports every event in the passed-in snapshot to dest, in order, in the
+ * given format. Returns the number of bytes written, or -1 if writing
+ * failed.
+ */
+long exportSnapshot(FILE* dest, ListSnapshot* snapshot, int format)
+{
+	Exporter* exporter;
+	long bytesWritten;
+	int ii;
+
+	/* the buffer is too big to want on the stack */
+	exporter = (Exporter*)malloc(sizeof(Exporter));
+	startExport(exporter, dest, format);
+
+	for (ii = 0; ii < snapshot->count; ii++)
+	{
+		exportEvent(exporter, snapshot->events[ii]);
+	}
+
+	bytesWritten = finishExport(exporter);
+	free(exporter);
+
+	return bytesWritten;
+}
@@ -0,0 +1,84 @@
+/**
+ * Contains streaming exporters that write events as CSV or as JSON Lines,
+ * for feeding calendars to other tools. Events are written one at a time
+ * through a fixed buffer, so a calendar of any size is exported in the
+ * same amount of memory. None of these functions use the gui, so they can
+ * be called from a background thread.
+ *
+ * Author: Alex Burress
+ */
+
+#ifndef CALEXPORT_H
+#define CALEXPORT_H
+#include "linkedList.h"
+#include "calRecur.h"
+#include "calZone.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* the formats events can be exported in */
+#define EXPORT_CSV 0
+#define EXPORT_JSON_LINES 1
+#define EXPORT_FORMATS 2
+
+/* the bytes of output held before they are written */
+#define EXPORT_BUFFER 65536
+
+/* the longest one event can be once exported, every character of its text
+ * escaped at worst to six */
+#define MAX_EXPORT_EVENT (6 * (MAX_ACTIVITY + MAX_LOCATION + MAX_RULE_TEXT + MAX_ZONE_NAME) + 128)
+
+/**
+ * An export under way to dest, in format. Output is gathered in buffer,
+ * used bytes of which are filled, and written out whenever there might not
+ * be room for another event. written counts the bytes written so far,
+ * failed is set once writing has failed, and startTime is when the export
+ * started, for its statistics.
+ */
+typedef struct Exporter {
+	FILE* dest;
+	int format;
+	char buffer[EXPORT_BUFFER];
+	int used;
+	long written;
+	int failed;
+	long startTime;
+} Exporter;
+
+/**
+ * Finds the export format named by the passed-in text: csv or jsonl.
+ * Returns FALSE if there is no such format.
+ */
+int parseExportFormat(char* text, int* outFormat);
+
+/**
+ * Starts an export to dest in the given format. A CSV export begins with a
+ * header row naming its columns: date, time, duration, activity, location
+ * and repeat.
+ */
+void startExport(Exporter* exporter, FILE* dest, int format);
+
+/**
+ * Adds one event to an export. In CSV it is a row, with fields quoted only
+ * if they need to be. In JSON Lines it is an object on a line of its own,
+ * with a missing location, repeat rule or zone given as null. Dates are
+ * written as YYYY-MM-DD, times as HH:MM (on the wall clock of the event's
+ * zone, if it has one), and a repeat rule as a calendar file's REPEAT line
+ * holds it.
+ */
+void exportEvent(Exporter* exporter, Event* event);
+
+/**
+ * Writes out what is left of an export. Returns the number of bytes
+ * written, or -1 if writing failed.
+ */
+long finishExport(Exporter* exporter);
+
+/**
+ * Exports every event in the passed-in snapshot to dest, in order, in the
+ * given format. Returns the number of bytes written, or -1 if writing
+ * failed.
+ */
+long exportSnapshot(FILE* dest, ListSnapshot* snapshot, int format);
+
+#endif
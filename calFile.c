@@ -0,0 +1,702 @@
+/**
+ * Contains functions for reading and writing calendar text files and
+ * validating the events they contain. None of these functions use the gui, so they can be
+ * called from a background thread.
+ *
+ * Author: Alex Burress
+ */
+
+/* for getc_unlocked and flockfile, and pwritev */
+#define _POSIX_C_SOURCE 200112L
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include "linkedList.h"
+#include "calText.h"
+#include "calFile.h"
+#include "calStats.h"
+#include "calRecur.h"
+#include "calIcs.h"
+#include "calIntern.h"
+#include "calArchive.h"
+#include "calReport.h"
+#include "calSort.h"
+#include "calRender.h"
+#include "calZone.h"
+
+#define FALSE 0
+#define TRUE !FALSE
+#define REPEAT_PREFIX "REPEAT "
+#define ZONE_PREFIX "ZONE "
+
+/* the events a load gathers before it first needs more room */
+#define FIRST_BATCH 256
+
+/**
+ * A line reader over a calendar file. text holds the current line, without
+ * its line break, and is grown as needed so a line of any length is read
+ * whole. It starts out as a buffer supplied by the caller, so most files are
+ * read without allocating. bytesRead counts every byte taken from the file,
+ * line breaks included, and lineNo the lines, so is the number of the line
+ * last read.
+ */
+typedef struct LineReader {
+	FILE* source;
+	char* text;
+	size_t length;
+	size_t size;
+	char* firstText;
+	long bytesRead;
+	long lineNo;
+} LineReader;
+
+/**
+ * Sets up a line reader over a file, using buffer, of size bytes, to hold
+ * lines until a longer one is read. lineNo is the number of lines already
+ * read from the file. The file must be locked by the caller.
+ */
+static void startLines(LineReader* reader, FILE* source, char* buffer, size_t size, long lineNo)
+{
+	reader->source = source;
+	reader->text = buffer;
+	reader->length = 0;
+	reader->size = size;
+	reader->firstText = buffer;
+	reader->bytesRead = 0;
+	reader->lineNo = lineNo;
+
+	reader->text[0] = '\0';
+}
+
+/**
+ * Frees any buffer a line reader allocated to hold long lines.
+ */
+static void endLines(LineReader* reader)
+{
+	if (reader->text != reader->firstText)
+	{
+		free(reader->text);
+	}
+}
+
+/**
+ * Reads the next line of the file into the reader's text, reading up to and
+ * including its newline but not storing it (or a carriage return before it).
+ * The buffer doubles whenever the line doesn't fit, so no part of the line
+ * is lost and the next read starts exactly at the following line. Returns
+ * FALSE, with an empty line, at the end of the file.
+ */
+static int readLine(LineReader* reader)
+{
+	char* larger;
+	int ch;
+	int gotLine;
+
+	reader->length = 0;
+	gotLine = FALSE;
+	ch = getc_unlocked(reader->source);
+
+	while (ch != EOF && ch != '\n')
+	{
+		gotLine = TRUE;
+
+		/* keep room for the null terminator */
+		if (reader->length + 1 == reader->size)
+		{
+			larger = (char*)malloc(reader->size * 2);
+			memcpy(larger, reader->text, reader->length);
+			endLines(reader);
+			reader->text = larger;
+			reader->size *= 2;
+		}
+
+		reader->text[reader->length] = (char)ch;
+		reader->length++;
+		ch = getc_unlocked(reader->source);
+	}
+
+	if (ch == '\n')
+	{
+		gotLine = TRUE;
+		reader->bytesRead++;
+	}
+	if (gotLine == TRUE)
+	{
+		reader->lineNo++;
+	}
+	reader->bytesRead += reader->length;
+
+	if (reader->length > 0 && reader->text[reader->length - 1] == '\r')
+	{
+		reader->length--;
+	}
+	reader->text[reader->length] = '\0';
+
+	return gotLine;
+}
+
+/**
+ * Skips the rest of an entry, up to and including the blank line that ends
+ * it, looking at each byte once and storing none of them.
+ */
+static void skipEntry(LineReader* reader)
+{
+	int ch;
+	int blank;
+
+	/* the line last read has been read up to its newline */
+	blank = TRUE;
+	ch = getc_unlocked(reader->source);
+
+	/* stop after a line holding nothing, or only a carriage return */
+	while (ch != EOF && (ch != '\n' || blank == FALSE))
+	{
+		reader->bytesRead++;
+
+		if (ch == '\n')
+		{
+			blank = TRUE;
+			reader->lineNo++;
+		}
+		else if (ch != '\r')
+		{
+			blank = FALSE;
+		}
+
+		ch = getc_unlocked(reader->source);
+	}
+
+	if (ch == '\n')
+	{
+		reader->bytesRead++;
+		reader->lineNo++;
+	}
+}
+
+/**
+ * Adds an entry whose date, time or duration failed eventValid to report,
+ * naming the first of them that is invalid.
+ */
+static void reportEventFields(ValidationReport* report, long line, int inYear, int inMonth, int inDay,
+	int inHours, int inMins)
+{
+	if (eventValid(inYear, inMonth, inDay, 0, 0, 1) == FALSE)
+	{
+		reportInvalid(report, line, "date", "not a valid date");
+	}
+	else if (eventValid(2000, 1, 1, inHours, inMins, 1) == FALSE)
+	{
+		reportInvalid(report, line, "time", "not a valid time");
+	}
+	else
+	{
+		reportInvalid(report, line, "duration", "not a positive number of minutes");
+	}
+}
+
+/**
+ * Returns the function for reading entries from the named file:
+ * readIcsEntry for iCalendar (.ics) files and readEntry for anything else.
+ */
+EntryReader entryReaderFor(char* filename)
+{
+	EntryReader reader;
+
+	reader = &readEntry;
+	if (isIcsFile(filename) == TRUE)
+	{
+		reader = &readIcsEntry;
+	}
+
+	return reader;
+}
+
+/**
+ * Reads every entry in the named file onto the passed-in list, without using
+ * the gui or a background thread. The events are gathered into one batch and
+ * added with bulkInsert, so a list in order of start time stays so. Each
+ * invalid entry skipped is added to report, which may be NULL. Archives
+ * (.calz) are read month by month. Returns the number of events added, or -1
+ * if the file couldn't be opened.
+ */
+long loadFile(LinkedList* list, char* filename, ValidationReport* report)
+{
+	FILE* source;
+	EntryReader readNext;
+	Event* newEvent;
+	Event** batch;
+	long batchSize;
+	long loaded;
+	int result;
+
+	loaded = -1;
+
+	/* archives are read a block at a time rather than an entry at a time */
+	if (isArchiveFile(filename) == TRUE)
+	{
+		loaded = loadArchiveRange(list, filename, LONG_MIN, LONG_MAX, report);
+	}
+	else
+	{
+		source = fopen(filename, "r");
+
+		if (source != NULL)
+		{
+			readNext = entryReaderFor(filename);
+			loaded = 0;
+			batchSize = FIRST_BATCH;
+			batch = (Event**)malloc(batchSize * sizeof(Event*));
+
+			do
+			{
+				result = (*readNext)(source, &newEvent, report);
+
+				if (result == ENTRY_VALID)
+				{
+					if (loaded == batchSize)
+					{
+						batchSize *= 2;
+						batch = (Event**)realloc(batch, batchSize * sizeof(Event*));
+					}
+					batch[loaded] = newEvent;
+					loaded++;
+				}
+			} while (result != ENTRY_NONE);
+
+			bulkInsert(list, batch, loaded);
+			free(batch);
+			fclose(source);
+		}
+	}
+
+	return loaded;
+}
+
+/**
+ * Reads the next entry from a calendar file. If the entry holds valid event
+ * data, a new Event is created, stored in outEvent and ENTRY_VALID is
+ * returned. Entries with invalid data are skipped over, added to report
+ * (which may be NULL) with their line and why they are invalid, and
+ * ENTRY_INVALID is returned. ENTRY_NONE is returned once the end of the file
+ * is reached. Lines of any length are read whole, so an activity or location too long
+ * to keep makes its entry invalid rather than running into the next line,
+ * and a malformed entry is skipped up to the blank line that ends it.
+ */
+int readEntry(FILE* source, Event** outEvent, ValidationReport* report)
+{
+	LineReader reader;
+	char firstText[MAX_EVENT_TEXT];
+	Event* newEvent;
+	char* activity;
+	char* field;
+	char* reason;
+	int tempYear;
+	int tempMonth;
+	int tempDay;
+	int tempHrs;
+	int tempMins;
+	int tempDuration;
+	int fieldsEnd;
+	int result;
+	int valid;
+	long entryLine;
+	long startTime;
+	long validStart;
+
+	startTime = STATS_BEGIN();
+	flockfile(source);
+	startLines(&reader, source, firstText, MAX_EVENT_TEXT, (report != NULL) ? report->linesRead : 0);
+	result = ENTRY_NONE;
+	*outEvent = NULL;
+
+	/* scan until an entry is found or the end of file is reached */
+	while (result == ENTRY_NONE && readLine(&reader) == TRUE)
+	{
+		entryLine = reader.lineNo;
+
+		/* blank lines between entries are skipped */
+		if (reader.length == 0)
+		{
+		}
+		/* check that line is formatted as event data */
+		else if (sscanf(reader.text, "%d-%d-%d %d:%d %d%n", &tempYear, &tempMonth, &tempDay, &tempHrs, &tempMins, &tempDuration, &fieldsEnd) == 6)
+		{
+			/* remainder of line will contain the activity */
+			activity = reader.text + fieldsEnd;
+			activity += strspn(activity, " \t");
+
+			/* validate scanned values */
+			validStart = STATS_BEGIN();
+			valid = eventValid(tempYear, tempMonth, tempDay, tempHrs, tempMins, tempDuration);
+			STATS_END(STAT_VALIDATE, validStart, 1);
+
+			/* text too long to be kept whole is rejected rather than cut short */
+			if (valid == TRUE && strlen(activity) < MAX_ACTIVITY)
+			{
+				newEvent = createEvent();
+				field = NULL;
+				reason = NULL;
+		
+				/* assign scanned values to an event */
+				newEvent->eDate.year = tempYear;
+				newEvent->eDate.month = tempMonth;
+				newEvent->eDate.day = tempDay;
+				newEvent->eTime.hrs = tempHrs;
+				newEvent->eTime.mins = tempMins;
+				newEvent->duration = tempDuration;
+				newEvent->activity = internText(activity);
+
+				/* next line will have a location, a repeat rule, a zone or be a blank line */
+				readLine(&reader);
+
+				/* if newly scanned line contains a location */
+				if (reader.length > 0 && strncmp(reader.text, REPEAT_PREFIX, strlen(REPEAT_PREFIX)) != 0 &&
+					strncmp(reader.text, ZONE_PREFIX, strlen(ZONE_PREFIX)) != 0)
+				{
+					/* assign location */
+					if (reader.length < MAX_LOCATION)
+					{
+						newEvent->location = internText(reader.text);
+					}
+					else
+					{
+						field = "location";
+						reason = "too long";
+					}
+
+					/* read next line, a repeat rule, a zone or an empty line */
+					readLine(&reader);
+				}
+
+				/* if newly scanned line contains a repeat rule */
+				if (strncmp(reader.text, REPEAT_PREFIX, strlen(REPEAT_PREFIX)) == 0)
+				{
+					newEvent->repeat = (Recurrence*)malloc(sizeof(Recurrence));
+					if (parseRecurrence(reader.text + strlen(REPEAT_PREFIX), newEvent->repeat) == FALSE && field == NULL)
+					{
+						field = "repeat";
+						reason = "not a valid repeat rule";
+					}
+
+					/* read next line, a zone or an empty line */
+					readLine(&reader);
+				}
+
+				/* if newly scanned line names the event's time zone */
+				if (strncmp(reader.text, ZONE_PREFIX, strlen(ZONE_PREFIX)) == 0)
+				{
+					newEvent->zone = findZone(reader.text + strlen(ZONE_PREFIX));
+					if (newEvent->zone == NULL && field == NULL)
+					{
+						field = "zone";
+						reason = "not a known time zone";
+					}
+
+					/* read next empty line */
+					readLine(&reader);
+				}
+
+				/* anything more before the blank line means the entry is malformed */
+				if (reader.length > 0)
+				{
+					skipEntry(&reader);
+					if (field == NULL)
+					{
+						field = "entry";
+						reason = "extra lines before the blank line ending it";
+					}
+				}
+		
+				if (field == NULL)
+				{
+					*outEvent = newEvent;
+					result = ENTRY_VALID;
+				}
+				else
+				{
+					releaseEvent(newEvent);
+					reportInvalid(report, entryLine, field, reason);
+					result = ENTRY_INVALID;
+				}
+			}
+
+			/* if event data was invalid, scan lines from entry but don't create an event */
+			else
+			{
+				if (valid == TRUE)
+				{
+					reportInvalid(report, entryLine, "activity", "too long");
+				}
+				else
+				{
+					reportEventFields(report, entryLine, tempYear, tempMonth, tempDay, tempHrs, tempMins);
+				}
+
+				skipEntry(&reader);
+				result = ENTRY_INVALID;
+			}
+		}
+		/* if the line isn't event data, skip the entry rather than scanning it again */
+		else
+		{
+			reportInvalid(report, entryLine, "entry", "not formatted as event data");
+			skipEntry(&reader);
+			result = ENTRY_INVALID;
+		}
+	}
+
+	if (report != NULL)
+	{
+		report->linesRead = reader.lineNo;
+	}
+
+	STATS_END(STAT_PARSE, startTime, reader.bytesRead);
+	endLines(&reader);
+	funlockfile(source);
+
+	return result;
+}
+
+/**
+ * Writes the text of formatted chunks, one after another, to a file from
+ * offset on, with as few pwritev calls as it takes. Returns FALSE if
+ * writing failed.
+ */
+static int writeChunksAt(int fd, FormatChunk* chunks, int numChunks, off_t offset)
+{
+	struct iovec parts[MAX_FORMAT_THREADS];
+	struct iovec* next;
+	ssize_t written;
+	int numParts;
+	int ii;
+
+	for (ii = 0; ii < numChunks; ii++)
+	{
+		parts[ii].iov_base = chunks[ii].text;
+		parts[ii].iov_len = chunks[ii].length;
+	}
+
+	next = parts;
+	numParts = numChunks;
+	written = 0;
+
+	/* a short write carries on from where it stopped, one that writes
+	 * nothing has failed
+	 */
+	while (numParts > 0 && written >= 0)
+	{
+		while (numParts > 0 && (size_t)written >= next->iov_len)
+		{
+			written -= next->iov_len;
+			next++;
+			numParts--;
+		}
+
+		if (numParts > 0)
+		{
+			next->iov_base = (char*)next->iov_base + written;
+			next->iov_len -= written;
+
+			written = pwritev(fd, next, numParts, offset);
+			offset += written;
+			written = (written == 0) ? -1 : written;
+		}
+	}
+
+	return written >= 0;
+}
+
+/**
+ * Writes the events of a snapshot in calendar text format, formatting
+ * numChunks runs at a time in parallel with formatChunks. Each round's runs
+ * go straight to the file at the offsets their lengths add up to, or, if
+ * the file can't seek (such as a pipe), through dest in order. Returns the
+ * number of bytes written, or -1 if writing failed.
+ */
+static long writeParallel(FILE* dest, ListSnapshot* snapshot, int numChunks)
+{
+	FormatChunk chunks[MAX_FORMAT_THREADS];
+	off_t offset;
+	long bytesWritten;
+	long round;
+	long done;
+	int fd;
+	int ii;
+
+	bytesWritten = 0;
+	fflush(dest);
+	fd = fileno(dest);
+	offset = lseek(fd, 0, SEEK_CUR);
+
+	for (done = 0; done < snapshot->count && bytesWritten >= 0; done += round)
+	{
+		round = (long)numChunks * FORMAT_CHUNK;
+		round = (snapshot->count - done < round) ? snapshot->count - done : round;
+
+		formatChunks(snapshot->events + done, NULL, round, RENDER_TEXT, chunks, numChunks);
+
+		if (offset >= 0 && writeChunksAt(fd, chunks, numChunks, offset + bytesWritten) == FALSE)
+		{
+			bytesWritten = -1;
+		}
+
+		for (ii = 0; ii < numChunks; ii++)
+		{
+			if (offset < 0 && bytesWritten >= 0)
+			{
+				fwrite(chunks[ii].text, 1, chunks[ii].length, dest);
+			}
+			if (bytesWritten >= 0)
+			{
+				bytesWritten += chunks[ii].length;
+			}
+			free(chunks[ii].text);
+		}
+	}
+
+	/* the stream carries on after what was written around it */
+	if (offset >= 0 && bytesWritten >= 0)
+	{
+		fseek(dest, (long)offset + bytesWritten, SEEK_SET);
+	}
+
+	return bytesWritten;
+}
+
+/**
+ * Writes every event in the passed-in snapshot to a file in calendar text
+ * format, one event at a time rather than building the whole file in memory.
+ * Large snapshots are formatted in parallel, a round of runs at a time (see
+ * formatChunks), and each round written with one pwritev.
+ * Returns the number of bytes written, or -1 if writing failed.
+ */
+long writeSnapshot(FILE* dest, ListSnapshot* snapshot)
+{
+	char eventText[MAX_EVENT_TEXT];
+	int numChunks;
+	int length;
+	int ii;
+	long startTime;
+	long bytesWritten;
+
+	startTime = STATS_BEGIN();
+	bytesWritten = 0;
+	numChunks = formatChunkCount(snapshot->count);
+
+	if (numChunks > 1)
+	{
+		bytesWritten = writeParallel(dest, snapshot, numChunks);
+	}
+	else
+	{
+		for (ii = 0; ii < snapshot->count; ii++)
+		{
+			length = renderEvent(eventText, snapshot->events[ii], RENDER_TEXT);
+			fwrite(eventText, 1, length, dest);
+			bytesWritten += length;
+		}
+	}
+
+	STATS_END(STAT_SAVE, startTime, bytesWritten);
+
+	if (ferror(dest) != 0)
+	{
+		bytesWritten = -1;
+	}
+
+	return bytesWritten;
+}
+
+/**
+ * Checks that the passed-in variables represent a valid date, time and duration
+ * to go in an Event struct. Allows Feb 29th as a valid date on leap years.
+ */
+int eventValid(int inYear, int inMonth, int inDay, int inHours, int inMins, int inDuration)
+{
+	int dateValid = FALSE;
+	int timeValid = FALSE;
+	int durationValid = FALSE;
+	int allValid = FALSE;
+
+	/* validate date */
+    if ( (inYear >= 1) && (inYear <= 3000) )
+    {
+        if ( (inMonth >= 1) && (inMonth <= 12) )
+        {
+            switch(inMonth)
+            {
+                case 1: case 3: case 5: case 7: case 8: case 10: case 12:
+                    if ( (inDay > 0) && (inDay < 32) )
+					{
+                        dateValid = TRUE;
+					}
+                    break;
+                case 4: case 6: case 9: case 11:
+                    if ( (inDay > 0) && (inDay < 31) )
+					{
+                        dateValid = TRUE;
+					}
+                    break;
+                case 2:
+                    if ( isLeapYear(inYear) == TRUE)
+                    {
+                        if ( (inDay > 0) && (inDay < 30) )
+						{
+                            dateValid = TRUE;
+						}
+                    }
+                    else if ( isLeapYear(inYear) == FALSE)
+                    {
+                        if ( (inDay > 0) && (inDay < 29) )
+						{
+                            dateValid = TRUE;
+						}
+                    }
+                default:
+                    break;
+            }
+        }
+    }
+
+	/* validate time */
+	if (inHours >= 0 && inHours <= 23)
+	{
+		if (inMins >= 0 && inMins <= 59)
+		{
+			timeValid = TRUE;
+		}
+	}
+
+	/* validate duration */
+	if (inDuration > 0)
+	{
+		durationValid = TRUE;
+	}
+
+	if (dateValid == TRUE && timeValid == TRUE && durationValid == TRUE)
+	{
+		allValid = TRUE;
+	}
+
+	return allValid;
+}
+
+/**
+ * Determines whether a year is a leap year.
+ */
+int isLeapYear(int year)
+{
+	int leapYear = FALSE;
+
+	if ( (year % 4 == 0) && ( (year % 100 != 0) || (year % 400 == 0) ) )
+	{
+        leapYear = TRUE;
+	}
+
+	return leapYear;
+}
@@ -0,0 +1,74 @@
+/**
+ * Contains functions for reading and writing calendar text files and
+ * validating the events they contain. None of these functions use the gui, so they can be
+ * called from a background thread.
+ *
+ * Author: Alex Burress
+ */
+
+#ifndef CALFILE_H
+#define CALFILE_H
+#include "linkedList.h"
+#include "calReport.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* results of reading one entry from a calendar file */
+#define ENTRY_NONE 0
+#define ENTRY_VALID 1
+#define ENTRY_INVALID 2
+
+/**
+ * A function that reads the next entry from a file, such as readEntry.
+ */
+typedef int (*EntryReader)(FILE* source, Event** outEvent, ValidationReport* report);
+
+/**
+ * Returns the function for reading entries from the named file:
+ * readIcsEntry for iCalendar (.ics) files and readEntry for anything else.
+ */
+EntryReader entryReaderFor(char* filename);
+
+/**
+ * Reads every entry in the named file onto the passed-in list, without using
+ * the gui or a background thread. The events are gathered into one batch and
+ * added with bulkInsert, so a list in order of start time stays so. Each
+ * invalid entry skipped is added to report, which may be NULL. Archives
+ * (.calz) are read month by month. Returns the number of events added, or -1
+ * if the file couldn't be opened.
+ */
+long loadFile(LinkedList* list, char* filename, ValidationReport* report);
+
+/**
+ * Reads the next entry from a calendar file. If the entry holds valid event
+ * data, a new Event is created, stored in outEvent and ENTRY_VALID is
+ * returned. Entries with invalid data are skipped over, added to report
+ * (which may be NULL) with their line and why they are invalid, and
+ * ENTRY_INVALID is returned. ENTRY_NONE is returned once the end of the file
+ * is reached. Lines of any length are read whole, so an activity or location too long
+ * to keep makes its entry invalid rather than running into the next line,
+ * and a malformed entry is skipped up to the blank line that ends it.
+ */
+int readEntry(FILE* source, Event** outEvent, ValidationReport* report);
+
+/**
+ * Writes every event in the passed-in snapshot to a file in calendar text
+ * format, one event at a time rather than building the whole file in memory.
+ * Large snapshots are formatted in parallel, a round of runs at a time (see
+ * formatChunks), and each round written with one pwritev.
+ * Returns the number of bytes written, or -1 if writing failed.
+ */
+long writeSnapshot(FILE* dest, ListSnapshot* snapshot);
+
+/**
+ * Checks that the passed-in variables represent a valid date, time and duration
+ * to go in an Event struct. Allows Feb 29th as a valid date on leap years.
+ */
+int eventValid(int inYear, int inMonth, int inDay, int inHours, int inMins, int inDuration);
+
+/**
+ * Determines whether a year is a leap year.
+ */
+int isLeapYear(int year);
+
+#endif
@@ -0,0 +1,476 @@
+/**
+ * Contains an undo/redo history of the changes made to calendar lists. Each
+ * change is kept as a small record holding the handle of each event it
+ * changed, so undoing or redoing it never searches the list. An edit keeps
+ * the events it swapped in and out, which are shared with the lists by
+ * reference counting, and a deleted event's node is kept off its list, with
+ * where it was, so it can be put back in the same place. The history costs
+ * memory in proportion to the changes made rather than to the size of the
+ * calendars. Lists are taken to be kept in order of start time (startKey).
+ *
+ * Author: Alex Burress
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "calHistory.h"
+#include "calSort.h"
+#define FALSE 0
+#define TRUE !FALSE
+
+/**
+ * Releases the history's hold on the events of a record, frees the nodes of
+ * added or deleted events it kept off their lists, and frees its items.
+ */
+static void releaseRecord(ChangeRecord* record)
+{
+	ChangeItem* item;
+	int ii;
+
+	for (ii = 0; ii < record->count; ii++)
+	{
+		item = &record->items[ii];
+
+		if (record->kind != CHANGE_EDIT)
+		{
+			dropHandle(item->list, item->place.handle);
+		}
+		if (item->before != NULL)
+		{
+			releaseEvent(item->before);
+		}
+		if (item->after != NULL)
+		{
+			releaseEvent(item->after);
+		}
+	}
+
+	free(record->items);
+	record->items = NULL;
+	record->count = 0;
+}
+
+/**
+ * Adds a record of the count changes in items, which it takes over, after
+ * the last change that can be undone, forgetting anything that could be
+ * redone, and the oldest change if the history is full.
+ */
+static void pushRecord(History* history, int kind, ChangeItem* items, int count)
+{
+	ChangeRecord* record;
+	int ii;
+
+	/* a new change replaces anything that was undone */
+	for (ii = 0; ii < history->numRedo; ii++)
+	{
+		releaseRecord(&history->records[(history->first + history->numUndo + ii) % MAX_UNDO]);
+	}
+	history->numRedo = 0;
+
+	/* forget the oldest change to make room */
+	if (history->numUndo == MAX_UNDO)
+	{
+		releaseRecord(&history->records[history->first]);
+		history->first = (history->first + 1) % MAX_UNDO;
+		history->numUndo--;
+	}
+
+	record = &history->records[(history->first + history->numUndo) % MAX_UNDO];
+	record->kind = kind;
+	record->count = count;
+	record->items = items;
+
+	history->numUndo++;
+}
+
+/**
+ * Records a change to a single event, retaining the events of the change.
+ * Returns the change's item.
+ */
+static ChangeItem* pushItem(History* history, int kind, LinkedList* list, EventHandle handle, Event* before,
+	Event* after)
+{
+	ChangeItem* item;
+
+	item = (ChangeItem*)malloc(sizeof(ChangeItem));
+	item->list = list;
+	item->place.handle = handle;
+	item->before = before;
+	item->after = after;
+
+	if (before != NULL)
+	{
+		retainEvent(before);
+	}
+	if (after != NULL)
+	{
+		retainEvent(after);
+	}
+
+	pushRecord(history, kind, item, 1);
+
+	return item;
+}
+
+/**
+ * Undoes the change to one event, or redoes it if undo is FALSE. An added
+ * or deleted event is taken off its list, keeping its node and where it
+ * was, or put back where it was; an edited event is pointed at the version
+ * of it from before or after the edit, and is left for applyRecord to
+ * move if its start changed. Returns FALSE if the list no longer
+ * matches the item, as when it has been changed without the history.
+ */
+static int applyItem(int kind, ChangeItem* item, int undo)
+{
+	Event* to;
+	int applied;
+
+	if (kind == CHANGE_EDIT)
+	{
+		to = (undo == TRUE) ? item->before : item->after;
+		retainEvent(to);
+		applied = replaceHandle(item->list, item->place.handle, to);
+
+		if (applied == FALSE)
+		{
+			releaseEvent(to);
+		}
+	}
+	/* undoing an add, or redoing a delete, takes the event off */
+	else if ((kind == CHANGE_ADD) == (undo == TRUE))
+	{
+		applied = detachHandle(item->list, &item->place);
+	}
+	else
+	{
+		applied = reattachHandle(item->list, &item->place, &startKey);
+	}
+
+	return applied;
+}
+
+/**
+ * Returns TRUE if the change to one event can be undone, or redone if undo
+ * is FALSE: the event to take off or edit is on its list, or the event to
+ * put back is off it.
+ */
+static int canApplyItem(int kind, ChangeItem* item, int undo)
+{
+	int applicable;
+
+	if (kind == CHANGE_EDIT || (kind == CHANGE_ADD) == (undo == TRUE))
+	{
+		applicable = (lookupHandle(item->list, item->place.handle) != NULL);
+	}
+	else
+	{
+		applicable = isDetached(item->list, item->place.handle);
+	}
+
+	return applicable;
+}
+
+/**
+ * Moves the events of an edit record whose starts changed to keep their
+ * lists in order of start time, all the events of each list together, as
+ * reorderHandles does, so a bulk edit costs one pass over each list.
+ */
+static void reorderRecord(ChangeRecord* record)
+{
+	EventHandle* handles;
+	int first;
+	int last;
+
+	handles = (EventHandle*)malloc(record->count * sizeof(EventHandle));
+
+	/* a record's items are grouped by list */
+	for (first = 0; first < record->count; first = last)
+	{
+		for (last = first; last < record->count && record->items[last].list == record->items[first].list; last++)
+		{
+			handles[last - first] = record->items[last].place.handle;
+		}
+
+		reorderHandles(record->items[first].list, handles, last - first, &startKey);
+	}
+
+	free(handles);
+}
+
+/**
+ * Undoes a record's change, the last event changed first, or redoes it,
+ * the first first, if undo is FALSE. Every event is checked before any is
+ * changed, so a record that no longer matches the lists changes nothing.
+ * Returns FALSE if the lists no longer match the record.
+ */
+static int applyRecord(ChangeRecord* record, int undo)
+{
+	int applied;
+	int ii;
+
+	applied = TRUE;
+
+	for (ii = 0; ii < record->count && applied == TRUE; ii++)
+	{
+		applied = canApplyItem(record->kind, &record->items[ii], undo);
+	}
+
+	for (ii = 0; ii < record->count && applied == TRUE; ii++)
+	{
+		applied = applyItem(record->kind, &record->items[(undo == TRUE) ? record->count - 1 - ii : ii], undo);
+	}
+
+	if (applied == TRUE && record->kind == CHANGE_EDIT)
+	{
+		reorderRecord(record);
+	}
+
+	return applied;
+}
+
+/**
+ * Returns the total number of events on the passed-in lists.
+ */
+static int countEvents(LinkedList** lists, int numLists)
+{
+	int total;
+	int ii;
+
+	total = 0;
+	for (ii = 0; ii < numLists; ii++)
+	{
+		total += lists[ii]->count;
+	}
+
+	return total;
+}
+
+/**
+ * Initialises an empty history.
+ */
+void initHistory(History* history)
+{
+	history->first = 0;
+	history->numUndo = 0;
+	history->numRedo = 0;
+}
+
+/**
+ * Forgets every change in a history, releasing its hold on their events.
+ * Must be called before any list the history refers to is freed.
+ */
+void clearHistory(History* history)
+{
+	int ii;
+
+	for (ii = 0; ii < history->numUndo + history->numRedo; ii++)
+	{
+		releaseRecord(&history->records[(history->first + ii) % MAX_UNDO]);
+	}
+
+	initHistory(history);
+}
+
+/**
+ * Records that an event was inserted on a list, given the handle it was
+ * inserted with. Anything that could be redone is forgotten.
+ */
+void recordAdd(History* history, LinkedList* list, EventHandle added)
+{
+	pushItem(history, CHANGE_ADD, list, added, NULL, NULL);
+}
+
+/**
+ * Records that the event before, that handle referred to on a list, was
+ * replaced by after. before must be kept unmodified from here on, which the
+ * list's copy-on-write editing does once the history holds it. Anything
+ * that could be redone is forgotten.
+ */
+void recordEdit(History* history, LinkedList* list, EventHandle handle, Event* before, Event* after)
+{
+	pushItem(history, CHANGE_EDIT, list, handle, before, after);
+}
+
+/**
+ * Deletes the event a handle refers to from a list, and records the delete.
+ * The event's node is kept off the list rather than freed, along with the
+ * events either side of it, so the delete is undone without searching the
+ * list. Anything that could be redone is forgotten. Returns FALSE, recording
+ * nothing, if the event isn't on the list.
+ */
+int recordDelete(History* history, LinkedList* list, EventHandle deleted)
+{
+	int recorded;
+
+	recorded = (lookupHandle(list, deleted) != NULL);
+
+	if (recorded == TRUE)
+	{
+		detachHandle(list, &pushItem(history, CHANGE_DELETE, list, deleted, NULL, NULL)->place);
+	}
+
+	return recorded;
+}
+
+/**
+ * Deletes every event whose activity contains inActivity from each of the
+ * passed-in lists, as deleteMatching does, and records the deletes as one
+ * change, so a single undo puts every event back where it was. Returns the
+ * number of events deleted; nothing is recorded if there were none.
+ */
+int recordDeleteMatching(History* history, LinkedList** lists, int numLists, char* inActivity)
+{
+	ChangeItem* items;
+	EventPlace* places;
+	int total;
+	int deleted;
+	int found;
+	int ii;
+	int jj;
+
+	total = countEvents(lists, numLists) + 1;
+	items = (ChangeItem*)malloc(total * sizeof(ChangeItem));
+	places = (EventPlace*)malloc(total * sizeof(EventPlace));
+	deleted = 0;
+
+	for (ii = 0; ii < numLists; ii++)
+	{
+		found = deleteMatching(lists[ii], inActivity, places);
+
+		for (jj = 0; jj < found; jj++)
+		{
+			items[deleted].list = lists[ii];
+			items[deleted].place = places[jj];
+			items[deleted].before = NULL;
+			items[deleted].after = NULL;
+			deleted++;
+		}
+	}
+	free(places);
+
+	if (deleted > 0)
+	{
+		pushRecord(history, CHANGE_DELETE, (ChangeItem*)realloc(items, deleted * sizeof(ChangeItem)), deleted);
+	}
+	else
+	{
+		free(items);
+	}
+
+	return deleted;
+}
+
+/**
+ * Calls update on every event whose activity contains inActivity on each
+ * of the passed-in lists, as updateMatching does, and records the events it
+ * changed as one edit, so a single undo restores all of them. Returns the
+ * number of events changed; nothing is recorded if there were none.
+ */
+int recordUpdateMatching(History* history, LinkedList** lists, int numLists, char* inActivity, EventUpdate update,
+	void* arg)
+{
+	ChangeItem* items;
+	EventHandle* handles;
+	Event** before;
+	int total;
+	int updated;
+	int found;
+	int ii;
+	int jj;
+
+	total = countEvents(lists, numLists) + 1;
+	items = (ChangeItem*)malloc(total * sizeof(ChangeItem));
+	handles = (EventHandle*)malloc(total * sizeof(EventHandle));
+	before = (Event**)malloc(total * sizeof(Event*));
+	updated = 0;
+
+	for (ii = 0; ii < numLists; ii++)
+	{
+		found = updateMatching(lists[ii], inActivity, update, arg, &startKey, handles, before);
+
+		/* the history takes over the hold on each event from before */
+		for (jj = 0; jj < found; jj++)
+		{
+			items[updated].list = lists[ii];
+			items[updated].place.handle = handles[jj];
+			items[updated].before = before[jj];
+			items[updated].after = lookupHandle(lists[ii], handles[jj]);
+			retainEvent(items[updated].after);
+			updated++;
+		}
+	}
+	free(handles);
+	free(before);
+
+	if (updated > 0)
+	{
+		pushRecord(history, CHANGE_EDIT, (ChangeItem*)realloc(items, updated * sizeof(ChangeItem)), updated);
+	}
+	else
+	{
+		free(items);
+	}
+
+	return updated;
+}
+
+/**
+ * Undoes the most recent change that hasn't been undone. Returns FALSE if
+ * there is nothing to undo.
+ */
+int undoChange(History* history)
+{
+	ChangeRecord* record;
+	int undone;
+
+	undone = FALSE;
+
+	if (history->numUndo > 0)
+	{
+		record = &history->records[(history->first + history->numUndo - 1) % MAX_UNDO];
+		undone = applyRecord(record, TRUE);
+
+		/* the list no longer matches the history, nothing can be undone */
+		if (undone == FALSE)
+		{
+			clearHistory(history);
+		}
+		else
+		{
+			history->numUndo--;
+			history->numRedo++;
+		}
+	}
+
+	return undone;
+}
+
+/**
+ * Redoes the most recently undone change. Returns FALSE if there is nothing
+ * to redo.
+ */
+int redoChange(History* history)
+{
+	ChangeRecord* record;
+	int redone;
+
+	redone = FALSE;
+
+	if (history->numRedo > 0)
+	{
+		record = &history->records[(history->first + history->numUndo) % MAX_UNDO];
+		redone = applyRecord(record, FALSE);
+
+		if (redone == FALSE)
+		{
+			clearHistory(history);
+		}
+		else
+		{
+			history->numUndo++;
+			history->numRedo--;
+		}
+	}
+
+	return redone;
+}
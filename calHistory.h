@@ -0,0 +1,127 @@
+/**
+ * Contains an undo/redo history of the changes made to calendar lists. Each
+ * change is kept as a small record holding the handle of each event it
+ * changed, so undoing or redoing it never searches the list. An edit keeps
+ * the events it swapped in and out, which are shared with the lists by
+ * reference counting, and a deleted event's node is kept off its list, with
+ * where it was, so it can be put back in the same place. The history costs
+ * memory in proportion to the changes made rather than to the size of the
+ * calendars. Lists are taken to be kept in order of start time (startKey).
+ *
+ * Author: Alex Burress
+ */
+
+#ifndef CALHISTORY_H
+#define CALHISTORY_H
+#include "linkedList.h"
+
+/* the kinds of change a history record can hold */
+#define CHANGE_ADD 1
+#define CHANGE_EDIT 2
+#define CHANGE_DELETE 3
+
+/* the most changes that can be undone, older changes are forgotten */
+#define MAX_UNDO 500
+
+/**
+ * The change made to one event. place holds the event's handle and, for an
+ * add or delete, the events either side of it when it was last taken off
+ * its list (by the delete, or by undoing the add); its node is kept off the
+ * list until the change is forgotten. For an edit, before and after are the
+ * events the change swapped out and in, which the history holds its own
+ * reference to, and are NULL otherwise.
+ */
+typedef struct ChangeItem {
+	LinkedList* list;
+	EventPlace place;
+	Event* before;
+	Event* after;
+} ChangeItem;
+
+/**
+ * One change that is undone and redone as a whole: count changes of the
+ * same kind, to one event each, such as every event a bulk delete took off
+ * any of the open calendars.
+ */
+typedef struct ChangeRecord {
+	int kind;
+	int count;
+	ChangeItem* items;
+} ChangeRecord;
+
+/**
+ * A ring of change records. The oldest record is at first, numUndo records
+ * from there can be undone, and the numRedo records after those can be
+ * redone.
+ */
+typedef struct History {
+	ChangeRecord records[MAX_UNDO];
+	int first;
+	int numUndo;
+	int numRedo;
+} History;
+
+/**
+ * Initialises an empty history.
+ */
+void initHistory(History* history);
+
+/**
+ * Forgets every change in a history, releasing its hold on their events.
+ * Must be called before any list the history refers to is freed.
+ */
+void clearHistory(History* history);
+
+/**
+ * Records that an event was inserted on a list, given the handle it was
+ * inserted with. Anything that could be redone is forgotten.
+ */
+void recordAdd(History* history, LinkedList* list, EventHandle added);
+
+/**
+ * Records that the event before, that handle referred to on a list, was
+ * replaced by after. before must be kept unmodified from here on, which the
+ * list's copy-on-write editing does once the history holds it. Anything
+ * that could be redone is forgotten.
+ */
+void recordEdit(History* history, LinkedList* list, EventHandle handle, Event* before, Event* after);
+
+/**
+ * Deletes the event a handle refers to from a list, and records the delete.
+ * The event's node is kept off the list rather than freed, along with the
+ * events either side of it, so the delete is undone without searching the
+ * list. Anything that could be redone is forgotten. Returns FALSE, recording
+ * nothing, if the event isn't on the list.
+ */
+int recordDelete(History* history, LinkedList* list, EventHandle deleted);
+
+/**
+ * Deletes every event whose activity contains inActivity from each of the
+ * passed-in lists, as deleteMatching does, and records the deletes as one
+ * change, so a single undo puts every event back where it was. Returns the
+ * number of events deleted; nothing is recorded if there were none.
+ */
+int recordDeleteMatching(History* history, LinkedList** lists, int numLists, char* inActivity);
+
+/**
+ * Calls update on every event whose activity contains inActivity on each
+ * of the passed-in lists, as updateMatching does, and records the events it
+ * changed as one edit, so a single undo restores all of them. Returns the
+ * number of events changed; nothing is recorded if there were none.
+ */
+int recordUpdateMatching(History* history, LinkedList** lists, int numLists, char* inActivity, EventUpdate update,
+	void* arg);
+
+/**
+ * Undoes the most recent change that hasn't been undone. Returns FALSE if
+ * there is nothing to undo.
+ */
+int undoChange(History* history);
+
+/**
+ * Redoes the most recently undone change. Returns FALSE if there is nothing
+ * to redo.
+ */
+int redoChange(History* history);
+
+#endif
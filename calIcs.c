@@ -0,0 +1,1090 @@
+/**
+ * Contains functions for reading and writing iCalendar (.ics) files. Files
+ * are streamed one event at a time, so a feed of any size is read or written
+ * in a fixed amount of memory. None of these functions use the gui, so they
+ * can be called from a background thread.
+ *
+ * Author: Alex Burress
+ */
+
+/* for getc_unlocked and flockfile */
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include "linkedList.h"
+#include "calFile.h"
+#include "calStats.h"
+#include "calDate.h"
+#include "calRecur.h"
+#include "calIcs.h"
+#include "calIntern.h"
+#include "calReport.h"
+#include "calZone.h"
+
+#define FALSE 0
+#define TRUE !FALSE
+
+/* the longest a line can be before it is folded, in bytes */
+#define ICS_FOLD 75
+
+/* the longest property name that is recognised */
+#define MAX_ICS_NAME 16
+
+/* the most occurrences an RRULE COUNT can ask for */
+#define MAX_COUNT 100000
+
+/* names the zone of an event written in UTC, as no VTIMEZONE is written */
+#define ZONE_PROPERTY "X-CAL-TZID"
+
+/* iCalendar names of the repeat frequencies, indexed by REPEAT_ value */
+static const char* frequencyNames[4] = { "", "DAILY", "WEEKLY", "MONTHLY" };
+
+/**
+ * Returns TRUE if the passed-in filename ends in .ics (in any case), so
+ * should be read and written as iCalendar rather than calendar text.
+ */
+int isIcsFile(char* filename)
+{
+	int length;
+	int ics;
+	int ii;
+
+	length = strlen(filename);
+	ics = (length >= 4);
+
+	for (ii = 0; ii < 4 && ics == TRUE; ii++)
+	{
+		ics = (tolower((unsigned char)filename[length - 4 + ii]) == ".ics"[ii]);
+	}
+
+	return ics;
+}
+
+/**
+ * Reads the next line of an iCalendar file into line, joining on any
+ * continuation lines that follow it (those starting with a space or tab) and
+ * dropping line breaks. Characters past MAX_ICS_LINE are read but not kept.
+ * lineNo is increased by the number of lines read. Returns FALSE at the end
+ * of the file. The file must be locked by the caller.
+ */
+static int readIcsLine(FILE* source, char* line, long* lineNo)
+{
+	int ch;
+	int length;
+	int gotLine;
+	int done;
+
+	length = 0;
+	gotLine = FALSE;
+	done = FALSE;
+
+	while (done == FALSE)
+	{
+		ch = getc_unlocked(source);
+
+		if (ch == EOF)
+		{
+			done = TRUE;
+		}
+		else
+		{
+			if (gotLine == FALSE)
+			{
+				gotLine = TRUE;
+				(*lineNo)++;
+			}
+
+			if (ch == '\n')
+			{
+				/* unless the next line is folded onto this one, put its first character back */
+				ch = getc_unlocked(source);
+				if (ch != ' ' && ch != '\t')
+				{
+					if (ch != EOF)
+					{
+						ungetc(ch, source);
+					}
+					done = TRUE;
+				}
+				else
+				{
+					(*lineNo)++;
+				}
+			}
+			else if (ch != '\r' && length < MAX_ICS_LINE - 1)
+			{
+				line[length] = (char)ch;
+				length++;
+			}
+		}
+	}
+
+	line[length] = '\0';
+
+	return gotLine;
+}
+
+/**
+ * Splits a line into its property name, in upper case, and its value.
+ * Parameters between the two are skipped, including any colons in quoted
+ * parameter values. Returns a pointer to the value within line, or NULL if
+ * the line has no value.
+ */
+static char* splitProperty(char* line, char* outName)
+{
+	char* value;
+	int quoted;
+	int ii;
+
+	for (ii = 0; line[ii] != '\0' && line[ii] != ';' && line[ii] != ':' && ii < MAX_ICS_NAME - 1; ii++)
+	{
+		outName[ii] = toupper((unsigned char)line[ii]);
+	}
+	outName[ii] = '\0';
+
+	value = NULL;
+	quoted = FALSE;
+
+	for (ii = 0; line[ii] != '\0' && value == NULL; ii++)
+	{
+		if (line[ii] == '"')
+		{
+			quoted = !quoted;
+		}
+		else if (line[ii] == ':' && quoted == FALSE)
+		{
+			value = line + ii + 1;
+		}
+	}
+
+	return value;
+}
+
+/**
+ * Finds the time zone of a DTSTART or DTEND line whose value starts at
+ * value: the zone named by its TZID parameter, UTC for a time ending in Z,
+ * or NULL for a local time. A TZID that isn't a zone of the tz database,
+ * such as a Windows zone name, is read as local time.
+ */
+static TimeZone* lineZone(char* line, char* value)
+{
+	TimeZone* zone;
+	char zoneName[MAX_ZONE_NAME];
+	char* param;
+	int length;
+	int ii;
+
+	zone = NULL;
+	param = strchr(line, ';');
+
+	while (param != NULL && param < value && zone == NULL)
+	{
+		param++;
+		for (ii = 0; ii < 5 && toupper((unsigned char)param[ii]) == "TZID="[ii]; ii++)
+		{
+		}
+
+		if (ii == 5)
+		{
+			/* the name may be quoted, or start with a / for a global one */
+			param += 5;
+			param += (*param == '"');
+			param += (*param == '/');
+			length = strcspn(param, "\";:");
+
+			if (length < MAX_ZONE_NAME)
+			{
+				memcpy(zoneName, param, length);
+				zoneName[length] = '\0';
+				zone = findZone(zoneName);
+			}
+		}
+
+		param = strchr(param, ';');
+	}
+
+	length = strlen(value);
+	if (zone == NULL && length > 0 && value[length - 1] == 'Z')
+	{
+		zone = findZone("UTC");
+	}
+
+	return zone;
+}
+
+/**
+ * Parses an iCalendar DATE (YYYYMMDD) or DATE-TIME (YYYYMMDDTHHMMSS, with an
+ * optional trailing Z) into outDate and outTime. A date alone is given a time
+ * of midnight and sets outDateOnly. Returns FALSE if the value isn't a valid
+ * date.
+ */
+static int parseIcsDate(char* value, Date* outDate, Time* outTime, int* outDateOnly)
+{
+	int seconds;
+	int valid;
+
+	valid = FALSE;
+	seconds = 0;
+	outTime->hrs = 0;
+	outTime->mins = 0;
+	*outDateOnly = FALSE;
+
+	if (strspn(value, "0123456789") == 8 &&
+		sscanf(value, "%4d%2d%2d", &outDate->year, &outDate->month, &outDate->day) == 3)
+	{
+		if (value[8] == '\0')
+		{
+			*outDateOnly = TRUE;
+			valid = TRUE;
+		}
+		else if (value[8] == 'T' && strspn(value + 9, "0123456789") == 6 &&
+			(value[15] == '\0' || strcmp(value + 15, "Z") == 0))
+		{
+			valid = (sscanf(value + 9, "%2d%2d%2d", &outTime->hrs, &outTime->mins, &seconds) == 3);
+		}
+	}
+
+	if (valid == TRUE)
+	{
+		valid = eventValid(outDate->year, outDate->month, outDate->day, outTime->hrs, outTime->mins, 1) && seconds <= 60;
+	}
+
+	return valid;
+}
+
+/**
+ * Parses an iCalendar DURATION, such as P1W, P2DT3H or PT45M, into a whole
+ * number of minutes. Returns FALSE if the value isn't a valid, positive
+ * duration.
+ */
+static int parseIcsDuration(char* value, int* outMins)
+{
+	char* end;
+	long amount;
+	long total;
+	int inTime;
+	int valid;
+
+	total = 0;
+	inTime = FALSE;
+	valid = FALSE;
+
+	if (*value == '+')
+	{
+		value++;
+	}
+
+	if (*value == 'P')
+	{
+		value++;
+		valid = TRUE;
+	}
+
+	while (valid == TRUE && *value != '\0')
+	{
+		if (*value == 'T' && inTime == FALSE)
+		{
+			inTime = TRUE;
+			value++;
+		}
+		else if (isdigit((unsigned char)*value))
+		{
+			amount = strtol(value, &end, 10);
+
+			if (*end == 'W' && inTime == FALSE)
+			{
+				total += amount * 7 * MINS_PER_DAY;
+			}
+			else if (*end == 'D' && inTime == FALSE)
+			{
+				total += amount * MINS_PER_DAY;
+			}
+			else if (*end == 'H' && inTime == TRUE)
+			{
+				total += amount * 60;
+			}
+			else if (*end == 'M' && inTime == TRUE)
+			{
+				total += amount;
+			}
+			else if (*end == 'S' && inTime == TRUE)
+			{
+				total += amount / 60;
+			}
+			else
+			{
+				valid = FALSE;
+			}
+
+			/* keeps the total within an int */
+			if (amount > MAX_COUNT * (long)MINS_PER_DAY || total > MAX_COUNT * (long)MINS_PER_DAY)
+			{
+				valid = FALSE;
+			}
+
+			value = end + 1;
+		}
+		else
+		{
+			valid = FALSE;
+		}
+	}
+
+	*outMins = (int)total;
+
+	return valid && total > 0;
+}
+
+/**
+ * Copies iCalendar TEXT from source to dest, undoing its escapes. Line breaks
+ * become spaces, as activities and locations are a single line. At most
+ * destSize - 1 characters are copied.
+ */
+static void unescapeText(char* dest, char* source, int destSize)
+{
+	int length;
+
+	length = 0;
+
+	while (*source != '\0' && length < destSize - 1)
+	{
+		if (*source == '\\' && source[1] != '\0')
+		{
+			source++;
+			dest[length] = (*source == 'n' || *source == 'N') ? ' ' : *source;
+		}
+		else
+		{
+			dest[length] = *source;
+		}
+
+		length++;
+		source++;
+	}
+
+	dest[length] = '\0';
+}
+
+/**
+ * Copies text to dest as iCalendar TEXT, escaping backslashes, semicolons,
+ * commas and line breaks. dest must have room for twice the length of text.
+ */
+static void escapeText(char* dest, char* text)
+{
+	while (*text != '\0')
+	{
+		if (*text == '\\' || *text == ';' || *text == ',')
+		{
+			*dest = '\\';
+			dest++;
+			*dest = *text;
+		}
+		else if (*text == '\n')
+		{
+			*dest = '\\';
+			dest++;
+			*dest = 'n';
+		}
+		else
+		{
+			*dest = *text;
+		}
+
+		dest++;
+		text++;
+	}
+
+	*dest = '\0';
+}
+
+/**
+ * Returns the day of the last occurrence of an event that starts on start
+ * and repeats count times in total under rule.
+ */
+static long lastOccurrenceDay(Date* start, Recurrence* rule, long count)
+{
+	long startDay;
+	long lastDay;
+	long monthIndex;
+	long found;
+	int year;
+	int month;
+
+	startDay = daysFromCivil(start->year, start->month, start->day);
+
+	if (rule->frequency == REPEAT_DAILY)
+	{
+		lastDay = startDay + (count - 1) * rule->interval;
+	}
+	else if (rule->frequency == REPEAT_WEEKLY)
+	{
+		lastDay = startDay + (count - 1) * rule->interval * 7;
+	}
+	else
+	{
+		/* monthly events skip months too short for their day, as in nextOccurrence */
+		lastDay = startDay;
+		monthIndex = start->year * 12L + start->month - 1;
+		found = 1;
+		year = start->year;
+
+		while (found < count && year <= 3000)
+		{
+			monthIndex += rule->interval;
+			year = (int)(monthIndex / 12);
+			month = (int)(monthIndex % 12) + 1;
+
+			if (start->day <= daysInMonth(year, month))
+			{
+				lastDay = daysFromCivil(year, month, start->day);
+				found++;
+			}
+		}
+	}
+
+	return lastDay;
+}
+
+/**
+ * Returns the day a DATE or DATE-TIME value falls on in zone (NULL for the
+ * display zone), as a day number. A time in UTC, ending in Z, is converted
+ * to zone first, a time without one is taken to be in zone already. Returns
+ * FALSE if the value isn't a valid date.
+ */
+static int parseIcsDay(char* value, TimeZone* zone, long* outDay)
+{
+	Date date;
+	Time time;
+	long minutes;
+	int dateOnly;
+	int valid;
+
+	valid = parseIcsDate(value, &date, &time, &dateOnly);
+	minutes = civilToMinutes(&date, &time);
+
+	if (valid == TRUE && value[strlen(value) - 1] == 'Z')
+	{
+		minutes = convertZone(minutes, findZone("UTC"), zone);
+	}
+	*outDay = minutesToDay(minutes);
+
+	return valid;
+}
+
+/**
+ * Parses an iCalendar RRULE, such as FREQ=WEEKLY;INTERVAL=2;COUNT=10, for an
+ * event starting on start, in zone, into rule. Only DAILY, WEEKLY and
+ * MONTHLY rules with INTERVAL, UNTIL or COUNT can be stored; a rule using
+ * any other part (BYDAY and the like) changes which days the event is on,
+ * so FALSE is returned for it. value is modified.
+ */
+static int parseIcsRule(char* value, Date* start, TimeZone* zone, Recurrence* rule)
+{
+	char* part;
+	char* next;
+	long count;
+	int valid;
+	int ii;
+
+	memset(rule, 0, sizeof(Recurrence));
+	rule->interval = 1;
+	count = 0;
+	valid = TRUE;
+	part = value;
+
+	while (valid == TRUE && part != NULL && *part != '\0')
+	{
+		next = strchr(part, ';');
+		if (next != NULL)
+		{
+			*next = '\0';
+			next++;
+		}
+
+		if (strncmp(part, "FREQ=", 5) == 0)
+		{
+			for (ii = REPEAT_DAILY; ii <= REPEAT_MONTHLY; ii++)
+			{
+				if (strcmp(part + 5, frequencyNames[ii]) == 0)
+				{
+					rule->frequency = ii;
+				}
+			}
+		}
+		else if (strncmp(part, "INTERVAL=", 9) == 0)
+		{
+			rule->interval = atoi(part + 9);
+			valid = (rule->interval >= 1 && rule->interval <= MAX_INTERVAL);
+		}
+		else if (strncmp(part, "UNTIL=", 6) == 0)
+		{
+			valid = parseIcsDay(part + 6, zone, &rule->untilDay);
+			rule->hasUntil = TRUE;
+		}
+		else if (strncmp(part, "COUNT=", 6) == 0)
+		{
+			count = atol(part + 6);
+			valid = (count >= 1 && count <= MAX_COUNT);
+		}
+		/* the start of the week only matters to BYDAY */
+		else if (strncmp(part, "WKST=", 5) != 0)
+		{
+			valid = FALSE;
+		}
+
+		part = next;
+	}
+
+	if (rule->frequency == 0 || (count > 0 && rule->hasUntil == TRUE))
+	{
+		valid = FALSE;
+	}
+
+	if (valid == TRUE && count > 0)
+	{
+		rule->untilDay = lastOccurrenceDay(start, rule, count);
+		rule->hasUntil = TRUE;
+	}
+
+	return valid;
+}
+
+/**
+ * Adds each date in a comma separated EXDATE value to exceptions, as the
+ * numbers of the days they fall on in zone (see parseIcsDay). Returns FALSE
+ * if a date is invalid or there are more than MAX_EXCEPTIONS of them. value
+ * is modified.
+ */
+static int parseIcsExceptions(char* value, TimeZone* zone, long* exceptions, int* numExceptions)
+{
+	char* next;
+	int valid;
+
+	valid = TRUE;
+
+	while (valid == TRUE && value != NULL)
+	{
+		next = strchr(value, ',');
+		if (next != NULL)
+		{
+			*next = '\0';
+			next++;
+		}
+
+		valid = (*numExceptions < MAX_EXCEPTIONS && parseIcsDay(value, zone, &exceptions[*numExceptions]) == TRUE);
+
+		if (valid == TRUE)
+		{
+			(*numExceptions)++;
+		}
+
+		value = next;
+	}
+
+	return valid;
+}
+
+/**
+ * Notes which property makes an event invalid and why, keeping only the
+ * first problem found.
+ */
+static void noteProblem(char** field, char** reason, char* newField, char* newReason)
+{
+	if (*field == NULL)
+	{
+		*field = newField;
+		*reason = newReason;
+	}
+}
+
+/**
+ * Reads the next VEVENT from an iCalendar file. Works the same way as
+ * readEntry: a valid event is created, stored in outEvent and ENTRY_VALID is
+ * returned, a VEVENT that can't be represented as an Event is skipped,
+ * added to report (which may be NULL) with the line it begins on and the
+ * property at fault, and ENTRY_INVALID is returned, and ENTRY_NONE is
+ * returned at the end of the file. DTSTART, DTEND or DURATION, SUMMARY, LOCATION, and simple RRULE and
+ * EXDATE properties are read, all other properties and components are
+ * ignored. A start with a TZID of the tz database, or in UTC, puts the
+ * event in that zone, other times are read as local times. A start in UTC
+ * with an X-CAL-TZID property naming a zone, as writeIcsSnapshot writes, is
+ * put back in that zone. The RRULE and EXDATE are read once the event's
+ * zone is known, so dates in UTC fall on the right days.
+ */
+int readIcsEntry(FILE* source, Event** outEvent, ValidationReport* report)
+{
+	char line[MAX_ICS_LINE];
+	char name[MAX_ICS_NAME];
+	char text[MAX_ACTIVITY];
+	char ruleText[MAX_ICS_LINE];
+	char exceptionText[MAX_ICS_LINE];
+	char* value;
+	char* field;
+	char* reason;
+	Event* newEvent;
+	Recurrence rule;
+	Date endDate;
+	Time endTime;
+	TimeZone* endZone;
+	TimeZone* namedZone;
+	TimeZone* utc;
+	long exceptions[MAX_EXCEPTIONS];
+	int numExceptions;
+	int result;
+	int depth;
+	int valid;
+	int hasStart;
+	int hasEnd;
+	int hasDuration;
+	int hasRule;
+	int dateOnly;
+	int ii;
+	long lineNo;
+	long entryLine;
+	long startTime;
+	long validStart;
+	long startOffset;
+
+	startTime = STATS_BEGIN();
+	flockfile(source);
+#ifdef CAL_STATS
+	startOffset = ftell(source);
+#else
+	startOffset = 0;
+#endif
+	result = ENTRY_NONE;
+	*outEvent = NULL;
+	newEvent = NULL;
+	lineNo = (report != NULL) ? report->linesRead : 0;
+	entryLine = 0;
+	field = NULL;
+	reason = NULL;
+
+	/* the flags are set when an event begins */
+	depth = 0;
+	valid = FALSE;
+	hasStart = FALSE;
+	hasEnd = FALSE;
+	hasDuration = FALSE;
+	hasRule = FALSE;
+	dateOnly = FALSE;
+	numExceptions = 0;
+	endZone = NULL;
+	namedZone = NULL;
+
+	while (result == ENTRY_NONE && readIcsLine(source, line, &lineNo) == TRUE)
+	{
+		value = splitProperty(line, name);
+
+		/* not a property, such as a blank line */
+		if (value == NULL)
+		{
+		}
+		/* skip everything up to the start of the next event */
+		else if (newEvent == NULL)
+		{
+			if (strcmp(name, "BEGIN") == 0 && strcmp(value, "VEVENT") == 0)
+			{
+				newEvent = createEvent();
+				entryLine = lineNo;
+				field = NULL;
+				depth = 0;
+				valid = TRUE;
+				hasStart = FALSE;
+				hasEnd = FALSE;
+				hasDuration = FALSE;
+				hasRule = FALSE;
+				numExceptions = 0;
+				endZone = NULL;
+				namedZone = NULL;
+				ruleText[0] = '\0';
+				exceptionText[0] = '\0';
+			}
+		}
+		/* components within the event, such as alarms, are skipped */
+		else if (strcmp(name, "BEGIN") == 0)
+		{
+			depth++;
+		}
+		else if (strcmp(name, "END") == 0 && depth > 0)
+		{
+			depth--;
+		}
+		else if (depth > 0)
+		{
+		}
+		else if (strcmp(name, "END") == 0)
+		{
+			validStart = STATS_BEGIN();
+
+			/* a start written in UTC for a zone goes back into that zone */
+			if (namedZone != NULL && newEvent->zone != NULL && strcmp(newEvent->zone->name, "UTC") == 0)
+			{
+				civilFromMinutes(convertZone(civilToMinutes(&newEvent->eDate, &newEvent->eTime), newEvent->zone,
+					namedZone), &newEvent->eDate, &newEvent->eTime);
+				newEvent->zone = namedZone;
+			}
+
+			/* DURATION is used over DTEND, and an all day event without either lasts the day */
+			if (hasDuration == FALSE && hasEnd == TRUE && hasStart == TRUE)
+			{
+				newEvent->duration = (int)minutesBetween(&newEvent->eDate, &newEvent->eTime, &endDate, &endTime);
+
+				/* times in zones are apart by as long as really passes */
+				if (newEvent->zone != NULL || endZone != NULL)
+				{
+					utc = findZone("UTC");
+					newEvent->duration = (int)(convertZone(civilToMinutes(&endDate, &endTime), endZone, utc) -
+						convertZone(civilToMinutes(&newEvent->eDate, &newEvent->eTime), newEvent->zone, utc));
+				}
+			}
+			else if (hasDuration == FALSE && dateOnly == TRUE)
+			{
+				newEvent->duration = MINS_PER_DAY;
+			}
+
+			if (strcmp(value, "VEVENT") != 0)
+			{
+				valid = FALSE;
+				noteProblem(&field, &reason, "END", "doesn't end a VEVENT");
+			}
+			else if (hasStart == FALSE)
+			{
+				valid = FALSE;
+				noteProblem(&field, &reason, "DTSTART", "missing");
+			}
+			else if (newEvent->activity == NO_TEXT)
+			{
+				valid = FALSE;
+				noteProblem(&field, &reason, "SUMMARY", "missing");
+			}
+			else if (eventValid(newEvent->eDate.year, newEvent->eDate.month, newEvent->eDate.day,
+				newEvent->eTime.hrs, newEvent->eTime.mins, newEvent->duration) == FALSE)
+			{
+				valid = FALSE;
+				noteProblem(&field, &reason, "DTSTART", "date, time or length out of range");
+			}
+
+			if (valid == TRUE && exceptionText[0] != '\0' &&
+				parseIcsExceptions(exceptionText, newEvent->zone, exceptions, &numExceptions) == FALSE)
+			{
+				valid = FALSE;
+				noteProblem(&field, &reason, "EXDATE", "not a valid list of dates");
+			}
+
+			if (valid == TRUE && hasRule == TRUE && parseIcsRule(ruleText, &newEvent->eDate, newEvent->zone, &rule) == FALSE)
+			{
+				valid = FALSE;
+				noteProblem(&field, &reason, "RRULE", "not a supported repeat rule");
+			}
+
+			if (valid == TRUE && hasRule == TRUE)
+			{
+				for (ii = 0; ii < numExceptions && valid == TRUE; ii++)
+				{
+					valid = addException(&rule, exceptions[ii]);
+				}
+				if (valid == FALSE)
+				{
+					noteProblem(&field, &reason, "EXDATE", "too many dates");
+				}
+
+				newEvent->repeat = (Recurrence*)malloc(sizeof(Recurrence));
+				*(newEvent->repeat) = rule;
+			}
+
+			STATS_END(STAT_VALIDATE, validStart, 1);
+
+			if (valid == TRUE)
+			{
+				*outEvent = newEvent;
+				result = ENTRY_VALID;
+			}
+			else
+			{
+				releaseEvent(newEvent);
+				reportInvalid(report, entryLine, field, reason);
+				result = ENTRY_INVALID;
+			}
+		}
+		else if (strcmp(name, "DTSTART") == 0)
+		{
+			if (parseIcsDate(value, &newEvent->eDate, &newEvent->eTime, &dateOnly) == FALSE)
+			{
+				valid = FALSE;
+				noteProblem(&field, &reason, "DTSTART", "not a valid date");
+			}
+			newEvent->zone = lineZone(line, value);
+			hasStart = TRUE;
+		}
+		else if (strcmp(name, "DTEND") == 0)
+		{
+			if (parseIcsDate(value, &endDate, &endTime, &ii) == FALSE)
+			{
+				valid = FALSE;
+				noteProblem(&field, &reason, "DTEND", "not a valid date");
+			}
+			endZone = lineZone(line, value);
+			hasEnd = TRUE;
+		}
+		else if (strcmp(name, "DURATION") == 0)
+		{
+			if (parseIcsDuration(value, &newEvent->duration) == FALSE)
+			{
+				valid = FALSE;
+				noteProblem(&field, &reason, "DURATION", "not a valid duration");
+			}
+			hasDuration = TRUE;
+		}
+		else if (strcmp(name, "SUMMARY") == 0)
+		{
+			unescapeText(text, value, MAX_ACTIVITY);
+			newEvent->activity = internText(text);
+		}
+		else if (strcmp(name, "LOCATION") == 0)
+		{
+			unescapeText(text, value, MAX_LOCATION);
+			newEvent->location = internText(text);
+		}
+		/* the rule's COUNT needs the start date, which may come later */
+		else if (strcmp(name, "RRULE") == 0)
+		{
+			if (hasRule == TRUE)
+			{
+				valid = FALSE;
+				noteProblem(&field, &reason, "RRULE", "not a supported repeat rule");
+			}
+			strcpy(ruleText, value);
+			hasRule = TRUE;
+		}
+		/* the dates of every EXDATE are read together at the end */
+		else if (strcmp(name, "EXDATE") == 0)
+		{
+			if (strlen(exceptionText) + strlen(value) + 2 > MAX_ICS_LINE)
+			{
+				valid = FALSE;
+				noteProblem(&field, &reason, "EXDATE", "too many dates");
+			}
+			else
+			{
+				if (exceptionText[0] != '\0')
+				{
+					strcat(exceptionText, ",");
+				}
+				strcat(exceptionText, value);
+			}
+		}
+		else if (strcmp(name, ZONE_PROPERTY) == 0)
+		{
+			namedZone = findZone(value);
+		}
+	}
+
+	/* the file ended part way through an event */
+	if (newEvent != NULL && result == ENTRY_NONE)
+	{
+		releaseEvent(newEvent);
+		reportInvalid(report, entryLine, "VEVENT", "the file ended before its END");
+		result = ENTRY_INVALID;
+	}
+
+	if (report != NULL)
+	{
+		report->linesRead = lineNo;
+	}
+
+	STATS_END(STAT_PARSE, startTime, ftell(source) - startOffset);
+	(void)startOffset;
+	funlockfile(source);
+
+	return result;
+}
+
+/**
+ * Writes one line to dest, folded so that no line is longer than ICS_FOLD
+ * bytes and no UTF-8 character is split. Returns the number of bytes written.
+ */
+static long writeIcsLine(FILE* dest, char* line)
+{
+	long length;
+	long written;
+	int chunk;
+
+	length = strlen(line);
+	written = 0;
+	chunk = ICS_FOLD;
+
+	while (length > chunk)
+	{
+		/* back up to the first byte of a character */
+		while (chunk > 1 && (((unsigned char)line[chunk]) & 0xC0) == 0x80)
+		{
+			chunk--;
+		}
+
+		fwrite(line, 1, chunk, dest);
+		fputs("\r\n ", dest);
+		written += chunk + 3;
+		line += chunk;
+		length -= chunk;
+
+		/* the space that starts a folded line counts towards its length */
+		chunk = ICS_FOLD - 1;
+	}
+
+	fputs(line, dest);
+	fputs("\r\n", dest);
+
+	return written + length + 2;
+}
+
+/**
+ * Formats a wall clock time in minutes (as for civilToMinutes) as an
+ * iCalendar DATE-TIME with the passed-in seconds. A time in a zone is
+ * written in UTC, ending in Z, and a time in no zone as a local time.
+ */
+static void formatIcsTime(char* out, long minutes, int seconds, TimeZone* zone)
+{
+	Date date;
+	Time time;
+
+	if (zone != NULL)
+	{
+		minutes = zoneToUtc(zone, minutes);
+	}
+	civilFromMinutes(minutes, &date, &time);
+
+	sprintf(out, "%04d%02d%02dT%02d%02d%02d%s", date.year, date.month, date.day, time.hrs, time.mins, seconds,
+		(zone != NULL) ? "Z" : "");
+}
+
+/**
+ * Writes one event to dest as a VEVENT. index and stamp, the time the file is
+ * being written, make up its UID and DTSTAMP. An event in a zone other than
+ * UTC has its times written in UTC and its zone named by ZONE_PROPERTY, as
+ * a TZID needs a VTIMEZONE describing the zone. Returns the number of bytes
+ * written.
+ */
+static long writeIcsEvent(FILE* dest, Event* event, long index, char* stamp)
+{
+	char line[MAX_ICS_LINE];
+	char start[20];
+	long written;
+	long minuteOfDay;
+	int ii;
+
+	formatIcsTime(start, civilToMinutes(&event->eDate, &event->eTime), 0, event->zone);
+	minuteOfDay = event->eTime.hrs * 60 + event->eTime.mins;
+
+	written = writeIcsLine(dest, "BEGIN:VEVENT");
+
+	sprintf(line, "UID:%ld-%s@super-cool-calendar", index, start);
+	written += writeIcsLine(dest, line);
+
+	sprintf(line, "DTSTAMP:%s", stamp);
+	written += writeIcsLine(dest, line);
+
+	sprintf(line, "DTSTART:%s", start);
+	written += writeIcsLine(dest, line);
+
+	if (event->zone != NULL && strcmp(event->zone->name, "UTC") != 0)
+	{
+		sprintf(line, "%s:%s", ZONE_PROPERTY, event->zone->name);
+		written += writeIcsLine(dest, line);
+	}
+
+	sprintf(line, "DURATION:PT%dM", event->duration);
+	written += writeIcsLine(dest, line);
+
+	strcpy(line, "SUMMARY:");
+	escapeText(line + strlen(line), internedText(event->activity));
+	written += writeIcsLine(dest, line);
+
+	if (event->location != NO_TEXT)
+	{
+		strcpy(line, "LOCATION:");
+		escapeText(line + strlen(line), internedText(event->location));
+		written += writeIcsLine(dest, line);
+	}
+
+	if (event->repeat != NULL)
+	{
+		sprintf(line, "RRULE:FREQ=%s;INTERVAL=%d", frequencyNames[event->repeat->frequency], event->repeat->interval);
+
+		/* UNTIL has to be a date-time, as DTSTART is, and in UTC if DTSTART is */
+		if (event->repeat->hasUntil == TRUE)
+		{
+			strcat(line, ";UNTIL=");
+			formatIcsTime(line + strlen(line), event->repeat->untilDay * MINS_PER_DAY + MINS_PER_DAY - 1, 59,
+				event->zone);
+		}
+		written += writeIcsLine(dest, line);
+
+		if (event->repeat->numExceptions > 0)
+		{
+			strcpy(line, "EXDATE:");
+			for (ii = 0; ii < event->repeat->numExceptions; ii++)
+			{
+				if (ii > 0)
+				{
+					strcat(line, ",");
+				}
+				formatIcsTime(line + strlen(line), event->repeat->exceptions[ii] * MINS_PER_DAY + minuteOfDay, 0,
+					event->zone);
+			}
+			written += writeIcsLine(dest, line);
+		}
+	}
+
+	written += writeIcsLine(dest, "END:VEVENT");
+
+	return written;
+}
+
+/**
+ * Writes every event in the passed-in snapshot to a file as an iCalendar
+ * VCALENDAR, one event at a time. Times in a zone are written in UTC, and
+ * the zone named by an X-CAL-TZID property. Returns the number of bytes
+ * written, or -1 if writing failed.
+ */
+long writeIcsSnapshot(FILE* dest, ListSnapshot* snapshot)
+{
+	char stamp[20];
+	Date today;
+	long now;
+	long startTime;
+	long bytesWritten;
+	int ii;
+
+	startTime = STATS_BEGIN();
+
+	/* the time of writing, in UTC */
+	now = (long)time(NULL);
+	civilFromDays(now / (60L * MINS_PER_DAY), &today);
+	sprintf(stamp, "%04d%02d%02dT%02ld%02ld%02ldZ", today.year, today.month, today.day,
+		(now / 3600) % 24, (now / 60) % 60, now % 60);
+
+	bytesWritten = writeIcsLine(dest, "BEGIN:VCALENDAR");
+	bytesWritten += writeIcsLine(dest, "VERSION:2.0");
+	bytesWritten += writeIcsLine(dest, "PRODID:-//super-cool-calendar//EN");
+
+	for (ii = 0; ii < snapshot->count; ii++)
+	{
+		bytesWritten += writeIcsEvent(dest, snapshot->events[ii], ii + 1, stamp);
+	}
+
+	bytesWritten += writeIcsLine(dest, "END:VCALENDAR");
+
+	STATS_END(STAT_SAVE, startTime, bytesWritten);
+
+	if (ferror(dest) != 0)
+	{
+		bytesWritten = -1;
+	}
+
+	return bytesWritten;
+}
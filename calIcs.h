@@ -0,0 +1,50 @@
+/**
+ * Contains functions for reading and writing iCalendar (.ics) files. Files
+ * are streamed one event at a time, so a feed of any size is read or written
+ * in a fixed amount of memory. None of these functions use the gui, so they
+ * can be called from a background thread.
+ *
+ * Author: Alex Burress
+ */
+
+#ifndef CALICS_H
+#define CALICS_H
+#include "linkedList.h"
+#include "calReport.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* the longest unfolded line that is kept, longer lines are cut short */
+#define MAX_ICS_LINE 2048
+
+/**
+ * Returns TRUE if the passed-in filename ends in .ics (in any case), so
+ * should be read and written as iCalendar rather than calendar text.
+ */
+int isIcsFile(char* filename);
+
+/**
+ * Reads the next VEVENT from an iCalendar file. Works the same way as
+ * readEntry: a valid event is created, stored in outEvent and ENTRY_VALID is
+ * returned, a VEVENT that can't be represented as an Event is skipped,
+ * added to report (which may be NULL) with the line it begins on and the
+ * property at fault, and ENTRY_INVALID is returned, and ENTRY_NONE is
+ * returned at the end of the file. DTSTART, DTEND or DURATION, SUMMARY, LOCATION, and simple RRULE and
+ * EXDATE properties are read, all other properties and components are
+ * ignored. A start with a TZID of the tz database, or in UTC, puts the
+ * event in that zone, other times are read as local times. A start in UTC
+ * with an X-CAL-TZID property naming a zone, as writeIcsSnapshot writes, is
+ * put back in that zone. The RRULE and EXDATE are read once the event's
+ * zone is known, so dates in UTC fall on the right days.
+ */
+int readIcsEntry(FILE* source, Event** outEvent, ValidationReport* report);
+
+/**
+ * Writes every event in the passed-in snapshot to a file as an iCalendar
+ * VCALENDAR, one event at a time. Times in a zone are written in UTC, and
+ * the zone named by an X-CAL-TZID property. Returns the number of bytes
+ * written, or -1 if writing failed.
+ */
+long writeIcsSnapshot(FILE* dest, ListSnapshot* snapshot);
+
+#endif
@@ -0,0 +1,272 @@
+/**
+ * Contains a table of interned strings. Each distinct activity and location
+ * is stored once, and events hold a 32-bit id for it, so repeated text costs
+ * nothing and two strings are equal exactly when their ids are. Text can be
+ * interned from any thread. Interned text is kept until the program exits.
+ *
+ * Author: Alex Burress
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include "calIntern.h"
+
+#define FALSE 0
+#define TRUE !FALSE
+
+/* ids are looked up through pages of PAGE_SIZE text pointers */
+#define PAGE_BITS 16
+#define PAGE_SIZE (1 << PAGE_BITS)
+#define MAX_PAGES 4096
+
+/* text is copied into chunks of at least this many bytes */
+#define CHUNK_SIZE 65536
+
+/* the hash slots start with room for this many, and double when half full */
+#define FIRST_SLOTS 1024
+
+/**
+ * The interned strings. pages maps an id to its text; pages are allocated
+ * as needed and never move, so internedText can read them without the lock.
+ * slots is an open-addressed hash table of ids, where 0 marks an empty slot
+ * (the empty string is never hashed). Text is copied into chunk, and a new
+ * chunk is started when it is full; old chunks are never freed.
+ */
+typedef struct InternTable {
+	pthread_mutex_t lock;
+	char** pages[MAX_PAGES];
+	unsigned int count;
+	unsigned int* slots;
+	unsigned int numSlots;
+	char* chunk;
+	size_t chunkLeft;
+} InternTable;
+
+static InternTable table;
+static pthread_once_t tableOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * Sets up the table with the empty string as its only entry.
+ */
+static void initTable()
+{
+	pthread_mutex_init(&table.lock, NULL);
+
+	table.pages[0] = (char**)malloc(PAGE_SIZE * sizeof(char*));
+	table.pages[0][NO_TEXT] = "";
+	table.count = 1;
+
+	table.numSlots = FIRST_SLOTS;
+	table.slots = (unsigned int*)calloc(table.numSlots, sizeof(unsigned int));
+	table.chunk = NULL;
+	table.chunkLeft = 0;
+}
+
+/**
+ * Returns the FNV-1a hash of a string.
+ */
+static unsigned int hashText(char* text)
+{
+	unsigned int hash;
+
+	hash = 2166136261u;
+	while (*text != '\0')
+	{
+		hash = (hash ^ (unsigned char)*text) * 16777619u;
+		text++;
+	}
+
+	return hash;
+}
+
+/**
+ * Returns the slot holding the id of the passed-in text, or the empty slot
+ * it would go in. Must be called with the lock held.
+ */
+static unsigned int* findSlot(char* text, unsigned int hash)
+{
+	unsigned int mask;
+	unsigned int ii;
+
+	mask = table.numSlots - 1;
+	ii = hash & mask;
+
+	while (table.slots[ii] != 0 && strcmp(internedText(table.slots[ii]), text) != 0)
+	{
+		ii = (ii + 1) & mask;
+	}
+
+	return &table.slots[ii];
+}
+
+/**
+ * Doubles the number of hash slots, rehashing every id. Must be called with
+ * the lock held.
+ */
+static void growSlots()
+{
+	unsigned int* oldSlots;
+	unsigned int oldNum;
+	unsigned int ii;
+	char* text;
+
+	oldSlots = table.slots;
+	oldNum = table.numSlots;
+
+	table.numSlots = oldNum * 2;
+	table.slots = (unsigned int*)calloc(table.numSlots, sizeof(unsigned int));
+
+	for (ii = 0; ii < oldNum; ii++)
+	{
+		if (oldSlots[ii] != 0)
+		{
+			text = internedText(oldSlots[ii]);
+			*findSlot(text, hashText(text)) = oldSlots[ii];
+		}
+	}
+
+	free(oldSlots);
+}
+
+/**
+ * Copies text into the current chunk, starting a new chunk if it doesn't
+ * fit, and returns the copy. Must be called with the lock held.
+ */
+static char* storeText(char* text)
+{
+	size_t length;
+	size_t size;
+	char* copy;
+
+	length = strlen(text) + 1;
+
+	if (length > table.chunkLeft)
+	{
+		size = length > CHUNK_SIZE ? length : CHUNK_SIZE;
+		table.chunk = (char*)malloc(size);
+		table.chunkLeft = size;
+	}
+
+	copy = table.chunk;
+	memcpy(copy, text, length);
+	table.chunk += length;
+	table.chunkLeft -= length;
+
+	return copy;
+}
+
+/**
+ * Returns the id of the passed-in text, adding it to the table if it hasn't
+ * been interned before. The empty string is always NO_TEXT.
+ */
+unsigned int internText(char* text)
+{
+	unsigned int* slot;
+	unsigned int id;
+	unsigned int page;
+
+	id = NO_TEXT;
+
+	if (text[0] != '\0')
+	{
+		pthread_once(&tableOnce, &initTable);
+		pthread_mutex_lock(&table.lock);
+
+		slot = findSlot(text, hashText(text));
+
+		if (*slot != 0)
+		{
+			id = *slot;
+		}
+		else
+		{
+			assert(table.count < (unsigned int)MAX_PAGES * PAGE_SIZE);
+
+			id = table.count;
+			page = id >> PAGE_BITS;
+
+			if ((id & (PAGE_SIZE - 1)) == 0)
+			{
+				table.pages[page] = (char**)malloc(PAGE_SIZE * sizeof(char*));
+			}
+			table.pages[page][id & (PAGE_SIZE - 1)] = storeText(text);
+			table.count++;
+			*slot = id;
+
+			/* keep at least half the slots empty so probes stay short */
+			if (table.count * 2 > table.numSlots)
+			{
+				growSlots();
+			}
+		}
+
+		pthread_mutex_unlock(&table.lock);
+	}
+
+	return id;
+}
+
+/**
+ * Finds the id of the passed-in text without adding it to the table. Returns
+ * FALSE if the text has never been interned, in which case no event holds it.
+ */
+int lookupText(char* text, unsigned int* outId)
+{
+	int found;
+
+	found = TRUE;
+	*outId = NO_TEXT;
+
+	if (text[0] != '\0')
+	{
+		pthread_once(&tableOnce, &initTable);
+		pthread_mutex_lock(&table.lock);
+
+		*outId = *findSlot(text, hashText(text));
+		found = (*outId != 0);
+
+		pthread_mutex_unlock(&table.lock);
+	}
+
+	return found;
+}
+
+/**
+ * Returns the text of an id returned by internText. The text must not be
+ * modified. Doesn't lock, as the table entry for an id is never changed
+ * once the id has been handed out.
+ */
+char* internedText(unsigned int id)
+{
+	char* text;
+
+	if (id == NO_TEXT)
+	{
+		text = "";
+	}
+	else
+	{
+		text = table.pages[id >> PAGE_BITS][id & (PAGE_SIZE - 1)];
+	}
+
+	return text;
+}
+
+/**
+ * Returns the number of distinct strings interned so far, including the
+ * empty string.
+ */
+unsigned int internedCount()
+{
+	unsigned int count;
+
+	pthread_once(&tableOnce, &initTable);
+	pthread_mutex_lock(&table.lock);
+	count = table.count;
+	pthread_mutex_unlock(&table.lock);
+
+	return count;
+}
@@ -0,0 +1,41 @@
+/**
+ * Contains a table of interned strings. Each distinct activity and location
+ * is stored once, and events hold a 32-bit id for it, so repeated text costs
+ * nothing and two strings are equal exactly when their ids are. Text can be
+ * interned from any thread. Interned text is kept until the program exits.
+ *
+ * Author: Alex Burress
+ */
+
+#ifndef CALINTERN_H
+#define CALINTERN_H
+
+/* the id of the empty string, which a new event's activity and location are */
+#define NO_TEXT 0
+
+/**
+ * Returns the id of the passed-in text, adding it to the table if it hasn't
+ * been interned before. The empty string is always NO_TEXT.
+ */
+unsigned int internText(char* text);
+
+/**
+ * Finds the id of the passed-in text without adding it to the table. Returns
+ * FALSE if the text has never been interned, in which case no event holds it.
+ */
+int lookupText(char* text, unsigned int* outId);
+
+/**
+ * Returns the text of an id returned by internText. The text must not be
+ * modified. Doesn't lock, as the table entry for an id is never changed
+ * once the id has been handed out.
+ */
+char* internedText(unsigned int id);
+
+/**
+ * Returns the number of distinct strings interned so far, including the
+ * empty string.
+ */
+unsigned int internedCount();
+
+#endif
@@ -0,0 +1,266 @@
+/**
+ * Contains a store of calendar history kept in an archive, paged in by
+ * month. Each block of the archive holds the events of one month (see
+ * writeArchiveSnapshot), so the block index doubles as a directory of
+ * partitions. Only the partitions overlapping the ranges asked for are read,
+ * and once the events paged in take more than a memory budget, the
+ * partitions used longest ago are dropped again. None of these functions use
+ * the gui, but a store must only be used from one thread.
+ *
+ * Author: Alex Burress
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include "linkedList.h"
+#include "calArchive.h"
+#include "calPartition.h"
+#include "calSort.h"
+#define FALSE 0
+#define TRUE !FALSE
+
+/**
+ * Returns the memory taken by a paged-in event: the event, its repeat rule,
+ * its node on the store's list and its place in a partition. Its text is
+ * interned, so isn't counted.
+ */
+static long eventBytes(Event* event)
+{
+	long bytes;
+
+	bytes = sizeof(Event) + sizeof(ListNode) + sizeof(Event*) + sizeof(EventHandle);
+	if (event->repeat != NULL)
+	{
+		bytes += sizeof(Recurrence);
+	}
+
+	return bytes;
+}
+
+/**
+ * Returns a handle to the last event on the store's list of the nearest
+ * partition before the passed-in one that is paged in and not empty, or a
+ * handle to no event if there is none. The recurring events, kept after
+ * every month, are passed over, as they are spread across the whole list.
+ */
+static EventHandle partitionBefore(PartitionStore* store, int partitionNo)
+{
+	Partition* partition;
+	EventHandle handle;
+	int ii;
+
+	handle.slot = 0;
+	handle.generation = NO_GENERATION;
+
+	for (ii = partitionNo - 1; ii >= 0 && handle.generation == NO_GENERATION; ii--)
+	{
+		partition = &store->partitions[ii];
+
+		if (partition->events != NULL && partition->count > 0 && store->archive->blocks[ii].lastEnd != LONG_MAX)
+		{
+			handle = partition->handles[partition->count - 1];
+		}
+	}
+
+	return handle;
+}
+
+/**
+ * Reads the events of a partition that isn't paged in, and merges them into
+ * the store's list from the end of the partition before it, so only this
+ * partition's events (and any others that start among them) are passed
+ * over. A damaged partition is left empty, and its events counted as
+ * invalid. If there isn't the memory to hold the partition it is left paged
+ * out, to be tried again when next needed, and FALSE is returned.
+ */
+static int pageIn(PartitionStore* store, int partitionNo)
+{
+	Partition* partition;
+	int numEvents;
+	int pagedIn;
+	int ii;
+
+	partition = &store->partitions[partitionNo];
+	numEvents = store->archive->blocks[partitionNo].count;
+	partition->events = (Event**)malloc((numEvents + 1) * sizeof(Event*));
+	partition->handles = (EventHandle*)malloc((numEvents + 1) * sizeof(EventHandle));
+	pagedIn = (partition->events != NULL && partition->handles != NULL);
+
+	if (pagedIn == FALSE)
+	{
+		free(partition->events);
+		free(partition->handles);
+		partition->events = NULL;
+		partition->handles = NULL;
+	}
+	else
+	{
+		partition->count = readArchiveBlock(store->archive, partitionNo, partition->events);
+		partition->bytes = 0;
+
+		if (partition->count < 0)
+		{
+			store->invalidCount += numEvents;
+			partition->count = 0;
+		}
+
+		for (ii = 0; ii < partition->count; ii++)
+		{
+			partition->bytes += eventBytes(partition->events[ii]);
+			retainEvent(partition->events[ii]);
+		}
+
+		/* blocks are in wall clock order, the list in order of start time */
+		sortEvents(partition->events, partition->count, SORT_START);
+		mergeSortedAfter(store->list, partitionBefore(store, partitionNo), partition->events, partition->count,
+			&startKey, partition->handles);
+
+		store->residentBytes += partition->bytes;
+	}
+
+	return pagedIn;
+}
+
+/**
+ * Deletes the events of a paged-in partition from the store's list by
+ * their handles, without walking the list, and releases them.
+ */
+static void pageOut(PartitionStore* store, int partitionNo)
+{
+	Partition* partition;
+	int ii;
+
+	partition = &store->partitions[partitionNo];
+
+	for (ii = 0; ii < partition->count; ii++)
+	{
+		deleteHandle(store->list, partition->handles[ii]);
+		releaseEvent(partition->events[ii]);
+	}
+	free(partition->events);
+	free(partition->handles);
+
+	partition->events = NULL;
+	partition->handles = NULL;
+	partition->count = 0;
+	store->residentBytes -= partition->bytes;
+	partition->bytes = 0;
+}
+
+/**
+ * Opens the named archive for paging, with nothing paged in yet. budget is
+ * the most memory, in bytes, the paged-in events should take. Returns NULL
+ * if the file can't be opened or isn't an archive.
+ */
+PartitionStore* openPartitions(char* filename, long budget)
+{
+	PartitionStore* store;
+	ArchiveReader* archive;
+	FILE* source;
+
+	store = NULL;
+	source = fopen(filename, "rb");
+
+	if (source != NULL)
+	{
+		archive = openArchive(source);
+
+		if (archive == NULL)
+		{
+			fclose(source);
+		}
+		else
+		{
+			store = (PartitionStore*)malloc(sizeof(PartitionStore));
+			store->source = source;
+			store->archive = archive;
+			store->partitions = (Partition*)calloc(archive->numBlocks + 1, sizeof(Partition));
+			store->budget = budget;
+			store->residentBytes = 0;
+			store->clock = 0;
+			store->list = createList();
+			store->invalidCount = 0;
+		}
+	}
+
+	return store;
+}
+
+/**
+ * Pages in every partition holding events that overlap rangeStart up to
+ * rangeEnd (in minutes, as for eventStart), then pages out the partitions
+ * used longest ago, other than those, until the store is within its budget.
+ * Returns TRUE if the store's list changed.
+ */
+int pageInRange(PartitionStore* store, long rangeStart, long rangeEnd)
+{
+	ArchiveBlock* block;
+	int changed;
+	int oldest;
+	int ii;
+
+	changed = FALSE;
+	store->clock++;
+
+	for (ii = 0; ii < store->archive->numBlocks; ii++)
+	{
+		block = &store->archive->blocks[ii];
+
+		if (block->firstStart < rangeEnd && block->lastEnd > rangeStart)
+		{
+			if (store->partitions[ii].events == NULL && pageIn(store, ii) == TRUE)
+			{
+				changed = TRUE;
+			}
+			store->partitions[ii].lastUsed = store->clock;
+		}
+	}
+
+	/* partitions needed now are kept even if they alone are over budget */
+	oldest = 0;
+	while (store->residentBytes > store->budget && oldest != -1)
+	{
+		oldest = -1;
+		for (ii = 0; ii < store->archive->numBlocks; ii++)
+		{
+			if (store->partitions[ii].events != NULL && store->partitions[ii].lastUsed != store->clock &&
+				(oldest == -1 || store->partitions[ii].lastUsed < store->partitions[oldest].lastUsed))
+			{
+				oldest = ii;
+			}
+		}
+
+		if (oldest != -1)
+		{
+			pageOut(store, oldest);
+			changed = TRUE;
+		}
+	}
+
+	return changed;
+}
+
+/**
+ * Closes a store, freeing its list and every paged-in event, and closing
+ * its file.
+ */
+void closePartitions(PartitionStore* store)
+{
+	int ii;
+
+	for (ii = 0; ii < store->archive->numBlocks; ii++)
+	{
+		if (store->partitions[ii].events != NULL)
+		{
+			pageOut(store, ii);
+		}
+	}
+
+	freeList(store->list);
+
+	free(store->partitions);
+	closeArchive(store->archive);
+	fclose(store->source);
+	free(store);
+}
@@ -0,0 +1,76 @@
+/**
+ * Contains a store of calendar history kept in an archive, paged in by
+ * month. Each block of the archive holds the events of one month (see
+ * writeArchiveSnapshot), so the block index doubles as a directory of
+ * partitions. Only the partitions overlapping the ranges asked for are read,
+ * and once the events paged in take more than a memory budget, the
+ * partitions used longest ago are dropped again. None of these functions use
+ * the gui, but a store must only be used from one thread.
+ *
+ * Author: Alex Burress
+ */
+
+#ifndef CALPARTITION_H
+#define CALPARTITION_H
+#include "linkedList.h"
+#include "calArchive.h"
+#include <stdio.h>
+
+/* the memory budget of a store when none is given, in bytes */
+#define DEFAULT_PAGE_BUDGET (64L * 1024L * 1024L)
+
+/**
+ * One partition of a store: the events of one archive block while it is
+ * paged in (events is NULL while it isn't), in order of start time, with
+ * the handles of their nodes on the store's list, the memory they take, and
+ * when the partition was last needed.
+ */
+typedef struct Partition {
+	Event** events;
+	EventHandle* handles;
+	int count;
+	long bytes;
+	unsigned long lastUsed;
+} Partition;
+
+/**
+ * An archive open for paging. partitions runs parallel to the archive's
+ * block index. list holds every paged-in event, in order of start time. A
+ * partition paged in is merged into it from the end of the nearest earlier
+ * partition, and one paged out has just its own nodes deleted, so the list
+ * must not be otherwise changed, and the events on it must not be edited.
+ * invalidCount counts the events of damaged partitions.
+ */
+typedef struct PartitionStore {
+	FILE* source;
+	ArchiveReader* archive;
+	Partition* partitions;
+	long budget;
+	long residentBytes;
+	unsigned long clock;
+	LinkedList* list;
+	int invalidCount;
+} PartitionStore;
+
+/**
+ * Opens the named archive for paging, with nothing paged in yet. budget is
+ * the most memory, in bytes, the paged-in events should take. Returns NULL
+ * if the file can't be opened or isn't an archive.
+ */
+PartitionStore* openPartitions(char* filename, long budget);
+
+/**
+ * Pages in every partition holding events that overlap rangeStart up to
+ * rangeEnd (in minutes, as for eventStart), then pages out the partitions
+ * used longest ago, other than those, until the store is within its budget.
+ * Returns TRUE if the store's list changed.
+ */
+int pageInRange(PartitionStore* store, long rangeStart, long rangeEnd);
+
+/**
+ * Closes a store, freeing its list and every paged-in event, and closing
+ * its file.
+ */
+void closePartitions(PartitionStore* store);
+
+#endif
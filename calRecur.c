@@ -0,0 +1,543 @@
+/**
+ * Contains functions for recurring events. A recurring event is stored once,
+ * with a repeat rule, and its occurrences are only worked out for the range
+ * of dates being displayed or searched.
+ *
+ * Author: Alex Burress
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "linkedList.h"
+#include "calText.h"
+#include "calFile.h"
+#include "calDate.h"
+#include "calRecur.h"
+#include "calCursor.h"
+#include "calZone.h"
+
+#define FALSE 0
+#define TRUE !FALSE
+
+/**
+ * Divides, rounding towards negative infinity rather than towards zero.
+ */
+static long floorDiv(long numerator, long denominator)
+{
+	long quotient;
+
+	quotient = numerator / denominator;
+	if ((numerator % denominator != 0) && ((numerator < 0) != (denominator < 0)))
+	{
+		quotient--;
+	}
+
+	return quotient;
+}
+
+/**
+ * Parses a date written as YYYY-MM-DD or DD/MM/YYYY into a day number.
+ * Returns FALSE if the text isn't a valid date.
+ */
+static int parseRuleDate(char* text, long* outDay)
+{
+	int year;
+	int month;
+	int day;
+	int valid;
+
+	valid = FALSE;
+
+	if (sscanf(text, "%d-%d-%d", &year, &month, &day) == 3 ||
+		sscanf(text, "%d/%d/%d", &day, &month, &year) == 3)
+	{
+		if (eventValid(year, month, day, 0, 0, 1) == TRUE)
+		{
+			*outDay = daysFromCivil(year, month, day);
+			valid = TRUE;
+		}
+	}
+
+	return valid;
+}
+
+/**
+ * Returns TRUE if day is one of the rule's exceptions, found by binary
+ * search.
+ */
+static int isException(Recurrence* rule, long day)
+{
+	int low;
+	int high;
+	int middle;
+	int found;
+
+	low = 0;
+	high = rule->numExceptions - 1;
+	found = FALSE;
+
+	while (low <= high && found == FALSE)
+	{
+		middle = (low + high) / 2;
+
+		if (rule->exceptions[middle] == day)
+		{
+			found = TRUE;
+		}
+		else if (rule->exceptions[middle] < day)
+		{
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle - 1;
+		}
+	}
+
+	return found;
+}
+
+/**
+ * Orders occurrences by start time, for qsort.
+ */
+static int compareOccurrences(const void* first, const void* second)
+{
+	long firstStart;
+	long secondStart;
+
+	firstStart = ((const Occurrence*)first)->start;
+	secondStart = ((const Occurrence*)second)->start;
+
+	return (firstStart > secondStart) - (firstStart < secondStart);
+}
+
+/**
+ * Returns the next word of the text at *rest, ending it with a null
+ * terminator in place, and moves *rest past it. Returns NULL once no words
+ * are left. Unlike strtok it keeps no state of its own, so rules can be
+ * parsed on several threads at once.
+ */
+static char* nextWord(char** rest)
+{
+	char* word;
+
+	word = *rest + strspn(*rest, " \t\r\n");
+	*rest = word + strcspn(word, " \t\r\n");
+
+	if (**rest != '\0')
+	{
+		**rest = '\0';
+		(*rest)++;
+	}
+
+	if (*word == '\0')
+	{
+		word = NULL;
+	}
+
+	return word;
+}
+
+/**
+ * Parses a repeat rule such as "weekly 2 until 2014-12-31 except 2014-03-04"
+ * into rule. The frequency is daily, weekly or monthly (in any case), the
+ * interval defaults to 1, and dates can be written as YYYY-MM-DD or
+ * DD/MM/YYYY. Returns FALSE if the text isn't a valid rule, or is longer than
+ * MAX_RULE_TEXT. Can be called from several threads at once.
+ */
+int parseRecurrence(char* text, Recurrence* rule)
+{
+	char words[MAX_RULE_TEXT];
+	char* word;
+	char* rest;
+	int valid;
+	int inExceptions;
+	long day;
+	int ii;
+
+	memset(rule, 0, sizeof(Recurrence));
+	rule->interval = 1;
+	valid = TRUE;
+	inExceptions = FALSE;
+
+	/* work on a lower case copy, as words are split in place */
+	strncpy(words, text, MAX_RULE_TEXT - 1);
+	words[MAX_RULE_TEXT - 1] = '\0';
+	for (ii = 0; words[ii] != '\0'; ii++)
+	{
+		words[ii] = tolower((unsigned char)words[ii]);
+	}
+
+	rest = words;
+	word = nextWord(&rest);
+
+	/* frequency comes first, and a rule too long to copy whole is rejected */
+	if (word == NULL || strlen(text) >= MAX_RULE_TEXT)
+	{
+		valid = FALSE;
+	}
+	else if (strcmp(word, "daily") == 0)
+	{
+		rule->frequency = REPEAT_DAILY;
+	}
+	else if (strcmp(word, "weekly") == 0)
+	{
+		rule->frequency = REPEAT_WEEKLY;
+	}
+	else if (strcmp(word, "monthly") == 0)
+	{
+		rule->frequency = REPEAT_MONTHLY;
+	}
+	else
+	{
+		valid = FALSE;
+	}
+
+	word = nextWord(&rest);
+
+	/* then an optional interval */
+	if (valid == TRUE && word != NULL && isdigit((unsigned char)word[0]) && strchr(word, '-') == NULL && strchr(word, '/') == NULL)
+	{
+		rule->interval = atoi(word);
+		if (rule->interval < 1 || rule->interval > MAX_INTERVAL)
+		{
+			valid = FALSE;
+		}
+		word = nextWord(&rest);
+	}
+
+	/* then optional end and exception dates */
+	while (valid == TRUE && word != NULL)
+	{
+		if (strcmp(word, "until") == 0)
+		{
+			word = nextWord(&rest);
+			if (word == NULL || parseRuleDate(word, &rule->untilDay) == FALSE)
+			{
+				valid = FALSE;
+			}
+			rule->hasUntil = TRUE;
+			inExceptions = FALSE;
+		}
+		else if (strcmp(word, "except") == 0)
+		{
+			inExceptions = TRUE;
+		}
+		else if (inExceptions == TRUE && parseRuleDate(word, &day) == TRUE &&
+			rule->numExceptions < MAX_EXCEPTIONS)
+		{
+			addException(rule, day);
+		}
+		else
+		{
+			valid = FALSE;
+		}
+
+		if (word != NULL)
+		{
+			word = nextWord(&rest);
+		}
+	}
+
+	return valid;
+}
+
+/**
+ * Adds a date, as a day number, to the dates a rule's event does not occur
+ * on, keeping them in ascending order. Dates already on the list are ignored.
+ * Returns FALSE if the rule already has MAX_EXCEPTIONS dates.
+ */
+int addException(Recurrence* rule, long day)
+{
+	int added;
+	int ii;
+
+	added = TRUE;
+
+	if (isException(rule, day) == FALSE)
+	{
+		if (rule->numExceptions < MAX_EXCEPTIONS)
+		{
+			ii = rule->numExceptions;
+			while (ii > 0 && rule->exceptions[ii - 1] > day)
+			{
+				rule->exceptions[ii] = rule->exceptions[ii - 1];
+				ii--;
+			}
+			rule->exceptions[ii] = day;
+			rule->numExceptions++;
+		}
+		else
+		{
+			added = FALSE;
+		}
+	}
+
+	return added;
+}
+
+/**
+ * Writes a repeat rule to outText in the form read by parseRecurrence,
+ * with dates as YYYY-MM-DD. outText must have room for MAX_RULE_TEXT chars.
+ */
+void recurrenceToText(char* outText, Recurrence* rule)
+{
+	Date date;
+	int length;
+	int ii;
+
+	switch (rule->frequency)
+	{
+		case REPEAT_DAILY:
+			length = sprintf(outText, "daily %d", rule->interval);
+			break;
+		case REPEAT_WEEKLY:
+			length = sprintf(outText, "weekly %d", rule->interval);
+			break;
+		default:
+			length = sprintf(outText, "monthly %d", rule->interval);
+			break;
+	}
+
+	if (rule->hasUntil == TRUE)
+	{
+		civilFromDays(rule->untilDay, &date);
+		length += sprintf(outText + length, " until %d-%02d-%02d", date.year, date.month, date.day);
+	}
+
+	if (rule->numExceptions > 0)
+	{
+		length += sprintf(outText + length, " except");
+
+		for (ii = 0; ii < rule->numExceptions; ii++)
+		{
+			civilFromDays(rule->exceptions[ii], &date);
+			length += sprintf(outText + length, " %d-%02d-%02d", date.year, date.month, date.day);
+		}
+	}
+}
+
+/**
+ * Writes a description of a repeat rule, for display in the gui, to outText.
+ * outText must have room for MAX_RULE_TEXT chars.
+ */
+void describeRecurrence(char* outText, Recurrence* rule)
+{
+	static const char* units[3] = { "day", "week", "month" };
+	static const char* singular[3] = { "daily", "weekly", "monthly" };
+	char textMonth[20];
+	Date date;
+	int length;
+
+	if (rule->interval == 1)
+	{
+		length = sprintf(outText, "Repeats %s", singular[rule->frequency - 1]);
+	}
+	else
+	{
+		length = sprintf(outText, "Repeats every %d %ss", rule->interval, units[rule->frequency - 1]);
+	}
+
+	if (rule->hasUntil == TRUE)
+	{
+		civilFromDays(rule->untilDay, &date);
+		spellMonth(textMonth, date.month);
+		length += sprintf(outText + length, " until %d %s%d", date.day, textMonth, date.year);
+	}
+
+	if (rule->numExceptions == 1)
+	{
+		sprintf(outText + length, ", except on 1 date");
+	}
+	else if (rule->numExceptions > 1)
+	{
+		sprintf(outText + length, ", except on %d dates", rule->numExceptions);
+	}
+}
+
+/**
+ * Sets up a cursor over the occurrences of event that start at or after
+ * rangeStart and before rangeEnd (both in minutes, as for eventStart). Jumps
+ * straight to the first repetition in range rather than stepping through
+ * the earlier ones.
+ */
+void firstOccurrence(OccurrenceCursor* cursor, Event* event, long rangeStart, long rangeEnd)
+{
+	Recurrence* rule;
+	Date rangeDate;
+	long start;
+	long step;
+	long months;
+
+	cursor->event = event;
+	cursor->rangeStart = rangeStart;
+	cursor->rangeEnd = rangeEnd;
+	cursor->index = 0;
+	cursor->firstDay = daysFromCivil(event->eDate.year, event->eDate.month, event->eDate.day);
+	cursor->timeOfDay = event->eTime.hrs * 60 + event->eTime.mins;
+	cursor->done = FALSE;
+
+	rule = event->repeat;
+	start = cursor->firstDay * MINS_PER_DAY + cursor->timeOfDay;
+
+	/* repetitions are stepped through on the event's own wall clock */
+	if (event->zone != NULL)
+	{
+		rangeStart = convertZone(rangeStart, NULL, event->zone);
+	}
+
+	if (rule != NULL && rangeStart > start)
+	{
+		if (rule->frequency == REPEAT_MONTHLY)
+		{
+			/* months from the event's month to the range's month */
+			civilFromDays(minutesToDay(rangeStart), &rangeDate);
+			months = (rangeDate.year - event->eDate.year) * 12L + (rangeDate.month - event->eDate.month);
+			cursor->index = floorDiv(months, rule->interval);
+		}
+		else
+		{
+			step = (long)rule->interval * MINS_PER_DAY * ((rule->frequency == REPEAT_WEEKLY) ? 7 : 1);
+			cursor->index = floorDiv(rangeStart - start + step - 1, step);
+		}
+
+		if (cursor->index < 0)
+		{
+			cursor->index = 0;
+		}
+	}
+}
+
+/**
+ * Stores the cursor's next occurrence in outOccurrence and returns TRUE, or
+ * returns FALSE once there are no more occurrences in range.
+ */
+int nextOccurrence(OccurrenceCursor* cursor, Occurrence* outOccurrence)
+{
+	Recurrence* rule;
+	Event* event;
+	Date date;
+	long day;
+	long months;
+	long start;
+	int found;
+	int dayValid;
+
+	event = cursor->event;
+	rule = event->repeat;
+	found = FALSE;
+
+	while (cursor->done == FALSE && found == FALSE)
+	{
+		dayValid = TRUE;
+
+		/* work out the date of repetition number index */
+		if (rule == NULL)
+		{
+			date = event->eDate;
+			day = cursor->firstDay;
+			cursor->done = TRUE;
+		}
+		else if (rule->frequency == REPEAT_MONTHLY)
+		{
+			months = (event->eDate.year * 12L + event->eDate.month - 1) + cursor->index * rule->interval;
+			date.year = (int)(months / 12);
+			date.month = (int)(months % 12) + 1;
+			date.day = event->eDate.day;
+
+			/* months too short for the day are skipped */
+			if (date.day > daysInMonth(date.year, date.month))
+			{
+				date.day = 1;
+				dayValid = FALSE;
+			}
+			day = daysFromCivil(date.year, date.month, date.day);
+		}
+		else
+		{
+			day = cursor->firstDay + cursor->index * rule->interval * ((rule->frequency == REPEAT_WEEKLY) ? 7 : 1);
+			civilFromDays(day, &date);
+		}
+		cursor->index++;
+
+		start = day * MINS_PER_DAY + cursor->timeOfDay;
+		if (event->zone != NULL)
+		{
+			start = convertZone(start, event->zone, NULL);
+		}
+
+		/* stop at the end of the range or of the rule */
+		if (start >= cursor->rangeEnd || date.year > 3000 ||
+			(rule != NULL && rule->hasUntil == TRUE && day > rule->untilDay))
+		{
+			cursor->done = TRUE;
+		}
+		else if (dayValid == TRUE && start >= cursor->rangeStart &&
+			(rule == NULL || isException(rule, day) == FALSE))
+		{
+			outOccurrence->event = event;
+			outOccurrence->date = date;
+			outOccurrence->start = start;
+			found = TRUE;
+		}
+	}
+
+	return found;
+}
+
+/**
+ * Finds every occurrence of every event on the list that starts within the
+ * range, in order of start time. One-off events and the expanded repetitions
+ * of recurring events are merged together. Returns an array that must be
+ * freed by the caller, and stores its length in outCount.
+ */
+Occurrence* queryRange(LinkedList* list, long rangeStart, long rangeEnd, int* outCount)
+{
+	return queryRanges(&list, 1, rangeStart, rangeEnd, outCount);
+}
+
+/**
+ * Finds every occurrence of every event on several lists that starts within
+ * the range, in order of start time, as queryRange does for one list.
+ */
+Occurrence* queryRanges(LinkedList** lists, int numLists, long rangeStart, long rangeEnd, int* outCount)
+{
+	Occurrence* found;
+	OccurrenceCursor cursor;
+	EventCursor events;
+	Event* event;
+	int capacity;
+	int count;
+	int ii;
+
+	capacity = 64;
+	count = 0;
+	found = (Occurrence*)malloc(capacity * sizeof(Occurrence));
+
+	for (ii = 0; ii < numLists; ii++)
+	{
+		openCursor(&events, lists[ii]);
+		for (event = cursorFirst(&events); event != NULL; event = cursorNext(&events))
+		{
+			firstOccurrence(&cursor, event, rangeStart, rangeEnd);
+
+			while (nextOccurrence(&cursor, &found[count]) == TRUE)
+			{
+				count++;
+
+				if (count == capacity)
+				{
+					capacity *= 2;
+					found = (Occurrence*)realloc(found, capacity * sizeof(Occurrence));
+				}
+			}
+		}
+	}
+
+	qsort(found, count, sizeof(Occurrence), &compareOccurrences);
+
+	*outCount = count;
+	return found;
+}
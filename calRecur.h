@@ -0,0 +1,104 @@
+/**
+ * Contains functions for recurring events. A recurring event is stored once,
+ * with a repeat rule, and its occurrences are only worked out for the range
+ * of dates being displayed or searched.
+ *
+ * Author: Alex Burress
+ */
+
+#ifndef CALRECUR_H
+#define CALRECUR_H
+#include "linkedList.h"
+
+/* the largest interval a repeat rule can have */
+#define MAX_INTERVAL 1000
+
+/* the longest text recurrenceToText or describeRecurrence can produce */
+#define MAX_RULE_TEXT (80 + MAX_EXCEPTIONS * 11)
+
+/**
+ * One occurrence of an event. For one-off events this is the event itself,
+ * for recurring events it is the event moved to the date of one repetition.
+ * date is on the event's own wall clock, and start is in minutes, as
+ * returned by eventStart.
+ */
+typedef struct Occurrence {
+	Event* event;
+	Date date;
+	long start;
+} Occurrence;
+
+/**
+ * Steps through the occurrences of one event that start within a range,
+ * without expanding any outside it. Set up with firstOccurrence, then call
+ * nextOccurrence until it returns FALSE. firstDay is the day number of the
+ * event's date and timeOfDay its minutes past midnight, so each daily or
+ * weekly repetition is found with a multiply and an add.
+ */
+typedef struct OccurrenceCursor {
+	Event* event;
+	long rangeStart;
+	long rangeEnd;
+	long index;
+	long firstDay;
+	int timeOfDay;
+	int done;
+} OccurrenceCursor;
+
+/**
+ * Parses a repeat rule such as "weekly 2 until 2014-12-31 except 2014-03-04"
+ * into rule. The frequency is daily, weekly or monthly (in any case), the
+ * interval defaults to 1, and dates can be written as YYYY-MM-DD or
+ * DD/MM/YYYY. Returns FALSE if the text isn't a valid rule, or is longer than
+ * MAX_RULE_TEXT. Can be called from several threads at once.
+ */
+int parseRecurrence(char* text, Recurrence* rule);
+
+/**
+ * Adds a date, as a day number, to the dates a rule's event does not occur
+ * on, keeping them in ascending order. Dates already on the list are ignored.
+ * Returns FALSE if the rule already has MAX_EXCEPTIONS dates.
+ */
+int addException(Recurrence* rule, long day);
+
+/**
+ * Writes a repeat rule to outText in the form read by parseRecurrence,
+ * with dates as YYYY-MM-DD. outText must have room for MAX_RULE_TEXT chars.
+ */
+void recurrenceToText(char* outText, Recurrence* rule);
+
+/**
+ * Writes a description of a repeat rule, for display in the gui, to outText.
+ * outText must have room for MAX_RULE_TEXT chars.
+ */
+void describeRecurrence(char* outText, Recurrence* rule);
+
+/**
+ * Sets up a cursor over the occurrences of event that start at or after
+ * rangeStart and before rangeEnd (both in minutes, as for eventStart). Jumps
+ * straight to the first repetition in range rather than stepping through
+ * the earlier ones.
+ */
+void firstOccurrence(OccurrenceCursor* cursor, Event* event, long rangeStart, long rangeEnd);
+
+/**
+ * Stores the cursor's next occurrence in outOccurrence and returns TRUE, or
+ * returns FALSE once there are no more occurrences in range.
+ */
+int nextOccurrence(OccurrenceCursor* cursor, Occurrence* outOccurrence);
+
+/**
+ * Finds every occurrence of every event on the list that starts within the
+ * range, in order of start time. One-off events and the expanded repetitions
+ * of recurring events are merged together. Returns an array that must be
+ * freed by the caller, and stores its length in outCount.
+ */
+Occurrence* queryRange(LinkedList* list, long rangeStart, long rangeEnd, int* outCount);
+
+/**
+ * Finds every occurrence of every event on several lists that starts within
+ * the range, in order of start time, as queryRange does for one list.
+ */
+Occurrence* queryRanges(LinkedList** lists, int numLists, long rangeStart, long rangeEnd, int* outCount);
+
+#endif
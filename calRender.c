@@ -0,0 +1,228 @@
+/**
+ * Contains a cache of the text each event renders to, for the gui window
+ * and for a calendar file, so an event is formatted once rather than on
+ * every refresh and save. An event's text is dropped when it is about to be
+ * modified in place or is freed. Once the cached text takes more than a
+ * memory budget, the text used longest ago is dropped. The cache can be used
+ * from any thread.
+ *
+ * Author: Alex Burress
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "linkedList.h"
+#include "calText.h"
+#include "calRender.h"
+
+#define FALSE 0
+#define TRUE !FALSE
+
+/**
+ * The cached text of every event. Entries run from newest, the most
+ * recently used, to oldest, and bytes is the memory they take in all.
+ */
+typedef struct RenderCache {
+	pthread_mutex_t lock;
+	RenderedText* newest;
+	RenderedText* oldest;
+	long bytes;
+	long budget;
+} RenderCache;
+
+static RenderCache cache;
+static pthread_once_t cacheOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * Sets up an empty cache with the default budget.
+ */
+static void initCache()
+{
+	pthread_mutex_init(&cache.lock, NULL);
+	cache.newest = NULL;
+	cache.oldest = NULL;
+	cache.bytes = 0;
+	cache.budget = DEFAULT_RENDER_BUDGET;
+}
+
+/**
+ * Takes an entry off the list of entries, leaving it in place on its event.
+ */
+static void unlinkEntry(RenderedText* entry)
+{
+	if (entry->newer != NULL)
+	{
+		entry->newer->older = entry->older;
+	}
+	else
+	{
+		cache.newest = entry->older;
+	}
+
+	if (entry->older != NULL)
+	{
+		entry->older->newer = entry->newer;
+	}
+	else
+	{
+		cache.oldest = entry->newer;
+	}
+}
+
+/**
+ * Puts an entry at the newest end of the list of entries.
+ */
+static void linkNewest(RenderedText* entry)
+{
+	entry->newer = NULL;
+	entry->older = cache.newest;
+
+	if (cache.newest != NULL)
+	{
+		cache.newest->newer = entry;
+	}
+	else
+	{
+		cache.oldest = entry;
+	}
+
+	cache.newest = entry;
+}
+
+/**
+ * Removes an entry from the cache and its event, and frees it. The cache
+ * must be locked.
+ */
+static void dropEntry(RenderedText* entry)
+{
+	int ii;
+
+	unlinkEntry(entry);
+	entry->event->rendered = NULL;
+	cache.bytes -= entry->bytes;
+
+	for (ii = 0; ii < RENDER_FORMS; ii++)
+	{
+		free(entry->text[ii]);
+	}
+	free(entry);
+}
+
+/**
+ * Drops the entries used longest ago, other than keep, until the cache is
+ * within its budget. The cache must be locked.
+ */
+static void trimCache(RenderedText* keep)
+{
+	while (cache.bytes > cache.budget && cache.oldest != NULL && cache.oldest != keep)
+	{
+		dropEntry(cache.oldest);
+	}
+}
+
+/**
+ * Copies the text of an event, in the given form (as parseEventWindow or
+ * parseEventText writes it), to dest, which must have room for
+ * MAX_EVENT_TEXT characters. The text is formatted and cached the first
+ * time, then copied from the cache. Returns the length of the text.
+ */
+int renderEvent(char* dest, Event* event, int form)
+{
+	RenderedText* entry;
+	int length;
+
+	pthread_once(&cacheOnce, &initCache);
+	pthread_mutex_lock(&cache.lock);
+
+	entry = event->rendered;
+
+	if (entry != NULL && entry->text[form] != NULL)
+	{
+		length = entry->length[form];
+		memcpy(dest, entry->text[form], length + 1);
+	}
+	else
+	{
+		/* formatting doesn't touch the cache, so it is done unlocked */
+		pthread_mutex_unlock(&cache.lock);
+
+		if (form == RENDER_WINDOW)
+		{
+			parseEventWindow(dest, event);
+		}
+		else
+		{
+			parseEventText(dest, event);
+		}
+		length = strlen(dest);
+
+		pthread_mutex_lock(&cache.lock);
+
+		/* another thread may have cached the event in the meantime */
+		entry = event->rendered;
+		if (entry == NULL)
+		{
+			entry = (RenderedText*)calloc(1, sizeof(RenderedText));
+			entry->event = event;
+			entry->bytes = sizeof(RenderedText);
+			event->rendered = entry;
+			linkNewest(entry);
+			cache.bytes += entry->bytes;
+		}
+
+		if (entry->text[form] == NULL)
+		{
+			entry->text[form] = (char*)malloc(length + 1);
+			memcpy(entry->text[form], dest, length + 1);
+			entry->length[form] = length;
+			entry->bytes += length + 1;
+			cache.bytes += length + 1;
+		}
+	}
+
+	/* the entry becomes the newest, then older ones make room for it */
+	unlinkEntry(entry);
+	linkNewest(entry);
+	trimCache(entry);
+
+	pthread_mutex_unlock(&cache.lock);
+
+	return length;
+}
+
+/**
+ * Drops any cached text of the passed-in event. Called when the event is
+ * about to be modified in place, or freed.
+ */
+void forgetRendered(Event* event)
+{
+	/* the field is checked under the lock too, as a save thread rendering
+	 * other events may drop this event's text to make room at any time
+	 */
+	pthread_once(&cacheOnce, &initCache);
+	pthread_mutex_lock(&cache.lock);
+
+	if (event->rendered != NULL)
+	{
+		dropEntry(event->rendered);
+	}
+
+	pthread_mutex_unlock(&cache.lock);
+}
+
+/**
+ * Sets the most memory, in bytes, the cached text may take, dropping the
+ * text used longest ago until the cache is within it.
+ */
+void setRenderBudget(long budget)
+{
+	pthread_once(&cacheOnce, &initCache);
+	pthread_mutex_lock(&cache.lock);
+
+	cache.budget = budget;
+	trimCache(NULL);
+
+	pthread_mutex_unlock(&cache.lock);
+}
@@ -0,0 +1,59 @@
+/**
+ * Contains a cache of the text each event renders to, for the gui window
+ * and for a calendar file, so an event is formatted once rather than on
+ * every refresh and save. An event's text is dropped when it is about to be
+ * modified in place or is freed. Once the cached text takes more than a
+ * memory budget, the text used longest ago is dropped. The cache can be used
+ * from any thread.
+ *
+ * Author: Alex Burress
+ */
+
+#ifndef CALRENDER_H
+#define CALRENDER_H
+#include "linkedList.h"
+
+/* the forms an event is rendered in */
+#define RENDER_WINDOW 0
+#define RENDER_TEXT 1
+#define RENDER_FORMS 2
+
+/* the memory the cache may take when no budget is set, in bytes */
+#define DEFAULT_RENDER_BUDGET (16L * 1024L * 1024L)
+
+/**
+ * The cached text of one event, held through event->rendered. text holds
+ * each form rendered so far, or NULL, with its length. Entries are kept on
+ * a list from most to least recently used, and bytes is the memory the entry
+ * takes.
+ */
+typedef struct RenderedText {
+	Event* event;
+	char* text[RENDER_FORMS];
+	int length[RENDER_FORMS];
+	long bytes;
+	struct RenderedText* newer;
+	struct RenderedText* older;
+} RenderedText;
+
+/**
+ * Copies the text of an event, in the given form (as parseEventWindow or
+ * parseEventText writes it), to dest, which must have room for
+ * MAX_EVENT_TEXT characters. The text is formatted and cached the first
+ * time, then copied from the cache. Returns the length of the text.
+ */
+int renderEvent(char* dest, Event* event, int form);
+
+/**
+ * Drops any cached text of the passed-in event. Called when the event is
+ * about to be modified in place, or freed.
+ */
+void forgetRendered(Event* event);
+
+/**
+ * Sets the most memory, in bytes, the cached text may take, dropping the
+ * text used longest ago until the cache is within it.
+ */
+void setRenderBudget(long budget);
+
+#endif
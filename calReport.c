@@ -0,0 +1,187 @@
+/**
+ * Contains a report of the invalid entries found while loading a calendar
+ * file. Rather than stopping to tell the user about each one, loaders add a
+ * diagnostic giving the line an entry starts on, the field at fault and why,
+ * and carry on, so a file with many bad entries loads at full speed. Only
+ * the first diagnostics, up to a cap, are kept, but every invalid entry is
+ * counted. None of these functions use the gui, but a report must only be
+ * added to from one thread at a time.
+ *
+ * Author: Alex Burress
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "calReport.h"
+
+#define FALSE 0
+#define TRUE !FALSE
+
+/* the longest a diagnostic is once written out, fields and reasons included */
+#define MAX_DIAGNOSTIC_TEXT 200
+
+/**
+ * Writes one diagnostic to outText as a line, without a newline.
+ */
+static void diagnosticToText(char* outText, Diagnostic* diagnostic)
+{
+	int length;
+
+	length = 0;
+	if (diagnostic->line > 0)
+	{
+		length = sprintf(outText, "line %ld, ", diagnostic->line);
+	}
+
+	length += sprintf(outText + length, "%.40s: %.80s", diagnostic->field, diagnostic->reason);
+
+	if (diagnostic->entries > 1)
+	{
+		sprintf(outText + length, " (%ld entries)", diagnostic->entries);
+	}
+}
+
+/**
+ * Returns the number of invalid entries the diagnostics of a report, from
+ * the first up to count, stand for.
+ */
+static long entriesIn(ValidationReport* report, int count)
+{
+	long entries;
+	int ii;
+
+	entries = 0;
+	for (ii = 0; ii < count; ii++)
+	{
+		entries += report->diagnostics[ii].entries;
+	}
+
+	return entries;
+}
+
+/**
+ * Sets up an empty report which will keep up to cap diagnostics.
+ */
+void initReport(ValidationReport* report, int cap)
+{
+	report->diagnostics = NULL;
+	report->count = 0;
+	report->cap = cap;
+	report->invalidCount = 0;
+	report->linesRead = 0;
+}
+
+/**
+ * Adds an invalid entry to a report. Entries with the same field and reason
+ * as the one before, without a line of their own, are kept as one
+ * diagnostic. Does nothing if report is NULL.
+ */
+void reportInvalid(ValidationReport* report, long line, char* field, char* reason)
+{
+	Diagnostic* last;
+
+	if (report != NULL)
+	{
+		report->invalidCount++;
+		last = (report->count > 0) ? &report->diagnostics[report->count - 1] : NULL;
+
+		/* such as each event of a damaged archive block */
+		if (last != NULL && line == 0 && last->line == 0 && last->field == field && last->reason == reason)
+		{
+			last->entries++;
+		}
+		else if (report->count < report->cap)
+		{
+			if (report->diagnostics == NULL)
+			{
+				report->diagnostics = (Diagnostic*)malloc(report->cap * sizeof(Diagnostic));
+			}
+
+			last = &report->diagnostics[report->count];
+			last->line = line;
+			last->field = field;
+			last->reason = reason;
+			last->entries = 1;
+			report->count++;
+		}
+	}
+}
+
+/**
+ * Returns a summary of a report, to be shown to the user in one message: the
+ * number of invalid entries, then up to maxShown diagnostics, one per line.
+ * The string must be freed by the caller.
+ */
+char* reportToText(ValidationReport* report, int maxShown)
+{
+	char* text;
+	int length;
+	int shown;
+	int ii;
+
+	shown = (report->count < maxShown) ? report->count : maxShown;
+
+	/* room for the first and last lines, and each diagnostic shown */
+	text = (char*)malloc((shown + 2) * MAX_DIAGNOSTIC_TEXT * sizeof(char));
+	length = sprintf(text, "Invalid event data found, %d invalid entries were omitted", report->invalidCount);
+
+	for (ii = 0; ii < shown; ii++)
+	{
+		text[length] = '\n';
+		length++;
+		diagnosticToText(text + length, &report->diagnostics[ii]);
+		length += strlen(text + length);
+	}
+
+	if (report->invalidCount > entriesIn(report, shown))
+	{
+		sprintf(text + length, "\n...and %ld more", report->invalidCount - entriesIn(report, shown));
+	}
+
+	return text;
+}
+
+/**
+ * Writes every diagnostic kept in a report to a file, one per line, after a
+ * line naming the calendar file they came from. Returns the number of bytes
+ * written, or -1 if writing failed.
+ */
+long writeReport(FILE* dest, ValidationReport* report, char* filename)
+{
+	char line[MAX_DIAGNOSTIC_TEXT];
+	long bytesWritten;
+	long unkept;
+	int ii;
+
+	bytesWritten = fprintf(dest, "%s: %d invalid entries were omitted\n", filename, report->invalidCount);
+
+	for (ii = 0; ii < report->count; ii++)
+	{
+		diagnosticToText(line, &report->diagnostics[ii]);
+		bytesWritten += fprintf(dest, "%s\n", line);
+	}
+
+	/* entries past the cap were counted but not kept */
+	unkept = report->invalidCount - entriesIn(report, report->count);
+	if (unkept > 0)
+	{
+		bytesWritten += fprintf(dest, "...and %ld more, past the limit of %d\n", unkept, report->cap);
+	}
+
+	if (ferror(dest) != 0)
+	{
+		bytesWritten = -1;
+	}
+
+	return bytesWritten;
+}
+
+/**
+ * Frees the diagnostics of a report, leaving it empty.
+ */
+void freeReport(ValidationReport* report)
+{
+	free(report->diagnostics);
+	initReport(report, report->cap);
+}
@@ -0,0 +1,78 @@
+/**
+ * Contains a report of the invalid entries found while loading a calendar
+ * file. Rather than stopping to tell the user about each one, loaders add a
+ * diagnostic giving the line an entry starts on, the field at fault and why,
+ * and carry on, so a file with many bad entries loads at full speed. Only
+ * the first diagnostics, up to a cap, are kept, but every invalid entry is
+ * counted. None of these functions use the gui, but a report must only be
+ * added to from one thread at a time.
+ *
+ * Author: Alex Burress
+ */
+
+#ifndef CALREPORT_H
+#define CALREPORT_H
+#include <stdio.h>
+
+/* the most diagnostics a report keeps when no cap is given */
+#define DEFAULT_MAX_DIAGNOSTICS 100
+
+/**
+ * Why one entry, or a run of entries with the same problem, was invalid.
+ * line is the line of the file the entry starts on, or 0 for formats
+ * without lines. field and reason are fixed strings, which aren't copied.
+ * entries counts the invalid entries in a row this diagnostic stands for.
+ */
+typedef struct Diagnostic {
+	long line;
+	char* field;
+	char* reason;
+	long entries;
+} Diagnostic;
+
+/**
+ * The invalid entries of one file. diagnostics holds up to cap of them, and
+ * is only allocated once the first is added. invalidCount counts every
+ * invalid entry, kept or not. linesRead is the number of lines a loader has
+ * read from the file so far, so that each entry read knows its line.
+ */
+typedef struct ValidationReport {
+	Diagnostic* diagnostics;
+	int count;
+	int cap;
+	int invalidCount;
+	long linesRead;
+} ValidationReport;
+
+/**
+ * Sets up an empty report which will keep up to cap diagnostics.
+ */
+void initReport(ValidationReport* report, int cap);
+
+/**
+ * Adds an invalid entry to a report. Entries with the same field and reason
+ * as the one before, without a line of their own, are kept as one
+ * diagnostic. Does nothing if report is NULL.
+ */
+void reportInvalid(ValidationReport* report, long line, char* field, char* reason);
+
+/**
+ * Returns a summary of a report, to be shown to the user in one message: the
+ * number of invalid entries, then up to maxShown diagnostics, one per line.
+ * The string must be freed by the caller.
+ */
+char* reportToText(ValidationReport* report, int maxShown);
+
+/**
+ * Writes every diagnostic kept in a report to a file, one per line, after a
+ * line naming the calendar file they came from. Returns the number of bytes
+ * written, or -1 if writing failed.
+ */
+long writeReport(FILE* dest, ValidationReport* report, char* filename);
+
+/**
+ * Frees the diagnostics of a report, leaving it empty.
+ */
+void freeReport(ValidationReport* report);
+
+#endif
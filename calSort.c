@@ -0,0 +1,601 @@
+/**
+ * Contains radix sorting of events on packed integer keys, and the bulk
+ * path for adding a batch of events to a list in order of start time, as
+ * every loader does. A batch is sorted in a few linear passes then merged
+ * into the list in one more, rather than each event being inserted on its
+ * own.
+ *
+ * Author: Alex Burress
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <assert.h>
+#include <pthread.h>
+#include "linkedList.h"
+#include "calDate.h"
+#include "calZone.h"
+#include "calStats.h"
+#include "calIntern.h"
+#include "calSort.h"
+
+#define FALSE 0
+#define TRUE !FALSE
+
+/* the bits sorted on in each pass */
+#define RADIX_BITS 11
+#define RADIX_SIZE (1 << RADIX_BITS)
+
+/* added to a start so that starts back to the year 1 are positive */
+#define START_OFFSET 2147483648UL
+
+/**
+ * The rank of the text of every interned id in strcmp order, kept from one
+ * sort by activity to the next. order holds the ids ranked so far in strcmp
+ * order, and ranks the rank of each, indexed by id. Like the texts, the
+ * table is kept until the program exits.
+ */
+typedef struct RankTable {
+	pthread_mutex_t lock;
+	unsigned int* order;
+	unsigned int* ranks;
+	unsigned int count;
+} RankTable;
+
+static RankTable ranking;
+static pthread_once_t rankingOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * Returns the number of bits needed to hold the passed-in value.
+ */
+static int bitsFor(unsigned long value)
+{
+	int bits;
+
+	bits = 0;
+	while (value != 0)
+	{
+		bits++;
+		value >>= 1;
+	}
+
+	return bits;
+}
+
+/**
+ * Returns a time in minutes (as for eventStart) offset to be positive. The
+ * end of a valid event packs into at most 33 bits.
+ */
+static unsigned long packTime(long minutes)
+{
+	return (unsigned long)(minutes + (long)START_OFFSET);
+}
+
+/**
+ * Returns the character of an activity's text at depth, as an unsigned
+ * value, or 0 past its end.
+ */
+static int charAt(unsigned int activity, int depth)
+{
+	return (unsigned char)internedText(activity)[depth];
+}
+
+/**
+ * Sorts activity ids into strcmp order of their text, every text having
+ * the first depth characters in common. A multikey quicksort: the ids are
+ * split three ways by the character at depth, and only the middle third
+ * moves on to the next character, so each character is looked at about
+ * once. Ids are distinct, so their texts are too.
+ */
+static void sortActivities(unsigned int* ids, long count, int depth)
+{
+	unsigned int swap;
+	long less;
+	long greater;
+	long ii;
+	int pivot;
+	int here;
+
+	while (count > 1)
+	{
+		pivot = charAt(ids[count / 2], depth);
+		less = 0;
+		greater = count;
+		ii = 0;
+
+		/* ids[0 to less) are below the pivot, ids[greater to count) above */
+		while (ii < greater)
+		{
+			here = charAt(ids[ii], depth);
+
+			if (here < pivot)
+			{
+				swap = ids[less];
+				ids[less] = ids[ii];
+				ids[ii] = swap;
+				less++;
+				ii++;
+			}
+			else if (here > pivot)
+			{
+				greater--;
+				swap = ids[greater];
+				ids[greater] = ids[ii];
+				ids[ii] = swap;
+			}
+			else
+			{
+				ii++;
+			}
+		}
+
+		sortActivities(ids, less, depth);
+		if (pivot != 0)
+		{
+			sortActivities(ids + less, greater - less, depth + 1);
+		}
+
+		/* the last third is sorted by looping rather than recursing */
+		ids += greater;
+		count -= greater;
+	}
+}
+
+/**
+ * Returns whether the text of activity id a comes before that of b in
+ * strcmp order.
+ */
+static int activityBefore(unsigned int a, unsigned int b)
+{
+	return strcmp(internedText(a), internedText(b)) < 0;
+}
+
+/**
+ * Brings the rank table up to date with every text interned so far. The
+ * texts interned since it was last brought up to date are sorted on their
+ * own, then each is merged in where a binary search of those already ranked
+ * puts it, so the table costs a full sort only the first time. Must be
+ * called with the table's lock held.
+ */
+static void updateRanks()
+{
+	unsigned int* merged;
+	unsigned int numIds;
+	unsigned int ranked;
+	unsigned int low;
+	unsigned int high;
+	unsigned int middle;
+	unsigned int next;
+	unsigned int ii;
+
+	numIds = internedCount();
+
+	if (numIds > ranking.count)
+	{
+		merged = (unsigned int*)malloc(numIds * sizeof(unsigned int));
+		ranking.ranks = (unsigned int*)realloc(ranking.ranks, numIds * sizeof(unsigned int));
+		ranking.order = (unsigned int*)realloc(ranking.order, numIds * sizeof(unsigned int));
+
+		/* the new ids go after those ranked, and are put in order there */
+		for (ii = ranking.count; ii < numIds; ii++)
+		{
+			ranking.order[ii] = ii;
+		}
+		sortActivities(ranking.order + ranking.count, numIds - ranking.count, 0);
+
+		/* each new id goes after every ranked id before it */
+		ranked = 0;
+		next = 0;
+		for (ii = ranking.count; ii < numIds; ii++)
+		{
+			low = ranked;
+			high = ranking.count;
+			while (low < high)
+			{
+				middle = low + (high - low) / 2;
+				if (activityBefore(ranking.order[middle], ranking.order[ii]) == TRUE)
+				{
+					low = middle + 1;
+				}
+				else
+				{
+					high = middle;
+				}
+			}
+
+			memcpy(merged + next, ranking.order + ranked, (low - ranked) * sizeof(unsigned int));
+			next += low - ranked;
+			ranked = low;
+			merged[next] = ranking.order[ii];
+			next++;
+		}
+		memcpy(merged + next, ranking.order + ranked, (ranking.count - ranked) * sizeof(unsigned int));
+
+		free(ranking.order);
+		ranking.order = merged;
+		ranking.count = numIds;
+
+		for (ii = 0; ii < numIds; ii++)
+		{
+			ranking.ranks[merged[ii]] = ii;
+		}
+	}
+}
+
+/**
+ * Sets up the rank table with nothing ranked.
+ */
+static void initRanking()
+{
+	pthread_mutex_init(&ranking.lock, NULL);
+	ranking.order = NULL;
+	ranking.ranks = NULL;
+	ranking.count = 0;
+}
+
+/**
+ * Returns an event's wall clock date and time packed into one number: the
+ * year, month, day, hour and minute, with the lowest bit set if the event
+ * is in a time zone. Only shifts are done on what is read, so a loop
+ * reading events this way isn't held up by each one's cache miss in turn,
+ * as it is when it works out each start with daysFromCivil.
+ */
+static unsigned long packCivil(Event* event)
+{
+	unsigned long civil;
+
+	civil = (unsigned long)event->eDate.year;
+	civil = (civil << 4) | (unsigned long)event->eDate.month;
+	civil = (civil << 5) | (unsigned long)event->eDate.day;
+	civil = (civil << 5) | (unsigned long)event->eTime.hrs;
+	civil = (civil << 6) | (unsigned long)event->eTime.mins;
+
+	return (civil << 1) | (unsigned long)(event->zone != NULL);
+}
+
+/**
+ * Returns the start (as for eventStart) of an event from its wall clock as
+ * packed by packCivil. The event is only read again if it is in a time
+ * zone, to convert its start to display, the display zone.
+ */
+static long unpackStart(unsigned long civil, Event* event, TimeZone* display)
+{
+	long start;
+
+	start = daysFromCivil((int)(civil >> 21), (int)((civil >> 17) & 15), (int)((civil >> 12) & 31)) * MINS_PER_DAY +
+		(long)((civil >> 7) & 31) * 60 + (long)((civil >> 1) & 63);
+
+	if ((civil & 1) != 0)
+	{
+		start = convertZone(start, event->zone, display);
+	}
+
+	return start;
+}
+
+/**
+ * Returns a key ordering events by start time, then by end time: the start
+ * (as for eventStart, offset so every valid date is positive) in the upper
+ * 32 bits, which it fits in for years up to 3000, above the duration. Can be
+ * passed to mergeSorted.
+ */
+unsigned long startKey(Event* event)
+{
+	assert(sizeof(unsigned long) >= 8);
+
+	return ((unsigned long)(eventStart(event) + (long)START_OFFSET) << 32) | (unsigned long)event->duration;
+}
+
+/**
+ * Sorts keys into ascending order of key, keeping keys that are equal in
+ * the order they were in. scratch must have room for count keys. The keys
+ * are sorted 11 bits at a time, least significant first, but only up to
+ * the highest bit that differs between any two keys, and digits that are
+ * the same in every key are skipped, so keys packed densely (as sortKeys
+ * packs them) take a few linear passes however they started out. Keys
+ * already in order take none.
+ */
+void radixSort(SortKey* keys, SortKey* scratch, long count)
+{
+	long* counts;
+	long* digitCounts;
+	SortKey* from;
+	SortKey* to;
+	SortKey* swap;
+	unsigned long differ;
+	long total;
+	long next;
+	int ascending;
+	int passes;
+	int shift;
+	int pass;
+	long ii;
+
+	/* only the bits that differ between keys need sorting on, and none if
+	 * the keys are in order already, as a list's events are by start
+	 */
+	differ = 0;
+	ascending = TRUE;
+	for (ii = 1; ii < count; ii++)
+	{
+		differ |= keys[ii].key ^ keys[0].key;
+		ascending &= (keys[ii].key >= keys[ii - 1].key);
+	}
+
+	passes = 0;
+	while (ascending == FALSE && passes * RADIX_BITS < 64 && (differ >> (passes * RADIX_BITS)) != 0)
+	{
+		passes++;
+	}
+
+	/* one read of the keys counts the digits of every pass */
+	counts = (long*)calloc(passes * RADIX_SIZE + 1, sizeof(long));
+	for (ii = 0; ii < count; ii++)
+	{
+		for (pass = 0; pass < passes; pass++)
+		{
+			counts[pass * RADIX_SIZE + ((keys[ii].key >> (pass * RADIX_BITS)) & (RADIX_SIZE - 1))]++;
+		}
+	}
+
+	from = keys;
+	to = scratch;
+
+	for (pass = 0; pass < passes; pass++)
+	{
+		shift = pass * RADIX_BITS;
+		digitCounts = counts + pass * RADIX_SIZE;
+
+		/* a digit that is the same in every key doesn't change the order */
+		if (digitCounts[(keys[0].key >> shift) & (RADIX_SIZE - 1)] != count)
+		{
+			/* turn the counts into where each digit value starts */
+			total = 0;
+			for (ii = 0; ii < RADIX_SIZE; ii++)
+			{
+				next = total + digitCounts[ii];
+				digitCounts[ii] = total;
+				total = next;
+			}
+
+			for (ii = 0; ii < count; ii++)
+			{
+				to[digitCounts[(from[ii].key >> shift) & (RADIX_SIZE - 1)]++] = from[ii];
+			}
+
+			swap = from;
+			from = to;
+			to = swap;
+		}
+	}
+
+	if (from != keys)
+	{
+		memcpy(keys, from, count * sizeof(SortKey));
+	}
+
+	free(counts);
+}
+
+/**
+ * Finds the sort order named by the passed-in text: start, end, duration or
+ * activity. Returns FALSE if there is no such order.
+ */
+int parseSortOrder(char* text, int* outOrder)
+{
+	int found;
+	int ii;
+
+	found = FALSE;
+
+	for (ii = 0; ii < SORT_ORDERS && found == FALSE; ii++)
+	{
+		if (strcmp(text, sortOrderName(ii)) == 0)
+		{
+			*outOrder = ii;
+			found = TRUE;
+		}
+	}
+
+	return found;
+}
+
+/**
+ * Returns the name of a sort order, as parseSortOrder takes.
+ */
+char* sortOrderName(int order)
+{
+	static char* names[SORT_ORDERS] = { "start", "end", "duration", "activity" };
+
+	return names[order];
+}
+
+/**
+ * Sets the key of each of the passed-in keys from its event, for sorting
+ * with radixSort in one of the orders of sortKeys, without sorting them.
+ * The events are read in one pass and their starts worked out from what
+ * was read in another, so the reads overlap rather than each waiting on
+ * the arithmetic of the last. Each field is packed into the key offset by its smallest
+ * value, so the key has no more bits than the events need. On entry, the
+ * key of each must hold where its event came from, below numSources, which
+ * is packed in below the fields. If the fields and source need more than
+ * the key's 64 bits, as only durations of thousands of years make them, the
+ * field that breaks ties loses its lowest bits, so events that differ only
+ * in those keep the order they were in.
+ */
+void packSortKeys(SortKey* keys, long count, int order, int numSources)
+{
+	unsigned long* fields;
+	unsigned long majorMin;
+	unsigned long majorMax;
+	unsigned long minorMin;
+	unsigned long minorMax;
+	unsigned long tied;
+	TimeZone* display;
+	int sourceBits;
+	int minorBits;
+	int dropBits;
+	Event* event;
+	long start;
+	long ii;
+
+	assert(sizeof(unsigned long) >= 8);
+
+	/* the field sorted on, then the field that breaks ties, for each key */
+	fields = (unsigned long*)malloc((count * 2 + 1) * sizeof(unsigned long));
+	display = displayZone();
+
+	/* read each event's wall clock, and its duration or activity's rank */
+	if (order == SORT_ACTIVITY)
+	{
+		pthread_once(&rankingOnce, &initRanking);
+		pthread_mutex_lock(&ranking.lock);
+		updateRanks();
+
+		for (ii = 0; ii < count; ii++)
+		{
+			fields[ii * 2] = packCivil(keys[ii].event);
+			fields[ii * 2 + 1] = ranking.ranks[keys[ii].event->activity];
+		}
+
+		pthread_mutex_unlock(&ranking.lock);
+	}
+	else
+	{
+		for (ii = 0; ii < count; ii++)
+		{
+			fields[ii * 2] = packCivil(keys[ii].event);
+			fields[ii * 2 + 1] = (unsigned long)keys[ii].event->duration;
+		}
+	}
+
+	majorMin = ULONG_MAX;
+	minorMin = ULONG_MAX;
+	majorMax = 0;
+	minorMax = 0;
+
+	for (ii = 0; ii < count; ii++)
+	{
+		event = keys[ii].event;
+		start = unpackStart(fields[ii * 2], event, display);
+		tied = fields[ii * 2 + 1];
+
+		/* of events ending together, the longest started first */
+		if (order == SORT_END)
+		{
+			fields[ii * 2] = packTime(start + (long)tied);
+			fields[ii * 2 + 1] = (unsigned long)INT_MAX - tied;
+		}
+		else if (order == SORT_DURATION || order == SORT_ACTIVITY)
+		{
+			fields[ii * 2] = tied;
+			fields[ii * 2 + 1] = packTime(start);
+		}
+		else
+		{
+			fields[ii * 2] = packTime(start);
+		}
+
+		majorMin = (fields[ii * 2] < majorMin) ? fields[ii * 2] : majorMin;
+		majorMax = (fields[ii * 2] > majorMax) ? fields[ii * 2] : majorMax;
+		minorMin = (fields[ii * 2 + 1] < minorMin) ? fields[ii * 2 + 1] : minorMin;
+		minorMax = (fields[ii * 2 + 1] > minorMax) ? fields[ii * 2 + 1] : minorMax;
+	}
+
+	if (count > 0)
+	{
+		sourceBits = bitsFor((unsigned long)(numSources - 1));
+		minorBits = bitsFor(minorMax - minorMin);
+
+		/* fields are at most 33 bits, if both are that wide the tie
+		 * breaking field loses its lowest bits
+		 */
+		dropBits = bitsFor(majorMax - majorMin) + minorBits + sourceBits - 64;
+		dropBits = (dropBits > 0) ? dropBits : 0;
+		minorBits -= dropBits;
+
+		for (ii = 0; ii < count; ii++)
+		{
+			keys[ii].key |= (((fields[ii * 2] - majorMin) << minorBits) |
+				((fields[ii * 2 + 1] - minorMin) >> dropBits)) << sourceBits;
+		}
+	}
+
+	free(fields);
+}
+
+/**
+ * Sets the key of each of the passed-in keys from its event, then sorts
+ * them, in the order given: by start (then end), end or duration (ties
+ * going to the earlier start), or by activity in strcmp order, then start.
+ * The keys are set by packSortKeys and sorted by radixSort. For activity
+ * order, the rank of every activity is kept from one sort to the next, and
+ * only activities interned since the last sort are put in order, with a
+ * multikey quicksort that looks at each character once. On entry, the key
+ * of each must hold where its event came from (such as its calendar), below
+ * numSources, which can be read back with keySource and breaks ties.
+ */
+void sortKeys(SortKey* keys, long count, int order, int numSources)
+{
+	SortKey* scratch;
+
+	packSortKeys(keys, count, order, numSources);
+
+	scratch = (SortKey*)malloc((count + 1) * sizeof(SortKey));
+	radixSort(keys, scratch, count);
+	free(scratch);
+}
+
+/**
+ * Returns where the event of a key sorted by sortKeys came from, as set
+ * before the sort. numSources must be as passed to sortKeys.
+ */
+int keySource(SortKey* key, int numSources)
+{
+	return (int)(key->key & ((1UL << bitsFor((unsigned long)(numSources - 1))) - 1));
+}
+
+/**
+ * Sorts an array of events in place, in any of the orders of sortKeys.
+ */
+void sortEvents(Event** events, long count, int order)
+{
+	SortKey* keys;
+	long ii;
+
+	keys = (SortKey*)malloc((count + 1) * sizeof(SortKey));
+
+	for (ii = 0; ii < count; ii++)
+	{
+		keys[ii].key = 0;
+		keys[ii].event = events[ii];
+	}
+
+	sortKeys(keys, count, order, 1);
+
+	for (ii = 0; ii < count; ii++)
+	{
+		events[ii] = keys[ii].event;
+	}
+
+	free(keys);
+}
+
+/**
+ * Adds a batch of events, in any order, to a list kept in order of start
+ * time. The batch is sorted with sortEvents, then merged into the list in
+ * one pass. The list takes over the caller's hold on each event.
+ */
+void bulkInsert(LinkedList* list, Event** events, long count)
+{
+	long startTime;
+
+	startTime = STATS_BEGIN();
+
+	sortEvents(events, count, SORT_START);
+	mergeSorted(list, events, count, &startKey, NULL);
+
+	STATS_END(STAT_INSERT, startTime, count);
+}
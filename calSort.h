@@ -0,0 +1,109 @@
+/**
+ * Contains radix sorting of events on packed integer keys, and the bulk
+ * path for adding a batch of events to a list in order of start time, as
+ * every loader does. A batch is sorted in a few linear passes then merged
+ * into the list in one more, rather than each event being inserted on its
+ * own.
+ *
+ * Author: Alex Burress
+ */
+
+#ifndef CALSORT_H
+#define CALSORT_H
+#include "linkedList.h"
+
+/* the orders events can be sorted in */
+#define SORT_START 0
+#define SORT_END 1
+#define SORT_DURATION 2
+#define SORT_ACTIVITY 3
+#define SORT_ORDERS 4
+
+/**
+ * An event with the key it is sorted on. Keys are compared as unsigned
+ * numbers, so a key packs every field the order depends on, most
+ * significant first. Keys are 64 bits, so unsigned long must be too,
+ * which packSortKeys and startKey assert.
+ */
+typedef struct SortKey {
+	unsigned long key;
+	Event* event;
+} SortKey;
+
+/**
+ * Returns a key ordering events by start time, then by end time: the start
+ * (as for eventStart, offset so every valid date is positive) in the upper
+ * 32 bits, which it fits in for years up to 3000, above the duration. Can be
+ * passed to mergeSorted.
+ */
+unsigned long startKey(Event* event);
+
+/**
+ * Sorts keys into ascending order of key, keeping keys that are equal in
+ * the order they were in. scratch must have room for count keys. The keys
+ * are sorted 11 bits at a time, least significant first, but only up to
+ * the highest bit that differs between any two keys, and digits that are
+ * the same in every key are skipped, so keys packed densely (as sortKeys
+ * packs them) take a few linear passes however they started out. Keys
+ * already in order take none.
+ */
+void radixSort(SortKey* keys, SortKey* scratch, long count);
+
+/**
+ * Finds the sort order named by the passed-in text: start, end, duration or
+ * activity. Returns FALSE if there is no such order.
+ */
+int parseSortOrder(char* text, int* outOrder);
+
+/**
+ * Returns the name of a sort order, as parseSortOrder takes.
+ */
+char* sortOrderName(int order);
+
+/**
+ * Sets the key of each of the passed-in keys from its event, for sorting
+ * with radixSort in one of the orders of sortKeys, without sorting them.
+ * The events are read in one pass and their starts worked out from what
+ * was read in another, so the reads overlap rather than each waiting on
+ * the arithmetic of the last. Each field is packed into the key offset by its smallest
+ * value, so the key has no more bits than the events need. On entry, the
+ * key of each must hold where its event came from, below numSources, which
+ * is packed in below the fields. If the fields and source need more than
+ * the key's 64 bits, as only durations of thousands of years make them, the
+ * field that breaks ties loses its lowest bits, so events that differ only
+ * in those keep the order they were in.
+ */
+void packSortKeys(SortKey* keys, long count, int order, int numSources);
+
+/**
+ * Sets the key of each of the passed-in keys from its event, then sorts
+ * them, in the order given: by start (then end), end or duration (ties
+ * going to the earlier start), or by activity in strcmp order, then start.
+ * The keys are set by packSortKeys and sorted by radixSort. For activity
+ * order, the rank of every activity is kept from one sort to the next, and
+ * only activities interned since the last sort are put in order, with a
+ * multikey quicksort that looks at each character once. On entry, the key
+ * of each must hold where its event came from (such as its calendar), below
+ * numSources, which can be read back with keySource and breaks ties.
+ */
+void sortKeys(SortKey* keys, long count, int order, int numSources);
+
+/**
+ * Returns where the event of a key sorted by sortKeys came from, as set
+ * before the sort. numSources must be as passed to sortKeys.
+ */
+int keySource(SortKey* key, int numSources);
+
+/**
+ * Sorts an array of events in place, in any of the orders of sortKeys.
+ */
+void sortEvents(Event** events, long count, int order);
+
+/**
+ * Adds a batch of events, in any order, to a list kept in order of start
+ * time. The batch is sorted with sortEvents, then merged into the list in
+ * one pass. The list takes over the caller's hold on each event.
+ */
+void bulkInsert(LinkedList* list, Event** events, long count);
+
+#endif
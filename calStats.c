@@ -0,0 +1,387 @@
+/**
+ * A set of functions for timing and counting calendar operations. Each
+ * thread records into its own bucket, so recording never waits on a lock.
+ * Buckets are summed when the statistics are reported.
+ *
+ * Recording is only compiled in when CAL_STATS is defined, otherwise the
+ * STATS_ macros expand to nothing and reports say statistics are disabled.
+ *
+ * Author: Alex Burress
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "calStats.h"
+
+#define FALSE 0
+#define TRUE !FALSE
+
+/**
+ * A bucket owned by one thread. Live buckets are kept on a linked list so
+ * they can be summed, and are folded into the retired totals when their
+ * thread exits.
+ */
+typedef struct ThreadBucket {
+	StatsBucket stats;
+	struct ThreadBucket* next;
+} ThreadBucket;
+
+/**
+ * Every bucket, and the lock guarding the list of them. The lock is only
+ * taken when a thread records for the first time, when it exits, and when
+ * the statistics are reported.
+ */
+typedef struct StatsRegistry {
+	pthread_mutex_t lock;
+	pthread_key_t key;
+	ThreadBucket* live;
+	StatsBucket retired;
+} StatsRegistry;
+
+static StatsRegistry registry;
+static pthread_once_t registryOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * Adds the totals in from into the totals in into.
+ */
+static void addBucket(StatsBucket* into, StatsBucket* from)
+{
+	int ii;
+	int jj;
+
+	for (ii = 0; ii < STAT_OPS; ii++)
+	{
+		into->ops[ii].calls += from->ops[ii].calls;
+		into->ops[ii].items += from->ops[ii].items;
+		into->ops[ii].totalNs += from->ops[ii].totalNs;
+
+		if (from->ops[ii].maxNs > into->ops[ii].maxNs)
+		{
+			into->ops[ii].maxNs = from->ops[ii].maxNs;
+		}
+
+		for (jj = 0; jj < STAT_HIST_BUCKETS; jj++)
+		{
+			into->ops[ii].histogram[jj] += from->ops[ii].histogram[jj];
+		}
+	}
+}
+
+/**
+ * Called as a thread exits. Folds the thread's bucket into the retired
+ * totals and frees it.
+ */
+static void retireBucket(void* data)
+{
+	ThreadBucket* bucket;
+	ThreadBucket** link;
+
+	bucket = (ThreadBucket*)data;
+
+	pthread_mutex_lock(&registry.lock);
+
+	addBucket(&registry.retired, &bucket->stats);
+
+	/* unlink the bucket from the live list */
+	link = &registry.live;
+	while (*link != bucket)
+	{
+		link = &((*link)->next);
+	}
+	*link = bucket->next;
+
+	pthread_mutex_unlock(&registry.lock);
+
+	free(bucket);
+}
+
+/**
+ * Sets up the registry, once only.
+ */
+static void initRegistry(void)
+{
+	memset(&registry.retired, 0, sizeof(StatsBucket));
+	registry.live = NULL;
+	pthread_mutex_init(&registry.lock, NULL);
+	pthread_key_create(&registry.key, &retireBucket);
+}
+
+/**
+ * Returns the calling thread's bucket, creating it on first use.
+ */
+static StatsBucket* threadBucket(void)
+{
+	ThreadBucket* bucket;
+
+	pthread_once(&registryOnce, &initRegistry);
+
+	bucket = (ThreadBucket*)pthread_getspecific(registry.key);
+
+	if (bucket == NULL)
+	{
+		bucket = (ThreadBucket*)malloc(sizeof(ThreadBucket));
+		memset(&bucket->stats, 0, sizeof(StatsBucket));
+
+		pthread_mutex_lock(&registry.lock);
+		bucket->next = registry.live;
+		registry.live = bucket;
+		pthread_mutex_unlock(&registry.lock);
+
+		pthread_setspecific(registry.key, bucket);
+	}
+
+	return &bucket->stats;
+}
+
+#ifdef CAL_STATS
+/**
+ * Returns the upper bound, in nanoseconds, of the histogram bucket holding
+ * the given fraction of calls to an operation.
+ */
+static unsigned long percentileNs(OpStats* op, double fraction)
+{
+	unsigned long target;
+	unsigned long seen;
+	int ii;
+
+	target = (unsigned long)(op->calls * fraction);
+	seen = 0;
+	ii = 0;
+
+	while (ii < STAT_HIST_BUCKETS - 1 && seen + op->histogram[ii] <= target)
+	{
+		seen += op->histogram[ii];
+		ii++;
+	}
+
+	return 2UL << ii;
+}
+
+/**
+ * Returns the number of items an operation processes per second.
+ */
+static double throughput(OpStats* op)
+{
+	double perSec = 0.0;
+
+	if (op->totalNs > 0)
+	{
+		perSec = (double)op->items * 1.0e9 / (double)op->totalNs;
+	}
+
+	return perSec;
+}
+#endif
+
+/**
+ * Returns the current time of the monotonic clock, in nanoseconds.
+ */
+long statsNow()
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (long)now.tv_sec * 1000000000L + (long)now.tv_nsec;
+}
+
+/**
+ * Records one call of operation op that started at the passed-in time (as
+ * returned by statsNow) and has just finished, having processed numItems
+ * units of work.
+ */
+void statsRecord(int op, long start, long numItems)
+{
+	OpStats* stats;
+	unsigned long elapsed;
+	unsigned long scaled;
+	int bucket;
+
+	elapsed = (unsigned long)(statsNow() - start);
+	stats = &(threadBucket()->ops[op]);
+
+	stats->calls++;
+	stats->items += (unsigned long)numItems;
+	stats->totalNs += elapsed;
+
+	if (elapsed > stats->maxNs)
+	{
+		stats->maxNs = elapsed;
+	}
+
+	/* histogram bucket is floor(log2(elapsed)) */
+	bucket = 0;
+	scaled = elapsed >> 1;
+	while (scaled > 0 && bucket < STAT_HIST_BUCKETS - 1)
+	{
+		scaled >>= 1;
+		bucket++;
+	}
+	stats->histogram[bucket]++;
+}
+
+/**
+ * Fills total with the sum of every thread's bucket, including threads that
+ * have since exited. Live buckets are read while their threads may still be
+ * recording, so the sum can be off by the calls in flight.
+ */
+void statsTotal(StatsBucket* total)
+{
+	ThreadBucket* current;
+
+	pthread_once(&registryOnce, &initRegistry);
+
+	memset(total, 0, sizeof(StatsBucket));
+
+	pthread_mutex_lock(&registry.lock);
+
+	addBucket(total, &registry.retired);
+	for (current = registry.live; current != NULL; current = current->next)
+	{
+		addBucket(total, &current->stats);
+	}
+
+	pthread_mutex_unlock(&registry.lock);
+}
+
+/**
+ * Returns the name of operation op.
+ */
+const char* statName(int op)
+{
+	static const char* names[STAT_OPS] = {
+		"parse", "validate", "insert", "render", "renderEvent", "save", "search", "setText"
+	};
+
+	return names[op];
+}
+
+/**
+ * Returns the unit counted by the items field of operation op.
+ */
+const char* statUnit(int op)
+{
+	static const char* units[STAT_OPS] = {
+		"bytes", "events", "events", "events", "events", "bytes", "events", "bytes"
+	};
+
+	return units[op];
+}
+
+/**
+ * Stores the current statistics in a single JSON formatted string. The
+ * string must be freed by the caller.
+ */
+char* statsToJson()
+{
+	char* json;
+	StatsBucket total;
+	OpStats* op;
+	int length;
+	int ii;
+	int jj;
+	int lastBucket;
+
+	json = (char*)malloc(STAT_OPS * 1500 + 100);
+
+#ifdef CAL_STATS
+	statsTotal(&total);
+
+	length = sprintf(json, "{\n  \"enabled\": true,\n  \"operations\": {\n");
+
+	for (ii = 0; ii < STAT_OPS; ii++)
+	{
+		op = &total.ops[ii];
+
+		length += sprintf(json + length,
+			"    \"%s\": {\"calls\": %lu, \"items\": %lu, \"unit\": \"%s\", \"totalNs\": %lu, "
+			"\"meanNs\": %lu, \"maxNs\": %lu, \"p50Ns\": %lu, \"p99Ns\": %lu, \"perSec\": %.1f, "
+			"\"histogramLog2Ns\": [",
+			statName(ii), op->calls, op->items, statUnit(ii), op->totalNs,
+			(op->calls > 0) ? op->totalNs / op->calls : 0UL, op->maxNs,
+			(op->calls > 0) ? percentileNs(op, 0.50) : 0UL,
+			(op->calls > 0) ? percentileNs(op, 0.99) : 0UL, throughput(op));
+
+		/* trailing empty buckets are left off */
+		lastBucket = -1;
+		for (jj = 0; jj < STAT_HIST_BUCKETS; jj++)
+		{
+			if (op->histogram[jj] > 0)
+			{
+				lastBucket = jj;
+			}
+		}
+
+		for (jj = 0; jj <= lastBucket; jj++)
+		{
+			length += sprintf(json + length, (jj == 0) ? "%lu" : ", %lu", op->histogram[jj]);
+		}
+
+		length += sprintf(json + length, (ii < STAT_OPS - 1) ? "]},\n" : "]}\n");
+	}
+
+	sprintf(json + length, "  }\n}\n");
+#else
+	(void)total;
+	(void)op;
+	(void)length;
+	(void)ii;
+	(void)jj;
+	(void)lastBucket;
+	sprintf(json, "{\n  \"enabled\": false\n}\n");
+#endif
+
+	return json;
+}
+
+/**
+ * Stores the current statistics in a single string formatted to be
+ * displayed in the gui. The string must be freed by the caller.
+ */
+char* statsToText()
+{
+	char* text;
+	StatsBucket total;
+	OpStats* op;
+	int length;
+	int ii;
+
+	text = (char*)malloc(STAT_OPS * 300 + 100);
+
+#ifdef CAL_STATS
+	statsTotal(&total);
+
+	length = sprintf(text, "Operation statistics\n\n");
+
+	for (ii = 0; ii < STAT_OPS; ii++)
+	{
+		op = &total.ops[ii];
+
+		if (op->calls > 0)
+		{
+			length += sprintf(text + length,
+				"%s: %lu calls, mean %.1f us, p50 under %.1f us, p99 under %.1f us, max %.1f us, %.0f %s/s\n",
+				statName(ii), op->calls, (double)op->totalNs / op->calls / 1000.0,
+				percentileNs(op, 0.50) / 1000.0, percentileNs(op, 0.99) / 1000.0,
+				op->maxNs / 1000.0, throughput(op), statUnit(ii));
+		}
+		else
+		{
+			length += sprintf(text + length, "%s: no calls\n", statName(ii));
+		}
+	}
+#else
+	(void)total;
+	(void)op;
+	(void)length;
+	(void)ii;
+	sprintf(text, "Statistics were not compiled in, rebuild with -DCAL_STATS\n");
+#endif
+
+	return text;
+}
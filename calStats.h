@@ -0,0 +1,96 @@
+/**
+ * A set of functions for timing and counting calendar operations. Each
+ * thread records into its own bucket, so recording never waits on a lock.
+ * Buckets are summed when the statistics are reported.
+ *
+ * Recording is only compiled in when CAL_STATS is defined, otherwise the
+ * STATS_ macros expand to nothing and reports say statistics are disabled.
+ *
+ * Author: Alex Burress
+ */
+
+#ifndef CALSTATS_H
+#define CALSTATS_H
+
+/* operations that are timed */
+#define STAT_PARSE 0
+#define STAT_VALIDATE 1
+#define STAT_INSERT 2
+#define STAT_RENDER 3
+#define STAT_RENDER_EVENT 4
+#define STAT_SAVE 5
+#define STAT_SEARCH 6
+#define STAT_SET_TEXT 7
+#define STAT_OPS 8
+
+/* latency histograms have one bucket per power of two nanoseconds */
+#define STAT_HIST_BUCKETS 40
+
+/**
+ * Totals recorded for one operation. items counts the units of work done
+ * (bytes or events, see statUnit), so throughput is items / totalNs.
+ */
+typedef struct OpStats {
+	unsigned long calls;
+	unsigned long items;
+	unsigned long totalNs;
+	unsigned long maxNs;
+	unsigned long histogram[STAT_HIST_BUCKETS];
+} OpStats;
+
+/**
+ * Everything recorded by one thread, or the sum over all threads.
+ */
+typedef struct StatsBucket {
+	OpStats ops[STAT_OPS];
+} StatsBucket;
+
+#ifdef CAL_STATS
+#define STATS_BEGIN() statsNow()
+#define STATS_END(op, start, numItems) statsRecord((op), (start), (numItems))
+#else
+#define STATS_BEGIN() 0L
+#define STATS_END(op, start, numItems) ((void)(start))
+#endif
+
+/**
+ * Returns the current time of the monotonic clock, in nanoseconds.
+ */
+long statsNow();
+
+/**
+ * Records one call of operation op that started at the passed-in time (as
+ * returned by statsNow) and has just finished, having processed numItems
+ * units of work.
+ */
+void statsRecord(int op, long start, long numItems);
+
+/**
+ * Fills total with the sum of every thread's bucket, including threads that
+ * have since exited.
+ */
+void statsTotal(StatsBucket* total);
+
+/**
+ * Returns the name of operation op.
+ */
+const char* statName(int op);
+
+/**
+ * Returns the unit counted by the items field of operation op.
+ */
+const char* statUnit(int op);
+
+/**
+ * Stores the current statistics in a single JSON formatted string. The
+ * string must be freed by the caller.
+ */
+char* statsToJson();
+
+/**
+ * Stores the current statistics in a single string formatted to be
+ * displayed in the gui. The string must be freed by the caller.
+ */
+char* statsToText();
+
+#endif
@@ -8,22 +8,41 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <limits.h>
+#include <pthread.h>
 #include "linkedList.h"
 #include "calText.h"
+#include "calDate.h"
+#include "calStats.h"
+#include "calRecur.h"
+#include "calIntern.h"
+#include "calSort.h"
+#include "calCursor.h"
+#include "calRender.h"
+#include "calZone.h"
 
 #define FALSE 0
 #define TRUE !FALSE
 
+/* the longest label an event can be given, such as "[work.txt] " */
+#define MAX_LABEL_TEXT (MAX_EVENT_TEXT / 4)
+
+/* the room a buffer of formatted events starts with for each event */
+#define EVENT_TEXT_GUESS 64
+
+/* the threads to format events on, or 0 for one per processor */
+static int formatThreads = 0;
+
 /**
  * Finds the first new line character in the passed-in string and replaces it
- * with a null terminator.
+ * with a null terminator. A string without one is left as it is.
  */
 void removeNewline(char* inString)
 {
 	int ii;
 
 	ii = 0;
-	while (inString[ii] != '\n')
+	while (inString[ii] != '\n' && inString[ii] != '\0')
 	{
 		ii++;
 	}
@@ -32,40 +51,272 @@ void removeNewline(char* inString)
 }
 
 /**
- * Stores the state of every Event struct in the passed-in linked list
- * in a single string. The string is formatted to be displayed in a gui
- * window.
+ * Writes the label of an event from a calendar called name, such as
+ * "[work.txt] ", to dest, which must have room for MAX_LABEL_TEXT
+ * characters. Returns the length of the label.
+ */
+static int writeLabel(char* dest, char* name)
+{
+	sprintf(dest, "[%.*s] ", MAX_LABEL_TEXT - 4, name);
+
+	return strlen(dest);
+}
+
+/**
+ * Starts a buffer for count events formatted one after another, with room
+ * for a typical event each, storing its size in capacity. reserveEvent
+ * grows it as the events are added.
+ */
+static char* startText(long count, long* capacity)
+{
+	*capacity = count * EVENT_TEXT_GUESS + MAX_EVENT_TEXT + MAX_LABEL_TEXT;
+
+	return (char*)malloc(*capacity * sizeof(char));
+}
+
+/**
+ * Makes sure a buffer from startText, of capacity characters of which
+ * length are used, has room for one more event and its label, doubling it
+ * if not, so formatting many events copies each only a few times. Returns
+ * the buffer, which may have moved.
+ */
+static char* reserveEvent(char* text, long* capacity, long length)
+{
+	if (*capacity - length < MAX_EVENT_TEXT + MAX_LABEL_TEXT)
+	{
+		*capacity *= 2;
+		text = (char*)realloc(text, *capacity * sizeof(char));
+	}
+
+	return text;
+}
+
+/**
+ * Returns the number of threads events are formatted on: as set with
+ * setFormatThreads, otherwise one per processor, up to MAX_FORMAT_THREADS.
+ */
+static int threadsWanted()
+{
+	long processors;
+	int threads;
+
+	threads = formatThreads;
+
+	if (threads <= 0)
+	{
+		processors = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = (processors > MAX_FORMAT_THREADS) ? MAX_FORMAT_THREADS : (int)processors;
+	}
+
+	return (threads > 0) ? threads : 1;
+}
+
+/**
+ * Formats the events of one chunk into a buffer of its own, grown as
+ * needed. Run on a thread of its own by formatChunks, so the events are
+ * formatted directly rather than through the render cache, which would
+ * have every thread waiting on its lock.
+ */
+static void* formatChunk(void* chunk)
+{
+	FormatChunk* format;
+	long capacity;
+	long ii;
+
+	format = (FormatChunk*)chunk;
+	format->text = startText(format->count, &capacity);
+	format->length = 0;
+
+	for (ii = 0; ii < format->count; ii++)
+	{
+		format->text = reserveEvent(format->text, &capacity, format->length);
+
+		if (format->labels != NULL)
+		{
+			format->length += writeLabel(format->text + format->length, format->labels[ii]);
+		}
+
+		if (format->form == RENDER_WINDOW)
+		{
+			parseEventWindow(format->text + format->length, format->events[ii]);
+		}
+		else
+		{
+			parseEventText(format->text + format->length, format->events[ii]);
+		}
+		format->length += strlen(format->text + format->length);
+	}
+
+	return NULL;
+}
+
+/**
+ * Sets the number of threads events are formatted on, or 0 for one per
+ * processor, which is the default.
+ */
+void setFormatThreads(int numThreads)
+{
+	formatThreads = numThreads;
+}
+
+/**
+ * Returns the number of chunks worth splitting count events into, so that
+ * each thread has at least FORMAT_CHUNK events to format. Returns 1 if the
+ * events are best formatted on the calling thread alone.
+ */
+int formatChunkCount(long count)
+{
+	int chunks;
+
+	chunks = threadsWanted();
+	if (count / FORMAT_CHUNK < chunks)
+	{
+		chunks = (int)(count / FORMAT_CHUNK);
+	}
+
+	return (chunks > 0) ? chunks : 1;
+}
+
+/**
+ * Splits events into numChunks runs of consecutive events, at most
+ * MAX_FORMAT_THREADS, and formats each run into a buffer of its own, each
+ * on its own thread, in the given form (RENDER_WINDOW or RENDER_TEXT). If
+ * labels isn't NULL, each event is preceded by a label naming the calendar
+ * in labels at the same place. The text and exact length of each run are
+ * stored in outChunks, in order, and each text must be freed. A run whose
+ * thread can't be started is formatted on the calling thread.
  */
-char* listToWindow(LinkedList* list)
+void formatChunks(Event** events, char** labels, long count, int form, FormatChunk* outChunks, int numChunks)
 {
+	pthread_t threads[MAX_FORMAT_THREADS];
+	int started[MAX_FORMAT_THREADS];
+	long first;
 	int ii;
-	ListNode* current;
-	char temp[500];
+
+	first = 0;
+
+	for (ii = 0; ii < numChunks; ii++)
+	{
+		outChunks[ii].events = events + first;
+		outChunks[ii].labels = (labels != NULL) ? labels + first : NULL;
+		outChunks[ii].count = (count * (ii + 1)) / numChunks - first;
+		outChunks[ii].form = form;
+		first += outChunks[ii].count;
+
+		/* the first chunk is formatted on this thread, while the others run */
+		started[ii] = (ii > 0 && pthread_create(&threads[ii], NULL, &formatChunk, (void*)&outChunks[ii]) == 0);
+	}
+
+	for (ii = 0; ii < numChunks; ii++)
+	{
+		if (started[ii] == FALSE)
+		{
+			formatChunk((void*)&outChunks[ii]);
+		}
+	}
+
+	for (ii = 0; ii < numChunks; ii++)
+	{
+		if (started[ii] == TRUE)
+		{
+			pthread_join(threads[ii], NULL);
+		}
+	}
+}
+
+/**
+ * Formats events, in order, into a single string in the given form
+ * (RENDER_WINDOW or RENDER_TEXT), each labelled from labels if it isn't
+ * NULL, as formatChunks does, storing the string's length in outLength.
+ * Events are copied from the render cache, unless there are enough of them
+ * to be worth formatting in parallel with formatChunks, in which case the
+ * runs are concatenated.
+ */
+char* formatEvents(Event** events, char** labels, long count, int form, long* outLength)
+{
+	FormatChunk chunks[MAX_FORMAT_THREADS];
 	char* state;
+	long capacity;
+	long length;
+	int numChunks;
+	long ii;
+
+	numChunks = formatChunkCount(count);
+	length = 0;
+
+	if (numChunks == 1)
+	{
+		state = startText(count, &capacity);
+
+		/* each event's cached text is copied straight after the last */
+		for (ii = 0; ii < count; ii++)
+		{
+			state = reserveEvent(state, &capacity, length);
+			if (labels != NULL)
+			{
+				length += writeLabel(state + length, labels[ii]);
+			}
+			length += renderEvent(state + length, events[ii], form);
+		}
+	}
+	else
+	{
+		formatChunks(events, labels, count, form, chunks, numChunks);
+
+		for (ii = 0; ii < numChunks; ii++)
+		{
+			length += chunks[ii].length;
+		}
+
+		state = (char*)malloc((length + 1) * sizeof(char));
+		length = 0;
+
+		for (ii = 0; ii < numChunks; ii++)
+		{
+			memcpy(state + length, chunks[ii].text, chunks[ii].length);
+			length += chunks[ii].length;
+			free(chunks[ii].text);
+		}
+	}
 
-	state = (char*)malloc(list->count * sizeof(char) * 500);
-	strcpy(state, "\0");
+	state[length] = '\0';
+	*outLength = length;
+
+	return state;
+}
+
+/**
+ * Formats every event on a list, in list order, into a single string in the
+ * given form, or returns a copy of emptyText if the list is empty.
+ */
+static char* formatList(LinkedList* list, int form, char* emptyText)
+{
+	EventCursor cursor;
+	Event** events;
+	Event* event;
+	char* state;
+	long length;
+	long count;
 
 	if (list->count == 0)
 	{
-		sprintf(state,"Error: list is empty.\n");
+		state = (char*)malloc((strlen(emptyText) + 1) * sizeof(char));
+		strcpy(state, emptyText);
 	}
 	else
 	{
-		current = list->head;
-		current->data = retrieveElement(list, 0);
-		
-		/* collect text from the first element */
-		parseEventWindow(temp, current->data);
-		strcat(state, temp);
+		events = (Event**)malloc(list->count * sizeof(Event*));
+		count = 0;
 
-		/* then collect text from the remaining elements */
-		for (ii = 1; ii < (list->count); ii++)
+		openCursor(&cursor, list);
+		for (event = cursorFirst(&cursor); event != NULL; event = cursorNext(&cursor))
 		{
-			current = current->next;
-			parseEventWindow(temp, current->data);
-			strcat(state, temp);
+			events[count] = event;
+			count++;
 		}
+
+		state = formatEvents(events, NULL, count, form, &length);
+		free(events);
 	}
 
 	return state;
@@ -78,39 +329,212 @@ char* listToWindow(LinkedList* list)
  */
 char* listToText(LinkedList* list)
 {
+	return formatList(list, RENDER_TEXT, "Calendar is empty.\n");
+}
+
+/**
+ * Formats events, in order, for display in a gui window, each labelled from
+ * labels if it isn't NULL, as formatEvents does. Returns the text shown for
+ * an empty calendar if there are no events.
+ */
+static char* formatWindow(Event** events, char** labels, long count)
+{
+	char* state;
+	long length;
+
+	if (count == 0)
+	{
+		state = (char*)malloc(sizeof("Error: list is empty.\n"));
+		strcpy(state, "Error: list is empty.\n");
+	}
+	else
+	{
+		state = formatEvents(events, labels, count, RENDER_WINDOW, &length);
+	}
+
+	return state;
+}
+
+/**
+ * Stores the state of every event on several timelines in a single string,
+ * merged into order of start time and formatted to be displayed in a gui
+ * window. Each event is labelled with the name of its timeline's calendar,
+ * from names. Large calendars are formatted in parallel (see formatEvents).
+ */
+char* mergedToWindow(Timeline** timelines, char** names, int numTimelines)
+{
+	TimelineMerge merge;
+	TimelineEntry entry;
+	Event** events;
+	char** labels;
+	char* state;
+	long total;
+	long startTime;
+	int source;
 	int ii;
-	ListNode* current;
-	char temp[500];
+
+	startTime = STATS_BEGIN();
+
+	total = 0;
+	for (ii = 0; ii < numTimelines; ii++)
+	{
+		total += timelines[ii]->count + timelines[ii]->numRecurring;
+	}
+
+	events = (Event**)malloc((total + 1) * sizeof(Event*));
+	labels = (char**)malloc((total + 1) * sizeof(char*));
+	total = 0;
+
+	startMerge(&merge, timelines, numTimelines, LONG_MIN, TRUE);
+
+	while (nextMerged(&merge, &entry, &source) == TRUE)
+	{
+		events[total] = entry.event;
+		labels[total] = names[source];
+		total++;
+	}
+
+	state = formatWindow(events, labels, total);
+
+	free(events);
+	free(labels);
+
+	STATS_END(STAT_RENDER, startTime, total);
+
+	return state;
+}
+
+/**
+ * Stores the state of every event on several lists in a single string,
+ * sorted into one of the orders of sortKeys and formatted to be displayed
+ * in a gui window. If names isn't NULL, each event is labelled with the
+ * name of its list's calendar, from names. Large calendars are formatted in
+ * parallel (see formatEvents).
+ */
+char* sortedToWindow(LinkedList** lists, char** names, int numLists, int order)
+{
+	SortKey* keys;
+	EventCursor cursor;
+	Event* event;
+	Event** events;
+	char** labels;
 	char* state;
+	long total;
+	long ii;
+	long startTime;
 
-	state = (char*)malloc(list->count * sizeof(char) * 500);
-	strcpy(state, "\0");
+	startTime = STATS_BEGIN();
 
-	if (list->count == 0)
+	total = 0;
+	for (ii = 0; ii < numLists; ii++)
 	{
-		sprintf(state,"Calendar is empty.\n");
+		total += lists[ii]->count;
 	}
-	else
+
+	keys = (SortKey*)malloc((total + 1) * sizeof(SortKey));
+	total = 0;
+
+	for (ii = 0; ii < numLists; ii++)
 	{
-		current = list->head;
-		current->data = retrieveElement(list, 0);
-		
-		/* collect text from the first element */
-		parseEventText(temp, current->data);
-		strcat(state, temp);
+		openCursor(&cursor, lists[ii]);
+		for (event = cursorFirst(&cursor); event != NULL; event = cursorNext(&cursor))
+		{
+			keys[total].key = (unsigned long)ii;
+			keys[total].event = event;
+			total++;
+		}
+	}
+
+	sortKeys(keys, total, order, numLists);
 
-		/* then collect text from the remaining elements */
-		for (ii = 1; ii < (list->count); ii++)
+	events = (Event**)malloc((total + 1) * sizeof(Event*));
+	labels = NULL;
+	if (names != NULL)
+	{
+		labels = (char**)malloc((total + 1) * sizeof(char*));
+	}
+
+	for (ii = 0; ii < total; ii++)
+	{
+		events[ii] = keys[ii].event;
+		if (labels != NULL)
 		{
-			current = current->next;
-			parseEventText(temp, current->data);
-			strcat(state, temp);
+			labels[ii] = names[keySource(&keys[ii], numLists)];
 		}
 	}
 
+	state = formatWindow(events, labels, total);
+
+	free(keys);
+	free(events);
+	free(labels);
+
+	STATS_END(STAT_RENDER, startTime, total);
+
 	return state;
 }
 
+/**
+ * Stores the passed-in occurrences, as returned by queryRange, in a single
+ * string formatted to be displayed in a gui window. Each occurrence is shown
+ * on its own date, so every repetition of a recurring event is listed.
+ */
+char* occurrencesToWindow(Occurrence* found, int count)
+{
+	int ii;
+	long length;
+	long capacity;
+	Event moved;
+	char* state;
+
+	state = startText(count, &capacity);
+	length = 0;
+	state[0] = '\0';
+
+	if (count == 0)
+	{
+		sprintf(state, "No events in this range.\n");
+	}
+
+	for (ii = 0; ii < count; ii++)
+	{
+		/* render a copy of the event moved to the occurrence's date */
+		moved = *(found[ii].event);
+		moved.eDate = found[ii].date;
+
+		state = reserveEvent(state, &capacity, length);
+		parseEventWindow(state + length, &moved);
+		length += strlen(state + length);
+	}
+
+	return state;
+}
+
+/**
+ * Writes a time of day to timeText in 12 hour format, such as "9am" or
+ * "12:30pm".
+ */
+static void spellTime(char* timeText, Time* time)
+{
+	int printedHrs;
+
+	/* midnight and noon are 12 */
+	printedHrs = time->hrs % 12;
+	if (printedHrs == 0)
+	{
+		printedHrs = 12;
+	}
+
+	if (time->mins != 0)
+	{
+		sprintf(timeText, "%d:%02d%s", printedHrs, time->mins, (time->hrs < 12) ? "am" : "pm");
+	}
+	else
+	{
+		sprintf(timeText, "%d%s", printedHrs, (time->hrs < 12) ? "am" : "pm");
+	}
+}
+
 /**
  * Parses the data in a single Event to the string eventState. The string
  * is formatted for display in the gui. Values are added to eventState one
@@ -118,19 +542,23 @@ char* listToText(LinkedList* list)
  */
 void parseEventWindow(char* eventState, Event* event)
 {
-	char tempLocation[100];
+	char tempLocation[MAX_LOCATION + 3];
 	char tempHrs[50];
 	char tempMins[50];
 	char twoDigits[50];
 	char tempDay[50];
 	char tempMonth[50];
 	char tempYear[50];
-	char tempTimeHrs[50];
-	char tempTimeMins[50];
+	char tempTime[50];
+	char tempRepeat[MAX_RULE_TEXT];
+	Date shownDate;
+	Time shownTime;
 	int durHrs;
 	int durMins;
-	int printedHrs;
+	long startTime;
 	
+	startTime = STATS_BEGIN();
+
 	/*splitting the duration (minutes) into hours and minutes */
 	durHrs = event->duration / 60;
 	durMins = event->duration % 60;
@@ -143,17 +571,15 @@ void parseEventWindow(char* eventState, Event* event)
 	strcpy(tempDay, "\0");
 	strcpy(tempMonth, "\0");
 	strcpy(tempYear, "\0");
-	strcpy(tempTimeHrs, "\0");
-	strcpy(tempTimeMins, "\0");
 	
 	/* add activity */
-	sprintf(eventState, "%s", event->activity);
+	sprintf(eventState, "%s", internedText(event->activity));
 	
 	/* add '@' if needed */
-	if (strcmp(event->location, "\0") != 0)
+	if (event->location != NO_TEXT)
 	{
 		strcpy(tempLocation, " @ ");
-		strcat(tempLocation, event->location);
+		strcat(tempLocation, internedText(event->location));
 	}
 	
 	/* add location */
@@ -190,56 +616,48 @@ void parseEventWindow(char* eventState, Event* event)
 	strcat(eventState, tempMins);
 	strcat(eventState, ")\n");
 
+	/* an event in another zone is shown on the display zone's clock */
+	shownDate = event->eDate;
+	shownTime = event->eTime;
+	if (event->zone != NULL && event->zone != displayZone())
+	{
+		civilFromMinutes(eventStart(event), &shownDate, &shownTime);
+	}
+
 	/* add day */
-	sprintf(tempDay, "%d ", event->eDate.day);
+	sprintf(tempDay, "%d ", shownDate.day);
 	strcat(eventState, tempDay);
 	
 	/* add month */
-	spellMonth(tempMonth, event->eDate.month);
+	spellMonth(tempMonth, shownDate.month);
 	strcat(eventState, tempMonth);
 	
 	/* add year */
-	sprintf(tempYear, "%d, ", event->eDate.year);
+	sprintf(tempYear, "%d, ", shownDate.year);
 	strcat(eventState, tempYear);
 	
-	/* add times hours component */
-	if (event->eTime.hrs > 0 && event->eTime.hrs <= 12)
-	{
-		sprintf(tempTimeHrs, "%d", event->eTime.hrs);
-	}
-	else if(event->eTime.hrs == 0)
-	{
-		sprintf(tempTimeHrs, "12");
-	}
-	else
-	{
-		printedHrs = event->eTime.hrs - 12;
-		sprintf(tempTimeHrs, "%d", printedHrs);
-	}
-	
-	/* add time minutes component */
-	if (event->eTime.mins != 0)
-	{
-		strcat(tempTimeHrs, ":");
-	}
-	strcat(eventState, tempTimeHrs);
-	
-	if (event->eTime.mins != 0)
-	{
-		sprintf(tempTimeMins, "%02d", event->eTime.mins);
-	}
-	
-	/* add "am" or "pm" to time */
-	if (event->eTime.hrs < 12)
+	/* add time, then the event's own time and zone if it is elsewhere */
+	spellTime(tempTime, &shownTime);
+	strcat(eventState, tempTime);
+
+	if (event->zone != NULL && event->zone != displayZone())
 	{
-		strcat(tempTimeMins, "am\n---\n\n");
+		spellTime(tempTime, &event->eTime);
+		sprintf(eventState + strlen(eventState), " (%s %s)", tempTime, event->zone->name);
 	}
-	else
+	strcat(eventState, "\n");
+
+	/* add how the event repeats, if it does */
+	if (event->repeat != NULL)
 	{
-		strcat(tempTimeMins, "pm\n---\n\n");
+		describeRecurrence(tempRepeat, event->repeat);
+		strcat(eventState, tempRepeat);
+		strcat(eventState, "\n");
 	}
-	strcat(eventState, tempTimeMins);
+	strcat(eventState, "---\n\n");
 	
+	STATS_END(STAT_RENDER_EVENT, startTime, 1);
+
 	/* eventState is now formatted for the gui! */
 }
 
@@ -249,18 +667,79 @@ void parseEventWindow(char* eventState, Event* event)
  */
 void parseEventText(char* eventState, Event* event)
 {
-	sprintf(eventState, "%d-%02d-%02d %02d:%02d %d %s\n", event->eDate.year, event->eDate.month, event->eDate.day, event->eTime.hrs, event->eTime.mins, event->duration, event->activity);
+	sprintf(eventState, "%d-%02d-%02d %02d:%02d %d %s\n", event->eDate.year, event->eDate.month, event->eDate.day, event->eTime.hrs, event->eTime.mins, event->duration, internedText(event->activity));
 	
 	/* optionally concatenate location */
-	if (strcmp(event->location, "\0") != 0)
+	if (event->location != NO_TEXT)
 	{
-		strcat(eventState, event->location);
+		strcat(eventState, internedText(event->location));
+		strcat(eventState, "\n");
+	}
+
+	/* optionally concatenate repeat rule */
+	if (event->repeat != NULL)
+	{
+		strcat(eventState, "REPEAT ");
+		recurrenceToText(eventState + strlen(eventState), event->repeat);
+		strcat(eventState, "\n");
+	}
+
+	/* optionally concatenate time zone */
+	if (event->zone != NULL)
+	{
+		strcat(eventState, "ZONE ");
+		strcat(eventState, event->zone->name);
 		strcat(eventState, "\n");
 	}
 	
 	strcat(eventState, "\n");
 }
 
+/**
+ * Writes a free slot to slotText, formatted for display in the gui, such as
+ * "Monday 13 January 2014, 09:00 to 10:30 (90 minutes)".
+ */
+void parseSlotWindow(char* slotText, FreeSlot* slot)
+{
+	static const char* weekdays[7] = { "Sunday", "Monday", "Tuesday", "Wednesday", "Thursday", "Friday", "Saturday" };
+	char tempMonth[50];
+	Date slotDate;
+	long day;
+	long startMins;
+	long endMins;
+
+	day = minutesToDay(slot->start);
+	civilFromDays(day, &slotDate);
+	spellMonth(tempMonth, slotDate.month);
+
+	/* times of day, the end may be midnight at the end of the day */
+	startMins = slot->start - day * MINS_PER_DAY;
+	endMins = slot->end - day * MINS_PER_DAY;
+
+	sprintf(slotText, "%s %d %s%d, %02ld:%02ld to %02ld:%02ld (%ld minutes)", weekdays[dayOfWeek(day)],
+		slotDate.day, tempMonth, slotDate.year, startMins / 60, startMins % 60, endMins / 60, endMins % 60,
+		slot->end - slot->start);
+}
+
+/**
+ * Writes a free slot to slotText as a line of text, with the start date and
+ * time in the same form as a calendar file and then its length in minutes,
+ * such as "2014-01-13 09:00 90".
+ */
+void parseSlotText(char* slotText, FreeSlot* slot)
+{
+	Date slotDate;
+	long day;
+	long startMins;
+
+	day = minutesToDay(slot->start);
+	civilFromDays(day, &slotDate);
+	startMins = slot->start - day * MINS_PER_DAY;
+
+	sprintf(slotText, "%04d-%02d-%02d %02ld:%02ld %ld", slotDate.year, slotDate.month, slotDate.day,
+		startMins / 60, startMins % 60, slot->end - slot->start);
+}
+
 /**
  * Finds the spelling of the month corresponding to the passed-in int.
  */
@@ -7,21 +7,78 @@
 #ifndef CALTEXT_H
 #define CALTEXT_H
 #include "linkedList.h"
+#include "calRecur.h"
+#include "calTimeline.h"
 #include <stdio.h>
 #include <stdlib.h>
 
+/* the longest string parseEventWindow or parseEventText can produce for one
+ * event, including the null terminator and any repeat rule */
+#define MAX_EVENT_TEXT 900
+
+/* the longest string parseSlotWindow or parseSlotText can produce */
+#define MAX_SLOT_TEXT 80
+
+/* the most threads events are formatted on at once */
+#define MAX_FORMAT_THREADS 16
+
+/* the fewest events worth handing to a thread of their own */
+#define FORMAT_CHUNK 16384
+
+/**
+ * A run of consecutive events formatted by one thread of formatChunks: the
+ * count events from events, each labelled from labels unless it is NULL,
+ * in form (RENDER_WINDOW or RENDER_TEXT), and the text they were formatted
+ * to, of exactly length characters.
+ */
+typedef struct FormatChunk {
+	Event** events;
+	char** labels;
+	long count;
+	int form;
+	char* text;
+	long length;
+} FormatChunk;
+
 /**
  * Finds the first new line character in the passed-in string and replaces it
- * with a null terminator.
+ * with a null terminator. A string without one is left as it is.
  */
 void removeNewline(char* inString);
 
 /**
- * Stores the state of every Event struct in the passed-in linked list
- * in a single string. The string is formatted to be displayed in a gui
- * window.
+ * Sets the number of threads events are formatted on, or 0 for one per
+ * processor, which is the default.
+ */
+void setFormatThreads(int numThreads);
+
+/**
+ * Returns the number of chunks worth splitting count events into, so that
+ * each thread has at least FORMAT_CHUNK events to format. Returns 1 if the
+ * events are best formatted on the calling thread alone.
+ */
+int formatChunkCount(long count);
+
+/**
+ * Splits events into numChunks runs of consecutive events, at most
+ * MAX_FORMAT_THREADS, and formats each run into a buffer of its own, each
+ * on its own thread, in the given form (RENDER_WINDOW or RENDER_TEXT). If
+ * labels isn't NULL, each event is preceded by a label naming the calendar
+ * in labels at the same place. The text and exact length of each run are
+ * stored in outChunks, in order, and each text must be freed. A run whose
+ * thread can't be started is formatted on the calling thread.
+ */
+void formatChunks(Event** events, char** labels, long count, int form, FormatChunk* outChunks, int numChunks);
+
+/**
+ * Formats events, in order, into a single string in the given form
+ * (RENDER_WINDOW or RENDER_TEXT), each labelled from labels if it isn't
+ * NULL, as formatChunks does, storing the string's length in outLength.
+ * Events are copied from the render cache, unless there are enough of them
+ * to be worth formatting in parallel with formatChunks, in which case the
+ * runs are concatenated.
  */
-char* listToWindow(LinkedList* list);
+char* formatEvents(Event** events, char** labels, long count, int form, long* outLength);
 
 /**
  * Stores the state of every Event struct in the passed-in linked list
@@ -30,6 +87,30 @@ char* listToWindow(LinkedList* list);
  */
 char* listToText(LinkedList* list);
 
+/**
+ * Stores the state of every event on several timelines in a single string,
+ * merged into order of start time and formatted to be displayed in a gui
+ * window. Each event is labelled with the name of its timeline's calendar,
+ * from names. Large calendars are formatted in parallel (see formatEvents).
+ */
+char* mergedToWindow(Timeline** timelines, char** names, int numTimelines);
+
+/**
+ * Stores the state of every event on several lists in a single string,
+ * sorted into one of the orders of sortKeys and formatted to be displayed
+ * in a gui window. If names isn't NULL, each event is labelled with the
+ * name of its list's calendar, from names. Large calendars are formatted in
+ * parallel (see formatEvents).
+ */
+char* sortedToWindow(LinkedList** lists, char** names, int numLists, int order);
+
+/**
+ * Stores the passed-in occurrences, as returned by queryRange, in a single
+ * string formatted to be displayed in a gui window. Each occurrence is shown
+ * on its own date, so every repetition of a recurring event is listed.
+ */
+char* occurrencesToWindow(Occurrence* found, int count);
+
 /**
  * Parses the data in a single Event to the string eventState. The string
  * is formatted for display in the gui. Values are added to eventState one
@@ -43,6 +124,19 @@ void parseEventWindow(char* eventState, Event* event);
  */
 void parseEventText(char* eventState, Event* event);
 
+/**
+ * Writes a free slot to slotText, formatted for display in the gui, such as
+ * "Monday 13 January 2014, 09:00 to 10:30 (90 minutes)".
+ */
+void parseSlotWindow(char* slotText, FreeSlot* slot);
+
+/**
+ * Writes a free slot to slotText as a line of text, with the start date and
+ * time in the same form as a calendar file and then its length in minutes,
+ * such as "2014-01-13 09:00 90".
+ */
+void parseSlotText(char* slotText, FreeSlot* slot);
+
 /**
  * Finds the spelling of the month corresponding to the passed-in int.
  */
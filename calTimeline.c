@@ -0,0 +1,505 @@
+/**
+ * Contains a time-ordered index of the events on a list, and a free/busy
+ * search over it for finding free time between events.
+ *
+ * Author: Alex Burress
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "linkedList.h"
+#include "calDate.h"
+#include "calRecur.h"
+#include "calTimeline.h"
+#include "calSort.h"
+#include "calCursor.h"
+
+#define FALSE 0
+#define TRUE !FALSE
+
+/**
+ * Orders occurrences by start time.
+ */
+static int compareStarts(const void* first, const void* second)
+{
+	long start1;
+	long start2;
+
+	start1 = ((const Occurrence*)first)->start;
+	start2 = ((const Occurrence*)second)->start;
+
+	return (start1 > start2) - (start1 < start2);
+}
+
+/**
+ * Builds a timeline of the events on the passed-in list, sorting them by
+ * start time. Must be freed with freeTimeline.
+ */
+Timeline* buildTimeline(LinkedList* list)
+{
+	Timeline* timeline;
+	EventCursor cursor;
+	Event* event;
+	SortKey* keys;
+	int ii;
+
+	timeline = (Timeline*)malloc(sizeof(Timeline));
+	timeline->entries = (TimelineEntry*)malloc((list->count + 1) * sizeof(TimelineEntry));
+	timeline->latestEnd = (long*)malloc((list->count + 1) * sizeof(long));
+	timeline->recurring = (Event**)malloc((list->count + 1) * sizeof(Event*));
+	timeline->count = 0;
+	timeline->numRecurring = 0;
+	timeline->list = list;
+	timeline->version = list->version;
+
+	keys = (SortKey*)malloc((list->count + 1) * sizeof(SortKey));
+
+	/* recurring events are kept apart, as they have no one start time */
+	openCursor(&cursor, list);
+	for (event = cursorFirst(&cursor); event != NULL; event = cursorNext(&cursor))
+	{
+		if (event->repeat != NULL)
+		{
+			timeline->recurring[timeline->numRecurring] = event;
+			timeline->numRecurring++;
+		}
+		else
+		{
+			keys[timeline->count].key = 0;
+			keys[timeline->count].event = event;
+			timeline->count++;
+		}
+	}
+
+	/* start order breaks ties by end, as the entries must be */
+	sortKeys(keys, timeline->count, SORT_START, 1);
+	sortEvents(timeline->recurring, timeline->numRecurring, SORT_START);
+
+	for (ii = 0; ii < timeline->count; ii++)
+	{
+		event = keys[ii].event;
+		timeline->entries[ii].start = eventStart(event);
+		timeline->entries[ii].end = timeline->entries[ii].start + event->duration;
+		timeline->entries[ii].event = event;
+
+		timeline->latestEnd[ii] = timeline->entries[ii].end;
+		if (ii > 0 && timeline->latestEnd[ii - 1] > timeline->latestEnd[ii])
+		{
+			timeline->latestEnd[ii] = timeline->latestEnd[ii - 1];
+		}
+	}
+
+	free(keys);
+
+	return timeline;
+}
+
+/**
+ * Frees a timeline, but not its events.
+ */
+void freeTimeline(Timeline* timeline)
+{
+	free(timeline->entries);
+	free(timeline->latestEnd);
+	free(timeline->recurring);
+	free(timeline);
+}
+
+/**
+ * Returns TRUE if the timeline was built from the passed-in list and the list
+ * hasn't changed since.
+ */
+int timelineCurrent(Timeline* timeline, LinkedList* list)
+{
+	return timeline != NULL && timeline->list == list && timeline->version == list->version;
+}
+
+/**
+ * Returns the index of the first entry starting at or after the passed-in
+ * time, or the number of entries if there is none.
+ */
+static int firstEntryFrom(Timeline* timeline, long time)
+{
+	int low;
+	int high;
+	int middle;
+
+	low = 0;
+	high = timeline->count;
+
+	while (low < high)
+	{
+		middle = low + (high - low) / 2;
+
+		if (timeline->entries[middle].start < time)
+		{
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+
+	return low;
+}
+
+/**
+ * Finds the occurrences of the timelines' recurring events that overlap the
+ * query's range, sorted by start time. Returns an array that must be freed by
+ * the caller, and stores its length in outCount.
+ */
+static Occurrence* recurringBusy(Timeline** timelines, int numTimelines, SlotQuery* query, int* outCount)
+{
+	OccurrenceCursor cursor;
+	Occurrence* found;
+	Event* event;
+	int capacity;
+	int ii;
+	int jj;
+
+	capacity = 16;
+	found = (Occurrence*)malloc(capacity * sizeof(Occurrence));
+	*outCount = 0;
+
+	for (ii = 0; ii < numTimelines; ii++)
+	{
+		for (jj = 0; jj < timelines[ii]->numRecurring; jj++)
+		{
+			event = timelines[ii]->recurring[jj];
+
+			/* start early enough to catch an occurrence running into the range */
+			firstOccurrence(&cursor, event, query->rangeStart - event->duration, query->rangeEnd);
+
+			while (nextOccurrence(&cursor, &found[*outCount]) == TRUE)
+			{
+				(*outCount)++;
+
+				if (*outCount == capacity)
+				{
+					capacity *= 2;
+					found = (Occurrence*)realloc(found, capacity * sizeof(Occurrence));
+				}
+			}
+		}
+	}
+
+	qsort(found, *outCount, sizeof(Occurrence), &compareStarts);
+
+	return found;
+}
+
+/**
+ * Stores the parts of the free time from freeStart to freeEnd that fall in
+ * the query's working hours and are long enough, up to maxSlots of them, in
+ * outSlots. Returns the number stored.
+ */
+static int workingSlots(SlotQuery* query, long freeStart, long freeEnd, FreeSlot* outSlots, int maxSlots)
+{
+	long day;
+	long slotStart;
+	long slotEnd;
+	int found;
+
+	found = 0;
+
+	for (day = minutesToDay(freeStart); day * MINS_PER_DAY < freeEnd && found < maxSlots; day++)
+	{
+		if (query->weekdaysOnly == FALSE || (dayOfWeek(day) != 0 && dayOfWeek(day) != 6))
+		{
+			slotStart = day * MINS_PER_DAY + query->dayStart;
+			slotEnd = day * MINS_PER_DAY + query->dayEnd;
+
+			if (slotStart < freeStart)
+			{
+				slotStart = freeStart;
+			}
+			if (slotEnd > freeEnd)
+			{
+				slotEnd = freeEnd;
+			}
+
+			if (slotEnd - slotStart >= query->length)
+			{
+				outSlots[found].start = slotStart;
+				outSlots[found].end = slotEnd;
+				found++;
+			}
+		}
+	}
+
+	return found;
+}
+
+/**
+ * Returns TRUE if the first run's next event should be merged before the
+ * second's. Ties go to the earlier timeline, then to one-off events.
+ */
+static int runBefore(MergeRun* first, MergeRun* second)
+{
+	int before;
+
+	if (first->start != second->start)
+	{
+		before = (first->start < second->start);
+	}
+	else if (first->source != second->source)
+	{
+		before = (first->source < second->source);
+	}
+	else
+	{
+		before = (first->recurring < second->recurring);
+	}
+
+	return before;
+}
+
+/**
+ * Moves the run at position ii of the heap down until neither of its
+ * children should be merged before it.
+ */
+static void siftDown(TimelineMerge* merge, int ii)
+{
+	MergeRun moving;
+	int child;
+	int placed;
+
+	moving = merge->heap[ii];
+	placed = FALSE;
+
+	while (placed == FALSE)
+	{
+		child = 2 * ii + 1;
+
+		if (child + 1 < merge->numRuns && runBefore(&merge->heap[child + 1], &merge->heap[child]) == TRUE)
+		{
+			child++;
+		}
+
+		if (child < merge->numRuns && runBefore(&merge->heap[child], &moving) == TRUE)
+		{
+			merge->heap[ii] = merge->heap[child];
+			ii = child;
+		}
+		else
+		{
+			placed = TRUE;
+		}
+	}
+
+	merge->heap[ii] = moving;
+}
+
+/**
+ * Updates the start of a run for its next event. Returns FALSE if the run
+ * has no events left.
+ */
+static int runStart(MergeRun* run)
+{
+	int more;
+
+	if (run->recurring == TRUE)
+	{
+		more = (run->next < run->timeline->numRecurring);
+		if (more == TRUE)
+		{
+			run->start = eventStart(run->timeline->recurring[run->next]);
+		}
+	}
+	else
+	{
+		more = (run->next < run->timeline->count);
+		if (more == TRUE)
+		{
+			run->start = run->timeline->entries[run->next].start;
+		}
+	}
+
+	return more;
+}
+
+/**
+ * Starts merging the events of the passed-in timelines, from the first
+ * starting at or after from. If withRecurring is set, recurring events are
+ * merged in at the start of their first occurrence, otherwise they are left
+ * out. At most MAX_MERGE_TIMELINES timelines can be merged.
+ */
+void startMerge(TimelineMerge* merge, Timeline** timelines, int numTimelines, long from, int withRecurring)
+{
+	MergeRun* run;
+	int ii;
+
+	assert(numTimelines <= MAX_MERGE_TIMELINES);
+
+	merge->numRuns = 0;
+
+	for (ii = 0; ii < numTimelines; ii++)
+	{
+		run = &merge->heap[merge->numRuns];
+		run->timeline = timelines[ii];
+		run->source = ii;
+		run->recurring = FALSE;
+		run->next = firstEntryFrom(timelines[ii], from);
+
+		if (runStart(run) == TRUE)
+		{
+			merge->numRuns++;
+		}
+
+		if (withRecurring == TRUE)
+		{
+			run = &merge->heap[merge->numRuns];
+			run->timeline = timelines[ii];
+			run->source = ii;
+			run->recurring = TRUE;
+			run->next = 0;
+
+			/* there are few recurring events, so these are skipped one by one */
+			while (runStart(run) == TRUE && run->start < from)
+			{
+				run->next++;
+			}
+
+			if (runStart(run) == TRUE)
+			{
+				merge->numRuns++;
+			}
+		}
+	}
+
+	for (ii = merge->numRuns / 2 - 1; ii >= 0; ii--)
+	{
+		siftDown(merge, ii);
+	}
+}
+
+/**
+ * Stores the next event of a merge, in order of start time, in outEntry and
+ * the position of its timeline in outSource. Returns FALSE once every event
+ * has been merged.
+ */
+int nextMerged(TimelineMerge* merge, TimelineEntry* outEntry, int* outSource)
+{
+	MergeRun* top;
+	int more;
+
+	more = (merge->numRuns > 0);
+
+	if (more == TRUE)
+	{
+		top = &merge->heap[0];
+		*outSource = top->source;
+
+		if (top->recurring == TRUE)
+		{
+			outEntry->event = top->timeline->recurring[top->next];
+			outEntry->start = top->start;
+			outEntry->end = top->start + outEntry->event->duration;
+		}
+		else
+		{
+			*outEntry = top->timeline->entries[top->next];
+		}
+
+		/* move the run on, dropping it once it runs out */
+		top->next++;
+		if (runStart(top) == FALSE)
+		{
+			merge->numRuns--;
+			merge->heap[0] = merge->heap[merge->numRuns];
+		}
+
+		if (merge->numRuns > 0)
+		{
+			siftDown(merge, 0);
+		}
+	}
+
+	return more;
+}
+
+/**
+ * Finds the first free slots matching query across all of the passed-in
+ * timelines, earliest first, storing up to maxSlots of them in outSlots.
+ * Returns the number found. To find more, search again with rangeStart moved
+ * to the end of the last slot found. Busy time is found with a binary search
+ * of each timeline, then only the events between one slot and the next are
+ * looked at.
+ */
+int findFreeSlots(Timeline** timelines, int numTimelines, SlotQuery* query, FreeSlot* outSlots, int maxSlots)
+{
+	TimelineMerge merge;
+	TimelineEntry pending;
+	Occurrence* repeats;
+	long freeFrom;
+	long busyStart;
+	long busyEnd;
+	int hasPending;
+	int numRepeats;
+	int source;
+	int found;
+	int first;
+	int ii;
+	int jj;
+
+	found = 0;
+	jj = 0;
+	repeats = recurringBusy(timelines, numTimelines, query, &numRepeats);
+	startMerge(&merge, timelines, numTimelines, query->rangeStart, FALSE);
+	hasPending = nextMerged(&merge, &pending, &source);
+
+	/* events that started before the range may still be running */
+	freeFrom = query->rangeStart;
+	for (ii = 0; ii < numTimelines; ii++)
+	{
+		first = firstEntryFrom(timelines[ii], query->rangeStart);
+		if (first > 0 && timelines[ii]->latestEnd[first - 1] > freeFrom)
+		{
+			freeFrom = timelines[ii]->latestEnd[first - 1];
+		}
+	}
+
+	/* merge one-off and recurring busy times in order, taking the gaps between them */
+	while (found < maxSlots && freeFrom < query->rangeEnd)
+	{
+		if (hasPending == TRUE && (jj >= numRepeats || pending.start <= repeats[jj].start))
+		{
+			busyStart = pending.start;
+			busyEnd = pending.end;
+			hasPending = nextMerged(&merge, &pending, &source);
+		}
+		else if (jj < numRepeats)
+		{
+			busyStart = repeats[jj].start;
+			busyEnd = repeats[jj].start + repeats[jj].event->duration;
+			jj++;
+		}
+		/* no more events, the rest of the range is free */
+		else
+		{
+			busyStart = query->rangeEnd;
+			busyEnd = query->rangeEnd;
+		}
+
+		if (busyStart > query->rangeEnd)
+		{
+			busyStart = query->rangeEnd;
+		}
+
+		if (busyStart > freeFrom)
+		{
+			found += workingSlots(query, freeFrom, busyStart, outSlots + found, maxSlots - found);
+		}
+
+		if (busyEnd > freeFrom)
+		{
+			freeFrom = busyEnd;
+		}
+	}
+
+	free(repeats);
+
+	return found;
+}
@@ -0,0 +1,133 @@
+/**
+ * Contains a time-ordered index of the events on a list, and a free/busy
+ * search over it for finding free time between events.
+ *
+ * Author: Alex Burress
+ */
+
+#ifndef CALTIMELINE_H
+#define CALTIMELINE_H
+#include "linkedList.h"
+
+/**
+ * One one-off event on a timeline, with its start and end in minutes (as
+ * returned by eventStart).
+ */
+typedef struct TimelineEntry {
+	long start;
+	long end;
+	Event* event;
+} TimelineEntry;
+
+/**
+ * The events of a list in order of start time. entries holds the one-off
+ * events, and latestEnd[ii] the latest end of entries 0 to ii, so the events
+ * overlapping any time can be found with a binary search. Recurring events
+ * are kept apart in recurring, ordered by the start of their first
+ * occurrence, and expanded only over the range being searched. The events
+ * are not retained, so a timeline can only be used while it is current for
+ * its list (see timelineCurrent).
+ */
+typedef struct Timeline {
+	TimelineEntry* entries;
+	long* latestEnd;
+	int count;
+	Event** recurring;
+	int numRecurring;
+	LinkedList* list;
+	unsigned long version;
+} Timeline;
+
+/* the most timelines that can be merged at once */
+#define MAX_MERGE_TIMELINES 8
+
+/**
+ * One sorted run of events being merged: the one-off or the recurring events
+ * of one timeline. source is the timeline's position in the array passed to
+ * startMerge, next the index of the run's next event and start its start.
+ */
+typedef struct MergeRun {
+	Timeline* timeline;
+	int source;
+	int recurring;
+	int next;
+	long start;
+} MergeRun;
+
+/**
+ * A k-way merge of the events of several timelines in order of start time.
+ * Runs are kept in a binary heap by the start of their next event, so each
+ * event costs O(log k) and nothing is copied into a combined list.
+ */
+typedef struct TimelineMerge {
+	MergeRun heap[MAX_MERGE_TIMELINES * 2];
+	int numRuns;
+} TimelineMerge;
+
+/**
+ * The free time being looked for: gaps of at least length minutes between
+ * rangeStart and rangeEnd (in minutes, as for eventStart), within the hours
+ * dayStart to dayEnd (in minutes after midnight) of each day, leaving out
+ * Saturdays and Sundays if weekdaysOnly is set.
+ */
+typedef struct SlotQuery {
+	long rangeStart;
+	long rangeEnd;
+	int length;
+	int dayStart;
+	int dayEnd;
+	int weekdaysOnly;
+} SlotQuery;
+
+/**
+ * A free period, from start up to end in minutes. A slot never runs past the
+ * end of the day it starts on.
+ */
+typedef struct FreeSlot {
+	long start;
+	long end;
+} FreeSlot;
+
+/**
+ * Builds a timeline of the events on the passed-in list, sorting them by
+ * start time. Must be freed with freeTimeline.
+ */
+Timeline* buildTimeline(LinkedList* list);
+
+/**
+ * Frees a timeline, but not its events.
+ */
+void freeTimeline(Timeline* timeline);
+
+/**
+ * Returns TRUE if the timeline was built from the passed-in list and the list
+ * hasn't changed since.
+ */
+int timelineCurrent(Timeline* timeline, LinkedList* list);
+
+/**
+ * Starts merging the events of the passed-in timelines, from the first
+ * starting at or after from. If withRecurring is set, recurring events are
+ * merged in at the start of their first occurrence, otherwise they are left
+ * out. At most MAX_MERGE_TIMELINES timelines can be merged.
+ */
+void startMerge(TimelineMerge* merge, Timeline** timelines, int numTimelines, long from, int withRecurring);
+
+/**
+ * Stores the next event of a merge, in order of start time, in outEntry and
+ * the position of its timeline in outSource. Returns FALSE once every event
+ * has been merged.
+ */
+int nextMerged(TimelineMerge* merge, TimelineEntry* outEntry, int* outSource);
+
+/**
+ * Finds the first free slots matching query across all of the passed-in
+ * timelines, earliest first, storing up to maxSlots of them in outSlots.
+ * Returns the number found. To find more, search again with rangeStart moved
+ * to the end of the last slot found. Busy time is found with a binary search
+ * of each timeline, then only the events between one slot and the next are
+ * looked at.
+ */
+int findFreeSlots(Timeline** timelines, int numTimelines, SlotQuery* query, FreeSlot* outSlots, int maxSlots);
+
+#endif
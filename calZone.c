@@ -0,0 +1,842 @@
+/**
+ * Contains time zones, read from the system's compiled tz database
+ * (ZONEINFO_DIR) when first named, for events whose date and time are the
+ * wall clock of a particular zone. Each zone is compiled into a table of the
+ * times its offset from UTC changes, from the file's own transitions and
+ * then its rule for later years worked out up to ZONE_LAST_YEAR, so a
+ * conversion is one binary search and libc's localtime is never used. Zones
+ * are kept until the program exits, and can be used from any thread.
+ *
+ * Times are in minutes since midnight on 1 January 1970, as for eventStart.
+ * Events with no zone are taken to be in the display zone, which events are
+ * shown, sorted and searched in.
+ *
+ * Author: Alex Burress
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+#include "linkedList.h"
+#include "calDate.h"
+#include "calFile.h"
+#include "calZone.h"
+
+#define FALSE 0
+#define TRUE !FALSE
+
+/* the zone the system is set to, read when TZ doesn't name one */
+#define SYSTEM_ZONE_FILE "/etc/localtime"
+
+/* the largest zone file read, real ones are a few kilobytes */
+#define MAX_ZONE_FILE (256 * 1024)
+
+/* a zone file's header: "TZif", a version, 15 unused bytes and six counts */
+#define TZIF_HEADER 44
+
+/* the ways a POSIX rule can give the day of a change */
+#define RULE_JULIAN 0
+#define RULE_DAY 1
+#define RULE_MONTH 2
+
+/* a rule's changes happen at 2am unless it says otherwise */
+#define DEFAULT_CHANGE_TIME (2 * 3600L)
+
+/**
+ * The zones read so far, and the display zone. Zones are added to the front
+ * of zones and never removed.
+ */
+typedef struct ZoneTable {
+	pthread_mutex_t lock;
+	TimeZone* zones;
+	TimeZone* display;
+} ZoneTable;
+
+/**
+ * The changes of a zone being compiled: count changes at times (in UTC
+ * minutes, in order), each to the offset in offsets, after firstOffset.
+ */
+typedef struct ZoneBuilder {
+	long* times;
+	int* offsets;
+	int count;
+	int capacity;
+	int firstOffset;
+} ZoneBuilder;
+
+/**
+ * The day and time, in seconds of local time, a POSIX rule changes offset
+ * on each year. kind says how the day is given: as day (1 to 365, never
+ * counting 29 February), as day (0 to 365), or as weekday (0 for Sunday) of
+ * week (1 to 4, or 5 for the last) of month.
+ */
+typedef struct RuleDate {
+	int kind;
+	int day;
+	int month;
+	int week;
+	int weekday;
+	long time;
+} RuleDate;
+
+/**
+ * A POSIX TZ rule, such as "CET-1CEST,M3.5.0,M10.5.0/3": the standard and,
+ * if hasDst is set, daylight saving offsets from UTC in seconds, and the
+ * dates daylight saving starts and ends.
+ */
+typedef struct ZoneRule {
+	long stdOffset;
+	long dstOffset;
+	int hasDst;
+	RuleDate start;
+	RuleDate end;
+} ZoneRule;
+
+static ZoneTable table;
+static pthread_once_t tableOnce = PTHREAD_ONCE_INIT;
+static pthread_once_t displayOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * Sets up an empty table of zones.
+ */
+static void initTable()
+{
+	pthread_mutex_init(&table.lock, NULL);
+	table.zones = NULL;
+	table.display = NULL;
+}
+
+/**
+ * Divides, rounding towards negative infinity rather than towards zero.
+ */
+static long floorDiv(long numerator, long denominator)
+{
+	long quotient;
+
+	quotient = numerator / denominator;
+	if ((numerator % denominator != 0) && ((numerator < 0) != (denominator < 0)))
+	{
+		quotient--;
+	}
+
+	return quotient;
+}
+
+/**
+ * Returns how many of the count times, in ascending order, are at or before
+ * when.
+ */
+static int changesUpTo(long* times, int count, long when)
+{
+	int low;
+	int high;
+	int middle;
+
+	low = 0;
+	high = count;
+
+	while (low < high)
+	{
+		middle = low + (high - low) / 2;
+		if (times[middle] <= when)
+		{
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+
+	return low;
+}
+
+/**
+ * Adds a change to offset (in minutes) at time (in UTC minutes) to a zone
+ * being compiled. Changes must be added in order: one before the last is
+ * ignored, one at the same time replaces it, and one to the offset already
+ * in force is left out.
+ */
+static void addChange(ZoneBuilder* builder, long time, int offset)
+{
+	int last;
+
+	last = builder->count - 1;
+
+	if (last >= 0 && time == builder->times[last])
+	{
+		builder->offsets[last] = offset;
+
+		/* a replaced change may no longer change anything */
+		if (offset == ((last > 0) ? builder->offsets[last - 1] : builder->firstOffset))
+		{
+			builder->count--;
+		}
+	}
+	else if ((last < 0 || time > builder->times[last]) &&
+		offset != ((last >= 0) ? builder->offsets[last] : builder->firstOffset))
+	{
+		if (builder->count == builder->capacity)
+		{
+			builder->capacity *= 2;
+			builder->times = (long*)realloc(builder->times, builder->capacity * sizeof(long));
+			builder->offsets = (int*)realloc(builder->offsets, builder->capacity * sizeof(int));
+		}
+
+		builder->times[builder->count] = time;
+		builder->offsets[builder->count] = offset;
+		builder->count++;
+	}
+}
+
+/**
+ * Returns the big-endian signed number of size bytes (4 or 8) at bytes.
+ */
+static long getBigEndian(unsigned char* bytes, int size)
+{
+	unsigned long value;
+	int ii;
+
+	value = (bytes[0] & 0x80) ? ~0UL : 0UL;
+	for (ii = 0; ii < size; ii++)
+	{
+		value = (value << 8) | bytes[ii];
+	}
+
+	return (long)value;
+}
+
+/**
+ * Reads the header of a compiled zone file's data, at offset start, into
+ * counts (isutcnt, isstdcnt, leapcnt, timecnt, typecnt and charcnt), and
+ * the length of the data after it, with times of timeSize bytes, into
+ * outBlockSize. Returns FALSE if the header isn't valid or the data runs
+ * past the end of the file.
+ */
+static int readTzifHeader(unsigned char* data, long length, long start, int timeSize, long* counts, long* outBlockSize)
+{
+	int valid;
+	int ii;
+
+	valid = (start + TZIF_HEADER <= length && memcmp(data + start, "TZif", 4) == 0);
+
+	for (ii = 0; ii < 6 && valid == TRUE; ii++)
+	{
+		counts[ii] = getBigEndian(data + start + 20 + ii * 4, 4);
+		valid = (counts[ii] >= 0 && counts[ii] <= MAX_ZONE_FILE);
+	}
+
+	if (valid == TRUE)
+	{
+		*outBlockSize = counts[3] * timeSize + counts[3] + counts[4] * 6 + counts[5] +
+			counts[2] * (timeSize + 4) + counts[1] + counts[0];
+		valid = (counts[4] > 0 && start + TZIF_HEADER + *outBlockSize <= length);
+	}
+
+	return valid;
+}
+
+/**
+ * Reads the changes of a compiled zone file (RFC 8536) into builder, from
+ * its 64-bit data if it has any, and points outRule at the POSIX rule that
+ * follows the data for later years, or NULL if there is none. The rule is
+ * null terminated in place. Returns FALSE if the file isn't valid.
+ */
+static int readTzif(unsigned char* data, long length, ZoneBuilder* builder, char** outRule)
+{
+	unsigned char* times;
+	unsigned char* types;
+	unsigned char* infos;
+	long counts[6];
+	long blockSize;
+	long start;
+	long end;
+	int timeSize;
+	int valid;
+	int ii;
+
+	start = 0;
+	timeSize = 4;
+	*outRule = NULL;
+	valid = readTzifHeader(data, length, start, timeSize, counts, &blockSize);
+
+	/* version 2 on repeats the data with 64-bit times, then adds the rule */
+	if (valid == TRUE && data[4] >= '2')
+	{
+		start = TZIF_HEADER + blockSize;
+		timeSize = 8;
+		valid = readTzifHeader(data, length, start, timeSize, counts, &blockSize);
+	}
+
+	if (valid == TRUE)
+	{
+		times = data + start + TZIF_HEADER;
+		types = times + counts[3] * timeSize;
+		infos = types + counts[3];
+
+		/* times before the first change are in the first type */
+		builder->firstOffset = (int)floorDiv(getBigEndian(infos, 4), 60);
+
+		for (ii = 0; ii < counts[3] && valid == TRUE; ii++)
+		{
+			valid = (types[ii] < counts[4]);
+			if (valid == TRUE)
+			{
+				addChange(builder, floorDiv(getBigEndian(times + ii * timeSize, timeSize), 60),
+					(int)floorDiv(getBigEndian(infos + types[ii] * 6, 4), 60));
+			}
+		}
+
+		/* the rule is on a line of its own after the data */
+		end = start + TZIF_HEADER + blockSize;
+		if (valid == TRUE && timeSize == 8 && end < length && data[end] == '\n')
+		{
+			ii = end + 1;
+			while (ii < length && data[ii] != '\n')
+			{
+				ii++;
+			}
+
+			if (ii < length && ii > end + 1)
+			{
+				data[ii] = '\0';
+				*outRule = (char*)data + end + 1;
+			}
+		}
+	}
+
+	return valid;
+}
+
+/**
+ * Skips a zone abbreviation in a POSIX rule, either letters or anything
+ * between angle brackets. Returns the text after it, or NULL if it is
+ * missing.
+ */
+static char* skipRuleName(char* text)
+{
+	char* after;
+
+	after = NULL;
+
+	if (*text == '<')
+	{
+		after = strchr(text, '>');
+		after = (after != NULL) ? after + 1 : NULL;
+	}
+	else if (isalpha((unsigned char)*text))
+	{
+		after = text;
+		while (isalpha((unsigned char)*after))
+		{
+			after++;
+		}
+	}
+
+	return after;
+}
+
+/**
+ * Parses a time in a POSIX rule, [+-]h[:mm[:ss]], into seconds. Returns the
+ * text after it, or NULL if there is no time.
+ */
+static char* parseRuleTime(char* text, long* outSeconds)
+{
+	long parts[3];
+	long sign;
+	int numParts;
+	char* after;
+
+	sign = 1;
+	if (*text == '+' || *text == '-')
+	{
+		sign = (*text == '-') ? -1 : 1;
+		text++;
+	}
+
+	after = NULL;
+	numParts = 0;
+	while (numParts < 3 && isdigit((unsigned char)*text))
+	{
+		parts[numParts] = strtol(text, &after, 10);
+		text = after;
+		numParts++;
+
+		if (*text == ':' && numParts < 3)
+		{
+			text++;
+		}
+	}
+
+	if (numParts > 0)
+	{
+		*outSeconds = parts[0] * 3600;
+		*outSeconds += (numParts > 1) ? parts[1] * 60 : 0;
+		*outSeconds += (numParts > 2) ? parts[2] : 0;
+		*outSeconds *= sign;
+		after = text;
+	}
+
+	return after;
+}
+
+/**
+ * Parses the date and optional time of a change in a POSIX rule: Jn, n or
+ * Mm.w.d, then /time. Returns the text after it, or NULL if it isn't valid.
+ */
+static char* parseRuleDate(char* text, RuleDate* outDate)
+{
+	char* after;
+
+	after = NULL;
+	outDate->time = DEFAULT_CHANGE_TIME;
+
+	if (*text == 'M')
+	{
+		outDate->kind = RULE_MONTH;
+		if (sscanf(text + 1, "%d.%d.%d", &outDate->month, &outDate->week, &outDate->weekday) == 3 &&
+			outDate->month >= 1 && outDate->month <= 12 && outDate->week >= 1 && outDate->week <= 5 &&
+			outDate->weekday >= 0 && outDate->weekday <= 6)
+		{
+			after = text + 1 + strspn(text + 1, "0123456789.");
+		}
+	}
+	else if (*text == 'J' || isdigit((unsigned char)*text))
+	{
+		outDate->kind = (*text == 'J') ? RULE_JULIAN : RULE_DAY;
+		text += (*text == 'J');
+		outDate->day = (int)strtol(text, &after, 10);
+
+		/* Jn counts from 1, n from 0 */
+		if (after == text || outDate->day < ((outDate->kind == RULE_JULIAN) ? 1 : 0) || outDate->day > 365)
+		{
+			after = NULL;
+		}
+	}
+
+	if (after != NULL && *after == '/')
+	{
+		after = parseRuleTime(after + 1, &outDate->time);
+	}
+
+	return after;
+}
+
+/**
+ * Parses a POSIX TZ rule, such as "CET-1CEST,M3.5.0,M10.5.0/3", into rule.
+ * A rule with daylight saving but no dates uses the United States' dates.
+ * Returns FALSE if the text isn't a valid rule.
+ */
+static int parseRule(char* text, ZoneRule* rule)
+{
+	char* next;
+
+	/* offsets in a rule are west of UTC, so are negated */
+	next = skipRuleName(text);
+	next = (next != NULL) ? parseRuleTime(next, &rule->stdOffset) : NULL;
+	rule->stdOffset = (next != NULL) ? -rule->stdOffset : 0;
+	rule->hasDst = FALSE;
+
+	if (next != NULL && *next != '\0')
+	{
+		next = skipRuleName(next);
+		rule->hasDst = TRUE;
+		rule->dstOffset = rule->stdOffset + 3600;
+
+		if (next != NULL && *next != ',' && *next != '\0')
+		{
+			next = parseRuleTime(next, &rule->dstOffset);
+			rule->dstOffset = -rule->dstOffset;
+		}
+
+		if (next != NULL && *next == '\0')
+		{
+			next = "M3.2.0,M11.1.0";
+		}
+		else if (next != NULL && *next == ',')
+		{
+			next++;
+		}
+		else
+		{
+			next = NULL;
+		}
+
+		next = (next != NULL) ? parseRuleDate(next, &rule->start) : NULL;
+		next = (next != NULL && *next == ',') ? parseRuleDate(next + 1, &rule->end) : NULL;
+	}
+
+	return (next != NULL && *next == '\0');
+}
+
+/**
+ * Returns the day number (see daysFromCivil) of a rule's change in a year.
+ */
+static long ruleDay(RuleDate* date, int year)
+{
+	long day;
+	long first;
+
+	if (date->kind == RULE_JULIAN)
+	{
+		day = daysFromCivil(year, 1, 1) + date->day - 1;
+		if (date->day >= 60 && isLeapYear(year) == TRUE)
+		{
+			day++;
+		}
+	}
+	else if (date->kind == RULE_DAY)
+	{
+		day = daysFromCivil(year, 1, 1) + date->day;
+	}
+	else
+	{
+		/* the first such weekday of the month, then the week asked for */
+		first = daysFromCivil(year, date->month, 1);
+		day = first + (date->weekday - dayOfWeek(first) + 7) % 7 + (date->week - 1) * 7L;
+
+		/* week 5 is the last, which some months have only four of */
+		while (day >= first + daysInMonth(year, date->month))
+		{
+			day -= 7;
+		}
+	}
+
+	return day;
+}
+
+/**
+ * Adds a rule's daylight saving changes to a zone being compiled, for every
+ * year from firstYear up to ZONE_LAST_YEAR.
+ */
+static void addRuleChanges(ZoneBuilder* builder, ZoneRule* rule, int firstYear)
+{
+	long start;
+	long end;
+	int year;
+
+	/* without daylight saving the offset never changes again */
+	for (year = firstYear; year <= ZONE_LAST_YEAR && rule->hasDst == TRUE; year++)
+	{
+		/* each change is in the wall clock of the offset before it */
+		start = floorDiv(ruleDay(&rule->start, year) * 86400L + rule->start.time - rule->stdOffset, 60);
+		end = floorDiv(ruleDay(&rule->end, year) * 86400L + rule->end.time - rule->dstOffset, 60);
+
+		/* south of the equator, daylight saving ends before it starts */
+		if (start < end)
+		{
+			addChange(builder, start, (int)floorDiv(rule->dstOffset, 60));
+			addChange(builder, end, (int)floorDiv(rule->stdOffset, 60));
+		}
+		else
+		{
+			addChange(builder, end, (int)floorDiv(rule->stdOffset, 60));
+			addChange(builder, start, (int)floorDiv(rule->dstOffset, 60));
+		}
+	}
+}
+
+/**
+ * Compiles a zone named name from the contents of a zone file, or, if data
+ * is NULL, from a POSIX rule alone. Returns NULL if either isn't valid.
+ */
+static TimeZone* compileZone(char* name, unsigned char* data, long length, char* ruleText)
+{
+	ZoneBuilder builder;
+	ZoneRule rule;
+	TimeZone* zone;
+	Date date;
+	long latest;
+	int firstYear;
+	int valid;
+	int ii;
+
+	builder.capacity = 64;
+	builder.count = 0;
+	builder.firstOffset = 0;
+	builder.times = (long*)malloc(builder.capacity * sizeof(long));
+	builder.offsets = (int*)malloc(builder.capacity * sizeof(int));
+	zone = NULL;
+	valid = TRUE;
+
+	if (data != NULL)
+	{
+		valid = readTzif(data, length, &builder, &ruleText);
+	}
+
+	if (valid == TRUE && ruleText != NULL)
+	{
+		valid = parseRule(ruleText, &rule);
+
+		/* a rule alone starts out in standard time */
+		if (valid == TRUE && data == NULL)
+		{
+			builder.firstOffset = (int)floorDiv(rule.stdOffset, 60);
+		}
+
+		/* the rule takes over in the year of the file's last change */
+		firstYear = 1970;
+		if (valid == TRUE && builder.count > 0)
+		{
+			latest = builder.times[builder.count - 1];
+			civilFromDays(minutesToDay(latest), &date);
+			firstYear = date.year;
+		}
+
+		if (valid == TRUE)
+		{
+			addRuleChanges(&builder, &rule, firstYear);
+		}
+	}
+
+	if (valid == TRUE)
+	{
+		zone = (TimeZone*)malloc(sizeof(TimeZone));
+		strcpy(zone->name, name);
+		zone->count = builder.count;
+		zone->utcChanges = builder.times;
+		zone->localChanges = (long*)malloc((builder.count + 1) * sizeof(long));
+		zone->offsets = (int*)malloc((builder.count + 1) * sizeof(int));
+		zone->offsets[0] = builder.firstOffset;
+		zone->next = NULL;
+
+		for (ii = 0; ii < builder.count; ii++)
+		{
+			zone->offsets[ii + 1] = builder.offsets[ii];
+
+			/* the later wall clock of either side, kept in order */
+			zone->localChanges[ii] = builder.times[ii] +
+				((zone->offsets[ii] > zone->offsets[ii + 1]) ? zone->offsets[ii] : zone->offsets[ii + 1]);
+			if (ii > 0 && zone->localChanges[ii] < zone->localChanges[ii - 1])
+			{
+				zone->localChanges[ii] = zone->localChanges[ii - 1];
+			}
+		}
+	}
+	else
+	{
+		free(builder.times);
+	}
+
+	free(builder.offsets);
+
+	return zone;
+}
+
+/**
+ * Reads a zone file and compiles it into a zone named name. Returns NULL if
+ * the file can't be read or isn't valid.
+ */
+static TimeZone* readZone(char* name, char* path)
+{
+	FILE* source;
+	TimeZone* zone;
+	unsigned char* data;
+	long length;
+
+	zone = NULL;
+	source = fopen(path, "rb");
+
+	if (source != NULL)
+	{
+		data = (unsigned char*)malloc(MAX_ZONE_FILE + 1);
+		length = (long)fread(data, 1, MAX_ZONE_FILE + 1, source);
+
+		if (length <= MAX_ZONE_FILE && ferror(source) == 0)
+		{
+			zone = compileZone(name, data, length, NULL);
+		}
+
+		free(data);
+		fclose(source);
+	}
+
+	return zone;
+}
+
+/**
+ * Returns TRUE if name can be a zone of the tz database, made of letters,
+ * digits and "/_+-." with no part of it going up a directory.
+ */
+static int zoneNameValid(char* name)
+{
+	int length;
+
+	length = strlen(name);
+
+	return (length > 0 && length < MAX_ZONE_NAME && name[0] != '/' && name[0] != '.' &&
+		strstr(name, "/.") == NULL && (int)strspn(name,
+		"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789/_+-.") == length);
+}
+
+/**
+ * Returns the zone of the passed-in name, such as "Europe/Paris" or "UTC",
+ * reading and compiling it the first time it is asked for. Returns NULL if
+ * there is no such zone or its file isn't valid.
+ */
+TimeZone* findZone(char* name)
+{
+	TimeZone* zone;
+	char path[MAX_ZONE_NAME + 256];
+	char* directory;
+
+	pthread_once(&tableOnce, &initTable);
+	pthread_mutex_lock(&table.lock);
+
+	zone = table.zones;
+	while (zone != NULL && strcmp(zone->name, name) != 0)
+	{
+		zone = zone->next;
+	}
+
+	if (zone == NULL && zoneNameValid(name) == TRUE)
+	{
+		directory = getenv("TZDIR");
+		if (directory == NULL || strlen(directory) > 255)
+		{
+			directory = ZONEINFO_DIR;
+		}
+		sprintf(path, "%s/%s", directory, name);
+
+		zone = readZone(name, path);
+
+		/* UTC needs no file */
+		if (zone == NULL && strcmp(name, "UTC") == 0)
+		{
+			zone = compileZone(name, NULL, 0, NULL);
+		}
+
+		if (zone != NULL)
+		{
+			zone->next = table.zones;
+			table.zones = zone;
+		}
+	}
+
+	pthread_mutex_unlock(&table.lock);
+
+	return zone;
+}
+
+/**
+ * Finds the zone the system is set to, unless a display zone has already
+ * been set: the zone or POSIX rule named by TZ, else /etc/localtime, else
+ * UTC.
+ */
+static void initDisplay()
+{
+	TimeZone* zone;
+	char* name;
+
+	pthread_once(&tableOnce, &initTable);
+	zone = NULL;
+	name = getenv("TZ");
+
+	/* a zone set before the first use leaves nothing to find */
+	pthread_mutex_lock(&table.lock);
+	zone = table.display;
+	pthread_mutex_unlock(&table.lock);
+
+	if (zone == NULL && name != NULL && *name != '\0')
+	{
+		name += (*name == ':');
+		zone = findZone(name);
+
+		if (zone == NULL && strlen(name) < MAX_ZONE_NAME)
+		{
+			zone = compileZone(name, NULL, 0, name);
+		}
+	}
+
+	if (zone == NULL)
+	{
+		zone = readZone("localtime", SYSTEM_ZONE_FILE);
+	}
+
+	if (zone == NULL)
+	{
+		zone = findZone("UTC");
+	}
+
+	pthread_mutex_lock(&table.lock);
+	if (table.display == NULL)
+	{
+		table.display = zone;
+	}
+	pthread_mutex_unlock(&table.lock);
+}
+
+/**
+ * Returns the zone events are shown, sorted and searched in. Unless one has
+ * been set, this is the zone named by the TZ environment variable, or else
+ * the system's zone (/etc/localtime), or else UTC.
+ */
+TimeZone* displayZone()
+{
+	pthread_once(&displayOnce, &initDisplay);
+
+	return table.display;
+}
+
+/**
+ * Sets the zone events are shown, sorted and searched in. Must be set before
+ * any event is loaded or rendered, as lists are kept in order of start time
+ * and rendered text is cached.
+ */
+void setDisplayZone(TimeZone* zone)
+{
+	pthread_once(&tableOnce, &initTable);
+
+	pthread_mutex_lock(&table.lock);
+	table.display = zone;
+	pthread_mutex_unlock(&table.lock);
+
+	/* so the system's zone is never looked for */
+	pthread_once(&displayOnce, &initDisplay);
+}
+
+/**
+ * Returns a zone's offset from UTC, in minutes, at the passed-in time (in
+ * UTC).
+ */
+int utcOffset(TimeZone* zone, long utcMinutes)
+{
+	return zone->offsets[changesUpTo(zone->utcChanges, zone->count, utcMinutes)];
+}
+
+/**
+ * Returns the UTC time of a wall clock time in the passed-in zone. A time
+ * skipped by a change of offset is moved past it, and a time that happens
+ * twice is taken the first time.
+ */
+long zoneToUtc(TimeZone* zone, long localMinutes)
+{
+	return localMinutes - zone->offsets[changesUpTo(zone->localChanges, zone->count, localMinutes)];
+}
+
+/**
+ * Returns the wall clock time in the passed-in zone of a UTC time.
+ */
+long utcToZone(TimeZone* zone, long utcMinutes)
+{
+	return utcMinutes + zone->offsets[changesUpTo(zone->utcChanges, zone->count, utcMinutes)];
+}
+
+/**
+ * Returns the wall clock time in zone to of a wall clock time in zone from.
+ * Either may be NULL for the display zone.
+ */
+long convertZone(long minutes, TimeZone* from, TimeZone* to)
+{
+	from = (from != NULL) ? from : displayZone();
+	to = (to != NULL) ? to : displayZone();
+
+	if (from != to)
+	{
+		minutes = utcToZone(to, zoneToUtc(from, minutes));
+	}
+
+	return minutes;
+}
@@ -0,0 +1,97 @@
+/**
+ * Contains time zones, read from the system's compiled tz database
+ * (ZONEINFO_DIR) when first named, for events whose date and time are the
+ * wall clock of a particular zone. Each zone is compiled into a table of the
+ * times its offset from UTC changes, from the file's own transitions and
+ * then its rule for later years worked out up to ZONE_LAST_YEAR, so a
+ * conversion is one binary search and libc's localtime is never used. Zones
+ * are kept until the program exits, and can be used from any thread.
+ *
+ * Times are in minutes since midnight on 1 January 1970, as for eventStart.
+ * Events with no zone are taken to be in the display zone, which events are
+ * shown, sorted and searched in.
+ *
+ * Author: Alex Burress
+ */
+
+#ifndef CALZONE_H
+#define CALZONE_H
+#include "linkedList.h"
+
+/* where compiled zone files are read from, unless TZDIR names another place */
+#define ZONEINFO_DIR "/usr/share/zoneinfo"
+
+/* the longest zone name, including the null terminator */
+#define MAX_ZONE_NAME 64
+
+/* the last year changes are worked out for, the last an event can be in */
+#define ZONE_LAST_YEAR 3000
+
+/* the furthest any zone's wall clock is from UTC, in minutes */
+#define MAX_ZONE_OFFSET (26 * 60)
+
+/**
+ * A time zone, named as in the tz database, such as "Europe/Paris".
+ * utcChanges holds the count times, in UTC, at which the zone's offset
+ * changes, in order, and offsets the offset from UTC in minutes before the
+ * first change (offsets[0]) and from each change on (offsets[ii + 1]).
+ * localChanges holds the same changes as wall clock times, from which a
+ * local time takes the change's offset: the later wall clock of the two
+ * either side of it, so a time skipped by a change is moved past it, and a
+ * time that happens twice is taken the first time.
+ */
+typedef struct TimeZone {
+	char name[MAX_ZONE_NAME];
+	int count;
+	long* utcChanges;
+	long* localChanges;
+	int* offsets;
+	struct TimeZone* next;
+} TimeZone;
+
+/**
+ * Returns the zone of the passed-in name, such as "Europe/Paris" or "UTC",
+ * reading and compiling it the first time it is asked for. Returns NULL if
+ * there is no such zone or its file isn't valid.
+ */
+TimeZone* findZone(char* name);
+
+/**
+ * Returns the zone events are shown, sorted and searched in. Unless one has
+ * been set, this is the zone named by the TZ environment variable, or else
+ * the system's zone (/etc/localtime), or else UTC.
+ */
+TimeZone* displayZone();
+
+/**
+ * Sets the zone events are shown, sorted and searched in. Must be set before
+ * any event is loaded or rendered, as lists are kept in order of start time
+ * and rendered text is cached.
+ */
+void setDisplayZone(TimeZone* zone);
+
+/**
+ * Returns a zone's offset from UTC, in minutes, at the passed-in time (in
+ * UTC).
+ */
+int utcOffset(TimeZone* zone, long utcMinutes);
+
+/**
+ * Returns the UTC time of a wall clock time in the passed-in zone. A time
+ * skipped by a change of offset is moved past it, and a time that happens
+ * twice is taken the first time.
+ */
+long zoneToUtc(TimeZone* zone, long localMinutes);
+
+/**
+ * Returns the wall clock time in the passed-in zone of a UTC time.
+ */
+long utcToZone(TimeZone* zone, long utcMinutes);
+
+/**
+ * Returns the wall clock time in zone to of a wall clock time in zone from.
+ * Either may be NULL for the display zone.
+ */
+long convertZone(long minutes, TimeZone* from, TimeZone* to);
+
+#endif
@@ -9,87 +9,420 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <time.h>
+#include <assert.h>
 #include "gui.h"
 #include "calendar.h"
 #include "linkedList.h"
 #include "calText.h"
+#include "calFile.h"
+#include "calStats.h"
+#include "calDate.h"
+#include "calRecur.h"
+#include "calIcs.h"
+#include "calTimeline.h"
+#include "calHistory.h"
+#include "calIntern.h"
+#include "calArchive.h"
+#include "calPartition.h"
+#include "calSort.h"
+#include "calRender.h"
+#include "calExport.h"
+#include "calZone.h"
 #define FALSE 0
 #define TRUE !FALSE
+#define FIRST_LOAD_BATCH 25
+
+/* the inputs of each dialog box, shared by every use of that dialog */
+static const InputProperties eventFields[EVENT_FIELDS] = {
+	{ "Enter activity", 398, FALSE },
+	{ "Enter location", 98, FALSE },
+	{ "Enter date (DD/MM/YYYY)", 20, FALSE },
+	{ "Enter time in 24 hour format (HH:MM)", 10, FALSE },
+	{ "Enter activity duration", 10, FALSE },
+	{ "Repeat, optional (e.g. weekly 1 until 31/12/2014 except 24/12/2014)", MAX_RULE_TEXT - 1, FALSE },
+	{ "Time zone, optional (e.g. Europe/Paris)", MAX_ZONE_NAME - 1, FALSE }
+};
+static const InputProperties searchFields[1] = {
+	{ "Enter a case sensitive search string that matches or partially matches an activity in the calendar", 398, FALSE }
+};
+static const InputProperties shiftFields[2] = {
+	{ "Enter a case sensitive search string that matches or partially matches the activities to move", 398, FALSE },
+	{ "Minutes to move them by (negative for earlier)", 10, FALSE }
+};
+static const InputProperties sortFields[1] = {
+	{ "Sort events by start, end, duration or activity", 20, FALSE }
+};
+static const InputProperties loadFields[1] = {
+	{ "Enter filename", 20, FALSE }
+};
+static const InputProperties saveFields[1] = {
+	{ "Save file as", 20, FALSE }
+};
+static const InputProperties rangeFields[2] = {
+	{ "Show events from date (DD/MM/YYYY)", 20, FALSE },
+	{ "Up to and including date (DD/MM/YYYY)", 20, FALSE }
+};
+static const InputProperties slotFields[SLOT_FIELDS] = {
+	{ "Find free time from date (DD/MM/YYYY)", 20, FALSE },
+	{ "Up to and including date (DD/MM/YYYY)", 20, FALSE },
+	{ "Length of free time needed, in minutes", 10, FALSE },
+	{ "Earliest start each day (HH:MM)", 10, FALSE },
+	{ "Latest end each day (HH:MM, 24:00 for midnight)", 10, FALSE },
+	{ "Weekdays only (y/n)", 5, FALSE }
+};
 
 /**
  * Main can optionally take one command line parameter, the command line
  * parameter is the name of a text file containing text formatted for the
  * calendar interface. Main creates a menu and runs a gui for manipulating
- * and viewing calendar data.
+ * and viewing calendar data. If the --stats option is given, operation
+ * statistics are printed as JSON when the gui is closed. If the
+ * --free-slots option is given, followed by the six inputs of the free time
+ * dialog, the free slots in the file are printed and no gui is shown. The
+ * --page-budget option sets the megabytes of events each calendar of
+ * history opened from an archive may keep paged in. The --max-errors
+ * option sets how many invalid entries of a file the details are kept of.
+ * The --delete-matching and --shift-matching options delete, or move by a
+ * number of minutes, every event in the file whose activity contains the
+ * text given, then save the file, again without a gui. The --sort option
+ * sets the order events are first shown and saved in, and the
+ * --render-cache option the megabytes of rendered event text kept. The
+ * --threads option sets how many threads large calendars are formatted on.
+ * The --export option writes the file's events to stdout as csv or jsonl,
+ * again without a gui, in the order given by --sort if it is given and as
+ * they are read otherwise.
  */
 int main(int argc, char** argv)
 {
 	MenuData* menuAndList;
+	char* filename;
+	char* statsJson;
+	char** slotArgs;
+	char* matchText;
+	char* shiftText;
+	TimeZone* zone;
+	long pageBudget;
+	long renderBudget;
+	int maxDiagnostics;
+	int numThreads;
+	int exportFormat;
+	int sortGiven;
+	int sortOrder;
+	int showStats;
+	int argsValid;
+	int status;
+	int ii;
 
-	/* no parameter provided, no calendar loaded at startup */
-	if (argc == 1)
+	filename = NULL;
+	slotArgs = NULL;
+	matchText = NULL;
+	shiftText = NULL;
+	zone = NULL;
+	pageBudget = DEFAULT_PAGE_BUDGET;
+	renderBudget = DEFAULT_RENDER_BUDGET;
+	numThreads = 0;
+	maxDiagnostics = DEFAULT_MAX_DIAGNOSTICS;
+	sortOrder = SORT_START;
+	sortGiven = FALSE;
+	exportFormat = -1;
+	showStats = FALSE;
+	argsValid = TRUE;
+	status = 0;
+
+	/* separate options from the calendar filename */
+	for (ii = 1; ii < argc; ii++)
 	{
-		menuAndList = (MenuData*)malloc(sizeof(MenuData));
-	
-		createMainMenu(menuAndList);
+		if (strcmp(argv[ii], "--stats") == 0)
+		{
+			showStats = TRUE;
+		}
+		else if (strcmp(argv[ii], "--page-budget") == 0 && ii + 1 < argc)
+		{
+			pageBudget = atol(argv[ii + 1]) * 1024L * 1024L;
+			if (pageBudget <= 0)
+			{
+				argsValid = FALSE;
+			}
+			ii++;
+		}
+		else if (strcmp(argv[ii], "--render-cache") == 0 && ii + 1 < argc)
+		{
+			renderBudget = atol(argv[ii + 1]) * 1024L * 1024L;
+			if (renderBudget < 0)
+			{
+				argsValid = FALSE;
+			}
+			ii++;
+		}
+		else if (strcmp(argv[ii], "--threads") == 0 && ii + 1 < argc)
+		{
+			numThreads = atoi(argv[ii + 1]);
+			if (numThreads <= 0)
+			{
+				argsValid = FALSE;
+			}
+			ii++;
+		}
+		else if (strcmp(argv[ii], "--max-errors") == 0 && ii + 1 < argc)
+		{
+			maxDiagnostics = atoi(argv[ii + 1]);
+			if (maxDiagnostics < 0)
+			{
+				argsValid = FALSE;
+			}
+			ii++;
+		}
+		else if (strcmp(argv[ii], "--sort") == 0 && ii + 1 < argc)
+		{
+			if (parseSortOrder(argv[ii + 1], &sortOrder) == FALSE)
+			{
+				argsValid = FALSE;
+			}
+			sortGiven = TRUE;
+			ii++;
+		}
+		else if (strcmp(argv[ii], "--zone") == 0 && ii + 1 < argc)
+		{
+			zone = findZone(argv[ii + 1]);
+			if (zone == NULL)
+			{
+				argsValid = FALSE;
+			}
+			ii++;
+		}
+		else if (strcmp(argv[ii], "--export") == 0 && ii + 1 < argc)
+		{
+			if (parseExportFormat(argv[ii + 1], &exportFormat) == FALSE)
+			{
+				argsValid = FALSE;
+			}
+			ii++;
+		}
+		else if (strcmp(argv[ii], "--free-slots") == 0 && ii + SLOT_FIELDS < argc)
+		{
+			slotArgs = argv + ii + 1;
+			ii += SLOT_FIELDS;
+		}
+		else if (strcmp(argv[ii], "--delete-matching") == 0 && ii + 1 < argc && matchText == NULL)
+		{
+			matchText = argv[ii + 1];
+			ii++;
+		}
+		else if (strcmp(argv[ii], "--shift-matching") == 0 && ii + 2 < argc && matchText == NULL)
+		{
+			matchText = argv[ii + 1];
+			shiftText = argv[ii + 2];
+			ii += 2;
+		}
+		else if (filename == NULL)
+		{
+			filename = argv[ii];
+		}
+		else
+		{
+			argsValid = FALSE;
+		}
+	}
 
-		runGUI(menuAndList->window);
+	setRenderBudget(renderBudget);
+	setFormatThreads(numThreads);
 
-		freeWindow(menuAndList->window);
-		freeList(menuAndList->list); /* */
-		free(menuAndList);
+	/* events are shown in the zone asked for, set before any are loaded */
+	if (zone != NULL)
+	{
+		setDisplayZone(zone);
+	}
+
+	/* more than 1 filename entered, a search, change or export without a
+	 * file, or more than one of them
+	 */
+	if (argsValid == FALSE || ((slotArgs != NULL || matchText != NULL || exportFormat != -1) && filename == NULL) ||
+		(slotArgs != NULL) + (matchText != NULL) + (exportFormat != -1) > 1)
+	{
+		printf("Usage: calendar [--stats] [--page-budget megabytes] [--render-cache megabytes] [--threads count] "
+			"[--max-errors count] [--sort start|end|duration|activity] [--zone name] "
+			"[--free-slots DD/MM/YYYY DD/MM/YYYY minutes HH:MM HH:MM y|n | --delete-matching text | "
+			"--shift-matching text minutes | --export csv|jsonl] [calendar file]\n");
+		status = 1;
+	}
+	/* change the file without a gui */
+	else if (matchText != NULL)
+	{
+		status = changeMatchingInFile(filename, matchText, shiftText, maxDiagnostics);
 	}
-	/* parameter provided, try and load file at startup */
-	else if (argc == 2)
+	/* search the file without a gui */
+	else if (slotArgs != NULL)
+	{
+		status = printFreeSlots(filename, slotArgs, maxDiagnostics);
+	}
+	/* export the file without a gui */
+	else if (exportFormat != -1)
+	{
+		status = exportFile(filename, exportFormat, (sortGiven == TRUE) ? sortOrder : -1, maxDiagnostics);
+	}
+	else
 	{
 		menuAndList = (MenuData*)malloc(sizeof(MenuData));
-	
-		createMenuFromFile(menuAndList, argv[1]);
+		menuAndList->pageBudget = pageBudget;
+		menuAndList->maxDiagnostics = maxDiagnostics;
+		menuAndList->sortOrder = sortOrder;
+
+		/* no parameter provided, no calendar loaded at startup */
+		if (filename == NULL)
+		{
+			createMainMenu(menuAndList);
+		}
+		/* parameter provided, try and load file at startup */
+		else
+		{
+			createMenuFromFile(menuAndList, filename);
+		}
 
 		runGUI(menuAndList->window);
+		waitForBackground();
 
 		freeWindow(menuAndList->window);
-		freeList(menuAndList->list); /* */
+		closeCalendars(menuAndList);
 		free(menuAndList);
 	}
-	/* more than 1 parameter entered */
-	else
+
+	if (showStats == TRUE)
 	{
-		printf("Error: This program only accepts 1 parameter representing a text formatted calendar file\n");
+		statsJson = statsToJson();
+		printf("%s", statsJson);
+		free(statsJson);
 	}
 
-	return 0;
+	return status;
 }
 
 /**
- * Creates a gui window with 5 buttons for manipulating calendar data.
+ * Creates a gui window with buttons for manipulating calendar data.
  * Used when the user doesn't provide a command line parameter.
  */
 void createMainMenu(MenuData* menuAndList)
 {
+	memset(menuAndList->calendars, 0, sizeof(menuAndList->calendars));
+	menuAndList->numCalendars = 0;
+	initHistory(&menuAndList->history);
 	menuAndList->window = createWindow("Amazing Calendar Interface");
 
-	addButton(menuAndList->window, "Load a calendar from file", &loadCalFromFile, (void*)menuAndList);
-	addButton(menuAndList->window, "Save the current calendar to file", &saveCalToFile, (void*)menuAndList);
-	addButton(menuAndList->window, "Add a calendar event", &addEvent, (void*)menuAndList);
-	addButton(menuAndList->window, "Edit a calendar event", &editEvent, (void*)menuAndList);
-	addButton(menuAndList->window, "Delete a calendar event", &deleteEvent, (void*)menuAndList);
+	addMenuButtons(menuAndList);
 }
 
 /**
- * Creates a gui window with 5 buttons for manipulating calendar data.
+ * Creates a gui window with buttons for manipulating calendar data.
  * Used when the user provides a command line parameter.
  */
 void createMenuFromFile(MenuData* menuAndList, char* filename)
 {
+	memset(menuAndList->calendars, 0, sizeof(menuAndList->calendars));
+	menuAndList->numCalendars = 0;
+	initHistory(&menuAndList->history);
 	menuAndList->window = createWindow("Amazing Calendar Interface");
 	loadCalFromCmd((void*)menuAndList, filename);
 
+	addMenuButtons(menuAndList);
+}
+
+/**
+ * Adds a button to the main window for each action the user can take.
+ */
+void addMenuButtons(MenuData* menuAndList)
+{
 	addButton(menuAndList->window, "Load a calendar from file", &loadCalFromFile, (void*)menuAndList);
+	addButton(menuAndList->window, "Open another calendar alongside", &openAnotherCalendar, (void*)menuAndList);
 	addButton(menuAndList->window, "Save the current calendar to file", &saveCalToFile, (void*)menuAndList);
 	addButton(menuAndList->window, "Add a calendar event", &addEvent, (void*)menuAndList);
 	addButton(menuAndList->window, "Edit a calendar event", &editEvent, (void*)menuAndList);
 	addButton(menuAndList->window, "Delete a calendar event", &deleteEvent, (void*)menuAndList);
+	addButton(menuAndList->window, "Delete all matching events", &deleteMatchingEvents, (void*)menuAndList);
+	addButton(menuAndList->window, "Move all matching events", &shiftMatchingEvents, (void*)menuAndList);
+	addButton(menuAndList->window, "Undo", &undoLastChange, (void*)menuAndList);
+	addButton(menuAndList->window, "Redo", &redoLastChange, (void*)menuAndList);
+	addButton(menuAndList->window, "Show events between two dates", &showRange, (void*)menuAndList);
+	addButton(menuAndList->window, "Find free time", &showFreeSlots, (void*)menuAndList);
+	addButton(menuAndList->window, "Sort events", &chooseSortOrder, (void*)menuAndList);
+	addButton(menuAndList->window, "Statistics", &showStatistics, (void*)menuAndList);
+}
+
+/**
+ * Lays out the passed-in fields in a FormBuffer, ready to be handed to
+ * dialogBox. Each input is given room for its field's maxLength plus a null
+ * terminator within the form's own storage, and starts as an empty string.
+ * Nothing is allocated, so a form can be reused for every dialog.
+ */
+void setForm(FormBuffer* form, const InputProperties* fields, int numFields)
+{
+	int ii;
+	int offset;
+
+	assert(numFields <= MAX_FORM_FIELDS);
+
+	offset = 0;
+	for (ii = 0; ii < numFields; ii++)
+	{
+		assert(offset + fields[ii].maxLength + 1 <= MAX_FORM_TEXT);
+
+		form->properties[ii] = fields[ii];
+		form->inputs[ii] = form->text + offset;
+		form->inputs[ii][0] = '\0';
+		offset += fields[ii].maxLength + 1;
+	}
+
+	form->numFields = numFields;
+}
+
+/**
+ * Parses a form laid out with eventFields into an Event. Returns TRUE if
+ * the date, time, duration and any repeat rule and time zone are valid and
+ * an activity was entered, otherwise FALSE and event is left incomplete. On success the
+ * event's repeat rule, if any, is newly allocated.
+ */
+int formToEvent(FormBuffer* form, Event* event)
+{
+	int valid;
+	Recurrence rule;
+
+	valid = FALSE;
+	memset(event, 0, sizeof(Event));
+
+	/* parse user input for date, time and duration */
+	if (sscanf(form->inputs[FIELD_DATE], "%d/%d/%d", &event->eDate.day, &event->eDate.month, &event->eDate.year) == 3 &&
+		sscanf(form->inputs[FIELD_TIME], "%d:%d", &event->eTime.hrs, &event->eTime.mins) == 2 &&
+		sscanf(form->inputs[FIELD_DURATION], "%d", &event->duration) == 1)
+	{
+		/* check that user input was valid */
+		if (eventValid(event->eDate.year, event->eDate.month, event->eDate.day, event->eTime.hrs, event->eTime.mins, event->duration) == TRUE &&
+			strlen(form->inputs[FIELD_ACTIVITY]) > 1)
+		{
+			event->activity = internText(form->inputs[FIELD_ACTIVITY]);
+			event->location = internText(form->inputs[FIELD_LOCATION]);
+			valid = TRUE;
+
+			/* a blank zone input leaves the event in the display zone */
+			if (strspn(form->inputs[FIELD_ZONE], " ") < strlen(form->inputs[FIELD_ZONE]))
+			{
+				event->zone = findZone(form->inputs[FIELD_ZONE]);
+				valid = (event->zone != NULL);
+			}
+
+			/* a blank repeat input makes a one-off event */
+			if (valid == TRUE && strspn(form->inputs[FIELD_REPEAT], " ") < strlen(form->inputs[FIELD_REPEAT]))
+			{
+				valid = parseRecurrence(form->inputs[FIELD_REPEAT], &rule);
+
+				if (valid == TRUE)
+				{
+					event->repeat = (Recurrence*)malloc(sizeof(Recurrence));
+					*(event->repeat) = rule;
+				}
+			}
+		}
+	}
+
+	return valid;
 }
 
 /**
@@ -98,9 +431,7 @@ void createMenuFromFile(MenuData* menuAndList, char* filename)
  */
 void loadCalFromCmd(void* data, char* filename)
 {
-	((MenuData*)data)->list = createList();
-
-	readFile(data, filename);
+	readFile(data, filename, openCalendar((MenuData*)data, filename));
 }
 
 /**
@@ -109,280 +440,237 @@ void loadCalFromCmd(void* data, char* filename)
  */
 void loadCalFromFile(void* data)
 {
-	InputProperties* properties;
-	char** inputs;
+	FormBuffer* form;
 	int clickedOk;
 	
-	/* if a linked list already exists in the MenuData, free it */
-	if (((MenuData*)data)->list != NULL && ((MenuData*)data)->list->count > 0)
-	{
-		freeList(((MenuData*)data)->list);
-	}
-	
-	((MenuData*)data)->list = createList();
+	/* if calendars are already open in the MenuData, close them */
+	closeCalendars((MenuData*)data);
 
-	properties = (InputProperties*)malloc(sizeof(InputProperties));
-	properties->label = "Enter filename";
-	properties->maxLength = 20;
-	properties->isMultiLine = FALSE;
-
-	inputs = (char**)malloc(sizeof(char*));
-	inputs[0] = (char*)malloc(21*sizeof(char));
-	strcpy(inputs[0], "");
+	form = &((MenuData*)data)->form;
+	setForm(form, loadFields, 1);
 
 	/* have user enter filename */
-	clickedOk = dialogBox(((MenuData*)data)->window, "Load a calendar from file", 1, properties, inputs);
+	clickedOk = dialogBox(((MenuData*)data)->window, "Load a calendar from file", form->numFields, form->properties, form->inputs);
 
 	if (clickedOk == TRUE)
 	{
-		readFile(data, inputs[0]);
+		readFile(data, form->inputs[0], openCalendar((MenuData*)data, form->inputs[0]));
+	}
+}
+
+/**
+ * Prompts the user for a filename, and opens the file as another calendar
+ * alongside those already open. An archive is opened as history, paged in
+ * by month as it is viewed.
+ */
+void openAnotherCalendar(void* data)
+{
+	FormBuffer* form;
+	int clickedOk;
+
+	if (((MenuData*)data)->numCalendars == MAX_CALENDARS)
+	{
+		messageBox(((MenuData*)data)->window, "Error: Too many calendars are open");
+	}
+	else
+	{
+		form = &((MenuData*)data)->form;
+		setForm(form, loadFields, 1);
+
+		clickedOk = dialogBox(((MenuData*)data)->window, "Open another calendar", form->numFields, form->properties, form->inputs);
+
+		if (clickedOk == TRUE && isArchiveFile(form->inputs[0]) == TRUE)
+		{
+			openHistory((MenuData*)data, form->inputs[0], openCalendar((MenuData*)data, form->inputs[0]));
+		}
+		else if (clickedOk == TRUE)
+		{
+			readFile(data, form->inputs[0], openCalendar((MenuData*)data, form->inputs[0]));
+		}
 	}
-	
-	free(properties); /* */
-	free(inputs[0]); /* */
-	free(inputs); /* */
 }
 
 /**
  * Saves data in the linked list to a text file. The user is prompted for a
- * filename, the file is either created or overwritten.
+ * filename, the file is either created or overwritten. The file is written
+ * on a background thread from a snapshot of the list.
  */
 void saveCalToFile(void* data)
 {
-	FILE* dest;
-	InputProperties* properties;
-	char** inputs;
+	FormBuffer* form;
+	LinkedList* lists[MAX_CALENDARS];
+	int numLists;
 	int clickedOk;
-	char* printedList;
+	int count;
+	int ii;
+	SaveJob* job;
 	
+	/* history is only ever paged in, so is never saved */
+	numLists = editableLists((MenuData*)data, lists);
+	count = 0;
+	for (ii = 0; ii < numLists; ii++)
+	{
+		count += lists[ii]->count;
+	}
+
 	/* check that a list exists and has at least one event in it */
-	if ((((MenuData*)data)->list == NULL) || ((MenuData*)data)->list->count <= 0)
+	if (count <= 0)
 	{
 		messageBox(((MenuData*)data)->window, "Error: No calendar has been loaded");
 	}
 	else
 	{
-		properties = (InputProperties*)malloc(sizeof(InputProperties));
-		properties->label = "Save file as";
-		properties->maxLength = 20;
-		properties->isMultiLine = FALSE;
-
-		inputs = (char**)malloc(sizeof(char*));
-		inputs[0] = (char*)malloc(21*sizeof(char));
-		strcpy(inputs[0], "");
+		form = &((MenuData*)data)->form;
+		setForm(form, saveFields, 1);
 
 		/* have user enter filename */
-		clickedOk = dialogBox(((MenuData*)data)->window, "Export calendar", 1, properties, inputs);
-		dest = fopen(inputs[0], "w");
+		clickedOk = dialogBox(((MenuData*)data)->window, "Export calendar", form->numFields, form->properties, form->inputs);
 		
-		/* check file opened properly */
-		if (dest == NULL)
-		{
-			messageBox(((MenuData*)data)->window, "Error opening file");
-		}
-		else
+		if (clickedOk == TRUE)
 		{
-			printedList = listToText(((MenuData*)data)->list);
-			fprintf(dest, "%s", printedList);
-			
-			free(printedList);
-			fclose(dest);
+			/* freeze the current list state and write it out in the background */
+			job = (SaveJob*)malloc(sizeof(SaveJob));
+			job->menu = (MenuData*)data;
+			job->snapshot = snapshotLists(lists, numLists);
+			job->sortOrder = ((MenuData*)data)->sortOrder;
+			strcpy(job->filename, form->inputs[0]);
+			job->opened = FALSE;
+			job->succeeded = FALSE;
+
+			runInBackground(&saveSnapshot, &saveFinished, (void*)job);
 		}
-		
-		free(properties); /* */
-		free(inputs[0]); /* */
-		free(inputs); /* */
 	}
 }
 
 /**
- * Checks that the passed-in variables represent a valid date, time and duration
- * to go in an Event struct. Allows Feb 29th as a valid date on leap years.
+ * Writes every event in the passed-in snapshot to dest in the format picked
+ * by filename's extension: iCalendar for .ics, an archive for .calz and
+ * calendar text otherwise. Returns the number of bytes written, or -1 if
+ * writing failed.
  */
-int eventValid(int inYear, int inMonth, int inDay, int inHours, int inMins, int inDuration)
+long writeCalendar(FILE* dest, char* filename, ListSnapshot* snapshot)
 {
-	int dateValid = FALSE;
-	int timeValid = FALSE;
-	int durationValid = FALSE;
-	int allValid = FALSE;
-
-	/* validate date */
-    if ( (inYear >= 1) && (inYear <= 3000) )
-    {
-        if ( (inMonth >= 1) && (inMonth <= 12) )
-        {
-            switch(inMonth)
-            {
-                case 1: case 3: case 5: case 7: case 8: case 10: case 12:
-                    if ( (inDay > 0) && (inDay < 32) )
-					{
-                        dateValid = TRUE;
-					}
-                    break;
-                case 4: case 6: case 9: case 11:
-                    if ( (inDay > 0) && (inDay < 31) )
-					{
-                        dateValid = TRUE;
-					}
-                    break;
-                case 2:
-                    if ( isLeapYear(inYear) == TRUE)
-                    {
-                        if ( (inDay > 0) && (inDay < 30) )
-						{
-                            dateValid = TRUE;
-						}
-                    }
-                    else if ( isLeapYear(inYear) == FALSE)
-                    {
-                        if ( (inDay > 0) && (inDay < 29) )
-						{
-                            dateValid = TRUE;
-						}
-                    }
-                default:
-                    break;
-            }
-        }
-    }
+	long bytesWritten;
 
-	/* validate time */
-	if (inHours >= 0 && inHours <= 23)
+	if (isIcsFile(filename) == TRUE)
 	{
-		if (inMins >= 0 && inMins <= 59)
-		{
-			timeValid = TRUE;
-		}
+		bytesWritten = writeIcsSnapshot(dest, snapshot);
 	}
-
-	/* validate duration */
-	if (inDuration > 0)
+	else if (isArchiveFile(filename) == TRUE)
 	{
-		durationValid = TRUE;
+		bytesWritten = writeArchiveSnapshot(dest, snapshot);
 	}
-
-	if (dateValid == TRUE && timeValid == TRUE && durationValid == TRUE)
+	else
 	{
-		allValid = TRUE;
+		bytesWritten = writeSnapshot(dest, snapshot);
 	}
 
-	return allValid;
+	return bytesWritten;
 }
 
 /**
- * Determines whether a year is a leap year.
+ * Writes the snapshot held by the passed-in SaveJob to its file. Runs on a
+ * background thread, so it must not touch the gui or the live list.
  */
-int isLeapYear(int year)
+void saveSnapshot(void* job)
 {
-	int leapYear = FALSE;
+	FILE* dest;
+	ListSnapshot* snapshot;
+
+	snapshot = ((SaveJob*)job)->snapshot;
+	sortEvents(snapshot->events, snapshot->count, ((SaveJob*)job)->sortOrder);
+	dest = fopen(((SaveJob*)job)->filename, "w");
+
+	/* check file opened properly */
+	((SaveJob*)job)->opened = (dest != NULL);
+	if (dest != NULL)
+	{
+		((SaveJob*)job)->succeeded = (writeCalendar(dest, ((SaveJob*)job)->filename, snapshot) >= 0);
+
+		if (fclose(dest) != 0)
+		{
+			((SaveJob*)job)->succeeded = FALSE;
+		}
+	}
+}
 
-	if ( (year % 4 == 0) && ( (year % 100 != 0) || (year % 400 == 0) ) )
+/**
+ * Reports the outcome of a background save to the user and frees the
+ * SaveJob. Runs on the gui thread once saveSnapshot has returned.
+ */
+void saveFinished(void* job)
+{
+	if (((SaveJob*)job)->opened == FALSE)
+	{
+		messageBox(((SaveJob*)job)->menu->window, "Error opening file");
+	}
+	else if (((SaveJob*)job)->succeeded == FALSE)
 	{
-        leapYear = FALSE;
+		messageBox(((SaveJob*)job)->menu->window, "Error writing file");
 	}
 
-	return leapYear;
+	/* the snapshot's events are released here, on the thread that edits the list */
+	freeSnapshot(((SaveJob*)job)->snapshot);
+	free(job);
 }
 
 /**
- * Adds an event to a linked list, a linked list is created if the passed-in
- * data does not contain one. Event data is gathered from user input.
+ * Adds an event to the first open calendar that isn't history, a calendar is
+ * created if there is none. Event data is gathered from user input. The
+ * event goes in order of start time, as loaded events do.
  */
 void addEvent(void* data)
 {
 	Event* newEvent;
+	Event entered;
+	EventHandle handle;
+	FormBuffer* form;
+	LinkedList* list;
 	int clickedOk;
-	InputProperties properties[5];
-	char** inputs;
-	int ii;
-	int dayEntry;
-	int monthEntry;
-	int yearEntry;
-	int hrsEntry;
-	int minsEntry;
-	int durationEntry;
-	char* printedList;
+	int calendar;
+	long startTime;
 	
-	/* create list if one doesn't exist */
-	if (((MenuData*)data)->list == NULL)
-	{
-		((MenuData*)data)->list = createList();
-	}
-
-	properties[0].label = "Enter activity";
-	properties[0].maxLength = 400;
-	properties[0].isMultiLine = FALSE;
-
-	properties[1].label = "Enter location";
-	properties[1].maxLength = 100;
-	properties[1].isMultiLine = FALSE;
-
-	properties[2].label = "Enter date (DD/MM/YYYY)";
-	properties[2].maxLength = 20;
-	properties[2].isMultiLine = FALSE;
-
-	properties[3].label = "Enter time in 24 hour format (HH:MM)";
-	properties[3].maxLength = 10;
-	properties[3].isMultiLine = FALSE;
-
-	properties[4].label = "Enter activity duration";
-	properties[4].maxLength = 10;
-	properties[4].isMultiLine = FALSE;
+	/* add to the first calendar that isn't history, creating one if needed */
+	calendar = editableCalendar((MenuData*)data);
 
-
-
-	inputs = (char**)malloc(5*sizeof(char*));
-	for (ii = 0; ii < 5; ii++)
+	if (calendar == -1)
 	{
-		inputs[ii] = (char*)malloc(properties[ii].maxLength*sizeof(char));
-		strcpy(inputs[ii], "\0");
+		messageBox(((MenuData*)data)->window, "Error: Too many calendars are open");
 	}
+	else
+	{
+		list = ((MenuData*)data)->calendars[calendar].list;
+		form = &((MenuData*)data)->form;
+		setForm(form, eventFields, EVENT_FIELDS);
 
-	/* prompt user for inputs */
-	clickedOk = dialogBox(((MenuData*)data)->window, "Create an event", 5, properties, inputs);
-	/*newEvent = (Event*)malloc(sizeof(Event));*/
+		/* prompt user for inputs */
+		clickedOk = dialogBox(((MenuData*)data)->window, "Create an event", form->numFields, form->properties, form->inputs);
 
-	/* parse user input for date, time and duration */
-	sscanf(inputs[2], "%d/%d/%d", &dayEntry, &monthEntry, &yearEntry);
-	sscanf(inputs[3], "%d:%d", &hrsEntry, &minsEntry);
-	sscanf(inputs[4], "%d", &durationEntry);
-
-	/* check that user input was valid */
-	if (eventValid(yearEntry, monthEntry, dayEntry, hrsEntry, minsEntry, durationEntry) == TRUE)
-	{
-		if (strlen(inputs[0]) > 1)
-		{
-			/* initialise newEvent with inputted data */
-			newEvent = (Event*)malloc(sizeof(Event));
-			strcpy(newEvent->activity, inputs[0]);
-			strcpy(newEvent->location, inputs[1]);
-			newEvent->eDate.day = dayEntry;
-			newEvent->eDate.month = monthEntry;
-			newEvent->eDate.year = yearEntry;
-			newEvent->eTime.hrs = hrsEntry;
-			newEvent->eTime.mins = minsEntry;
-			newEvent->duration = durationEntry;
-		
-			/* insert event in the list */
-			insertFirst(((MenuData*)data)->list, newEvent);
-			
-			/* print new list state and display in the gui */
-			printedList = listToWindow(((MenuData*)data)->list);
-			setText(((MenuData*)data)->window, printedList);
+		if (clickedOk == TRUE)
+		{
+			/* check that user input was valid */
+			if (formToEvent(form, &entered) == TRUE)
+			{
+				/* initialise newEvent with inputted data */
+				newEvent = createEvent();
+				*newEvent = entered;
+				newEvent->refCount = 1;
 			
-			free(printedList); /* */
+				/* insert event in start order, which loading merges against */
+				startTime = STATS_BEGIN();
+				mergeSorted(list, &newEvent, 1, &startKey, &handle);
+				STATS_END(STAT_INSERT, startTime, 1);
+				recordAdd(&((MenuData*)data)->history, list, handle);
+				
+				/* print new list state and display in the gui */
+				refreshWindow((MenuData*)data);
+			}
+			else
+			{
+				messageBox(((MenuData*)data)->window, "Event contained invalid data and was not added");
+			}
 		}
 	}
-	else
-	{
-		messageBox(((MenuData*)data)->window, "Event contained invalid data and was not added");
-	}
-	
-	for (ii = 0; ii < 5; ii++)
-	{
-		free(inputs[ii]); /* */
-	}
-	free(inputs); /* */
 }
 
 /**
@@ -393,327 +681,1284 @@ void addEvent(void* data)
 void editEvent(void* data)
 {
 	Event* foundEvent;
+	Event* editedEvent;
+	Event entered;
+	EventHandle handle;
+	LinkedList* list;
+	FormBuffer* form;
 	int clickedOk;
-	InputProperties properties[1];
-	char** inputs;
-	int elementNo;
-	InputProperties foundEvProps[5];
-	char** foundEvInputs;
-	int ii;
-	int dayEntry;
-	int monthEntry;
-	int yearEntry;
-	int hrsEntry;
-	int minsEntry;
-	int durationEntry;
-	char* printedList;
-	char foundMsg[500];
-	char foundActivity[400];
-
-	inputs = (char**)malloc(sizeof(char*));
-	inputs[0] = (char*)malloc(400*sizeof(char));
-	properties[0].label = "Enter a case sensitive search string that matches or partially matches an activity in the calendar";
-	properties[0].maxLength = 400;
-	properties[0].isMultiLine = FALSE;
-	strcpy(inputs[0], "");
+	int calendar;
+	int generation;
+	char foundMsg[MAX_FORM_TEXT];
+
+	form = &((MenuData*)data)->form;
+	setForm(form, searchFields, 1);
 	
 	/* prompt user for search string */
-	clickedOk = dialogBox(((MenuData*)data)->window, "Find matching event", 1, properties, inputs);
+	clickedOk = dialogBox(((MenuData*)data)->window, "Find matching event", form->numFields, form->properties, form->inputs);
 	
-	/* find element number of matching event in linked list */
-	elementNo = findEvent(((MenuData*)data)->list, inputs[0]);
-	
-	/* if no match was found, display message */
-	if (elementNo == -1)
-	{
-		messageBox(((MenuData*)data)->window, "No matching activity found");
-	}
-	else
+	if (clickedOk == TRUE)
 	{
-		foundEvent = retrieveElement(((MenuData*)data)->list, elementNo);
-		strcpy(foundMsg, "Matching event found: ");
-		strcpy(foundActivity, foundEvent->activity);
-		strcat(foundMsg, foundActivity);
-		messageBox(((MenuData*)data)->window, foundMsg);
-		
-		foundEvProps[0].label = "Enter activity";
-		foundEvProps[0].maxLength = 400;
-		foundEvProps[0].isMultiLine = FALSE;
-	
-		foundEvProps[1].label = "Enter location";
-		foundEvProps[1].maxLength = 100;
-		foundEvProps[1].isMultiLine = FALSE;
-	
-		foundEvProps[2].label = "Enter date (DD/MM/YYYY)";
-		foundEvProps[2].maxLength = 20;
-		foundEvProps[2].isMultiLine = FALSE;
-	
-		foundEvProps[3].label = "Enter time in 24 hour format (HH:MM)";
-		foundEvProps[3].maxLength = 10;
-		foundEvProps[3].isMultiLine = FALSE;
-	
-		foundEvProps[4].label = "Enter activity duration";
-		foundEvProps[4].maxLength = 10;
-		foundEvProps[4].isMultiLine = FALSE;
+		/* find a handle to the matching event in any open calendar */
+		handle = findInCalendars((MenuData*)data, form->inputs[0], &calendar);
 		
-		foundEvInputs = (char**)malloc(5*sizeof(char*));
-		for (ii = 0; ii < 5; ii++)
+		/* if no match was found, display message */
+		if (handle.generation == NO_GENERATION)
 		{
-			foundEvInputs[ii] = (char*)malloc(foundEvProps[ii].maxLength*sizeof(char));
-			strcpy(foundEvInputs[ii], "\0");
+			messageBox(((MenuData*)data)->window, "No matching activity found");
 		}
-		
-		/* prompt user for new event values */
-		clickedOk = dialogBox(((MenuData*)data)->window, "Editing found event", 5, foundEvProps, foundEvInputs);
-	
-		/* parse user input */
-		sscanf(foundEvInputs[2], "%d/%d/%d", &dayEntry, &monthEntry, &yearEntry);
-		sscanf(foundEvInputs[3], "%d:%d", &hrsEntry, &minsEntry);
-		sscanf(foundEvInputs[4], "%d", &durationEntry);
-	
-		/* check user input is valid */
-		if (eventValid(yearEntry, monthEntry, dayEntry, hrsEntry, minsEntry, durationEntry) == TRUE)
-		{
-			if (strlen(foundEvInputs[0]) > 1)
-			{
-				/* assign inputted values */
-				strcpy(foundEvent->activity, foundEvInputs[0]);
-				strcpy(foundEvent->location, foundEvInputs[1]);
-				foundEvent->eDate.day = dayEntry;
-				foundEvent->eDate.month = monthEntry;
-				foundEvent->eDate.year = yearEntry;
-				foundEvent->eTime.hrs = hrsEntry;
-				foundEvent->eTime.mins = minsEntry;
-				foundEvent->duration = durationEntry;
-			
-				/* refresh text in main window */
-				printedList = listToWindow(((MenuData*)data)->list);
-				setText(((MenuData*)data)->window, printedList);
-				free(printedList);
-			}
-		}
-		/* if input validation fails, display error message */
 		else
 		{
-			messageBox(((MenuData*)data)->window, "Invalid value/s entered, event was not modified");
-		}
+			list = ((MenuData*)data)->calendars[calendar].list;
+			generation = ((MenuData*)data)->calendars[calendar].loadGeneration;
+			foundEvent = lookupHandle(list, handle);
+			strcpy(foundMsg, "Matching event found: ");
+			strcat(foundMsg, internedText(foundEvent->activity));
+			messageBox(((MenuData*)data)->window, foundMsg);
+			
+			/* the search input is no longer needed, reuse the form for the event */
+			setForm(form, eventFields, EVENT_FIELDS);
+			
+			/* prompt user for new event values */
+			clickedOk = dialogBox(((MenuData*)data)->window, "Editing found event", form->numFields, form->properties, form->inputs);
 		
-		free(inputs[0]); /* */
-		free(inputs); /* */
-		for (ii = 0; ii < 5; ii++)
-		{
-			free(foundEvInputs[ii]); /* */
+			/* events loaded while the dialogs were open don't affect the
+			 * handle, but the calendar may have been closed and another
+			 * opened, perhaps at the same address, which changes its
+			 * generation
+			 */
+			if (clickedOk == TRUE && (((MenuData*)data)->calendars[calendar].loadGeneration != generation ||
+				lookupHandle(list, handle) != foundEvent))
+			{
+				messageBox(((MenuData*)data)->window, "The calendar was reloaded, event was not modified");
+			}
+			else if (clickedOk == TRUE)
+			{
+				/* check user input is valid */
+				if (formToEvent(form, &entered) == TRUE)
+				{
+					/* the edited event replaces the found one, which is kept
+					 * unchanged by the history so the edit can be undone
+					 */
+					editedEvent = createEvent();
+					*editedEvent = entered;
+					editedEvent->refCount = 1;
+
+					recordEdit(&((MenuData*)data)->history, list, handle, foundEvent, editedEvent);
+					replaceHandle(list, handle, editedEvent);
+
+					/* a new start moves the event to keep the list in order */
+					reorderHandle(list, handle, &startKey);
+				
+					/* refresh text in main window */
+					refreshWindow((MenuData*)data);
+				}
+				/* if input validation fails, display error message */
+				else
+				{
+					messageBox(((MenuData*)data)->window, "Invalid value/s entered, event was not modified");
+				}
+			}
 		}
-		free(foundEvInputs); /* */
 	}
 }
 
 /**
- * Checks every activity in a linked list against the passed-in string.
- * If inActivity exists in any activity string on the list, a corresponding
- * linked list element number is returned. The value -1 is returned if no
- * match is found. The first matching event is returned, following matching
- * events are ignored.
+ * Prompts the user to enter a search string corresponding to an activity
+ * in the linked list. If a match is found, the event is deleted.
  */
-int findEvent(LinkedList* list, char* inActivity)
+void deleteEvent(void* data)
 {
-	ListNode* current;
-	ListNode* next;
-	int ii;
-	int match;
-	int elementNo;
+	Event* foundEvent;
+	EventHandle handle;
+	LinkedList* list;
+	FormBuffer* form;
+	int clickedOk;
+	int calendar;
+	int generation;
+	char foundMsg[MAX_FORM_TEXT];
 
-	ii = 0;
-	match = FALSE;
-	elementNo = -1;
+	form = &((MenuData*)data)->form;
+	setForm(form, searchFields, 1);
 	
-	current = list->head;
-
-	/* traverse list until a match is found or the list ends */
-	while (ii < list->count && match == FALSE)
+	/* prompt user for search string */
+	clickedOk = dialogBox(((MenuData*)data)->window, "Find matching event to delete", form->numFields, form->properties, form->inputs);
+	
+	if (clickedOk == TRUE)
 	{
-		/* if a match is found, exit loop */
-		if (strstr(current->data->activity, inActivity) != NULL)
+		/* find a handle to the matching event on the list */
+		handle = findInCalendars((MenuData*)data, form->inputs[0], &calendar);
+		
+		/* if no match was found, display message */
+		if (handle.generation == NO_GENERATION)
 		{
-			match = TRUE;
-			elementNo = ii;
+			messageBox(((MenuData*)data)->window, "No matching activity found");
 		}
-		/* else, keep searching */
+		/* else match found */
 		else
 		{
-			next = current->next;
-			current = next;
-			ii++;
+			/* display the name of the deleted event to the user */
+			list = ((MenuData*)data)->calendars[calendar].list;
+			generation = ((MenuData*)data)->calendars[calendar].loadGeneration;
+			foundEvent = lookupHandle(list, handle);
+			strcpy(foundMsg, "Event deleted: ");
+			strcat(foundMsg, internedText(foundEvent->activity));
+			messageBox(((MenuData*)data)->window, foundMsg);
+		
+			/* delete the event AFTER displaying confirmation message, the
+			 * history keeps hold of it, and of where it was, so the delete
+			 * can be undone
+			 */
+			if (((MenuData*)data)->calendars[calendar].loadGeneration == generation &&
+				lookupHandle(list, handle) == foundEvent)
+			{
+				recordDelete(&((MenuData*)data)->history, list, handle);
+			
+				/* refresh text in main window */
+				refreshWindow((MenuData*)data);
+			}
 		}
 	}
-	
-	/* if no match was found */
-	if (match == FALSE)
+}
+
+/**
+ * Prompts the user for a search string, and deletes every event whose
+ * activity contains it from each open calendar that isn't history, one pass
+ * over each calendar. The deletes are recorded as a single change, which one
+ * undo reverses.
+ */
+void deleteMatchingEvents(void* data)
+{
+	LinkedList* lists[MAX_CALENDARS];
+	FormBuffer* form;
+	int clickedOk;
+	int numLists;
+	int deleted;
+	char resultMsg[MAX_FORM_TEXT];
+
+	form = &((MenuData*)data)->form;
+	setForm(form, searchFields, 1);
+
+	clickedOk = dialogBox(((MenuData*)data)->window, "Find matching events to delete", form->numFields, form->properties, form->inputs);
+
+	if (clickedOk == TRUE)
 	{
-		elementNo = -1;
+		numLists = editableLists((MenuData*)data, lists);
+		deleted = recordDeleteMatching(&((MenuData*)data)->history, lists, numLists, form->inputs[0]);
+
+		if (deleted == 0)
+		{
+			messageBox(((MenuData*)data)->window, "No matching activity found");
+		}
+		else
+		{
+			refreshWindow((MenuData*)data);
+
+			sprintf(resultMsg, "%d events deleted", deleted);
+			messageBox(((MenuData*)data)->window, resultMsg);
+		}
 	}
-	
-	return elementNo;
 }
 
 /**
- * Prompts the user to enter a search string corresponding to an activity
- * in the linked list. If a match is found, the event is deleted.
+ * Prompts the user for a search string and a number of minutes, and moves
+ * every event whose activity contains the string by that many minutes, in
+ * each open calendar that isn't history. Events that would be moved outside
+ * the dates the calendar allows are left where they are. As with
+ * deleteMatchingEvents, the moves are undone together.
  */
-void deleteEvent(void* data)
+void shiftMatchingEvents(void* data)
 {
-	Event* foundEvent;
+	LinkedList* lists[MAX_CALENDARS];
+	FormBuffer* form;
+	long minutes;
 	int clickedOk;
-	InputProperties properties[1];
-	char** inputs;
-	int elementNo;
-	char* printedList;
-	char foundMsg[500];
-	char foundActivity[400];
-
-	inputs = (char**)malloc(sizeof(char*));
-	inputs[0] = (char*)malloc(400*sizeof(char));
-	properties[0].label = "Enter a case sensitive search string that matches or partially matches an activity in the calendar";
-	properties[0].maxLength = 400;
-	properties[0].isMultiLine = FALSE;
-	strcpy(inputs[0], "");
-	
-	/* prompt user for search string */
-	clickedOk = dialogBox(((MenuData*)data)->window, "Find matching event to delete", 1, properties, inputs);
-	
-	/* retrieve element number of matching event on the list */
-	elementNo = findEvent(((MenuData*)data)->list, inputs[0]);
-	
-	/* if no match was found, display message */
-	if (elementNo == -1)
+	int numLists;
+	int shifted;
+	char resultMsg[MAX_FORM_TEXT];
+
+	form = &((MenuData*)data)->form;
+	setForm(form, shiftFields, 2);
+
+	clickedOk = dialogBox(((MenuData*)data)->window, "Find matching events to move", form->numFields, form->properties, form->inputs);
+
+	if (clickedOk == TRUE)
+	{
+		if (sscanf(form->inputs[1], "%ld", &minutes) != 1)
+		{
+			messageBox(((MenuData*)data)->window, "Error: Invalid number of minutes");
+		}
+		else
+		{
+			numLists = editableLists((MenuData*)data, lists);
+			shifted = recordUpdateMatching(&((MenuData*)data)->history, lists, numLists, form->inputs[0], &shiftEvent,
+				(void*)&minutes);
+
+			if (shifted == 0)
+			{
+				messageBox(((MenuData*)data)->window, "No matching activity found");
+			}
+			else
+			{
+				refreshWindow((MenuData*)data);
+
+				sprintf(resultMsg, "%d events moved", shifted);
+				messageBox(((MenuData*)data)->window, resultMsg);
+			}
+		}
+	}
+}
+
+/**
+ * Undoes the most recent add, edit or delete that hasn't been undone.
+ */
+void undoLastChange(void* data)
+{
+	if (undoChange(&((MenuData*)data)->history) == TRUE)
 	{
-		messageBox(((MenuData*)data)->window, "No matching activity found");
+		refreshWindow((MenuData*)data);
 	}
-	/* else match found */
 	else
 	{
-		/* display the name of the deleted event to the user */
-		foundEvent = retrieveElement(((MenuData*)data)->list, elementNo);
-		strcpy(foundMsg, "Event deleted: ");
-		strcpy(foundActivity, foundEvent->activity);
-		strcat(foundMsg, foundActivity);
-		messageBox(((MenuData*)data)->window, foundMsg);
-	
-		/* delete the event AFTER displaying confirmation message */
-		deleteNthElement(((MenuData*)data)->list, elementNo);
-		
-		/* refresh text in main window */
-		printedList = listToWindow(((MenuData*)data)->list);
-		setText(((MenuData*)data)->window, printedList);
-		
-		if (((MenuData*)data)->list->count > 0)
-		{
-			free(printedList);
-		}
+		messageBox(((MenuData*)data)->window, "There is nothing to undo");
+	}
+}
+
+/**
+ * Redoes the most recently undone add, edit or delete.
+ */
+void redoLastChange(void* data)
+{
+	if (redoChange(&((MenuData*)data)->history) == TRUE)
+	{
+		refreshWindow((MenuData*)data);
+	}
+	else
+	{
+		messageBox(((MenuData*)data)->window, "There is nothing to redo");
 	}
-	
-	free(inputs[0]);
-	free(inputs);
 }
 
 /**
  * Parses text from a file matching the passed-in filename. Text is formatted
- * for display in the gui main window.
+ * for display in the gui main window. The file is parsed on a background
+ * thread, and the window is refreshed as each batch of events arrives.
  */
-void readFile(void* data, char* filename)
+void readFile(void* data, char* filename, int calendar)
 {
-	FILE* source;
-	Event* newEvent;
-	int tempYear;
-	int tempMonth;
-	int tempDay;
-	int tempHrs;
-	int tempMins;
-	int tempDuration;
-	char possEmptyLine[100];
-	char* printedList;
-	char junkString[500];
-	
-	source = fopen(filename, "r");
-	/* if file didn't open correctly, display error message */
-	if (source == NULL)
+	LoadJob* job;
+
+	/* any load still running into the calendar is superseded by this one */
+	((MenuData*)data)->calendars[calendar].loadGeneration++;
+
+	job = (LoadJob*)malloc(sizeof(LoadJob));
+	job->menu = (MenuData*)data;
+	job->calendar = calendar;
+	job->generation = ((MenuData*)data)->calendars[calendar].loadGeneration;
+	job->filename = (char*)malloc((strlen(filename) + 1) * sizeof(char));
+	strcpy(job->filename, filename);
+	job->opened = FALSE;
+	initReport(&job->report, ((MenuData*)data)->maxDiagnostics);
+
+	runInBackground(&loadEvents, &loadFinished, (void*)job);
+}
+
+/**
+ * Opens an archive as a calendar of history, paging in only the current
+ * month and the VIEW_MONTHS - 1 after it. Other months are paged in as
+ * queries reach them.
+ */
+void openHistory(MenuData* menu, char* filename, int calendar)
+{
+	PartitionStore* store;
+	Date today;
+	long viewStart;
+	long viewEnd;
+	int endMonth;
+
+	store = openPartitions(filename, menu->pageBudget);
+
+	if (store == NULL)
 	{
-		messageBox(((MenuData*)data)->window, "Error opening file");
+		messageBox(menu->window, "Error opening file");
 	}
 	else
 	{
-		/* scan until end of file is reached */
-		while (!feof(source))
+		freeList(menu->calendars[calendar].list);
+		menu->calendars[calendar].list = store->list;
+		menu->calendars[calendar].store = store;
+
+		/* from the start of this month to the start of the month after the view */
+		civilFromDays((long)time(NULL) / (60L * MINS_PER_DAY), &today);
+		endMonth = today.month - 1 + VIEW_MONTHS;
+		viewStart = daysFromCivil(today.year, today.month, 1) * MINS_PER_DAY;
+		viewEnd = daysFromCivil(today.year + endMonth / 12, endMonth % 12 + 1, 1) * MINS_PER_DAY;
+
+		pageInRange(store, viewStart, viewEnd);
+		refreshWindow(menu);
+	}
+}
+
+/**
+ * Parses every entry of the file named in the passed-in LoadJob, posting
+ * batches of valid events to the gui thread. Runs on a background thread.
+ */
+void loadEvents(void* job)
+{
+	FILE* source;
+	Event* newEvent;
+	LoadBatch* batch;
+	EntryReader readNext;
+	ArchiveReader* archive;
+	int batchSize;
+	int result;
+
+	source = fopen(((LoadJob*)job)->filename, "r");
+	readNext = entryReaderFor(((LoadJob*)job)->filename);
+	archive = NULL;
+
+	if (source != NULL)
+	{
+		((LoadJob*)job)->opened = TRUE;
+		batchSize = FIRST_LOAD_BATCH;
+		batch = NULL;
+
+		/* archives are read through their block index, one that can't be
+		 * read counts as a single invalid entry
+		 */
+		if (isArchiveFile(((LoadJob*)job)->filename) == TRUE)
 		{
-			/* check that line is formatted as event data */
-			if (fscanf(source, "%d-%d-%d %d:%d %d ", &tempYear, &tempMonth, &tempDay, &tempHrs, &tempMins, &tempDuration) == 6)
+			readNext = NULL;
+			archive = openArchive(source);
+			if (archive == NULL)
 			{
-				/* validate scanned values */
-				if (eventValid(tempYear, tempMonth, tempDay, tempHrs, tempMins, tempDuration) == TRUE)
-				{
-					newEvent = (Event*)malloc(sizeof(Event));
-			
-					/* assign scanned values to an event */
-					newEvent->eDate.year = tempYear;
-					newEvent->eDate.month = tempMonth;
-					newEvent->eDate.day = tempDay;
-					newEvent->eTime.hrs = tempHrs;
-					newEvent->eTime.mins = tempMins;
-					newEvent->duration = tempDuration;
-					
-					/* remainder of line will contain th activity */
-					fgets(newEvent->activity, 399, source);
-					removeNewline(newEvent->activity);
-
-					/* next line will have a location or be a blank line */
-					fgets(possEmptyLine, 99, source);
-
-					/* if newly scanned line contains a location */					
-					if (strlen(possEmptyLine) > 1)
-					{
-						/* assign location */
-						strcpy(newEvent->location, possEmptyLine);
-						removeNewline(newEvent->location);
+				reportInvalid(&((LoadJob*)job)->report, 0, "archive", "not a valid archive");
+			}
+		}
 
-						/* read next empty line */
-						fgets(possEmptyLine, 99, source);
-					}
-	
-					/* else make location an empty string */
-					else
-					{
-						strcpy(newEvent->location, "\0");
-					}
-			
-					/* insert the new event into the linked list */
-					insertFirst(((MenuData*)data)->list, newEvent);
-				}
+		do
+		{
+			if (archive != NULL)
+			{
+				result = readArchiveEntry(archive, &newEvent, &((LoadJob*)job)->report);
+			}
+			else if (readNext != NULL)
+			{
+				result = (*readNext)(source, &newEvent, &((LoadJob*)job)->report);
+			}
+			else
+			{
+				result = ENTRY_NONE;
+			}
 
-				/* if event data was invalid, scan lines from entry but don't send anything to the linked list */
-				else
+			if (result == ENTRY_VALID)
+			{
+				/* start a new batch if needed */
+				if (batch == NULL)
 				{
+					batch = (LoadBatch*)malloc(sizeof(LoadBatch));
+					batch->job = (LoadJob*)job;
+					batch->events = (Event**)malloc(batchSize * sizeof(Event*));
+					batch->count = 0;
+				}
 
-					messageBox(((MenuData*)data)->window, "Invalid event data found, invalid entry will be omitted");
-					fgets(junkString, 499, source);
-				
-					fgets(junkString, 99, source);
+				batch->events[batch->count] = newEvent;
+				batch->count++;
 
-					/* if newly scanned line contains a location */					
-					if (strlen(junkString) > 1)
-					{
-						/* read next empty line */
-						fgets(possEmptyLine, 99, source);
-					}
-				}			
+				/* hand full batches to the gui, sorted here rather than on
+				 * the gui thread, doubling the size of the next
+				 */
+				if (batch->count == batchSize)
+				{
+					sortEvents(batch->events, batch->count, SORT_START);
+					postToGui(&insertLoadedBatch, (void*)batch);
+					batch = NULL;
+					batchSize *= 2;
+				}
 			}
+		} while (result != ENTRY_NONE);
+
+		/* hand over the partly filled last batch */
+		if (batch != NULL)
+		{
+			sortEvents(batch->events, batch->count, SORT_START);
+			postToGui(&insertLoadedBatch, (void*)batch);
 		}
 
-		/* display every activity in the linked list in the main window */
-		printedList = listToWindow(((MenuData*)data)->list);
-		setText(((MenuData*)data)->window, printedList);
-		
-		free(printedList);
+		if (archive != NULL)
+		{
+			closeArchive(archive);
+		}
 		fclose(source);
 	}
 }
 
+/**
+ * Merges a LoadBatch of events into the list and refreshes the main window.
+ * Runs on the gui thread.
+ */
+void insertLoadedBatch(void* batch)
+{
+	MenuData* menu;
+	OpenCalendar* calendar;
+	int ii;
+	long startTime;
+
+	menu = ((LoadBatch*)batch)->job->menu;
+	calendar = &menu->calendars[((LoadBatch*)batch)->job->calendar];
+
+	/* only add the events if no newer load has replaced this one */
+	if (((LoadBatch*)batch)->job->generation == calendar->loadGeneration && calendar->list != NULL)
+	{
+		/* the batch was sorted on the loading thread, so one merge adds it */
+		startTime = STATS_BEGIN();
+		mergeSorted(calendar->list, ((LoadBatch*)batch)->events, ((LoadBatch*)batch)->count, &startKey, NULL);
+		STATS_END(STAT_INSERT, startTime, ((LoadBatch*)batch)->count);
+
+		/* display every activity loaded so far in the main window */
+		refreshWindow(menu);
+	}
+	else
+	{
+		for (ii = 0; ii < ((LoadBatch*)batch)->count; ii++)
+		{
+			releaseEvent(((LoadBatch*)batch)->events[ii]);
+		}
+	}
+
+	free(((LoadBatch*)batch)->events);
+	free(batch);
+}
+
+/**
+ * Reports the outcome of a background load to the user, including a single
+ * summary of any invalid entries, and frees the LoadJob. Runs on the gui
+ * thread once loadEvents has returned.
+ */
+void loadFinished(void* job)
+{
+	char* summary;
+	MenuData* menu;
+	OpenCalendar* calendar;
+
+	menu = ((LoadJob*)job)->menu;
+	calendar = &menu->calendars[((LoadJob*)job)->calendar];
+
+	if (((LoadJob*)job)->generation == calendar->loadGeneration)
+	{
+		/* if file didn't open correctly, display error message */
+		if (((LoadJob*)job)->opened == FALSE)
+		{
+			messageBox(menu->window, "Error opening file");
+		}
+		else
+		{
+			/* a file with no valid events still replaces the window text */
+			if (calendar->list->count == 0)
+			{
+				refreshWindow(menu);
+			}
+
+			if (((LoadJob*)job)->report.invalidCount > 0)
+			{
+				summary = reportToText(&((LoadJob*)job)->report, SHOWN_DIAGNOSTICS);
+				messageBox(menu->window, summary);
+				free(summary);
+			}
+		}
+	}
+
+	freeReport(&((LoadJob*)job)->report);
+	free(((LoadJob*)job)->filename);
+	free(job);
+}
+
+/**
+ * Displays every event in the list in the main window, in the menu's sort
+ * order. If several calendars are open, the events of all of them are
+ * shown together, each labelled with its calendar.
+ */
+void refreshWindow(MenuData* menu)
+{
+	Timeline* timelines[MAX_CALENDARS];
+	LinkedList* lists[MAX_CALENDARS];
+	char* names[MAX_CALENDARS];
+	char* printedList;
+	int numTimelines;
+	int numLists;
+	int ii;
+	long startTime;
+
+	/* several calendars in time order are merged from their timelines */
+	if (menu->numCalendars > 1 && menu->sortOrder == SORT_START)
+	{
+		numTimelines = calendarTimelines(menu, timelines);
+		for (ii = 0; ii < numTimelines; ii++)
+		{
+			names[ii] = menu->calendars[ii].name;
+		}
+
+		printedList = mergedToWindow(timelines, names, numTimelines);
+	}
+	else
+	{
+		numLists = calendarLists(menu, lists);
+		for (ii = 0; ii < numLists; ii++)
+		{
+			names[ii] = menu->calendars[ii].name;
+		}
+
+		/* a single calendar's events aren't labelled */
+		printedList = sortedToWindow(lists, (numLists > 1) ? names : NULL, numLists, menu->sortOrder);
+	}
+
+	startTime = STATS_BEGIN();
+	setText(menu->window, printedList);
+	STATS_END(STAT_SET_TEXT, startTime, strlen(printedList));
+
+	free(printedList);
+}
+
+/**
+ * Prompts the user for the order to show and save events in, and shows
+ * them in that order.
+ */
+void chooseSortOrder(void* data)
+{
+	FormBuffer* form;
+	int clickedOk;
+	int order;
+
+	form = &((MenuData*)data)->form;
+	setForm(form, sortFields, 1);
+
+	clickedOk = dialogBox(((MenuData*)data)->window, "Sort events", form->numFields, form->properties, form->inputs);
+
+	if (clickedOk == TRUE)
+	{
+		if (parseSortOrder(form->inputs[0], &order) == FALSE)
+		{
+			messageBox(((MenuData*)data)->window, "Error: Sort by start, end, duration or activity");
+		}
+		else
+		{
+			((MenuData*)data)->sortOrder = order;
+			refreshWindow((MenuData*)data);
+		}
+	}
+}
+
+/**
+ * Displays the time taken by each kind of calendar operation so far.
+ */
+void showStatistics(void* data)
+{
+	char* statsText;
+
+	statsText = statsToText();
+	messageBox(((MenuData*)data)->window, statsText);
+	free(statsText);
+}
+
+/**
+ * Prompts the user for two dates, and displays every occurrence of every
+ * event between them (inclusive) in order, with recurring events expanded.
+ */
+void showRange(void* data)
+{
+	FormBuffer* form;
+	Occurrence* found;
+	LinkedList* lists[MAX_CALENDARS];
+	Date from;
+	Date to;
+	long rangeStart;
+	long rangeEnd;
+	int numLists;
+	int clickedOk;
+	int count;
+	char* printedRange;
+
+	numLists = calendarLists((MenuData*)data, lists);
+
+	if (numLists == 0)
+	{
+		messageBox(((MenuData*)data)->window, "Error: No calendar has been loaded");
+	}
+	else
+	{
+		form = &((MenuData*)data)->form;
+		setForm(form, rangeFields, 2);
+
+		clickedOk = dialogBox(((MenuData*)data)->window, "Show events between two dates", form->numFields, form->properties, form->inputs);
+
+		if (clickedOk == TRUE)
+		{
+			if (sscanf(form->inputs[0], "%d/%d/%d", &from.day, &from.month, &from.year) == 3 &&
+				sscanf(form->inputs[1], "%d/%d/%d", &to.day, &to.month, &to.year) == 3 &&
+				eventValid(from.year, from.month, from.day, 0, 0, 1) == TRUE &&
+				eventValid(to.year, to.month, to.day, 0, 0, 1) == TRUE)
+			{
+				/* the range runs to the end of the last day, across every open calendar */
+				rangeStart = daysFromCivil(from.year, from.month, from.day) * MINS_PER_DAY;
+				rangeEnd = (daysFromCivil(to.year, to.month, to.day) + 1) * MINS_PER_DAY;
+
+				pageCalendars((MenuData*)data, rangeStart, rangeEnd);
+				found = queryRanges(lists, numLists, rangeStart, rangeEnd, &count);
+
+				printedRange = occurrencesToWindow(found, count);
+				setText(((MenuData*)data)->window, printedRange);
+
+				free(printedRange);
+				free(found);
+			}
+			else
+			{
+				messageBox(((MenuData*)data)->window, "Invalid date/s entered");
+			}
+		}
+	}
+}
+
+/**
+ * Prompts the user for a date range, a length of time and the hours of the
+ * day to look in, and displays the first free slots of that length.
+ */
+void showFreeSlots(void* data)
+{
+	FormBuffer* form;
+	SlotQuery query;
+	FreeSlot slots[MAX_SHOWN_SLOTS];
+	Timeline* timelines[MAX_CALENDARS];
+	char slotsMsg[MAX_SHOWN_SLOTS * MAX_SLOT_TEXT + 100];
+	int clickedOk;
+	int found;
+	int ii;
+
+	if (((MenuData*)data)->numCalendars == 0)
+	{
+		messageBox(((MenuData*)data)->window, "Error: No calendar has been loaded");
+	}
+	else
+	{
+		form = &((MenuData*)data)->form;
+		setForm(form, slotFields, SLOT_FIELDS);
+
+		clickedOk = dialogBox(((MenuData*)data)->window, "Find free time", form->numFields, form->properties, form->inputs);
+
+		if (clickedOk == TRUE)
+		{
+			if (parseSlotQuery(form->inputs, &query) == TRUE)
+			{
+				/* time is only free if it is free in every open calendar */
+				pageCalendars((MenuData*)data, query.rangeStart, query.rangeEnd);
+				found = findFreeSlots(timelines, calendarTimelines((MenuData*)data, timelines), &query, slots, MAX_SHOWN_SLOTS);
+
+				if (found == 0)
+				{
+					sprintf(slotsMsg, "No free time of %d minutes found", query.length);
+				}
+				else
+				{
+					sprintf(slotsMsg, "First free times of at least %d minutes:\n", query.length);
+					for (ii = 0; ii < found; ii++)
+					{
+						parseSlotWindow(slotsMsg + strlen(slotsMsg), &slots[ii]);
+						strcat(slotsMsg, "\n");
+					}
+				}
+
+				messageBox(((MenuData*)data)->window, slotsMsg);
+			}
+			else
+			{
+				messageBox(((MenuData*)data)->window, "Invalid value/s entered");
+			}
+		}
+	}
+}
+
+/**
+ * Opens an empty calendar with the passed-in name, after those already open.
+ * Returns its position, or -1 if MAX_CALENDARS are already open.
+ */
+int openCalendar(MenuData* menu, char* name)
+{
+	OpenCalendar* calendar;
+	int position;
+
+	position = -1;
+
+	if (menu->numCalendars < MAX_CALENDARS)
+	{
+		position = menu->numCalendars;
+		calendar = &menu->calendars[position];
+
+		sprintf(calendar->name, "%.*s", MAX_CALENDAR_NAME, name);
+		calendar->list = createList();
+		calendar->timeline = NULL;
+		calendar->store = NULL;
+		menu->numCalendars++;
+	}
+
+	return position;
+}
+
+/**
+ * Closes every open calendar, freeing its events and forgetting the changes
+ * made to them. Loads still running into them are abandoned.
+ */
+void closeCalendars(MenuData* menu)
+{
+	int ii;
+
+	/* the history refers to the lists, so must let go of them first */
+	clearHistory(&menu->history);
+
+	for (ii = 0; ii < menu->numCalendars; ii++)
+	{
+		if (menu->calendars[ii].timeline != NULL)
+		{
+			freeTimeline(menu->calendars[ii].timeline);
+		}
+		/* the list of a calendar of history belongs to its store */
+		if (menu->calendars[ii].store != NULL)
+		{
+			closePartitions(menu->calendars[ii].store);
+		}
+		else
+		{
+			freeList(menu->calendars[ii].list);
+		}
+
+		menu->calendars[ii].list = NULL;
+		menu->calendars[ii].timeline = NULL;
+		menu->calendars[ii].store = NULL;
+	}
+
+	/* batches from loads still running are dropped when they arrive */
+	for (ii = 0; ii < MAX_CALENDARS; ii++)
+	{
+		menu->calendars[ii].loadGeneration++;
+	}
+
+	menu->numCalendars = 0;
+}
+
+/**
+ * Returns the position of the first open calendar that isn't history,
+ * opening a new one if there is none. Returns -1 if there is none and no
+ * more calendars can be opened.
+ */
+int editableCalendar(MenuData* menu)
+{
+	int position;
+	int ii;
+
+	position = -1;
+
+	for (ii = 0; ii < menu->numCalendars && position == -1; ii++)
+	{
+		if (menu->calendars[ii].store == NULL)
+		{
+			position = ii;
+		}
+	}
+
+	if (position == -1)
+	{
+		position = openCalendar(menu, "new");
+	}
+
+	return position;
+}
+
+/**
+ * Stores the list of each open calendar in outLists, which must have room
+ * for MAX_CALENDARS lists. Returns the number of calendars open.
+ */
+int calendarLists(MenuData* menu, LinkedList** outLists)
+{
+	int ii;
+
+	for (ii = 0; ii < menu->numCalendars; ii++)
+	{
+		outLists[ii] = menu->calendars[ii].list;
+	}
+
+	return menu->numCalendars;
+}
+
+/**
+ * Stores the list of each open calendar that isn't history in outLists,
+ * which must have room for MAX_CALENDARS lists. Returns the number stored.
+ */
+int editableLists(MenuData* menu, LinkedList** outLists)
+{
+	int numLists;
+	int ii;
+
+	numLists = 0;
+
+	for (ii = 0; ii < menu->numCalendars; ii++)
+	{
+		if (menu->calendars[ii].store == NULL)
+		{
+			outLists[numLists] = menu->calendars[ii].list;
+			numLists++;
+		}
+	}
+
+	return numLists;
+}
+
+/**
+ * Pages in the events of every calendar of history that overlap rangeStart
+ * up to rangeEnd (in minutes, as for eventStart).
+ */
+void pageCalendars(MenuData* menu, long rangeStart, long rangeEnd)
+{
+	int ii;
+
+	for (ii = 0; ii < menu->numCalendars; ii++)
+	{
+		if (menu->calendars[ii].store != NULL)
+		{
+			pageInRange(menu->calendars[ii].store, rangeStart, rangeEnd);
+		}
+	}
+}
+
+/**
+ * Stores the time-ordered index of each open calendar in outTimelines,
+ * which must have room for MAX_CALENDARS timelines, rebuilding any that are
+ * out of date. Returns the number of calendars open.
+ */
+int calendarTimelines(MenuData* menu, Timeline** outTimelines)
+{
+	int ii;
+
+	for (ii = 0; ii < menu->numCalendars; ii++)
+	{
+		outTimelines[ii] = currentTimeline(menu, ii);
+	}
+
+	return menu->numCalendars;
+}
+
+/**
+ * Searches every open calendar that isn't history in turn for an event
+ * whose activity contains the passed-in string. Returns a handle to the first match and
+ * stores its calendar in outCalendar, or returns a handle to no event if there is no match.
+ */
+EventHandle findInCalendars(MenuData* menu, char* inActivity, int* outCalendar)
+{
+	EventHandle handle;
+	int ii;
+
+	handle.slot = 0;
+	handle.generation = NO_GENERATION;
+
+	for (ii = 0; ii < menu->numCalendars && handle.generation == NO_GENERATION; ii++)
+	{
+		if (menu->calendars[ii].store == NULL)
+		{
+			handle = findEvent(menu->calendars[ii].list, inActivity);
+			*outCalendar = ii;
+		}
+	}
+
+	return handle;
+}
+
+/**
+ * Returns the time-ordered index of one open calendar's list, rebuilding it
+ * first if the list has changed since it was built.
+ */
+Timeline* currentTimeline(MenuData* menu, int calendar)
+{
+	OpenCalendar* open;
+
+	open = &menu->calendars[calendar];
+
+	if (timelineCurrent(open->timeline, open->list) == FALSE)
+	{
+		if (open->timeline != NULL)
+		{
+			freeTimeline(open->timeline);
+		}
+		open->timeline = buildTimeline(open->list);
+	}
+
+	return open->timeline;
+}
+
+/**
+ * Parses the SLOT_FIELDS strings of a free time search, in the order of the
+ * free time dialog, into query. Returns FALSE if any are invalid.
+ */
+int parseSlotQuery(char** inputs, SlotQuery* query)
+{
+	Date from;
+	Date to;
+	int startHrs;
+	int startMins;
+	int endHrs;
+	int endMins;
+	int valid;
+
+	valid = FALSE;
+
+	if (sscanf(inputs[SLOT_FROM], "%d/%d/%d", &from.day, &from.month, &from.year) == 3 &&
+		sscanf(inputs[SLOT_TO], "%d/%d/%d", &to.day, &to.month, &to.year) == 3 &&
+		sscanf(inputs[SLOT_LENGTH], "%d", &query->length) == 1 &&
+		sscanf(inputs[SLOT_DAY_START], "%d:%d", &startHrs, &startMins) == 2 &&
+		sscanf(inputs[SLOT_DAY_END], "%d:%d", &endHrs, &endMins) == 2)
+	{
+		query->dayStart = startHrs * 60 + startMins;
+		query->dayEnd = endHrs * 60 + endMins;
+		query->weekdaysOnly = (inputs[SLOT_WEEKDAYS][0] == 'y' || inputs[SLOT_WEEKDAYS][0] == 'Y');
+
+		/* the range runs to the end of the last day */
+		if (eventValid(from.year, from.month, from.day, 0, 0, 1) == TRUE &&
+			eventValid(to.year, to.month, to.day, 0, 0, 1) == TRUE &&
+			startMins >= 0 && startMins <= 59 && endMins >= 0 && endMins <= 59 &&
+			query->dayStart >= 0 && query->dayEnd <= MINS_PER_DAY &&
+			query->length > 0 && query->length <= query->dayEnd - query->dayStart)
+		{
+			query->rangeStart = daysFromCivil(from.year, from.month, from.day) * MINS_PER_DAY;
+			query->rangeEnd = (daysFromCivil(to.year, to.month, to.day) + 1) * MINS_PER_DAY;
+			valid = (query->rangeStart < query->rangeEnd);
+		}
+	}
+
+	return valid;
+}
+
+/**
+ * Loads the events of the named calendar file that a free time search could
+ * need onto the list. From an archive, only the blocks overlapping the
+ * search's range are read. Returns the same as loadFile.
+ */
+long loadSearchedFile(LinkedList* list, char* filename, SlotQuery* query, ValidationReport* report)
+{
+	long loaded;
+
+	if (isArchiveFile(filename) == TRUE)
+	{
+		loaded = loadArchiveRange(list, filename, query->rangeStart, query->rangeEnd, report);
+	}
+	else
+	{
+		loaded = loadFile(list, filename, report);
+	}
+
+	return loaded;
+}
+
+/**
+ * Writes the invalid entries found in the named calendar file to a report
+ * beside it, named by adding REPORT_SUFFIX, and says where on stderr.
+ */
+void writeReportFile(char* filename, ValidationReport* report)
+{
+	FILE* dest;
+	char* reportName;
+	long written;
+
+	reportName = (char*)malloc((strlen(filename) + strlen(REPORT_SUFFIX) + 1) * sizeof(char));
+	sprintf(reportName, "%s%s", filename, REPORT_SUFFIX);
+
+	written = -1;
+	dest = fopen(reportName, "w");
+	if (dest != NULL)
+	{
+		written = writeReport(dest, report, filename);
+		fclose(dest);
+	}
+
+	if (written < 0)
+	{
+		fprintf(stderr, "Invalid event data found, %d invalid entries were omitted, error writing %s\n", report->invalidCount, reportName);
+	}
+	else
+	{
+		fprintf(stderr, "Invalid event data found, %d invalid entries were omitted, see %s\n", report->invalidCount, reportName);
+	}
+
+	free(reportName);
+}
+
+/**
+ * Loads the named calendar file and prints every free slot matching the
+ * passed-in --free-slots arguments, one per line, without opening a window.
+ * Details of up to maxDiagnostics invalid entries are written to a report
+ * beside the file. Returns the program's exit status.
+ */
+int printFreeSlots(char* filename, char** slotArgs, int maxDiagnostics)
+{
+	LinkedList* list;
+	Timeline* timeline;
+	SlotQuery query;
+	ValidationReport report;
+	FreeSlot slots[MAX_SHOWN_SLOTS];
+	char slotText[MAX_SLOT_TEXT];
+	int status;
+	int found;
+	int ii;
+
+	status = 0;
+	list = createList();
+	initReport(&report, maxDiagnostics);
+
+	if (parseSlotQuery(slotArgs, &query) == FALSE)
+	{
+		fprintf(stderr, "Invalid free slot search\n");
+		status = 1;
+	}
+	else if (loadSearchedFile(list, filename, &query, &report) < 0)
+	{
+		fprintf(stderr, "Error opening file\n");
+		status = 1;
+	}
+	else
+	{
+		if (report.invalidCount > 0)
+		{
+			writeReportFile(filename, &report);
+		}
+
+		timeline = buildTimeline(list);
+
+		/* each search carries on from the end of the last slot found */
+		do
+		{
+			found = findFreeSlots(&timeline, 1, &query, slots, MAX_SHOWN_SLOTS);
+
+			for (ii = 0; ii < found; ii++)
+			{
+				parseSlotText(slotText, &slots[ii]);
+				printf("%s\n", slotText);
+			}
+
+			if (found > 0)
+			{
+				query.rangeStart = slots[found - 1].end;
+			}
+		} while (found == MAX_SHOWN_SLOTS);
+
+		freeTimeline(timeline);
+	}
+
+	freeReport(&report);
+	freeList(list);
+
+	return status;
+}
+
+/**
+ * Loads the named calendar file, deletes every event whose activity
+ * contains inActivity or, if shiftText isn't NULL, moves each such event by
+ * the minutes in shiftText, and writes the file back in the same format,
+ * without opening a window. The file is written under another name first,
+ * then renamed over the original. A file with invalid entries is left
+ * unchanged, as they would be lost, and details of up to maxDiagnostics of
+ * them are written to a report beside it. Returns the program's exit
+ * status.
+ */
+int changeMatchingInFile(char* filename, char* inActivity, char* shiftText, int maxDiagnostics)
+{
+	LinkedList* list;
+	ListSnapshot* snapshot;
+	ValidationReport report;
+	FILE* dest;
+	char* tempName;
+	long minutes;
+	long bytesWritten;
+	int changed;
+	int status;
+
+	status = 1;
+	list = createList();
+	initReport(&report, maxDiagnostics);
+
+	if (shiftText != NULL && sscanf(shiftText, "%ld", &minutes) != 1)
+	{
+		fprintf(stderr, "Invalid number of minutes\n");
+	}
+	else if (loadFile(list, filename, &report) < 0)
+	{
+		fprintf(stderr, "Error opening file\n");
+	}
+	else if (report.invalidCount > 0)
+	{
+		writeReportFile(filename, &report);
+		fprintf(stderr, "%s was not changed, as its invalid entries would be lost\n", filename);
+	}
+	else
+	{
+		if (shiftText == NULL)
+		{
+			changed = deleteMatching(list, inActivity, NULL);
+		}
+		else
+		{
+			changed = updateMatching(list, inActivity, &shiftEvent, (void*)&minutes, &startKey, NULL, NULL);
+		}
+
+		tempName = (char*)malloc(strlen(filename) + 5);
+		strcpy(tempName, filename);
+		strcat(tempName, ".tmp");
+
+		snapshot = snapshotList(list);
+		dest = fopen(tempName, "w");
+		bytesWritten = -1;
+
+		if (dest != NULL)
+		{
+			bytesWritten = writeCalendar(dest, filename, snapshot);
+			if (fclose(dest) != 0)
+			{
+				bytesWritten = -1;
+			}
+		}
+
+		if (bytesWritten >= 0 && rename(tempName, filename) == 0)
+		{
+			printf("%d events %s\n", changed, (shiftText == NULL) ? "deleted" : "moved");
+			status = 0;
+		}
+		else
+		{
+			fprintf(stderr, "Error writing file\n");
+			remove(tempName);
+		}
+
+		freeSnapshot(snapshot);
+		free(tempName);
+	}
+
+	freeReport(&report);
+	freeList(list);
+
+	return status;
+}
+
+/**
+ * Writes every valid event of the named calendar file to stdout as CSV or
+ * JSON Lines (see calExport.h), without opening a window. If sortOrder is
+ * -1, events are streamed in the order they are read, one entry (or, for an
+ * archive, one block) at a time, so a file of any size is exported in the
+ * same amount of memory. Otherwise the file is loaded whole and sorted into
+ * that order (one of the orders of sortKeys) first. Details of up to
+ * maxDiagnostics invalid entries are written to a report beside the file.
+ * Returns the program's exit status.
+ */
+int exportFile(char* filename, int format, int sortOrder, int maxDiagnostics)
+{
+	Exporter* exporter;
+	ArchiveReader* archive;
+	EntryReader readNext;
+	LinkedList* list;
+	ListSnapshot* snapshot;
+	ValidationReport report;
+	FILE* source;
+	Event* event;
+	long bytesWritten;
+	int result;
+	int opened;
+	int status;
+
+	initReport(&report, maxDiagnostics);
+	bytesWritten = -1;
+	opened = FALSE;
+
+	if (sortOrder >= 0)
+	{
+		list = createList();
+
+		if (loadFile(list, filename, &report) < 0)
+		{
+			fprintf(stderr, "Error opening file\n");
+		}
+		else
+		{
+			opened = TRUE;
+			snapshot = snapshotList(list);
+			sortEvents(snapshot->events, snapshot->count, sortOrder);
+			bytesWritten = exportSnapshot(stdout, snapshot, format);
+			freeSnapshot(snapshot);
+		}
+
+		freeList(list);
+	}
+	else
+	{
+		source = fopen(filename, isArchiveFile(filename) == TRUE ? "rb" : "r");
+		archive = NULL;
+		readNext = entryReaderFor(filename);
+
+		if (source != NULL && isArchiveFile(filename) == TRUE)
+		{
+			archive = openArchive(source);
+		}
+
+		if (source == NULL || (isArchiveFile(filename) == TRUE && archive == NULL))
+		{
+			fprintf(stderr, "Error opening file\n");
+		}
+		else
+		{
+			opened = TRUE;
+
+			/* the buffer is too big to want on the stack */
+			exporter = (Exporter*)malloc(sizeof(Exporter));
+			startExport(exporter, stdout, format);
+
+			/* each event is written then released as soon as it is read */
+			do
+			{
+				if (archive != NULL)
+				{
+					result = readArchiveEntry(archive, &event, &report);
+				}
+				else
+				{
+					result = (*readNext)(source, &event, &report);
+				}
+
+				if (result == ENTRY_VALID)
+				{
+					exportEvent(exporter, event);
+					releaseEvent(event);
+				}
+			} while (result != ENTRY_NONE);
+
+			bytesWritten = finishExport(exporter);
+			free(exporter);
+		}
+
+		if (archive != NULL)
+		{
+			closeArchive(archive);
+		}
+		if (source != NULL)
+		{
+			fclose(source);
+		}
+	}
+
+	if (opened == TRUE && bytesWritten < 0)
+	{
+		fprintf(stderr, "Error writing export\n");
+	}
+
+	if (report.invalidCount > 0)
+	{
+		writeReportFile(filename, &report);
+	}
+
+	freeReport(&report);
+	status = (bytesWritten >= 0) ? 0 : 1;
+
+	return status;
+}
@@ -8,30 +8,182 @@
 #ifndef CALENDAR_H
 #define CALENDAR_H
 #include "linkedList.h"
+#include "calTimeline.h"
+#include "calHistory.h"
+#include "calPartition.h"
+#include "calReport.h"
 #include <stdio.h>
 #include <stdlib.h>
 
+/* the inputs of the add and edit event dialogs, in order */
+#define FIELD_ACTIVITY 0
+#define FIELD_LOCATION 1
+#define FIELD_DATE 2
+#define FIELD_TIME 3
+#define FIELD_DURATION 4
+#define FIELD_REPEAT 5
+#define FIELD_ZONE 6
+#define EVENT_FIELDS 7
+
+/* the inputs of the free time dialog, and the --free-slots option, in order */
+#define SLOT_FROM 0
+#define SLOT_TO 1
+#define SLOT_LENGTH 2
+#define SLOT_DAY_START 3
+#define SLOT_DAY_END 4
+#define SLOT_WEEKDAYS 5
+#define SLOT_FIELDS 6
+
+/* the most free slots shown in the gui at once */
+#define MAX_SHOWN_SLOTS 10
+
+/* the most inputs, and characters across all inputs, a dialog can have */
+#define MAX_FORM_FIELDS 7
+#define MAX_FORM_TEXT 900
+
+/**
+ * The inputs of a dialog box, with storage for the text the user enters.
+ * One FormBuffer is kept with the main window and reused by every dialog,
+ * so showing a dialog allocates nothing.
+ */
+typedef struct FormBuffer {
+	InputProperties properties[MAX_FORM_FIELDS];
+	char* inputs[MAX_FORM_FIELDS];
+	char text[MAX_FORM_TEXT];
+	int numFields;
+} FormBuffer;
+
+/* the most calendars that can be open at once */
+#define MAX_CALENDARS MAX_MERGE_TIMELINES
+
+/* the longest calendar name kept, names are the files calendars came from */
+#define MAX_CALENDAR_NAME 20
+
+/* the months, from the current one, paged in when history is opened */
+#define VIEW_MONTHS 3
+
+/* the invalid entries listed in the summary shown after a load */
+#define SHOWN_DIAGNOSTICS 10
+
+/* added to a calendar's filename to name the report of its invalid entries */
+#define REPORT_SUFFIX ".invalid.txt"
+
+/**
+ * One open calendar: its events, and the time-ordered index of them, which
+ * is built when first needed and rebuilt once the list changes. A load is
+ * only added to the calendar if loadGeneration is unchanged since it began.
+ * loadGeneration also goes up when the calendar is closed, so a handle held
+ * across a dialog is only used if it is unchanged, even if a new list has
+ * been given the old one's address.
+ * A calendar of history opened from an archive has a store, which pages its
+ * events in by month; its list is the store's, and is read-only.
+ */
+typedef struct OpenCalendar {
+	char name[MAX_CALENDAR_NAME + 1];
+	LinkedList* list;
+	Timeline* timeline;
+	int loadGeneration;
+	PartitionStore* store;
+} OpenCalendar;
+
 /**
  * A struct for holding a gui window and linked list ov events. Used to
- * conveniently pass windows and linked lists to callback functions
+ * conveniently pass windows and linked lists to callback functions. Several
+ * calendars can be open at once, new events are added to the first that
+ * isn't history. history holds the changes made since the calendars were
+ * opened, and pageBudget is the memory, in bytes, each calendar of history
+ * may keep paged in. maxDiagnostics caps how many invalid entries a load
+ * keeps the details of. sortOrder is the order events are shown and saved
+ * in (see sortKeys).
  */
 typedef struct MenuData {
 	Window* window;
-	LinkedList* list;
+	OpenCalendar calendars[MAX_CALENDARS];
+	int numCalendars;
+	FormBuffer form;
+	History history;
+	long pageBudget;
+	int maxDiagnostics;
+	int sortOrder;
 } MenuData;
 
 /**
- * Creates a gui window with 5 buttons for manipulating calendar data.
+ * A struct for handing a save over to a background thread. It holds a
+ * snapshot of the list taken when the save was requested, so the user can
+ * keep editing the list while the snapshot is written out. The snapshot is
+ * sorted into sortOrder before it is written. opened records whether the
+ * file could be opened, and succeeded whether it was then written out.
+ */
+typedef struct SaveJob {
+	MenuData* menu;
+	ListSnapshot* snapshot;
+	int sortOrder;
+	char filename[21];
+	int opened;
+	int succeeded;
+} SaveJob;
+
+/**
+ * A struct for handing a file load over to a background thread. Events are
+ * parsed into batches which are passed back to the gui thread as they fill,
+ * each batch twice the size of the last, so the first screenful of events is
+ * shown almost immediately. calendar is the open calendar being loaded and
+ * generation identifies the load, a batch is only added to the calendar's
+ * list if no newer load into it has been started since. report collects the
+ * invalid entries skipped, to be shown once the load has finished.
+ */
+typedef struct LoadJob {
+	MenuData* menu;
+	int calendar;
+	int generation;
+	char* filename;
+	int opened;
+	ValidationReport report;
+} LoadJob;
+
+/**
+ * A batch of events parsed by a background load, sorted by start time,
+ * waiting to be merged into the list by the gui thread.
+ */
+typedef struct LoadBatch {
+	LoadJob* job;
+	Event** events;
+	int count;
+} LoadBatch;
+
+/**
+ * Creates a gui window with buttons for manipulating calendar data.
  * Used when the user doesn't provide a command line parameter.
  */
 void createMainMenu(MenuData* menuAndList);
 
 /**
- * Creates a gui window with 5 buttons for manipulating calendar data.
+ * Creates a gui window with buttons for manipulating calendar data.
  * Used when the user provides a command line parameter.
  */
 void createMenuFromFile(MenuData* menuAndList, char* filename);
 
+/**
+ * Adds a button to the main window for each action the user can take.
+ */
+void addMenuButtons(MenuData* menuAndList);
+
+/**
+ * Lays out the passed-in fields in a FormBuffer, ready to be handed to
+ * dialogBox. Each input is given room for its field's maxLength plus a null
+ * terminator within the form's own storage, and starts as an empty string.
+ * Nothing is allocated, so a form can be reused for every dialog.
+ */
+void setForm(FormBuffer* form, const InputProperties* fields, int numFields);
+
+/**
+ * Parses a form laid out with eventFields into an Event. Returns TRUE if
+ * the date, time, duration and any repeat rule and time zone are valid and
+ * an activity was entered, otherwise FALSE and event is left incomplete. On success the
+ * event's repeat rule, if any, is newly allocated.
+ */
+int formToEvent(FormBuffer* form, Event* event);
+
 /**
  * Used when the user supplies a command line parameter at startup. Creates a
  * linked list and adds events in the file to the linked list
@@ -40,30 +192,49 @@ void loadCalFromCmd(void* data, char* filename);
 
 /**
  * Prompts the user for a filename, and loads a corresponding file of event
- * data into a linked list
+ * data into a linked list. Any open calendars are closed first.
  */
 void loadCalFromFile(void* data);
 
+/**
+ * Prompts the user for a filename, and opens the file as another calendar
+ * alongside those already open. An archive is opened as history, paged in
+ * by month as it is viewed.
+ */
+void openAnotherCalendar(void* data);
+
 /**
  * Saves data in the linked list to a text file. The user is prompted for a
- * filename, the file is either created or overwritten.
+ * filename, the file is either created or overwritten. The file is written
+ * on a background thread from a snapshot of the list. If several calendars
+ * are open, the events of all of them are saved to the one file.
  */
 void saveCalToFile(void* data);
 
 /**
- * Checks that the passed-in variables represent a valid date, time and duration
- * to go in an Event struct. Allows Feb 29th as a valid date on leap years.
+ * Writes every event in the passed-in snapshot to dest in the format picked
+ * by filename's extension: iCalendar for .ics, an archive for .calz and
+ * calendar text otherwise. Returns the number of bytes written, or -1 if
+ * writing failed.
+ */
+long writeCalendar(FILE* dest, char* filename, ListSnapshot* snapshot);
+
+/**
+ * Writes the snapshot held by the passed-in SaveJob to its file. Runs on a
+ * background thread, so it must not touch the gui or the live list.
  */
-int eventValid(int inYear, int inMonth, int inDay, int inHours, int inMins, int inDuration);
+void saveSnapshot(void* job);
 
 /**
- * Determines whether a year is a leap year.
+ * Reports the outcome of a background save to the user and frees the
+ * SaveJob. Runs on the gui thread once saveSnapshot has returned.
  */
-int isLeapYear(int year);
+void saveFinished(void* job);
 
 /**
- * Adds an event to a linked list, a linked list is created if the passed-in
- * data does not contain one. Event data is gathered from user input.
+ * Adds an event to the first open calendar that isn't history, a calendar is
+ * created if there is none. Event data is gathered from user input. The
+ * event goes in order of start time, as loaded events do.
  */
 void addEvent(void* data);
 
@@ -74,25 +245,208 @@ void addEvent(void* data);
  */
 void editEvent(void* data);
 
-/**
- * Checks every activity in a linked list against the passed-in string.
- * If inActivity exists in any activity string on the list, a corresponding
- * linked list element number is returned. The value -1 is returned if no
- * match is found. The first matching event is returned, following matching
- * events are ignored.
- */
-int findEvent(LinkedList* list, char* inActivity);
-
 /**
  * Prompts the user to enter a search string corresponding to an activity
  * in the linked list. If a match is found, the event is deleted.
  */
 void deleteEvent(void* data);
 
+/**
+ * Prompts the user for a search string, and deletes every event whose
+ * activity contains it from each open calendar that isn't history, one pass
+ * over each calendar. The deletes are recorded as a single change, which one
+ * undo reverses.
+ */
+void deleteMatchingEvents(void* data);
+
+/**
+ * Prompts the user for a search string and a number of minutes, and moves
+ * every event whose activity contains the string by that many minutes, in
+ * each open calendar that isn't history. Events that would be moved outside
+ * the dates the calendar allows are left where they are. As with
+ * deleteMatchingEvents, the moves are undone together.
+ */
+void shiftMatchingEvents(void* data);
+
+/**
+ * Undoes the most recent add, edit or delete that hasn't been undone.
+ */
+void undoLastChange(void* data);
+
+/**
+ * Redoes the most recently undone add, edit or delete.
+ */
+void redoLastChange(void* data);
+
 /**
  * Parses text from a file matching the passed-in filename. Text is formatted
- * for display in the gui main window.
+ * for display in the gui main window. The file is parsed on a background
+ * thread, and the window is refreshed as each batch of events arrives.
+ */
+void readFile(void* data, char* filename, int calendar);
+
+/**
+ * Opens an archive as a calendar of history, paging in only the current
+ * month and the VIEW_MONTHS - 1 after it. Other months are paged in as
+ * queries reach them.
+ */
+void openHistory(MenuData* menu, char* filename, int calendar);
+
+/**
+ * Parses every entry of the file named in the passed-in LoadJob, posting
+ * batches of valid events to the gui thread. Runs on a background thread.
+ */
+void loadEvents(void* job);
+
+/**
+ * Merges a LoadBatch of events into the list and refreshes the main window.
+ * Runs on the gui thread.
+ */
+void insertLoadedBatch(void* batch);
+
+/**
+ * Reports the outcome of a background load to the user, including a single
+ * summary of any invalid entries, and frees the LoadJob. Runs on the gui
+ * thread once loadEvents has returned.
+ */
+void loadFinished(void* job);
+
+/**
+ * Displays every event in the list in the main window, in the menu's sort
+ * order. If several calendars are open, the events of all of them are
+ * shown together, each labelled with its calendar.
+ */
+void refreshWindow(MenuData* menu);
+
+/**
+ * Prompts the user for the order to show and save events in, and shows
+ * them in that order.
+ */
+void chooseSortOrder(void* data);
+
+/**
+ * Displays the time taken by each kind of calendar operation so far.
+ */
+void showStatistics(void* data);
+
+/**
+ * Prompts the user for two dates, and displays every occurrence of every
+ * event between them (inclusive) in order, with recurring events expanded.
+ */
+void showRange(void* data);
+
+/**
+ * Prompts the user for a date range, a length of time and the hours of the
+ * day to look in, and displays the first free slots of that length.
+ */
+void showFreeSlots(void* data);
+
+/**
+ * Opens an empty calendar with the passed-in name, after those already open.
+ * Returns its position, or -1 if MAX_CALENDARS are already open.
+ */
+int openCalendar(MenuData* menu, char* name);
+
+/**
+ * Closes every open calendar, freeing its events and forgetting the changes
+ * made to them. Loads still running into them are abandoned.
+ */
+void closeCalendars(MenuData* menu);
+
+/**
+ * Returns the position of the first open calendar that isn't history,
+ * opening a new one if there is none. Returns -1 if there is none and no
+ * more calendars can be opened.
+ */
+int editableCalendar(MenuData* menu);
+
+/**
+ * Stores the list of each open calendar in outLists, which must have room
+ * for MAX_CALENDARS lists. Returns the number of calendars open.
+ */
+int calendarLists(MenuData* menu, LinkedList** outLists);
+
+/**
+ * Stores the list of each open calendar that isn't history in outLists,
+ * which must have room for MAX_CALENDARS lists. Returns the number stored.
+ */
+int editableLists(MenuData* menu, LinkedList** outLists);
+
+/**
+ * Pages in the events of every calendar of history that overlap rangeStart
+ * up to rangeEnd (in minutes, as for eventStart).
+ */
+void pageCalendars(MenuData* menu, long rangeStart, long rangeEnd);
+
+/**
+ * Stores the time-ordered index of each open calendar in outTimelines,
+ * which must have room for MAX_CALENDARS timelines, rebuilding any that are
+ * out of date. Returns the number of calendars open.
+ */
+int calendarTimelines(MenuData* menu, Timeline** outTimelines);
+
+/**
+ * Searches every open calendar that isn't history in turn for an event
+ * whose activity contains the passed-in string. Returns a handle to the first match and
+ * stores its calendar in outCalendar, or returns a handle to no event if there is no match.
+ */
+EventHandle findInCalendars(MenuData* menu, char* inActivity, int* outCalendar);
+
+/**
+ * Returns the time-ordered index of one open calendar's list, rebuilding it
+ * first if the list has changed since it was built.
+ */
+Timeline* currentTimeline(MenuData* menu, int calendar);
+
+/**
+ * Parses the SLOT_FIELDS strings of a free time search, in the order of the
+ * free time dialog, into query. Returns FALSE if any are invalid.
+ */
+int parseSlotQuery(char** inputs, SlotQuery* query);
+
+/**
+ * Loads the events of the named calendar file that a free time search could
+ * need onto the list. From an archive, only the blocks overlapping the
+ * search's range are read. Returns the same as loadFile.
+ */
+long loadSearchedFile(LinkedList* list, char* filename, SlotQuery* query, ValidationReport* report);
+
+/**
+ * Writes the invalid entries found in the named calendar file to a report
+ * beside it, named by adding REPORT_SUFFIX, and says where on stderr.
+ */
+void writeReportFile(char* filename, ValidationReport* report);
+
+/**
+ * Loads the named calendar file and prints every free slot matching the
+ * passed-in --free-slots arguments, one per line, without opening a window.
+ * Details of up to maxDiagnostics invalid entries are written to a report
+ * beside the file. Returns the program's exit status.
+ */
+int printFreeSlots(char* filename, char** slotArgs, int maxDiagnostics);
+
+/**
+ * Loads the named calendar file, deletes every event whose activity
+ * contains inActivity or, if shiftText isn't NULL, moves each such event by
+ * the minutes in shiftText, and writes the file back in the same format,
+ * without opening a window. The file is written under another name first,
+ * then renamed over the original. A file with invalid entries is left
+ * unchanged, as they would be lost, and details of up to maxDiagnostics of
+ * them are written to a report beside it. Returns the program's exit
+ * status.
+ */
+int changeMatchingInFile(char* filename, char* inActivity, char* shiftText, int maxDiagnostics);
+
+/**
+ * Writes every valid event of the named calendar file to stdout as CSV or
+ * JSON Lines (see calExport.h), without opening a window. If sortOrder is
+ * -1, events are streamed in the order they are read, one entry (or, for an
+ * archive, one block) at a time, so a file of any size is exported in the
+ * same amount of memory. Otherwise the file is loaded whole and sorted into
+ * that order (one of the orders of sortKeys) first. Details of up to
+ * maxDiagnostics invalid entries are written to a report beside the file.
+ * Returns the program's exit status.
  */
-void readFile(void* data, char* filename);
+int exportFile(char* filename, int format, int sortOrder, int maxDiagnostics);
 
 #endif
@@ -0,0 +1,179 @@
+/**
+ * Contains functions for generating synthetic calendar text files, used to
+ * benchmark loading, rendering and saving on diaries far larger than any
+ * hand written one. The same settings and seed always produce the same file.
+ *
+ * Author: Alex Burress
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "diaryGen.h"
+
+#define FALSE 0
+#define TRUE !FALSE
+#define MAX_ACTIVITY_LEN 397
+#define NUM_WORDS 16
+#define NUM_LOCATIONS 12
+
+/**
+ * Returns a random number between 0 and 1, not including 1.
+ */
+static double randomFraction(unsigned long* state)
+{
+	return (double)(nextRandom(state) % 1000000UL) / 1000000.0;
+}
+
+/**
+ * Returns a random int between low and high inclusive.
+ */
+static int randomBetween(unsigned long* state, int low, int high)
+{
+	return low + (int)(nextRandom(state) % (unsigned long)(high - low + 1));
+}
+
+/**
+ * Fills activity with words until it is length characters long.
+ */
+static void makeActivity(char* activity, int length, unsigned long* state)
+{
+	static const char* words[NUM_WORDS] = {
+		"Meeting", "with", "the", "team", "Review", "UCP", "Assignment", "Lunch",
+		"Call", "Standup", "Planning", "Bruce", "Willis", "about", "Project", "Gym"
+	};
+	int used;
+	int wordLen;
+	const char* word;
+
+	used = 0;
+	while (used < length)
+	{
+		word = words[nextRandom(state) % NUM_WORDS];
+		wordLen = strlen(word);
+
+		if (used > 0)
+		{
+			activity[used] = ' ';
+			used++;
+		}
+
+		/* cut the last word short to hit the length exactly */
+		if (used + wordLen > length)
+		{
+			wordLen = length - used;
+		}
+
+		memcpy(activity + used, word, wordLen);
+		used += wordLen;
+	}
+
+	activity[used] = '\0';
+}
+
+/**
+ * Fills settings with the defaults: 10000 events, seed 1, activities
+ * averaging 30 characters, locations on half of all entries and no invalid
+ * entries.
+ */
+void defaultDiarySettings(DiarySettings* settings)
+{
+	settings->numEvents = 10000;
+	settings->seed = 1;
+	settings->meanActivityLen = 30;
+	settings->locationRatio = 0.5;
+	settings->invalidRatio = 0.0;
+}
+
+/**
+ * Writes a diary to dest following the passed-in settings. Returns the
+ * number of bytes written.
+ */
+long generateDiary(FILE* dest, DiarySettings* settings)
+{
+	static const char* locations[NUM_LOCATIONS] = {
+		"Home", "The Labs", "Earth", "Building 314 Room 220", "Library", "Gym",
+		"Cafe", "Meeting Room A", "Meeting Room B", "Lecture Theatre 1", "Office", "Online"
+	};
+	unsigned long state;
+	char activity[MAX_ACTIVITY_LEN + 1];
+	long ii;
+	long bytes;
+	int length;
+	int year;
+	int month;
+	int day;
+	int hrs;
+	int mins;
+	int duration;
+
+	/* a zero state would make xorshift return zeros forever */
+	state = (settings->seed == 0) ? 0x9E3779B9UL : settings->seed;
+	bytes = 0;
+
+	for (ii = 0; ii < settings->numEvents; ii++)
+	{
+		year = randomBetween(&state, 2010, 2020);
+		month = randomBetween(&state, 1, 12);
+		day = randomBetween(&state, 1, 28);
+		hrs = randomBetween(&state, 0, 23);
+		mins = randomBetween(&state, 0, 59);
+		duration = randomBetween(&state, 5, 240);
+
+		/* break one field of invalid entries */
+		if (randomFraction(&state) < settings->invalidRatio)
+		{
+			switch (nextRandom(&state) % 3)
+			{
+				case 0:
+					month = 13;
+					break;
+				case 1:
+					hrs = 24;
+					break;
+				default:
+					duration = 0;
+					break;
+			}
+		}
+
+		/* exponentially distributed around the mean */
+		length = 1 + (int)(-log(1.0 - randomFraction(&state)) * settings->meanActivityLen);
+		if (length > MAX_ACTIVITY_LEN)
+		{
+			length = MAX_ACTIVITY_LEN;
+		}
+		makeActivity(activity, length, &state);
+
+		bytes += fprintf(dest, "%d-%02d-%02d %02d:%02d %d %s\n", year, month, day, hrs, mins, duration, activity);
+
+		if (randomFraction(&state) < settings->locationRatio)
+		{
+			bytes += fprintf(dest, "%s\n", locations[nextRandom(&state) % NUM_LOCATIONS]);
+		}
+
+		bytes += fprintf(dest, "\n");
+	}
+
+	return bytes;
+}
+
+/**
+ * Returns the next number from a small, fast random number generator
+ * (xorshift), and advances its state. Used instead of rand() so generated
+ * diaries are identical on every platform.
+ */
+unsigned long nextRandom(unsigned long* state)
+{
+	unsigned long x;
+
+	/* keep to 32 bits so the sequence doesn't depend on the size of long */
+	x = *state & 0xFFFFFFFFUL;
+	x ^= (x << 13) & 0xFFFFFFFFUL;
+	x ^= x >> 17;
+	x ^= (x << 5) & 0xFFFFFFFFUL;
+	*state = x;
+
+	return x;
+}
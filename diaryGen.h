@@ -0,0 +1,53 @@
+/**
+ * Contains functions for generating synthetic calendar text files, used to
+ * benchmark loading, rendering and saving on diaries far larger than any
+ * hand written one. The same settings and seed always produce the same file.
+ *
+ * Author: Alex Burress
+ */
+
+#ifndef DIARYGEN_H
+#define DIARYGEN_H
+#include <stdio.h>
+
+/**
+ * Settings for a generated diary.
+ * numEvents         -- the number of entries written, valid or not.
+ * seed              -- seeds the random number generator.
+ * meanActivityLen   -- the average activity length in characters. Lengths
+ *                      are spread roughly exponentially around the mean, so
+ *                      most are short with a long tail, up to the 397
+ *                      characters the loader accepts.
+ * locationRatio     -- the fraction of entries (0 to 1) with a location.
+ * invalidRatio      -- the fraction of entries (0 to 1) with an invalid
+ *                      date, time or duration.
+ */
+typedef struct DiarySettings {
+	long numEvents;
+	unsigned long seed;
+	int meanActivityLen;
+	double locationRatio;
+	double invalidRatio;
+} DiarySettings;
+
+/**
+ * Fills settings with the defaults: 10000 events, seed 1, activities
+ * averaging 30 characters, locations on half of all entries and no invalid
+ * entries.
+ */
+void defaultDiarySettings(DiarySettings* settings);
+
+/**
+ * Writes a diary to dest following the passed-in settings. Returns the
+ * number of bytes written.
+ */
+long generateDiary(FILE* dest, DiarySettings* settings);
+
+/**
+ * Returns the next number from a small, fast random number generator
+ * (xorshift), and advances its state. Used instead of rand() so generated
+ * diaries are identical on every platform.
+ */
+unsigned long nextRandom(unsigned long* state);
+
+#endif
@@ -31,6 +31,33 @@ typedef struct {
 } Callback;
 
 
+/**
+ * Used internally by the runInBackground function. Contains the task to run 
+ * on a separate thread, the function to call back on the GUI thread 
+ * afterwards, and the data to be passed to both.
+ */
+typedef struct {
+    void (*task)(void*);
+    void (*finished)(void*);
+    void *data;
+} BackgroundJob;
+
+
+/**
+ * Not visible outside this file. The number of background tasks that have 
+ * been started but have not yet returned.
+ */
+static volatile gint runningTasks = 0;
+
+
+/**
+ * Not visible outside this file. Set once runGUI has returned, when the
+ * window has been destroyed, so that callbacks still to be run by 
+ * waitForBackground don't try to show anything in it.
+ */
+static int guiFinished = FALSE;
+
+
 /**
  * Creates and returns a new GUI window. This window will have space for a set 
  * of buttons on the left, and an area to display text on the right. You must 
@@ -46,6 +73,12 @@ Window *createWindow(char *title)
     
     if(!init)
     {
+#if !GLIB_CHECK_VERSION(2, 32, 0)
+        if(!g_thread_supported())
+        {
+            g_thread_init(NULL);
+        }
+#endif
         gtk_init(NULL, NULL);
         init = TRUE;
     }
@@ -96,7 +129,10 @@ void setText(Window *window, char *newText)
 {
     assert(window != NULL);
     assert(newText != NULL);
-    gtk_text_buffer_set_text(GTK_TEXT_BUFFER(window->textBuffer), newText, -1);
+    if(!guiFinished)
+    {
+        gtk_text_buffer_set_text(GTK_TEXT_BUFFER(window->textBuffer), newText, -1);
+    }
 }
 
 
@@ -173,6 +209,7 @@ void runGUI(Window *window)
     assert(window != NULL);
     gtk_widget_show_all(GTK_WIDGET(window->gtkWindow));
     gtk_main();
+    guiFinished = TRUE;
 }
 
 /**
@@ -323,15 +360,128 @@ void messageBox(Window *window, char *message)
     assert(window != NULL);
     assert(message != NULL);
     
-    dialog = gtk_message_dialog_new(
-        GTK_WINDOW(window->gtkWindow),
-        GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
-        GTK_MESSAGE_INFO,
-        GTK_BUTTONS_CLOSE,
-        NULL
-    );
+    if(!guiFinished) /* Once the window has gone, there is nowhere to show it. */
+    {
+        dialog = gtk_message_dialog_new(
+            GTK_WINDOW(window->gtkWindow),
+            GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
+            GTK_MESSAGE_INFO,
+            GTK_BUTTONS_CLOSE,
+            NULL
+        );
+        
+        gtk_message_dialog_set_markup(GTK_MESSAGE_DIALOG(dialog), message);
+        gtk_dialog_run(GTK_DIALOG(dialog));
+        gtk_widget_destroy(dialog);
+    }        
+}
+
+
+/**
+ * Not visible outside this file. Called on the GUI thread (as an idle 
+ * callback) once a background task has returned.
+ */
+static gboolean backgroundFinished(gpointer data)
+{
+    BackgroundJob *job = (BackgroundJob*)data;
+    if(job->finished != NULL)
+    {
+        job->finished(job->data);
+    }
+    free(job);
+    return FALSE; /* Run once only. */
+}
+
+/**
+ * Not visible outside this file. The body of each background thread. It runs
+ * the task, then hands the job back to the GUI thread.
+ */
+static gpointer backgroundThread(gpointer data)
+{
+    BackgroundJob *job = (BackgroundJob*)data;
+    job->task(job->data);
+    g_idle_add(backgroundFinished, job);
+    g_atomic_int_add(&runningTasks, -1);
+    return NULL;
+}
+
+/**
+ * Runs a task on a separate thread, so that the window keeps responding to
+ * button presses while the task works. You must specify:
+ * task     -- a function to be called on the separate thread. It must *not*
+ *             call any of the functions declared in this file, or modify 
+ *             anything the GUI thread might be using at the same time.
+ * finished -- a function to be called back on the GUI thread once task has 
+ *             returned (or NULL). Unlike task, it may call any function 
+ *             declared in this file.
+ * data     -- A pointer to a set of data to be passed as a parameter to both
+ *             functions.
+ */
+void runInBackground(void (*task)(void*), void (*finished)(void*), void *data)
+{
+    BackgroundJob *job;
     
-    gtk_message_dialog_set_markup(GTK_MESSAGE_DIALOG(dialog), message);
-    gtk_dialog_run(GTK_DIALOG(dialog));
-    gtk_widget_destroy(dialog);        
+    assert(task != NULL);
+    
+    job = (BackgroundJob*)malloc(sizeof(BackgroundJob));
+    job->task = task;
+    job->finished = finished;
+    job->data = data;
+    
+    g_atomic_int_add(&runningTasks, 1);
+#if GLIB_CHECK_VERSION(2, 32, 0)
+    g_thread_unref(g_thread_new("background", backgroundThread, job));
+#else
+    g_thread_create(backgroundThread, job, FALSE, NULL);
+#endif
+}
+
+/**
+ * Not visible outside this file. Called on the GUI thread (as an idle 
+ * callback) for each function passed to postToGui.
+ */
+static gboolean postedCallback(gpointer data)
+{
+    Callback *callback = (Callback*)data;
+    callback->function(callback->data);
+    free(callback);
+    return FALSE; /* Run once only. */
+}
+
+/**
+ * Asks the GUI thread to call a function with the passed-in data as soon as
+ * it is free. This may be called from a task started with runInBackground, 
+ * to hand partial results back to the GUI thread before the task finishes.
+ * Functions are called in the order they were passed to postToGui.
+ */
+void postToGui(void (*function)(void*), void *data)
+{
+    Callback *callback;
+    
+    assert(function != NULL);
+    
+    callback = (Callback*)malloc(sizeof(Callback));
+    callback->function = function;
+    callback->data = data;
+    g_idle_add(postedCallback, callback);
+}
+
+/**
+ * Waits until every task started with runInBackground has returned. Call this
+ * after runGUI has finished, so that the program does not exit half way
+ * through a task. The finished callbacks of those tasks, and any functions
+ * still waiting from postToGui, are then called, so they can free their 
+ * data. As the window has gone by then, setText and messageBox do nothing.
+ */
+void waitForBackground(void)
+{
+    /* Callbacks queued for the GUI thread are run while waiting, in case
+     * one of them starts another task. */
+    while(g_atomic_int_get(&runningTasks) > 0 || g_main_context_pending(NULL))
+    {
+        if(!g_main_context_iteration(NULL, FALSE))
+        {
+            g_usleep(10000);
+        }
+    }
 }
@@ -121,4 +121,38 @@ int dialogBox(Window *window, char *dialogTitle, int nInputs,
  */
 void messageBox(Window *window, char *message);
 
+
+/**
+ * Runs a task on a separate thread, so that the window keeps responding to
+ * button presses while the task works. You must specify:
+ * task     -- a function to be called on the separate thread. It must *not*
+ *             call any of the functions declared in this file, or modify 
+ *             anything the GUI thread might be using at the same time.
+ * finished -- a function to be called back on the GUI thread once task has 
+ *             returned (or NULL). Unlike task, it may call any function 
+ *             declared in this file.
+ * data     -- A pointer to a set of data to be passed as a parameter to both
+ *             functions.
+ */
+void runInBackground(void (*task)(void*), void (*finished)(void*), void *data);
+
+
+/**
+ * Asks the GUI thread to call a function with the passed-in data as soon as
+ * it is free. This may be called from a task started with runInBackground, 
+ * to hand partial results back to the GUI thread before the task finishes.
+ * Functions are called in the order they were passed to postToGui.
+ */
+void postToGui(void (*function)(void*), void *data);
+
+
+/**
+ * Waits until every task started with runInBackground has returned. Call this
+ * after runGUI has finished, so that the program does not exit half way
+ * through a task. The finished callbacks of those tasks, and any functions
+ * still waiting from postToGui, are then called, so they can free their 
+ * data. As the window has gone by then, setText and messageBox do nothing.
+ */
+void waitForBackground(void);
+
 #endif
\ No newline at end of file
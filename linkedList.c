@@ -9,7 +9,308 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <limits.h>
 #include "linkedList.h"
+#include "calStats.h"
+#include "calIntern.h"
+#include "calCursor.h"
+#include "calRender.h"
+
+#define FALSE 0
+#define TRUE !FALSE
+
+/* the handle table starts with room for this many nodes */
+#define FIRST_SLOTS 64
+
+/* marks the end of a list's free handle table entries */
+#define NO_FREE_SLOT UINT_MAX
+
+/**
+ * A node being moved by reorderNodes, with its key and where it was among
+ * the nodes moved, which breaks ties so nodes with equal keys keep their
+ * order.
+ */
+typedef struct KeyedNode {
+	unsigned long key;
+	long order;
+	ListNode* node;
+} KeyedNode;
+
+/**
+ * Gives a new node an entry of the list's handle table, reusing a free
+ * entry if there is one, and doubling the table if not.
+ */
+static void attachSlot(LinkedList* list, ListNode* node)
+{
+	unsigned int slot;
+	unsigned int ii;
+
+	if (list->firstFree == NO_FREE_SLOT)
+	{
+		/* every new entry goes on the free list */
+		slot = list->numSlots;
+		list->numSlots = (list->numSlots == 0) ? FIRST_SLOTS : list->numSlots * 2;
+		list->slots = (HandleSlot*)realloc(list->slots, list->numSlots * sizeof(HandleSlot));
+
+		for (ii = slot; ii < list->numSlots; ii++)
+		{
+			list->slots[ii].node = NULL;
+			list->slots[ii].generation = NO_GENERATION + 1;
+			list->slots[ii].nextFree = (ii + 1 < list->numSlots) ? ii + 1 : NO_FREE_SLOT;
+		}
+		list->firstFree = slot;
+	}
+
+	slot = list->firstFree;
+	list->firstFree = list->slots[slot].nextFree;
+	list->slots[slot].node = node;
+	node->slot = slot;
+	node->detached = FALSE;
+}
+
+/**
+ * Frees the handle table entry of a node leaving the list. The entry's
+ * generation goes up, so handles to the node no longer lead anywhere.
+ */
+static void detachSlot(LinkedList* list, ListNode* node)
+{
+	HandleSlot* entry;
+
+	entry = &list->slots[node->slot];
+	entry->node = NULL;
+	entry->generation++;
+
+	/* after wrapping around, generations start again past NO_GENERATION */
+	if (entry->generation == NO_GENERATION)
+	{
+		entry->generation++;
+	}
+
+	entry->nextFree = list->firstFree;
+	list->firstFree = node->slot;
+}
+
+/**
+ * Returns a handle to a node on the list.
+ */
+static EventHandle handleOf(LinkedList* list, ListNode* node)
+{
+	EventHandle handle;
+
+	handle.slot = node->slot;
+	handle.generation = list->slots[node->slot].generation;
+
+	return handle;
+}
+
+/**
+ * Returns a handle that refers to no event.
+ */
+static EventHandle noHandle()
+{
+	EventHandle handle;
+
+	handle.slot = 0;
+	handle.generation = NO_GENERATION;
+
+	return handle;
+}
+
+/**
+ * Returns the node a handle's table entry holds, on the list or kept off it
+ * by detachHandle, or NULL if its event has been deleted or it refers to no
+ * event.
+ */
+static ListNode* slotNode(LinkedList* list, EventHandle handle)
+{
+	ListNode* node;
+
+	node = NULL;
+
+	if (handle.slot < list->numSlots && list->slots[handle.slot].generation == handle.generation)
+	{
+		node = list->slots[handle.slot].node;
+	}
+
+	return node;
+}
+
+/**
+ * Returns the node on the list a handle leads to, or NULL if its event has
+ * been deleted or taken off the list, or it refers to no event.
+ */
+static ListNode* handleNode(LinkedList* list, EventHandle handle)
+{
+	ListNode* node;
+
+	node = slotNode(list, handle);
+	if (node != NULL && node->detached == TRUE)
+	{
+		node = NULL;
+	}
+
+	return node;
+}
+
+/**
+ * Links a node into the list between prev and next, which must be adjacent
+ * (either may be NULL at an end of the list).
+ */
+static void linkNode(LinkedList* list, ListNode* node, ListNode* prev, ListNode* next)
+{
+	node->prev = prev;
+	node->next = next;
+
+	if (prev == NULL)
+	{
+		list->head = node;
+	}
+	else
+	{
+		prev->next = node;
+	}
+
+	if (next == NULL)
+	{
+		list->tail = node;
+	}
+	else
+	{
+		next->prev = node;
+	}
+
+	list->count++;
+	list->version++;
+}
+
+/**
+ * Returns the n'th node on the list (0-based), walking from whichever end is
+ * nearer.
+ */
+static ListNode* nthNode(LinkedList* list, int elNo)
+{
+	ListNode* current;
+	int ii;
+
+	assert(elNo >= 0);
+	assert(elNo < list->count);
+
+	if (elNo <= list->count / 2)
+	{
+		current = list->head;
+		for (ii = 0; ii < elNo; ii++)
+		{
+			current = current->next;
+		}
+	}
+	else
+	{
+		current = list->tail;
+		for (ii = list->count - 1; ii > elNo; ii--)
+		{
+			current = current->prev;
+		}
+	}
+
+	return current;
+}
+
+/**
+ * Takes a node out of the chain of the list's nodes, leaving the node and
+ * its handle table entry as they are.
+ */
+static void spliceOut(LinkedList* list, ListNode* node)
+{
+	if (node->prev == NULL)
+	{
+		list->head = node->next;
+	}
+	else
+	{
+		node->prev->next = node->next;
+	}
+
+	if (node->next == NULL)
+	{
+		list->tail = node->prev;
+	}
+	else
+	{
+		node->next->prev = node->prev;
+	}
+
+	list->count--;
+	list->version++;
+}
+
+/**
+ * Takes a node off the list, freeing it and its handle table entry, and
+ * releasing the list's hold on its event.
+ */
+static void unlinkNode(LinkedList* list, ListNode* node)
+{
+	spliceOut(list, node);
+
+	detachSlot(list, node);
+	releaseEvent(node->data);
+	free(node);
+}
+
+/**
+ * Points a node at a different Event. The list's hold on the old event is
+ * released, and it takes over the caller's hold on the new.
+ */
+static void replaceNode(LinkedList* list, ListNode* node, Event* event)
+{
+	releaseEvent(node->data);
+	node->data = event;
+	list->version++;
+}
+
+/**
+ * Returns a node's event, safe to modify. If the event is shared with a
+ * snapshot, the node is first pointed at a private copy so the snapshot
+ * keeps seeing the old values, otherwise its cached text is dropped.
+ */
+static Event* editNode(LinkedList* list, ListNode* node)
+{
+	Event* copy;
+
+	/* the caller is about to change the event */
+	list->version++;
+
+	/* copy on write: detach the list from the shared event */
+	if (node->data->refCount > 1)
+	{
+		copy = copyEvent(node->data);
+
+		releaseEvent(node->data);
+		node->data = copy;
+	}
+	else
+	{
+		/* the event's cached text will no longer match it */
+		forgetRendered(node->data);
+	}
+
+	return node->data;
+}
+
+/**
+ * Returns TRUE if the text of an activity id contains inActivity. The id
+ * last checked and whether it matched are kept in lastId and lastMatch, so a
+ * run of events sharing an activity costs one search.
+ */
+static int activityMatches(unsigned int activity, char* inActivity, unsigned int* lastId, int* lastMatch)
+{
+	if (activity != *lastId)
+	{
+		*lastId = activity;
+		*lastMatch = (strstr(internedText(activity), inActivity) != NULL);
+	}
+
+	return *lastMatch;
+}
 
 /**
  * Creates an empty linked list.
@@ -21,22 +322,26 @@ LinkedList* createList()
 	newList->head = NULL;
 	newList->tail = NULL;
 	newList->count = 0;
+	newList->version = 0;
+	newList->slots = NULL;
+	newList->numSlots = 0;
+	newList->firstFree = NO_FREE_SLOT;
 	
 	return newList;
 }
 
 /**
  * Creates a node for the passed-in Event and inserts the node at the start of
- * the list.
+ * the list. Returns a handle to the event.
  */
-void insertFirst(LinkedList* list, Event* event)
+EventHandle insertFirst(LinkedList* list, Event* event)
 {
 	ListNode* newNode;
-	ListNode* current;
-	int ii;
 
 	newNode = (ListNode*)malloc(sizeof(ListNode));
 	newNode->data = event;
+	newNode->prev = NULL;
+	attachSlot(list, newNode);
 
 	/* if list is empty, point head and tail at the new node */
 	if (list->head == NULL)
@@ -46,49 +351,51 @@ void insertFirst(LinkedList* list, Event* event)
 		list->tail = newNode;
 	}
 	/* else make the new node point at the first node, and have head point to
-	 * the new node.
+	 * the new node. The tail is unchanged by inserting at the start.
 	 */
 	else
 	{
 		newNode->next = list->head;
+		list->head->prev = newNode;
 		list->head = newNode;
-
-		/* pointing tail to last node */
-		current = list->head;
-		for (ii = 1; ii < (list->count); ii++)
-		{
-			current = current->next;
-		}
-		list->tail = current;
 	}
 
 	list->count++;
+	list->version++;
+
+	return handleOf(list, newNode);
 }
 
 /**
  * Creates a node for the passed-in Event, and inserts the node at the end
- * of the list.
+ * of the list. Returns a handle to the event.
  */
-void insertLast(LinkedList* list, Event* event)
+EventHandle insertLast(LinkedList* list, Event* event)
 {
 	ListNode* newNode;
 
 	newNode = (ListNode*)malloc(sizeof(ListNode));
 	newNode->data = event;
 	newNode->next = NULL;
+	attachSlot(list, newNode);
 
 	/* if list is empty, point head and tail to the new node */
 	if (list->count <= 0)
 	{
+		newNode->prev = NULL;
 		list->head = newNode;
 		list->tail = newNode;
 	}
 	else
 	{
+		newNode->prev = list->tail;
 		list->tail->next = newNode;
 		list->tail = newNode;
 	}
 	list->count++;
+	list->version++;
+
+	return handleOf(list, newNode);
 }
 
 /**
@@ -123,11 +430,17 @@ Event* removeFirst(LinkedList* list)
 	{
 		removedNode = list->head;
 		list->head = list->head->next;
+		list->head->prev = NULL;
 		removedNode->next = NULL;
 		list->count--;
 		outEvent = removedNode->data;
 	}
 	
+	list->version++;
+	if (removedNode != NULL)
+	{
+		detachSlot(list, removedNode);
+	}
 	free(removedNode);
 
 	return outEvent;
@@ -136,134 +449,930 @@ Event* removeFirst(LinkedList* list)
 /**
  * Deletes the n'th element on the linked list along with its node. The
  * passed-in int elNo represents n. Elements have a 0-based count.
- * i.e. if elNo = 0, the first node on the list is deleted. The variable
- * 'previous' is used to keep track of the node preceding to the node being
- * deleted. When the n'th node is deleted, previous->next is pointed to the
- * deleted node's next address.
+ * i.e. if elNo = 0, the first node on the list is deleted. The node is
+ * found from whichever end of the list is nearer, then unlinked from the
+ * nodes either side of it.
  */
 void deleteNthElement(LinkedList* list, int elNo)
 {
-	ListNode* current;
+	unlinkNode(list, nthNode(list, elNo));
+}
+
+/**
+ * Creates a node for the passed-in Event and inserts it so it becomes the
+ * n'th element on the list (0-based). If elNo is the list's count, the node
+ * is added at the end. Returns a handle to the event.
+ */
+EventHandle insertNthElement(LinkedList* list, int elNo, Event* event)
+{
+	EventHandle handle;
+	ListNode* newNode;
 	ListNode* previous;
-	int ii;
-	
+
 	assert(elNo >= 0);
-	assert(elNo < list->count);
-	
-	current = list->head;
-	previous = NULL;
-	
-	/* if deleting node that isn't head */
-	if (elNo > 0)
+	assert(elNo <= list->count);
+
+	if (elNo == 0)
 	{
-		for (ii = 0; ii < elNo; ii++)
-		{
-			previous = current;
-			current = current->next;
-		}
-	
-		previous->next = current->next;
+		handle = insertFirst(list, event);
+	}
+	else if (elNo == list->count)
+	{
+		handle = insertLast(list, event);
 	}
-	/* else deleting head node */
 	else
 	{
-		list->head = current->next;
+		previous = nthNode(list, elNo - 1);
+
+		newNode = (ListNode*)malloc(sizeof(ListNode));
+		newNode->data = event;
+		newNode->prev = previous;
+		newNode->next = previous->next;
+		previous->next->prev = newNode;
+		previous->next = newNode;
+		attachSlot(list, newNode);
+
+		list->count++;
+		list->version++;
+		handle = handleOf(list, newNode);
 	}
 
-	list->count--;
-	
-	free(current->data);
-	free(current);
+	return handle;
 }
 
 /**
- * Returns a pointer to the n'th element on the list, where the count for n
- * is 0-based. i.e. if elNo = 0, the first event on the list is retrieved. 
+ * Merges a batch of events, sorted in ascending order of key, into a list
+ * sorted the same way, in one pass over both. Each event goes after any on
+ * the list with an equal key. If the list isn't sorted, the batch is still
+ * all added, in order, each before the first event found with a greater
+ * key. The list takes over the caller's hold on each event. If outHandles
+ * isn't NULL, the handle of each event is stored in it, in batch order.
  */
-Event* retrieveElement(LinkedList* list, int elNo)
+void mergeSorted(LinkedList* list, Event** events, long count, EventKey key, EventHandle* outHandles)
 {
-	ListNode* current;
-	int ii;
-	Event* returnEvent;
+	mergeSortedAfter(list, noHandle(), events, count, key, outHandles);
+}
 
-	current = list->head;
+/**
+ * Merges a batch of events into a sorted list as mergeSorted does, but
+ * starting from the event a handle refers to rather than from the head, so
+ * only the events from there to where the batch ends are passed over. If
+ * that event has been deleted, or its key is greater than the first of the
+ * batch, the merge starts from the head.
+ */
+void mergeSortedAfter(LinkedList* list, EventHandle after, Event** events, long count, EventKey key,
+	EventHandle* outHandles)
+{
+	ListNode* current;
+	ListNode* newNode;
+	EventHandle handle;
+	unsigned long currentKey;
+	unsigned long eventKey;
+	long ii;
 
-	/* check if list is empty */
-	if (list->count == 0)
-	{
-		printf("Error: list is empty.\n");
-		returnEvent = NULL;
-	}
-	/* validate that elNo is within bounds */
-	else if (elNo > (list->count - 1))
+	/* every event before the one to start from has a key no greater */
+	current = handleNode(list, after);
+	if (current == NULL || count == 0 || (*key)(current->data) > (*key)(events[0]))
 	{
-		printf("Error: There are fewer than %d elements in this list.\n", (elNo + 1));
-		returnEvent = NULL;
+		current = list->head;
 	}
-	else
+	currentKey = (current != NULL) ? (*key)(current->data) : 0;
+
+	for (ii = 0; ii < count; ii++)
 	{
-		/* if head is being retrieved */
-		if (elNo == 0)
-		{
-			returnEvent = current->data;
-		}
-		/* else traverse list to desired element */
-		else
+		/* each node's key is found once, as the merge passes it, and past
+		 * the end of the list the rest of the batch goes on without keys
+		 */
+		if (current != NULL)
 		{
-			for (ii = 0; ii < elNo; ii++)
+			eventKey = (*key)(events[ii]);
+
+			while (current != NULL && currentKey <= eventKey)
 			{
 				current = current->next;
+				currentKey = (current != NULL) ? (*key)(current->data) : 0;
 			}
-			returnEvent = current->data;
+		}
+
+		if (current == NULL)
+		{
+			handle = insertLast(list, events[ii]);
+		}
+		else if (current->prev == NULL)
+		{
+			handle = insertFirst(list, events[ii]);
+		}
+		else
+		{
+			newNode = (ListNode*)malloc(sizeof(ListNode));
+			newNode->data = events[ii];
+			attachSlot(list, newNode);
+			linkNode(list, newNode, current->prev, current);
+			handle = handleOf(list, newNode);
+		}
+
+		if (outHandles != NULL)
+		{
+			outHandles[ii] = handle;
 		}
 	}
+}
 
-	return returnEvent;
+/**
+ * Points the n'th node on the list at a different Event. The list's hold on
+ * the old event is released, and it takes over the caller's hold on the new.
+ */
+void replaceNthElement(LinkedList* list, int elNo, Event* event)
+{
+	replaceNode(list, nthNode(list, elNo), event);
 }
 
 /**
- * Prints the state of each element in the list.
+ * Returns the element number of the passed-in Event on the list, comparing
+ * pointers rather than contents, or -1 if it isn't on the list.
  */
-void printList(LinkedList* list)
+int findElement(LinkedList* list, Event* event)
 {
-	int ii;
 	ListNode* current;
+	int ii;
+	int elementNo;
 
-	if (list->count == 0)
-	{
-		printf("Error: list is empty.\n");
-	}
-	else
+	elementNo = -1;
+	current = list->head;
+
+	for (ii = 0; current != NULL && elementNo == -1; ii++)
 	{
-		current = list->head;
-		current->data = retrieveElement(list, 0);
-		printf("%s @ %s (%d minutes)\n%d %d %d, %d:%d\n---\n\n", current->data->activity, current->data->location, current->data->duration, current->data->eDate.day, current->data->eDate.month, current->data->eDate.year, current->data->eTime.hrs, current->data->eTime.mins);
-		for (ii = 1; ii < (list->count); ii++)
+		if (current->data == event)
 		{
-			current = current->next;
-			printf("%s @ %s (%d minutes)\n%d %d %d, %d:%d\n---\n\n", current->data->activity, current->data->location, current->data->duration, current->data->eDate.day, current->data->eDate.month, current->data->eDate.year, current->data->eTime.hrs, current->data->eTime.mins);
+			elementNo = ii;
 		}
+		current = current->next;
 	}
+
+	return elementNo;
 }
 
 /**
- * Frees each list node and event from memory, and the list itself.
+ * Returns a pointer to the n'th element on the list, where the count for n
+ * is 0-based. i.e. if elNo = 0, the first event on the list is retrieved. 
  */
-void freeList(LinkedList* list)
+Event* retrieveElement(LinkedList* list, int elNo)
+{
+	Event* returnEvent;
+
+	/* check if list is empty */
+	if (list->count == 0)
+	{
+		printf("Error: list is empty.\n");
+		returnEvent = NULL;
+	}
+	/* validate that elNo is within bounds */
+	else if (elNo > (list->count - 1))
+	{
+		printf("Error: There are fewer than %d elements in this list.\n", (elNo + 1));
+		returnEvent = NULL;
+	}
+	else
+	{
+		returnEvent = nthNode(list, elNo)->data;
+	}
+
+	return returnEvent;
+}
+
+/**
+ * Returns a pointer to the n'th element on the list that is safe to modify.
+ * If the event is shared with a snapshot, the list's node is first pointed at
+ * a private copy so the snapshot keeps seeing the old values. Otherwise its
+ * cached text is dropped, so it must be modified before it is next rendered.
+ */
+Event* retrieveElementForEdit(LinkedList* list, int elNo)
+{
+	return editNode(list, nthNode(list, elNo));
+}
+
+/**
+ * Returns the event a handle refers to, or NULL if it has been deleted from
+ * the list since. Takes the same time however long the list is.
+ */
+Event* lookupHandle(LinkedList* list, EventHandle handle)
+{
+	ListNode* node;
+	Event* event;
+
+	node = handleNode(list, handle);
+	event = (node != NULL) ? node->data : NULL;
+
+	return event;
+}
+
+/**
+ * Returns the event a handle refers to, made safe to modify in the same way
+ * as retrieveElementForEdit, or NULL if it has been deleted from the list.
+ */
+Event* lookupHandleForEdit(LinkedList* list, EventHandle handle)
+{
+	ListNode* node;
+	Event* event;
+
+	node = handleNode(list, handle);
+	event = (node != NULL) ? editNode(list, node) : NULL;
+
+	return event;
+}
+
+/**
+ * Points the node a handle refers to at a different Event, in the same way
+ * as replaceNthElement. The handle stays valid, referring to the new event.
+ * Returns FALSE, leaving the caller's hold on the event, if the handle's
+ * event has been deleted.
+ */
+int replaceHandle(LinkedList* list, EventHandle handle, Event* event)
+{
+	ListNode* node;
+
+	node = handleNode(list, handle);
+	if (node != NULL)
+	{
+		replaceNode(list, node, event);
+	}
+
+	return (node != NULL);
+}
+
+/**
+ * Deletes the event a handle refers to along with its node, without walking
+ * the list. Returns FALSE if it had already been deleted.
+ */
+int deleteHandle(LinkedList* list, EventHandle handle)
+{
+	ListNode* node;
+
+	node = handleNode(list, handle);
+	if (node != NULL)
+	{
+		unlinkNode(list, node);
+	}
+
+	return (node != NULL);
+}
+
+/**
+ * Returns a handle to the first node on the list holding the passed-in
+ * Event, comparing pointers rather than contents, or a handle to no event if
+ * it isn't on the list.
+ */
+EventHandle findHandle(LinkedList* list, Event* event)
+{
+	ListNode* current;
+	EventHandle handle;
+
+	handle = noHandle();
+	current = list->head;
+
+	while (current != NULL && handle.generation == NO_GENERATION)
+	{
+		if (current->data == event)
+		{
+			handle = handleOf(list, current);
+		}
+		current = current->next;
+	}
+
+	return handle;
+}
+
+/**
+ * Takes a node off the list without freeing it or its handle table entry,
+ * storing where it was in place.
+ */
+static void detachNode(LinkedList* list, ListNode* node, EventPlace* place)
+{
+	place->handle = handleOf(list, node);
+	place->prev = (node->prev != NULL) ? handleOf(list, node->prev) : noHandle();
+	place->next = (node->next != NULL) ? handleOf(list, node->next) : noHandle();
+
+	spliceOut(list, node);
+	node->detached = TRUE;
+}
+
+/**
+ * Takes the event of place's handle off the list without freeing its node
+ * or handle, so reattachHandle can put it back, and stores the events that
+ * were either side of it in place. The handle leads nowhere while its event
+ * is off the list. Returns FALSE if its event isn't on the list.
+ */
+int detachHandle(LinkedList* list, EventPlace* place)
+{
+	ListNode* node;
+
+	node = handleNode(list, place->handle);
+	if (node != NULL)
+	{
+		detachNode(list, node, place);
+	}
+
+	return (node != NULL);
+}
+
+/**
+ * Links a node that is off the list into a list sorted by key, after every
+ * event with a key no greater, as mergeSorted would. The search starts from
+ * near, or the head if near is NULL, and walks whichever way the node's key
+ * lies, so a node put back near where it belongs passes over few others.
+ */
+static void linkInOrder(LinkedList* list, ListNode* node, ListNode* near, EventKey key)
+{
+	ListNode* after;
+	unsigned long nodeKey;
+
+	nodeKey = (*key)(node->data);
+	after = (near != NULL) ? near : list->head;
+
+	/* back over events with greater keys, then on over those no greater */
+	while (after != NULL && after->prev != NULL && (*key)(after->prev->data) > nodeKey)
+	{
+		after = after->prev;
+	}
+	while (after != NULL && (*key)(after->data) <= nodeKey)
+	{
+		after = after->next;
+	}
+
+	linkNode(list, node, (after != NULL) ? after->prev : list->tail, after);
+}
+
+/**
+ * Returns TRUE if a node's key puts it between before and after, either of
+ * which may be NULL at an end of the list.
+ */
+static int fitsBetween(ListNode* node, ListNode* before, ListNode* after, EventKey key)
+{
+	unsigned long nodeKey;
+
+	nodeKey = (*key)(node->data);
+
+	return (before == NULL || (*key)(before->data) <= nodeKey) &&
+		(after == NULL || nodeKey <= (*key)(after->data));
+}
+
+/**
+ * Puts an event taken off the list by detachHandle back where it was: after
+ * place's previous event if that is on the list, otherwise before its next.
+ * If neither is on the list, or the events there have since moved so that
+ * key no longer puts it between them, it goes where key puts it, as
+ * mergeSorted would, so a list sorted by key stays sorted. Returns FALSE if
+ * the handle doesn't refer to an event taken off the list.
+ */
+int reattachHandle(LinkedList* list, EventPlace* place, EventKey key)
+{
+	ListNode* node;
+	ListNode* before;
+	ListNode* after;
+
+	node = slotNode(list, place->handle);
+	if (node != NULL && node->detached == TRUE)
+	{
+		before = handleNode(list, place->prev);
+		after = handleNode(list, place->next);
+
+		if (before != NULL)
+		{
+			after = before->next;
+		}
+		else if (after != NULL)
+		{
+			before = after->prev;
+		}
+
+		node->detached = FALSE;
+
+		if ((before != NULL || after != NULL) && fitsBetween(node, before, after, key) == TRUE)
+		{
+			linkNode(list, node, before, after);
+		}
+		else
+		{
+			/* its place is found by key, from near where it was */
+			linkInOrder(list, node, (after != NULL) ? after : before, key);
+		}
+	}
+
+	return (node != NULL && node->detached == FALSE);
+}
+
+/**
+ * Moves the event a handle refers to, once it has been replaced or edited,
+ * to where key puts it on a list sorted by key, if it is no longer between
+ * the events either side of it. The search starts from where it was, so an
+ * event that moves a little passes over few others. The handle stays valid.
+ * Returns FALSE if the handle's event has been deleted.
+ */
+int reorderHandle(LinkedList* list, EventHandle handle, EventKey key)
+{
+	ListNode* node;
+	ListNode* near;
+
+	node = handleNode(list, handle);
+	if (node != NULL && fitsBetween(node, node->prev, node->next, key) == FALSE)
+	{
+		near = (node->next != NULL) ? node->next : node->prev;
+		spliceOut(list, node);
+		linkInOrder(list, node, near, key);
+	}
+
+	return (node != NULL);
+}
+
+/**
+ * Compares two KeyedNodes by key, then by where they were, for qsort.
+ */
+static int compareKeyed(const void* a, const void* b)
+{
+	KeyedNode* nodeA;
+	KeyedNode* nodeB;
+	int result;
+
+	nodeA = (KeyedNode*)a;
+	nodeB = (KeyedNode*)b;
+	result = (nodeA->key > nodeB->key) - (nodeA->key < nodeB->key);
+
+	if (result == 0)
+	{
+		result = (nodeA->order > nodeB->order) - (nodeA->order < nodeB->order);
+	}
+
+	return result;
+}
+
+/**
+ * Moves count nodes on the list, whose events have changed, to where key
+ * puts them on a list that is otherwise sorted by key. They are all taken
+ * off the list, sorted by key, then merged back in one pass, as mergeSorted
+ * would, so each node keeps its handle. A single node is instead moved from
+ * where it is, as reorderHandle does.
+ */
+static void reorderNodes(LinkedList* list, ListNode** nodes, long count, EventKey key)
+{
+	KeyedNode* keyed;
+	ListNode* current;
+	unsigned long currentKey;
+	long ii;
+
+	if (count == 1)
+	{
+		reorderHandle(list, handleOf(list, nodes[0]), key);
+	}
+	else if (count > 1)
+	{
+		keyed = (KeyedNode*)malloc(count * sizeof(KeyedNode));
+
+		for (ii = 0; ii < count; ii++)
+		{
+			keyed[ii].key = (*key)(nodes[ii]->data);
+			keyed[ii].order = ii;
+			keyed[ii].node = nodes[ii];
+			spliceOut(list, nodes[ii]);
+		}
+
+		qsort(keyed, count, sizeof(KeyedNode), &compareKeyed);
+
+		current = list->head;
+		currentKey = (current != NULL) ? (*key)(current->data) : 0;
+
+		for (ii = 0; ii < count; ii++)
+		{
+			while (current != NULL && currentKey <= keyed[ii].key)
+			{
+				current = current->next;
+				currentKey = (current != NULL) ? (*key)(current->data) : 0;
+			}
+
+			linkNode(list, keyed[ii].node, (current != NULL) ? current->prev : list->tail, current);
+		}
+
+		free(keyed);
+	}
+}
+
+/**
+ * Moves the events count handles refer to, once they have been replaced or
+ * edited, to where key puts them on a list that is otherwise sorted by key,
+ * in a single pass over the list however many there are. Handles to events
+ * that have been deleted are skipped. The handles stay valid.
+ */
+void reorderHandles(LinkedList* list, EventHandle* handles, long count, EventKey key)
+{
+	ListNode** nodes;
+	long found;
+	long ii;
+
+	nodes = (ListNode**)malloc((count + 1) * sizeof(ListNode*));
+	found = 0;
+
+	for (ii = 0; ii < count; ii++)
+	{
+		nodes[found] = handleNode(list, handles[ii]);
+		if (nodes[found] != NULL)
+		{
+			found++;
+		}
+	}
+
+	reorderNodes(list, nodes, found, key);
+	free(nodes);
+}
+
+/**
+ * Returns TRUE if a handle refers to an event taken off the list by
+ * detachHandle, which reattachHandle can put back.
+ */
+int isDetached(LinkedList* list, EventHandle handle)
+{
+	ListNode* node;
+
+	node = slotNode(list, handle);
+
+	return (node != NULL && node->detached == TRUE);
+}
+
+/**
+ * Frees the node and handle of an event taken off the list by detachHandle,
+ * releasing the list's hold on the event. Does nothing if the handle doesn't
+ * refer to an event taken off the list.
+ */
+void dropHandle(LinkedList* list, EventHandle handle)
+{
+	ListNode* node;
+
+	node = slotNode(list, handle);
+	if (node != NULL && node->detached == TRUE)
+	{
+		detachSlot(list, node);
+		releaseEvent(node->data);
+		free(node);
+	}
+}
+
+/**
+ * Creates an event with every field empty, held by one owner.
+ */
+Event* createEvent()
+{
+	Event* newEvent;
+
+	newEvent = (Event*)malloc(sizeof(Event));
+	memset(newEvent, 0, sizeof(Event));
+	newEvent->refCount = 1;
+
+	return newEvent;
+}
+
+/**
+ * Creates a copy of the passed-in event, including its repeat rule, held
+ * by one owner.
+ */
+Event* copyEvent(Event* event)
+{
+	Event* copy;
+
+	copy = (Event*)malloc(sizeof(Event));
+	*copy = *event;
+	copy->refCount = 1;
+	copy->rendered = NULL;
+
+	if (event->repeat != NULL)
+	{
+		copy->repeat = (Recurrence*)malloc(sizeof(Recurrence));
+		*(copy->repeat) = *(event->repeat);
+	}
+
+	return copy;
+}
+
+/**
+ * Records another holder of the passed-in event.
+ */
+void retainEvent(Event* event)
+{
+	event->refCount++;
+}
+
+/**
+ * Drops one holder of the passed-in event, the event is freed once nothing
+ * holds it.
+ */
+void releaseEvent(Event* event)
+{
+	event->refCount--;
+
+	if (event->refCount <= 0)
+	{
+		forgetRendered(event);
+		free(event->repeat);
+		free(event);
+	}
+}
+
+/**
+ * Takes a snapshot of the events currently on the list, in list order. The
+ * list may be modified freely afterwards without affecting the snapshot.
+ */
+ListSnapshot* snapshotList(LinkedList* list)
+{
+	return snapshotLists(&list, 1);
+}
+
+/**
+ * Takes a single snapshot of the events on several lists, one list after
+ * another, each in list order.
+ */
+ListSnapshot* snapshotLists(LinkedList** lists, int numLists)
+{
+	ListSnapshot* snapshot;
+	ListNode* current;
+	int total;
+	int ii;
+
+	total = 0;
+	for (ii = 0; ii < numLists; ii++)
+	{
+		total += lists[ii]->count;
+	}
+
+	snapshot = (ListSnapshot*)malloc(sizeof(ListSnapshot));
+	snapshot->count = 0;
+	snapshot->events = (Event**)malloc((total + 1) * sizeof(Event*));
+
+	for (ii = 0; ii < numLists; ii++)
+	{
+		for (current = lists[ii]->head; current != NULL; current = current->next)
+		{
+			snapshot->events[snapshot->count] = current->data;
+			retainEvent(current->data);
+			snapshot->count++;
+		}
+	}
+
+	return snapshot;
+}
+
+/**
+ * Frees a snapshot, releasing its hold on each of its events. Must be called
+ * from the same thread that modifies the list.
+ */
+void freeSnapshot(ListSnapshot* snapshot)
+{
+	int ii;
+
+	for (ii = 0; ii < snapshot->count; ii++)
+	{
+		releaseEvent(snapshot->events[ii]);
+	}
+
+	free(snapshot->events);
+	free(snapshot);
+}
+
+/**
+ * Checks every activity in a linked list against the passed-in string.
+ * If inActivity exists in any activity string on the list, a handle to the
+ * event is returned. A handle to no event is returned if no
+ * match is found. The first matching event is returned, following matching
+ * events are ignored.
+ */
+EventHandle findEvent(LinkedList* list, char* inActivity)
+{
+	ListNode* current;
+	EventHandle handle;
+	int ii;
+	long startTime;
+
+	startTime = STATS_BEGIN();
+	ii = 0;
+	handle = noHandle();
+	
+	current = list->head;
+
+	/* traverse list until a match is found or the list ends */
+	while (current != NULL && handle.generation == NO_GENERATION)
+	{
+		/* if a match is found, exit loop */
+		if (strstr(internedText(current->data->activity), inActivity) != NULL)
+		{
+			handle = handleOf(list, current);
+		}
+		current = current->next;
+		ii++;
+	}
+	
+	STATS_END(STAT_SEARCH, startTime, ii);
+
+	return handle;
+}
+
+/**
+ * Returns a handle to the first event on the list whose location is exactly
+ * the passed-in string, or a handle to no event if there is none. The
+ * location is looked up once, then events are compared by id.
+ */
+EventHandle findEventAt(LinkedList* list, char* inLocation)
+{
+	ListNode* current;
+	EventHandle handle;
+	unsigned int location;
+	int ii;
+	long startTime;
+
+	startTime = STATS_BEGIN();
+	ii = 0;
+	handle = noHandle();
+
+	/* text that was never interned can't be the location of any event */
+	if (lookupText(inLocation, &location) == TRUE)
+	{
+		current = list->head;
+
+		while (current != NULL && handle.generation == NO_GENERATION)
+		{
+			if (current->data->location == location)
+			{
+				handle = handleOf(list, current);
+			}
+			current = current->next;
+			ii++;
+		}
+	}
+
+	STATS_END(STAT_SEARCH, startTime, ii);
+
+	return handle;
+}
+
+/**
+ * Deletes every event on the list whose activity contains inActivity, along
+ * with its node, in a single pass over the list. If outPlaces isn't NULL,
+ * the nodes are instead taken off the list as by detachHandle, in list
+ * order, and where each was is stored in outPlaces, which must have room
+ * for every event on the list. Returns the number of events deleted.
+ */
+int deleteMatching(LinkedList* list, char* inActivity, EventPlace* outPlaces)
+{
+	ListNode* current;
+	ListNode* next;
+	unsigned int lastId;
+	int lastMatch;
+	int deleted;
+
+	deleted = 0;
+	lastId = NO_TEXT;
+	lastMatch = (inActivity[0] == '\0');
+	current = list->head;
+
+	while (current != NULL)
+	{
+		next = current->next;
+
+		if (activityMatches(current->data->activity, inActivity, &lastId, &lastMatch) == TRUE)
+		{
+			if (outPlaces != NULL)
+			{
+				detachNode(list, current, &outPlaces[deleted]);
+			}
+			else
+			{
+				unlinkNode(list, current);
+			}
+			deleted++;
+		}
+		current = next;
+	}
+
+	return deleted;
+}
+
+/**
+ * Calls update on every event on the list whose activity contains
+ * inActivity, in a single pass over the list. Each event is first made safe
+ * to modify, as by retrieveElementForEdit. If outHandles isn't NULL, the
+ * handle of each event updated is stored in it, and the event as it was
+ * before the update in outBefore, which the caller then holds; both must
+ * have room for every event on the list. If key isn't NULL, the events
+ * updated are then moved together, as by reorderHandles, to keep a list
+ * sorted by key in order. Returns the number of events update returned
+ * TRUE for.
+ */
+int updateMatching(LinkedList* list, char* inActivity, EventUpdate update, void* arg, EventKey key,
+	EventHandle* outHandles, Event** outBefore)
+{
+	ListNode* current;
+	ListNode** moved;
+	Event* before;
+	unsigned int lastId;
+	int lastMatch;
+	int updated;
+
+	updated = 0;
+	lastId = NO_TEXT;
+	lastMatch = (inActivity[0] == '\0');
+	moved = NULL;
+	if (key != NULL)
+	{
+		moved = (ListNode**)malloc((list->count + 1) * sizeof(ListNode*));
+	}
+
+	for (current = list->head; current != NULL; current = current->next)
+	{
+		if (activityMatches(current->data->activity, inActivity, &lastId, &lastMatch) == TRUE)
+		{
+			/* holding the event as it was makes editing it copy it */
+			before = current->data;
+			if (outHandles != NULL)
+			{
+				retainEvent(before);
+			}
+
+			if ((*update)(editNode(list, current), arg) == TRUE)
+			{
+				if (outHandles != NULL)
+				{
+					outHandles[updated] = handleOf(list, current);
+					outBefore[updated] = before;
+				}
+				if (moved != NULL)
+				{
+					moved[updated] = current;
+				}
+				updated++;
+			}
+			else if (outHandles != NULL)
+			{
+				releaseEvent(before);
+			}
+		}
+	}
+
+	if (moved != NULL)
+	{
+		reorderNodes(list, moved, updated, key);
+		free(moved);
+	}
+
+	return updated;
+}
+
+/**
+ * Prints the state of each element in the list.
+ */
+void printList(LinkedList* list)
+{
+	EventCursor cursor;
+	Event* event;
+
+	if (list->count == 0)
+	{
+		printf("Error: list is empty.\n");
+	}
+
+	openCursor(&cursor, list);
+	for (event = cursorFirst(&cursor); event != NULL; event = cursorNext(&cursor))
+	{
+		printf("%s @ %s (%d minutes)\n%d %d %d, %d:%d\n---\n\n", internedText(event->activity), internedText(event->location), event->duration, event->eDate.day, event->eDate.month, event->eDate.year, event->eTime.hrs, event->eTime.mins);
+	}
+}
+
+/**
+ * Frees each list node and event from memory, including any taken off the
+ * list by detachHandle, and the list itself.
+ */
+void freeList(LinkedList* list)
 {
 	ListNode* current;
 	ListNode* next;
+	unsigned int slot;
 	int ii;
 
+	/* nodes kept off the list are only reachable through their handles */
+	for (slot = 0; slot < list->numSlots; slot++)
+	{
+		current = list->slots[slot].node;
+		if (current != NULL && current->detached == TRUE)
+		{
+			releaseEvent(current->data);
+			free(current);
+		}
+	}
+
 	current = list->head;
 
 	for (ii = 0; ii < (list->count); ii++)
 	{
 		next = current->next;
-		free(current->data); /* */
+		releaseEvent(current->data); /* */
 		free(current);
 		current = next;
 	}
+	free(list->slots);
 	free(list);
 }
 
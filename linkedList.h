@@ -26,39 +26,142 @@ typedef struct Time {
 	int mins;
 } Time;
 
+/* how often a recurring event repeats */
+#define REPEAT_DAILY 1
+#define REPEAT_WEEKLY 2
+#define REPEAT_MONTHLY 3
+
+/* the longest activity and location, including the null terminator */
+#define MAX_ACTIVITY 400
+#define MAX_LOCATION 100
+
+/* the most dates that can be left out of one recurring event */
+#define MAX_EXCEPTIONS 16
+
+/**
+ * A rule for repeating an event. The event repeats every interval days,
+ * weeks or months (as given by frequency) from its own date, up to and
+ * including untilDay if hasUntil is set. Dates are stored as day numbers
+ * (see daysFromCivil). exceptions holds the numExceptions dates, in
+ * ascending order, on which the event does not occur. Monthly events skip
+ * months that are too short for their day.
+ */
+typedef struct Recurrence {
+	int frequency;
+	int interval;
+	int hasUntil;
+	long untilDay;
+	int numExceptions;
+	long exceptions[MAX_EXCEPTIONS];
+} Recurrence;
+
 /**
  * A struct representing a calendar event. Each event has a time, date,
- * duration in minutes, an activity, and optionally, a location.
+ * duration in minutes, an activity, and optionally, a location. The activity
+ * and location are held as ids of interned text (see internedText), and a
+ * missing location is NO_TEXT. Recurring
+ * events also have a repeat rule, one-off events have a NULL rule, and the
+ * date of a recurring event is that of its first occurrence. refCount
+ * counts the lists and snapshots holding the event; an event with more than
+ * one holder is shared and must be copied before it is modified. rendered
+ * is the event's cached text (see renderEvent), or NULL, and is never
+ * copied with the event. zone is the time zone the date and time are the
+ * wall clock of (see findZone), or NULL for the display zone.
  */
 typedef struct Event {
 	Date eDate;
 	Time eTime;
 	int duration;
-	char activity[400];
-	char location[100];
+	unsigned int activity;
+	unsigned int location;
+	Recurrence* repeat;
+	int refCount;
+	struct RenderedText* rendered;
+	struct TimeZone* zone;
 } Event;
 
 
+/* the generation of a handle that refers to no event */
+#define NO_GENERATION 0
+
 /**
- * A linked list node. It holds a pointer to an Event and a pointer to another
- * node.
+ * A reference to an event on a list which, unlike an element number, stays
+ * valid however the list changes around it, until the event is deleted.
+ * slot picks an entry of the list's handle table, and generation must match
+ * the entry's, which goes up each time the entry is freed, so a handle to a
+ * deleted event is recognised rather than leading to whatever took its
+ * place. A handle with generation NO_GENERATION, as returned when a search
+ * finds nothing, refers to no event. Handles only mean anything on the list
+ * they came from.
+ */
+typedef struct EventHandle {
+	unsigned int slot;
+	unsigned int generation;
+} EventHandle;
+
+/**
+ * Where an event taken off a list by detachHandle was: the event's handle,
+ * and the handles of the events either side of it (handles to no event at
+ * the ends of the list).
+ */
+typedef struct EventPlace {
+	EventHandle handle;
+	EventHandle prev;
+	EventHandle next;
+} EventPlace;
+
+/**
+ * A linked list node. It holds a pointer to an Event, pointers to the nodes
+ * before and after it, and the entry of the list's handle table that leads
+ * to it. detached is set while the node is kept off the list by
+ * detachHandle, when its other pointers mean nothing.
  */
 typedef struct ListNode{
 	Event* data;
 	struct ListNode* next;
+	struct ListNode* prev;
+	unsigned int slot;
+	int detached;
 } ListNode;
 
 /**
- * A double ended, singly linked list struct. It has head and tail pointers
+ * An entry of a list's handle table: the node its handles lead to, or NULL
+ * while the entry is free, when nextFree is the next free entry.
+ */
+typedef struct HandleSlot {
+	ListNode* node;
+	unsigned int generation;
+	unsigned int nextFree;
+} HandleSlot;
+
+/**
+ * A double ended, doubly linked list struct. It has head and tail pointers
  * for pointing at the first and last nodes respectively, and an int for
- * storing the count of nodes on the list.
+ * storing the count of nodes on the list. version goes up with every change
+ * to the list, so an index built from the list can tell when it is stale.
+ * slots is the handle table, of numSlots entries, with the free entries
+ * linked from firstFree.
  */
 typedef struct {
 	ListNode* head;
 	ListNode* tail;
 	int count;
+	unsigned long version;
+	HandleSlot* slots;
+	unsigned int numSlots;
+	unsigned int firstFree;
 } LinkedList;
 
+/**
+ * A read-only copy of the order of events on a list at one point in time.
+ * The events themselves are shared with the list rather than copied, so
+ * taking a snapshot costs one pointer per event.
+ */
+typedef struct ListSnapshot {
+	Event** events;
+	int count;
+} ListSnapshot;
+
 /**
  * Creates an empty linked list.
  */
@@ -66,15 +169,15 @@ LinkedList* createList();
 
 /**
  * Creates a node for the passed-in Event and inserts the node at the start of
- * the list.
+ * the list. Returns a handle to the event.
  */
-void insertFirst(LinkedList* list, Event* event);
+EventHandle insertFirst(LinkedList* list, Event* event);
 
 /**
  * Creates a node for the passed-in Event, and inserts the node at the end
- * of the list.
+ * of the list. Returns a handle to the event.
  */
-void insertLast(LinkedList* list, Event* event);
+EventHandle insertLast(LinkedList* list, Event* event);
 
 /**
  * Removes the first node from the list, extracts and returns a pointer to
@@ -86,26 +189,246 @@ Event* removeFirst(LinkedList* list);
 /**
  * Deletes the n'th element on the linked list along with its node. The
  * passed-in int elNo represents n. Elements have a 0-based count.
- * i.e. if elNo = 0, the first node on the list is deleted. The variable
- * 'previous' is used to keep track of the node preceding to the node being
- * deleted. When the n'th node is deleted, previous->next is pointed to the
- * deleted node's next address.
+ * i.e. if elNo = 0, the first node on the list is deleted. The node is
+ * found from whichever end of the list is nearer, then unlinked from the
+ * nodes either side of it.
  */
 void deleteNthElement(LinkedList* list, int elNo);
 
+/**
+ * Creates a node for the passed-in Event and inserts it so it becomes the
+ * n'th element on the list (0-based). If elNo is the list's count, the node
+ * is added at the end. Returns a handle to the event.
+ */
+EventHandle insertNthElement(LinkedList* list, int elNo, Event* event);
+
+/**
+ * Returns a key that events are sorted on, such as startKey, compared as an
+ * unsigned number.
+ */
+typedef unsigned long (*EventKey)(Event* event);
+
+/**
+ * Merges a batch of events, sorted in ascending order of key, into a list
+ * sorted the same way, in one pass over both. Each event goes after any on
+ * the list with an equal key. If the list isn't sorted, the batch is still
+ * all added, in order, each before the first event found with a greater
+ * key. The list takes over the caller's hold on each event. If outHandles
+ * isn't NULL, the handle of each event is stored in it, in batch order.
+ */
+void mergeSorted(LinkedList* list, Event** events, long count, EventKey key, EventHandle* outHandles);
+
+/**
+ * Merges a batch of events into a sorted list as mergeSorted does, but
+ * starting from the event a handle refers to rather than from the head, so
+ * only the events from there to where the batch ends are passed over. If
+ * that event has been deleted, or its key is greater than the first of the
+ * batch, the merge starts from the head.
+ */
+void mergeSortedAfter(LinkedList* list, EventHandle after, Event** events, long count, EventKey key,
+	EventHandle* outHandles);
+
+/**
+ * Points the n'th node on the list at a different Event. The list's hold on
+ * the old event is released, and it takes over the caller's hold on the new.
+ */
+void replaceNthElement(LinkedList* list, int elNo, Event* event);
+
+/**
+ * Returns the element number of the passed-in Event on the list, comparing
+ * pointers rather than contents, or -1 if it isn't on the list.
+ */
+int findElement(LinkedList* list, Event* event);
+
 /**
  * Returns a pointer to the n'th element on the list, where the count for n
  * is 0-based. i.e. if elNo = 0, the first event on the list is retrieved. 
  */
 Event* retrieveElement(LinkedList* list, int elNo);
 
+/**
+ * Returns a pointer to the n'th element on the list that is safe to modify.
+ * If the event is shared with a snapshot, the list's node is first pointed at
+ * a private copy so the snapshot keeps seeing the old values. Otherwise its
+ * cached text is dropped, so it must be modified before it is next rendered.
+ */
+Event* retrieveElementForEdit(LinkedList* list, int elNo);
+
+/**
+ * Returns the event a handle refers to, or NULL if it has been deleted from
+ * the list since. Takes the same time however long the list is.
+ */
+Event* lookupHandle(LinkedList* list, EventHandle handle);
+
+/**
+ * Returns the event a handle refers to, made safe to modify in the same way
+ * as retrieveElementForEdit, or NULL if it has been deleted from the list.
+ */
+Event* lookupHandleForEdit(LinkedList* list, EventHandle handle);
+
+/**
+ * Points the node a handle refers to at a different Event, in the same way
+ * as replaceNthElement. The handle stays valid, referring to the new event.
+ * Returns FALSE, leaving the caller's hold on the event, if the handle's
+ * event has been deleted.
+ */
+int replaceHandle(LinkedList* list, EventHandle handle, Event* event);
+
+/**
+ * Deletes the event a handle refers to along with its node, without walking
+ * the list. Returns FALSE if it had already been deleted.
+ */
+int deleteHandle(LinkedList* list, EventHandle handle);
+
+/**
+ * Returns a handle to the first node on the list holding the passed-in
+ * Event, comparing pointers rather than contents, or a handle to no event if
+ * it isn't on the list.
+ */
+EventHandle findHandle(LinkedList* list, Event* event);
+
+/**
+ * Takes the event of place's handle off the list without freeing its node
+ * or handle, so reattachHandle can put it back, and stores the events that
+ * were either side of it in place. The handle leads nowhere while its event
+ * is off the list. Returns FALSE if its event isn't on the list.
+ */
+int detachHandle(LinkedList* list, EventPlace* place);
+
+/**
+ * Puts an event taken off the list by detachHandle back where it was: after
+ * place's previous event if that is on the list, otherwise before its next.
+ * If neither is on the list, or the events there have since moved so that
+ * key no longer puts it between them, it goes where key puts it, as
+ * mergeSorted would, so a list sorted by key stays sorted. Returns FALSE if
+ * the handle doesn't refer to an event taken off the list.
+ */
+int reattachHandle(LinkedList* list, EventPlace* place, EventKey key);
+
+/**
+ * Moves the event a handle refers to, once it has been replaced or edited,
+ * to where key puts it on a list sorted by key, if it is no longer between
+ * the events either side of it. The search starts from where it was, so an
+ * event that moves a little passes over few others. The handle stays valid.
+ * Returns FALSE if the handle's event has been deleted.
+ */
+int reorderHandle(LinkedList* list, EventHandle handle, EventKey key);
+
+/**
+ * Moves the events count handles refer to, once they have been replaced or
+ * edited, to where key puts them on a list that is otherwise sorted by key,
+ * in a single pass over the list however many there are. Handles to events
+ * that have been deleted are skipped. The handles stay valid.
+ */
+void reorderHandles(LinkedList* list, EventHandle* handles, long count, EventKey key);
+
+/**
+ * Returns TRUE if a handle refers to an event taken off the list by
+ * detachHandle, which reattachHandle can put back.
+ */
+int isDetached(LinkedList* list, EventHandle handle);
+
+/**
+ * Frees the node and handle of an event taken off the list by detachHandle,
+ * releasing the list's hold on the event. Does nothing if the handle doesn't
+ * refer to an event taken off the list.
+ */
+void dropHandle(LinkedList* list, EventHandle handle);
+
+/**
+ * Creates an event with every field empty, held by one owner.
+ */
+Event* createEvent();
+
+/**
+ * Creates a copy of the passed-in event, including its repeat rule, held
+ * by one owner.
+ */
+Event* copyEvent(Event* event);
+
+/**
+ * Records another holder of the passed-in event.
+ */
+void retainEvent(Event* event);
+
+/**
+ * Drops one holder of the passed-in event, the event is freed once nothing
+ * holds it.
+ */
+void releaseEvent(Event* event);
+
+/**
+ * Takes a snapshot of the events currently on the list, in list order. The
+ * list may be modified freely afterwards without affecting the snapshot.
+ */
+ListSnapshot* snapshotList(LinkedList* list);
+
+/**
+ * Takes a single snapshot of the events on several lists, one list after
+ * another, each in list order.
+ */
+ListSnapshot* snapshotLists(LinkedList** lists, int numLists);
+
+/**
+ * Frees a snapshot, releasing its hold on each of its events. Must be called
+ * from the same thread that modifies the list.
+ */
+void freeSnapshot(ListSnapshot* snapshot);
+
+/**
+ * Checks every activity in a linked list against the passed-in string.
+ * If inActivity exists in any activity string on the list, a handle to the
+ * event is returned. A handle to no event is returned if no
+ * match is found. The first matching event is returned, following matching
+ * events are ignored.
+ */
+EventHandle findEvent(LinkedList* list, char* inActivity);
+
+/**
+ * Returns a handle to the first event on the list whose location is exactly
+ * the passed-in string, or a handle to no event if there is none. The
+ * location is looked up once, then events are compared by id.
+ */
+EventHandle findEventAt(LinkedList* list, char* inLocation);
+
+/**
+ * A change made to each of a set of events by updateMatching, such as
+ * shiftEvent. arg is passed through from updateMatching unchanged. Returns
+ * TRUE if the event was changed.
+ */
+typedef int (*EventUpdate)(Event* event, void* arg);
+
+/**
+ * Deletes every event on the list whose activity contains inActivity, along
+ * with its node, in a single pass over the list. If outPlaces isn't NULL,
+ * the nodes are instead taken off the list as by detachHandle, in list
+ * order, and where each was is stored in outPlaces, which must have room
+ * for every event on the list. Returns the number of events deleted.
+ */
+int deleteMatching(LinkedList* list, char* inActivity, EventPlace* outPlaces);
+
+/**
+ * Calls update on every event on the list whose activity contains
+ * inActivity, in a single pass over the list. Each event is first made safe
+ * to modify, as by retrieveElementForEdit. If outHandles isn't NULL, the
+ * handle of each event updated is stored in it, and the event as it was
+ * before the update in outBefore, which the caller then holds; both must
+ * have room for every event on the list. If key isn't NULL, the events
+ * updated are then moved together, as by reorderHandles, to keep a list
+ * sorted by key in order. Returns the number of events update returned
+ * TRUE for.
+ */
+int updateMatching(LinkedList* list, char* inActivity, EventUpdate update, void* arg, EventKey key,
+	EventHandle* outHandles, Event** outBefore);
+
 /**
  * Prints the state of each element in the list.
  */
 void printList(LinkedList* list);
 
 /**
- * Frees each list node and event from memory, and the list itself.
+ * Frees each list node and event from memory, including any taken off the
+ * list by detachHandle, and the list itself.
  */
 void freeList(LinkedList* list);
 